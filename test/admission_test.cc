@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <thread>
+
+#include "admission.h"
+#include "io_governor.h"
+#include "temp_directory_test_base.h"
+
+
+namespace fs = std::filesystem;
+
+using namespace std::chrono_literals;
+
+
+namespace
+{
+
+class AdmissionTest : public TempDirectoryTest
+{
+protected:
+    void SetUp() override
+    {
+        TempDirectoryTest::SetUp();
+        fs::create_directories(_directory / "sub");
+    }
+};
+
+xvc::StorageBenchmark storage(double write_mb_per_s)
+{
+    return {write_mb_per_s, 100us, 1ms, std::chrono::system_clock::now()};
+}
+
+}  // namespace
+
+
+TEST_F(AdmissionTest, BenchmarksADirectory)
+{
+    auto benchmark = xvc::benchmark_storage(_directory, 8 << 20, 4);
+    ASSERT_TRUE(benchmark);
+    EXPECT_GT(benchmark->write_mb_per_s, 1);
+    EXPECT_GT(benchmark->fsync_p50.count(), 0);
+    EXPECT_GE(benchmark->fsync_max, benchmark->fsync_p50);
+    // The scratch file is gone.
+    EXPECT_TRUE(fs::is_empty(_directory / "sub"));
+    EXPECT_EQ(std::distance(fs::directory_iterator(_directory), fs::directory_iterator()), 1);
+
+    EXPECT_FALSE(xvc::benchmark_storage(_directory / "missing", 1 << 20, 1));
+}
+
+TEST_F(AdmissionTest, CachesBenchmarks)
+{
+    xvc::StorageCache cache;
+    cache.put(_directory, storage(500));
+    // Another spelling of the same directory.
+    auto cached = cache.get(_directory / "sub" / "..");
+    ASSERT_TRUE(cached);
+    EXPECT_EQ(cached->write_mb_per_s, 500);
+
+    cache.forget(_directory);
+    auto measured = cache.get(_directory);
+    ASSERT_TRUE(measured);
+    EXPECT_NE(measured->write_mb_per_s, 500);
+    EXPECT_EQ(cache.get(_directory)->measured, measured->measured);
+}
+
+TEST_F(AdmissionTest, MeasuresADirectoryOnceThroughTheGovernor)
+{
+    xvc::StorageCache cache;
+    xvc::IoGovernor governor;
+    std::optional<xvc::StorageBenchmark> other;
+    std::thread thread([&] { other = cache.get(_directory, 24h, &governor); });
+    auto measured = cache.get(_directory / "sub" / "..", 24h, &governor);
+    thread.join();
+    ASSERT_TRUE(measured && other);
+    EXPECT_EQ(measured->measured, other->measured);
+    // The benchmark's queue is gone with it.
+    EXPECT_TRUE(governor.stats().empty());
+}
+
+TEST(AdmissionEstimateTest, EstimatesByCodec)
+{
+    EXPECT_DOUBLE_EQ(xvc::estimate_mb_per_s("image/jpeg", 1920, 1080, 60), 23.328);
+    EXPECT_DOUBLE_EQ(xvc::estimate_mb_per_s("video/x-h265", 1920, 1080, 60), 2.3328);
+    EXPECT_DOUBLE_EQ(xvc::estimate_mb_per_s("video/x-raw", 1920, 1080, 60), 248.832);
+    EXPECT_EQ(xvc::estimate_mb_per_s("image/jpeg", 0, 0, 0), 0);
+}
+
+TEST_F(AdmissionTest, ComparesVolumes)
+{
+    EXPECT_TRUE(xvc::same_volume(_directory, _directory / "sub"));
+    EXPECT_FALSE(xvc::same_volume(_directory, _directory / "missing"));
+}
+
+TEST_F(AdmissionTest, CountsOtherCamerasOnTheVolume)
+{
+    xvc::StorageCache cache;
+    cache.put(_directory, storage(100));
+    xvc::IoGovernor governor;
+    auto other = governor.join((_directory / "sub" / "other").generic_string());
+    other->expect(40);
+    auto self = governor.join((_directory / "camera").generic_string());
+    self->expect(30);
+
+    auto check = xvc::check_admission(_directory / "camera", 30, 0.7, governor, cache);
+    ASSERT_TRUE(check);
+    EXPECT_TRUE(check->within_budget);
+    EXPECT_DOUBLE_EQ(check->active_mb_per_s, 40);
+    EXPECT_DOUBLE_EQ(check->budget_mb_per_s, 70);
+    EXPECT_EQ(check->storage.write_mb_per_s, 100);
+
+    check = xvc::check_admission(_directory / "camera", 31, 0.7, governor, cache);
+    ASSERT_TRUE(check);
+    EXPECT_FALSE(check->within_budget);
+}
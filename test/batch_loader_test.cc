@@ -0,0 +1,52 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <vector>
+
+#include "batch_loader.h"
+#include "recording_test_base.h"
+#include "sidecar.h"
+#include "xdaqmetadata/xdaqmetadata.h"
+
+
+TEST_F(RecordingTest, BatchesFollowTheSegmentAndItsSidecar)
+{
+    if (!can_record()) {
+        GTEST_SKIP() << "GStreamer plugins missing";
+    }
+    auto bin = play(jpeg_parse_saving_metadata);
+    ASSERT_NE(bin, nullptr);
+    auto result = record(bin, _directory / "clip-%02d.mkv", 1500ms);
+    ASSERT_TRUE(result.ok);
+    ASSERT_EQ(result.files.size(), 1);
+    auto records = xvc::read_sidecar(xvc::find_sidecar(result.files.front()));
+    ASSERT_FALSE(records.empty());
+
+    xvc::BatchLoader loader(result.files, {.batch_size = 8, .workers = 4, .prefetch = 2});
+    ASSERT_TRUE(loader.start());
+    EXPECT_EQ(loader.width(), 320);
+    EXPECT_EQ(loader.height(), 240);
+
+    // Frames decoded by four workers still come out consecutive, in batches numbered in order.
+    std::uint64_t sequence = 0;
+    std::uint32_t frame = 0;
+    while (auto batch = loader.next()) {
+        EXPECT_EQ(batch->sequence(), sequence++);
+        EXPECT_EQ(batch->frame_bytes(), 320 * 240 * 3);
+        for (const auto &info : batch->info()) {
+            EXPECT_EQ(info.segment, 0);
+            ASSERT_EQ(info.frame, frame++);
+            ASSERT_LT(info.frame, records.size());
+            EXPECT_EQ(info.timestamp, records[info.frame].fpga_timestamp);
+            EXPECT_EQ(info.sample, records[info.frame].rhythm_timestamp);
+        }
+        // Only the last batch may be short.
+        if (batch->size() < 8) {
+            EXPECT_EQ(loader.next(), nullptr);
+            break;
+        }
+    }
+    EXPECT_EQ(frame, records.size());
+    EXPECT_EQ(loader.stats().failed, 0);
+    EXPECT_EQ(loader.stats().frames, frame);
+}
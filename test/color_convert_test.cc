@@ -0,0 +1,303 @@
+#include <gst/video/video.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "color_convert.h"
+
+
+namespace
+{
+
+struct Image {
+    int width;
+    int height;
+    std::vector<std::uint8_t> y;
+    std::vector<std::uint8_t> u;
+    std::vector<std::uint8_t> v;
+    std::vector<std::uint8_t> uv;
+};
+
+Image random_image(int width, int height, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> byte(0, 255);
+    auto chroma_width = (width + 1) / 2;
+    auto chroma_height = (height + 1) / 2;
+
+    Image image{width, height, {}, {}, {}, {}};
+    image.y.resize(static_cast<size_t>(width) * height);
+    image.u.resize(static_cast<size_t>(chroma_width) * chroma_height);
+    image.v.resize(image.u.size());
+    image.uv.resize(image.u.size() * 2);
+    for (auto &p : image.y) p = static_cast<std::uint8_t>(byte(rng));
+    for (size_t i = 0; i < image.u.size(); ++i) {
+        image.u[i] = static_cast<std::uint8_t>(byte(rng));
+        image.v[i] = static_cast<std::uint8_t>(byte(rng));
+        image.uv[2 * i] = image.u[i];
+        image.uv[2 * i + 1] = image.v[i];
+    }
+    return image;
+}
+
+std::vector<std::uint8_t> convert(
+    const Image &image, bool nv12, xvc::RgbFormat format, xvc::ColorMatrix matrix,
+    xvc::SimdLevel level
+)
+{
+    auto stride = image.width * xvc::bytes_per_pixel(format);
+    std::vector<std::uint8_t> out(static_cast<size_t>(stride) * image.height);
+    auto chroma_width = (image.width + 1) / 2;
+    if (nv12) {
+        xvc::nv12_to_rgb(
+            image.y.data(),
+            image.width,
+            image.uv.data(),
+            chroma_width * 2,
+            out.data(),
+            stride,
+            image.width,
+            image.height,
+            format,
+            matrix,
+            level
+        );
+    } else {
+        xvc::i420_to_rgb(
+            image.y.data(),
+            image.width,
+            image.u.data(),
+            chroma_width,
+            image.v.data(),
+            chroma_width,
+            out.data(),
+            stride,
+            image.width,
+            image.height,
+            format,
+            matrix,
+            level
+        );
+    }
+    return out;
+}
+
+// GstVideoConverter without chroma resampling or dithering, so it sees the same samples as
+// nv12_to_rgb. Packed RGB has no fast path, so this is its generic matrix.
+std::vector<std::uint8_t> convert_with_gstreamer(
+    const Image &image, GstVideoColorRange range, GstVideoColorMatrix matrix
+)
+{
+    GstVideoInfo in_info, out_info;
+    gst_video_info_set_format(&in_info, GST_VIDEO_FORMAT_NV12, image.width, image.height);
+    in_info.colorimetry.range = range;
+    in_info.colorimetry.matrix = matrix;
+    gst_video_info_set_format(&out_info, GST_VIDEO_FORMAT_RGB, image.width, image.height);
+
+    auto in_buffer = gst_buffer_new_allocate(nullptr, GST_VIDEO_INFO_SIZE(&in_info), nullptr);
+    auto out_buffer = gst_buffer_new_allocate(nullptr, GST_VIDEO_INFO_SIZE(&out_info), nullptr);
+    GstVideoFrame in, out;
+    gst_video_frame_map(&in, &in_info, in_buffer, GST_MAP_WRITE);
+    gst_video_frame_map(&out, &out_info, out_buffer, GST_MAP_WRITE);
+    auto chroma_bytes = (image.width + 1) / 2 * 2;
+    for (auto row = 0; row < image.height; ++row) {
+        std::memcpy(
+            static_cast<std::uint8_t *>(GST_VIDEO_FRAME_PLANE_DATA(&in, 0)) +
+                row * GST_VIDEO_FRAME_PLANE_STRIDE(&in, 0),
+            image.y.data() + row * image.width,
+            image.width
+        );
+    }
+    for (auto row = 0; row < (image.height + 1) / 2; ++row) {
+        std::memcpy(
+            static_cast<std::uint8_t *>(GST_VIDEO_FRAME_PLANE_DATA(&in, 1)) +
+                row * GST_VIDEO_FRAME_PLANE_STRIDE(&in, 1),
+            image.uv.data() + row * chroma_bytes,
+            chroma_bytes
+        );
+    }
+
+    // clang-format off
+    auto config = gst_structure_new(
+        "GstVideoConverter",
+        GST_VIDEO_CONVERTER_OPT_CHROMA_MODE, GST_TYPE_VIDEO_CHROMA_MODE, GST_VIDEO_CHROMA_MODE_NONE,
+        GST_VIDEO_CONVERTER_OPT_DITHER_METHOD, GST_TYPE_VIDEO_DITHER_METHOD, GST_VIDEO_DITHER_NONE,
+        nullptr
+    );
+    // clang-format on
+    auto converter = gst_video_converter_new(&in_info, &out_info, config);
+    gst_video_converter_frame(converter, &in, &out);
+    gst_video_converter_free(converter);
+
+    auto stride = image.width * 3;
+    std::vector<std::uint8_t> result(static_cast<size_t>(stride) * image.height);
+    for (auto row = 0; row < image.height; ++row) {
+        std::memcpy(
+            result.data() + row * stride,
+            static_cast<const std::uint8_t *>(GST_VIDEO_FRAME_PLANE_DATA(&out, 0)) +
+                row * GST_VIDEO_FRAME_PLANE_STRIDE(&out, 0),
+            stride
+        );
+    }
+    gst_video_frame_unmap(&out);
+    gst_video_frame_unmap(&in);
+    gst_buffer_unref(out_buffer);
+    gst_buffer_unref(in_buffer);
+    return result;
+}
+
+}  // namespace
+
+
+TEST(ColorConvertTest, ReferenceColors)
+{
+    // Limited-range black and white with neutral chroma.
+    for (auto [luma, expected] : {std::pair{16, 0}, std::pair{235, 255}}) {
+        std::vector<std::uint8_t> y(2, static_cast<std::uint8_t>(luma));
+        std::vector<std::uint8_t> uv{128, 128};
+        std::vector<std::uint8_t> out(6);
+        xvc::nv12_to_rgb(
+            y.data(),
+            2,
+            uv.data(),
+            2,
+            out.data(),
+            6,
+            2,
+            1,
+            xvc::RgbFormat::RGB,
+            xvc::ColorMatrix::BT601,
+            xvc::SimdLevel::Scalar
+        );
+        for (auto value : out) {
+            EXPECT_EQ(value, expected);
+        }
+    }
+}
+
+TEST(ColorConvertTest, PackedLayouts)
+{
+    // Saturated red in BT.601: Y=81, U=90, V=240.
+    std::vector<std::uint8_t> y{81, 81};
+    std::vector<std::uint8_t> uv{90, 240};
+    std::vector<std::uint8_t> rgba(8), bgrx(8);
+    xvc::nv12_to_rgb(
+        y.data(),
+        2,
+        uv.data(),
+        2,
+        rgba.data(),
+        8,
+        2,
+        1,
+        xvc::RgbFormat::RGBA,
+        xvc::ColorMatrix::BT601
+    );
+    xvc::nv12_to_rgb(
+        y.data(),
+        2,
+        uv.data(),
+        2,
+        bgrx.data(),
+        8,
+        2,
+        1,
+        xvc::RgbFormat::BGRx,
+        xvc::ColorMatrix::BT601
+    );
+    EXPECT_GE(rgba[0], 250);
+    EXPECT_LE(rgba[1], 5);
+    EXPECT_LE(rgba[2], 5);
+    EXPECT_EQ(rgba[3], 255);
+    EXPECT_EQ(bgrx[0], rgba[2]);
+    EXPECT_EQ(bgrx[1], rgba[1]);
+    EXPECT_EQ(bgrx[2], rgba[0]);
+    EXPECT_EQ(bgrx[3], 255);
+}
+
+TEST(ColorConvertTest, SimdMatchesScalar)
+{
+    auto best = xvc::detect_simd_level();
+    if (best == xvc::SimdLevel::Scalar) {
+        GTEST_SKIP() << "No SIMD kernel available on this CPU";
+    }
+
+    // Odd sizes exercise the scalar tails after the vector loops.
+    for (auto [width, height] : {std::pair{64, 4}, std::pair{97, 7}, std::pair{1920, 2}}) {
+        auto image = random_image(width, height, static_cast<unsigned>(width * height));
+        for (auto nv12 : {true, false}) {
+            for (auto format : {xvc::RgbFormat::RGB, xvc::RgbFormat::RGBA, xvc::RgbFormat::BGRx}) {
+                for (auto matrix :
+                     {xvc::ColorMatrix::BT601,
+                      xvc::ColorMatrix::BT709,
+                      xvc::ColorMatrix::BT601Full,
+                      xvc::ColorMatrix::BT709Full}) {
+                    auto reference = convert(image, nv12, format, matrix, xvc::SimdLevel::Scalar);
+                    for (auto level : {xvc::SimdLevel::SSE41, xvc::SimdLevel::AVX2}) {
+                        if (level > best) continue;
+                        EXPECT_EQ(convert(image, nv12, format, matrix, level), reference)
+                            << xvc::simd_level_name(level) << " " << width << "x" << height
+                            << (nv12 ? " NV12" : " I420");
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(ColorConvertTest, FullRangeReferenceColors)
+{
+    for (auto [luma, expected] : {std::pair{0, 0}, std::pair{128, 128}, std::pair{255, 255}}) {
+        std::vector<std::uint8_t> y(2, static_cast<std::uint8_t>(luma));
+        std::vector<std::uint8_t> uv{128, 128};
+        std::vector<std::uint8_t> out(6);
+        xvc::nv12_to_rgb(
+            y.data(),
+            2,
+            uv.data(),
+            2,
+            out.data(),
+            6,
+            2,
+            1,
+            xvc::RgbFormat::RGB,
+            xvc::ColorMatrix::BT601Full,
+            xvc::SimdLevel::Scalar
+        );
+        for (auto value : out) {
+            EXPECT_EQ(value, expected);
+        }
+    }
+}
+
+TEST(ColorConvertTest, MatchesGstVideoConverter)
+{
+    gst_init(nullptr, nullptr);
+    struct Case {
+        GstVideoColorRange range;
+        GstVideoColorMatrix gst_matrix;
+        xvc::ColorMatrix matrix;
+    };
+    const Case cases[] = {
+        {GST_VIDEO_COLOR_RANGE_16_235, GST_VIDEO_COLOR_MATRIX_BT601, xvc::ColorMatrix::BT601},
+        {GST_VIDEO_COLOR_RANGE_16_235, GST_VIDEO_COLOR_MATRIX_BT709, xvc::ColorMatrix::BT709},
+        {GST_VIDEO_COLOR_RANGE_0_255, GST_VIDEO_COLOR_MATRIX_BT601, xvc::ColorMatrix::BT601Full},
+        {GST_VIDEO_COLOR_RANGE_0_255, GST_VIDEO_COLOR_MATRIX_BT709, xvc::ColorMatrix::BT709Full},
+    };
+    auto image = random_image(96, 48, 7);
+    for (auto [range, gst_matrix, matrix] : cases) {
+        auto reference = convert_with_gstreamer(image, range, gst_matrix);
+        auto output = convert(image, true, xvc::RgbFormat::RGB, matrix, xvc::detect_simd_level());
+        ASSERT_EQ(output.size(), reference.size());
+        auto difference = 0;
+        for (size_t i = 0; i < output.size(); ++i) {
+            difference = std::max(difference, std::abs(output[i] - reference[i]));
+        }
+        EXPECT_LE(difference, 1) << "matrix " << static_cast<int>(matrix);
+    }
+}
@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "compact_sidecar.h"
+
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+
+std::vector<xvc::SidecarRecord> records(std::size_t count)
+{
+    std::vector<xvc::SidecarRecord> result;
+    for (std::size_t i = 0; i < count; ++i) {
+        result.push_back(
+            {i * 33'333'333,
+             1'000'000'000 + i * 1000 + (i % 3),
+             static_cast<std::uint32_t>(0xFFFFFF00u + i * 30),  // Wraps around.
+             static_cast<std::uint32_t>(i / 100 % 2),
+             0,
+             static_cast<std::uint32_t>(i * 7919 % 65536),
+             0}
+        );
+    }
+    return result;
+}
+
+bool equal(const std::vector<xvc::SidecarRecord> &a, const std::vector<xvc::SidecarRecord> &b)
+{
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(a[0])) == 0;
+}
+
+class CompactSidecarTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        _path = fs::temp_directory_path() / "xvc_compact_sidecar_test.xbin";
+        fs::remove(_path);
+    }
+    void TearDown() override { fs::remove(_path); }
+
+    void write(const std::vector<xvc::SidecarRecord> &input, std::size_t block_records)
+    {
+        xvc::CompactSidecarWriter writer(_path, block_records);
+        for (const auto &record : input) {
+            ASSERT_TRUE(writer.append(record));
+        }
+        ASSERT_TRUE(writer.close());
+    }
+
+    fs::path _path;
+};
+
+}  // namespace
+
+
+TEST_F(CompactSidecarTest, RoundTripsAndCompresses)
+{
+    auto input = records(10'000);
+    write(input, 1000);
+
+    xvc::CompactSidecarReader reader(_path);
+    ASSERT_TRUE(reader.is_open());
+    EXPECT_FALSE(reader.recovered());
+    EXPECT_EQ(reader.size(), input.size());
+    std::vector<xvc::SidecarRecord> output;
+    ASSERT_TRUE(reader.read_all(output));
+    EXPECT_TRUE(equal(input, output));
+    EXPECT_LT(fs::file_size(_path) * 3, input.size() * sizeof(xvc::SidecarRecord));
+}
+
+TEST_F(CompactSidecarTest, ReadsRangesAcrossBlocks)
+{
+    auto input = records(2500);
+    write(input, 1000);
+
+    xvc::CompactSidecarReader reader(_path);
+    std::vector<xvc::SidecarRecord> output;
+    ASSERT_TRUE(reader.read(990, 1020, output));
+    EXPECT_TRUE(equal({input.begin() + 990, input.begin() + 2010}, output));
+    ASSERT_TRUE(reader.read(2400, 1000, output));
+    EXPECT_EQ(output.size(), 100);
+    ASSERT_TRUE(reader.read(3000, 10, output));
+    EXPECT_TRUE(output.empty());
+}
+
+TEST_F(CompactSidecarTest, RecoversBlocksWithoutIndex)
+{
+    auto input = records(2500);
+    write(input, 1000);
+    fs::resize_file(_path, fs::file_size(_path) - 1);
+
+    xvc::CompactSidecarReader reader(_path);
+    ASSERT_TRUE(reader.is_open());
+    EXPECT_TRUE(reader.recovered());
+    std::vector<xvc::SidecarRecord> output;
+    ASSERT_TRUE(reader.read_all(output));
+    EXPECT_TRUE(equal(input, output));
+}
+
+TEST_F(CompactSidecarTest, DetectsCorruption)
+{
+    write(records(100), 1000);
+    {
+        std::fstream file(_path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(40);
+        file.put('\x55');
+    }
+    xvc::CompactSidecarReader reader(_path);
+    std::vector<xvc::SidecarRecord> output;
+    EXPECT_FALSE(reader.read_all(output));
+}
+
+TEST_F(CompactSidecarTest, RejectsOversizedBlockHeaders)
+{
+    // The count and then the size of the second block, each claiming far more than the file has.
+    for (auto field : {4, 8}) {
+        write(records(2500), 1000);
+        {
+            // The first block follows the 16-byte file header; its size is at offset 8 of its own.
+            std::fstream file(_path, std::ios::in | std::ios::out | std::ios::binary);
+            std::uint32_t size = 0;
+            file.seekg(16 + 8);
+            file.read(reinterpret_cast<char *>(&size), sizeof(size));
+            std::uint32_t huge = 0xFFFFFFF0;
+            file.seekp(16 + 16 + size + field);
+            file.write(reinterpret_cast<const char *>(&huge), sizeof(huge));
+        }
+        xvc::CompactSidecarReader reader(_path);
+        ASSERT_TRUE(reader.is_open());
+        EXPECT_TRUE(reader.recovered());
+        EXPECT_EQ(reader.size(), 1000);
+        std::vector<xvc::SidecarRecord> output;
+        EXPECT_TRUE(reader.read_all(output));
+        EXPECT_EQ(output.size(), 1000);
+    }
+}
+
+TEST_F(CompactSidecarTest, KeepsATruncatedBin)
+{
+    auto bin = fs::path(_path).replace_extension(".bin");
+    auto input = records(100);
+    std::ofstream(bin, std::ios::binary)
+        .write(reinterpret_cast<const char *>(input.data()), input.size() * sizeof(input[0]));
+    ASSERT_TRUE(xvc::compact_sidecar(bin, _path));
+    EXPECT_EQ(xvc::CompactSidecarReader(_path).size(), input.size());
+    fs::remove(_path);
+
+    fs::resize_file(bin, fs::file_size(bin) - 5);
+    EXPECT_FALSE(xvc::compact_sidecar(bin, _path));
+    EXPECT_FALSE(fs::exists(_path));
+    EXPECT_FALSE(fs::exists(fs::path(_path) += ".part"));
+    fs::remove(bin);
+}
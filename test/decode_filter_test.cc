@@ -0,0 +1,144 @@
+#include <gst/gst.h>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "decode_filter.h"
+
+
+namespace
+{
+
+// Pushes access units straight into a fakesink carrying the filter, so every decision is made
+// before push() returns.
+class DecodeFilterTest : public ::testing::Test
+{
+protected:
+    static void SetUpTestSuite() { gst_init(nullptr, nullptr); }
+
+    void SetUp() override
+    {
+        _sink = gst_element_factory_make("fakesink", nullptr);
+        if (!_sink) GTEST_SKIP() << "GStreamer plugins missing";
+        _bin = GST_BIN(gst_object_ref_sink(gst_bin_new(nullptr)));
+        g_object_set(
+            G_OBJECT(_sink), "sync", FALSE, "async", FALSE, "signal-handoffs", TRUE, nullptr
+        );
+        g_signal_connect(
+            _sink,
+            "handoff",
+            G_CALLBACK(+[](GstElement *, GstBuffer *buffer, GstPad *, gpointer passed) {
+                static_cast<std::vector<std::uint64_t> *>(passed)->push_back(
+                    GST_BUFFER_OFFSET(buffer)
+                );
+            }),
+            &_passed
+        );
+        gst_bin_add(_bin, _sink);
+
+        _src = gst_pad_new("src", GST_PAD_SRC);
+        auto sink_pad = gst_element_get_static_pad(_sink, "sink");
+        ASSERT_EQ(gst_pad_link(_src, sink_pad), GST_PAD_LINK_OK);
+        gst_object_unref(sink_pad);
+        gst_element_set_state(GST_ELEMENT(_bin), GST_STATE_PLAYING);
+        gst_pad_set_active(_src, TRUE);
+
+        gst_pad_push_event(_src, gst_event_new_stream_start("decode-filter-test"));
+        auto caps = gst_caps_new_empty_simple("video/x-h265");
+        gst_pad_push_event(_src, gst_event_new_caps(caps));
+        gst_caps_unref(caps);
+        GstSegment segment;
+        gst_segment_init(&segment, GST_FORMAT_TIME);
+        gst_pad_push_event(_src, gst_event_new_segment(&segment));
+    }
+
+    void TearDown() override
+    {
+        if (!_bin) return;
+        gst_pad_set_active(_src, FALSE);
+        gst_element_set_state(GST_ELEMENT(_bin), GST_STATE_NULL);
+        gst_object_unref(_src);
+        gst_object_unref(_bin);
+    }
+
+    xvc::DecodeFilter *attach(xvc::DecodeMode mode, int prefix = 1)
+    {
+        return xvc::DecodeFilter::attach(_bin, _sink, mode, prefix);
+    }
+
+    // One buffer per character, numbered by its offset: 'K' a keyframe, 'd' a delta unit, 'x' a
+    // delta unit after a loss, flagged DISCONT as a demuxer does.
+    void push(const std::string &units)
+    {
+        for (auto unit : units) {
+            auto buffer = gst_buffer_new();
+            GST_BUFFER_OFFSET(buffer) = _pushed++;
+            if (unit != 'K') {
+                GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+            }
+            if (unit == 'x') {
+                GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DISCONT);
+            }
+            gst_pad_push(_src, buffer);
+        }
+    }
+
+    GstBin *_bin = nullptr;
+    GstElement *_sink = nullptr;
+    GstPad *_src = nullptr;
+    std::uint64_t _pushed = 0;
+    std::vector<std::uint64_t> _passed;
+};
+
+using Offsets = std::vector<std::uint64_t>;
+
+}  // namespace
+
+
+TEST_F(DecodeFilterTest, KeyframesOnly)
+{
+    auto filter = attach(xvc::DecodeMode::Keyframes);
+    ASSERT_NE(filter, nullptr);
+    push("KdddKddK");
+    EXPECT_EQ(_passed, (Offsets{0, 4, 7}));
+    EXPECT_EQ(filter->stats().passed, 3);
+    EXPECT_EQ(filter->stats().dropped, 5);
+}
+
+TEST_F(DecodeFilterTest, GopPrefix)
+{
+    auto filter = attach(xvc::DecodeMode::GopPrefix, 2);
+    push("KdddKdd");
+    EXPECT_EQ(_passed, (Offsets{0, 1, 4, 5}));
+    EXPECT_EQ(filter->stats().dropped, 3);
+}
+
+TEST_F(DecodeFilterTest, WaitsForTheFirstKeyframe)
+{
+    auto filter = attach(xvc::DecodeMode::All);
+    push("ddKd");
+    EXPECT_EQ(_passed, (Offsets{2, 3}));
+    EXPECT_EQ(filter->stats().dropped, 2);
+}
+
+TEST_F(DecodeFilterTest, DenserModeStartsAtTheNextKeyframe)
+{
+    auto filter = attach(xvc::DecodeMode::Keyframes);
+    push("Kdd");
+    filter->set_mode(xvc::DecodeMode::All, 1);
+    // The GOP lost its delta units to the old mode, so the rest of it is dropped too.
+    push("dKdd");
+    EXPECT_EQ(_passed, (Offsets{0, 4, 5, 6}));
+    EXPECT_EQ(filter->stats().dropped, 3);
+}
+
+TEST_F(DecodeFilterTest, DropsTheRestOfTheGopAfterALoss)
+{
+    auto filter = attach(xvc::DecodeMode::All);
+    push("KddxdKd");
+    EXPECT_EQ(_passed, (Offsets{0, 1, 2, 5, 6}));
+    // What was lost never reached the filter, so only the units after it count as dropped.
+    EXPECT_EQ(filter->stats().dropped, 2);
+}
@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "direct_file_writer.h"
+#include "temp_directory_test_base.h"
+
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+
+using Bytes = std::vector<std::uint8_t>;
+
+Bytes read_file(const fs::path &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+// Writes `data` at `offset` both to the writer and to `expected`.
+void write(xvc::DirectFileWriter &writer, Bytes &expected, std::uint64_t offset, const Bytes &data)
+{
+    if (expected.size() < offset + data.size()) expected.resize(offset + data.size());
+    std::copy(data.begin(), data.end(), expected.begin() + offset);
+    ASSERT_TRUE(writer.write(offset, data));
+}
+
+Bytes pattern(std::size_t size, std::uint8_t seed)
+{
+    Bytes bytes(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        bytes[i] = static_cast<std::uint8_t>(seed + i * 7);
+    }
+    return bytes;
+}
+
+class DirectFileWriterTest : public TempDirectoryTest
+{
+protected:
+    // Small blocks, so a few kilobytes already cross several of them.
+    static constexpr xvc::DirectFileWriter::Options Small{
+        .block_size = 2 * xvc::DirectFileWriter::Alignment, .blocks = 2, .preallocate = 1 << 20
+    };
+};
+
+}  // namespace
+
+
+TEST_F(DirectFileWriterTest, WritesAppendedDataExactly)
+{
+    xvc::DirectFileWriter writer(Small);
+    auto path = _directory / "append.bin";
+    ASSERT_TRUE(writer.open(path));
+    Bytes expected;
+    std::uint64_t offset = 0;
+    for (auto i = 0; i < 50; ++i) {
+        auto data = pattern(100 + i * 37, static_cast<std::uint8_t>(i));
+        write(writer, expected, offset, data);
+        offset += data.size();
+    }
+    ASSERT_TRUE(writer.close());
+
+    // Trimmed to the data: neither the padding of the last block nor the reservation remain.
+    EXPECT_EQ(fs::file_size(path), expected.size());
+    EXPECT_EQ(read_file(path), expected);
+    auto stats = writer.stats();
+    EXPECT_GE(stats.bytes, expected.size());
+    EXPECT_EQ(stats.bytes % xvc::DirectFileWriter::Alignment, 0);
+    EXPECT_EQ(stats.patches, 0);
+}
+
+TEST_F(DirectFileWriterTest, RewritesDataBehindTheCurrentBlock)
+{
+    xvc::DirectFileWriter writer(Small);
+    auto path = _directory / "seek.bin";
+    ASSERT_TRUE(writer.open(path));
+    Bytes expected;
+    write(writer, expected, 0, pattern(40000, 1));
+    // Behind the block being filled, across a block boundary, then inside it.
+    write(writer, expected, 10, pattern(8, 2));
+    write(writer, expected, 8190, pattern(4, 3));
+    write(writer, expected, 39990, pattern(20, 4));
+    // A hole, which reads as zeros, and then back to the end.
+    write(writer, expected, 60000, pattern(100, 5));
+    write(writer, expected, 45000, pattern(100, 6));
+    ASSERT_TRUE(writer.close());
+
+    EXPECT_EQ(read_file(path), expected);
+    EXPECT_GT(writer.stats().patches, 0);
+}
+
+TEST_F(DirectFileWriterTest, ReusesTheWriterAndSharesTheMeter)
+{
+    xvc::WriteMeter meter;
+    xvc::DirectFileWriter writer({}, &meter);
+    std::mt19937 random(7);
+    std::vector<std::pair<fs::path, Bytes>> files;
+    for (auto i = 0; i < 3; ++i) {
+        auto path = _directory / ("file" + std::to_string(i) + ".bin");
+        ASSERT_TRUE(writer.open(path));
+        Bytes expected;
+        std::uint64_t offset = 0;
+        for (auto j = 0; j < 20; ++j) {
+            auto data = pattern(random() % 300000, static_cast<std::uint8_t>(j));
+            write(writer, expected, offset, data);
+            offset += data.size();
+        }
+        ASSERT_TRUE(writer.close());
+        files.emplace_back(path, std::move(expected));
+    }
+    for (const auto &[path, expected] : files) {
+        EXPECT_EQ(read_file(path), expected);
+    }
+    EXPECT_GE(meter.stats().writes, 3);
+    EXPECT_EQ(meter.stats().bytes, writer.stats().bytes);
+}
+
+TEST_F(DirectFileWriterTest, WritesThroughAGovernorQueue)
+{
+    xvc::IoGovernor governor;
+    auto queue = governor.join("camera");
+    xvc::DirectFileWriter writer(Small, nullptr, queue.get());
+    auto path = _directory / "governed.bin";
+    ASSERT_TRUE(writer.open(path));
+    Bytes expected;
+    write(writer, expected, 0, pattern(50000, 1));
+    write(writer, expected, 100, pattern(10, 2));
+    ASSERT_TRUE(writer.close());
+
+    EXPECT_EQ(read_file(path), expected);
+    EXPECT_EQ(governor.stats().front().finalized, 1);
+}
+
+TEST_F(DirectFileWriterTest, FailsToOpenAMissingDirectory)
+{
+    xvc::DirectFileWriter writer(Small);
+    EXPECT_FALSE(writer.open(_directory / "missing" / "file.bin"));
+    EXPECT_FALSE(writer.is_open());
+    EXPECT_FALSE(writer.write(0, pattern(10, 0)));
+}
@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "elementary_stream.h"
+#include "sidecar.h"
+#include "temp_directory_test_base.h"
+#include "timestamp_index.h"
+
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+
+class ElementaryStreamTest : public TempDirectoryTest
+{
+protected:
+    // Writes `count` JPEG-like frames of growing size, every fifth one a keyframe, and their index.
+    fs::path write(const std::string &name, int count)
+    {
+        auto path = _directory / name;
+        std::ofstream stream(path, std::ios::binary);
+        xvc::FrameIndexWriter index(xvc::frame_index_path(path), xvc::ElementaryCodec::Jpeg);
+        std::uint64_t offset = 0;
+        for (auto i = 0; i < count; ++i) {
+            auto frame = std::string(100 + i, static_cast<char>('a' + i % 26));
+            stream << frame;
+            EXPECT_TRUE(index.append(
+                {offset,
+                 static_cast<std::uint32_t>(frame.size()),
+                 i % 5 == 0,
+                 i * 33'333'333LL,
+                 i * 33'333'333LL}
+            ));
+            offset += frame.size();
+        }
+        EXPECT_TRUE(index.close());
+        return path;
+    }
+};
+
+}  // namespace
+
+
+TEST_F(ElementaryStreamTest, ReadsFramesThroughTheIndex)
+{
+    auto path = write("camera.mjpeg", 30);
+    EXPECT_EQ(xvc::frame_index_path(path), _directory / "camera.idx");
+
+    xvc::ElementaryReader reader(path);
+    ASSERT_TRUE(reader.is_open());
+    EXPECT_EQ(reader.codec(), xvc::ElementaryCodec::Jpeg);
+    ASSERT_EQ(reader.size(), 30);
+    for (std::size_t i = 0; i < reader.size(); ++i) {
+        auto frame = reader.frame(i);
+        ASSERT_EQ(frame.size(), 100 + i);
+        EXPECT_EQ(frame.front(), 'a' + i % 26);
+        EXPECT_EQ(frame.back(), 'a' + i % 26);
+        EXPECT_EQ(reader.record(i).keyframe != 0, i % 5 == 0);
+        EXPECT_EQ(reader.record(i).pts, static_cast<std::int64_t>(i) * 33'333'333);
+    }
+}
+
+TEST_F(ElementaryStreamTest, DropsWhatACrashCutShort)
+{
+    auto path = write("camera.mjpeg", 10);
+    // The stream loses half of its last frame, the index half of a record.
+    fs::resize_file(path, fs::file_size(path) - 50);
+    auto index = xvc::frame_index_path(path);
+    fs::resize_file(index, fs::file_size(index) + 16);
+
+    xvc::ElementaryReader reader(path);
+    ASSERT_TRUE(reader.is_open());
+    EXPECT_EQ(reader.size(), 9);
+}
+
+TEST_F(ElementaryStreamTest, NeedsAFrameIndex)
+{
+    auto path = write("camera.mjpeg", 3);
+    fs::remove(xvc::frame_index_path(path));
+    EXPECT_FALSE(xvc::ElementaryReader(path).is_open());
+
+    std::ofstream(xvc::frame_index_path(path), std::ios::binary) << std::string(64, 'x');
+    EXPECT_FALSE(xvc::ElementaryReader(path).is_open());
+}
+
+TEST_F(ElementaryStreamTest, IndexesTimestamps)
+{
+    auto path = write("camera.mjpeg", 20);
+    std::vector<xvc::SidecarRecord> records;
+    for (auto i = 0; i < 20; ++i) {
+        records.push_back(
+            {static_cast<std::uint64_t>(i) * 33'333'333,
+             1000u * i,
+             30u * i,
+             0,
+             0,
+             0,
+             0}
+        );
+    }
+    std::ofstream(fs::path(path).replace_extension(".bin"), std::ios::binary)
+        .write(
+            reinterpret_cast<const char *>(records.data()),
+            records.size() * sizeof(xvc::SidecarRecord)
+        );
+
+    xvc::TimestampIndex index;
+    ASSERT_TRUE(index.add_segment(path));
+    auto location = index.at_timestamp(12'500);
+    ASSERT_TRUE(location);
+    EXPECT_EQ(location->entry.frame, 12);
+    EXPECT_EQ(location->entry.offset, 12 * 100 + 11 * 12 / 2);
+    EXPECT_FALSE(location->entry.keyframe);
+    EXPECT_TRUE(index.at_timestamp(10'000)->entry.keyframe);
+}
@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <thread>
+
+#include "frame_ring.h"
+
+
+TEST(FrameRingTest, PushPopPreservesOrder)
+{
+    xvc::FrameRing<int> ring(3);
+    for (auto i = 0; i < 3; ++i) {
+        ASSERT_TRUE(ring.push(i));
+    }
+    EXPECT_TRUE(ring.full());
+    EXPECT_EQ(ring.size(), 3);
+
+    auto rejected = 3;
+    EXPECT_FALSE(ring.push(rejected));
+
+    for (auto i = 0; i < 3; ++i) {
+        auto value = ring.pop();
+        ASSERT_TRUE(value.has_value());
+        EXPECT_EQ(*value, i);
+    }
+    EXPECT_TRUE(ring.empty());
+    EXPECT_FALSE(ring.pop().has_value());
+}
+
+TEST(FrameRingTest, ReleasesSharedHandles)
+{
+    xvc::FrameRing<std::shared_ptr<int>> ring(2);
+    auto handle = std::make_shared<int>(42);
+    std::weak_ptr<int> weak = handle;
+
+    ASSERT_TRUE(ring.push(handle));
+    EXPECT_EQ(handle, nullptr);
+    EXPECT_FALSE(weak.expired());
+
+    auto popped = ring.pop();
+    ASSERT_TRUE(popped.has_value());
+    EXPECT_EQ(**popped, 42);
+    popped.reset();
+    EXPECT_TRUE(weak.expired());
+}
+
+TEST(FrameRingTest, SingleProducerSingleConsumer)
+{
+    constexpr auto Count = 10000;
+    xvc::FrameRing<int> ring(8);
+
+    std::thread producer([&] {
+        for (auto i = 0; i < Count; ++i) {
+            auto value = i;
+            while (!ring.push(value)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    auto expected = 0;
+    while (expected < Count) {
+        if (auto value = ring.pop()) {
+            ASSERT_EQ(*value, expected);
+            ++expected;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    EXPECT_TRUE(ring.empty());
+}
@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "io_governor.h"
+
+
+using namespace std::chrono_literals;
+
+
+TEST(IoGovernorTest, SharesWritesByWeight)
+{
+    xvc::IoGovernor governor({.writes = 1});
+    auto heavy = governor.join("heavy", {.weight = 3});
+    auto light = governor.join("light", {.weight = 1});
+    std::atomic<int> total{0};
+    auto record = [&](xvc::IoGovernor::Queue &queue, int &count) {
+        xvc::IoGovernor::Grant grant;
+        while (total < 400) {
+            grant = queue.write(1000, std::move(grant));
+            ++count;
+            ++total;
+            std::this_thread::sleep_for(100us);
+        }
+    };
+
+    auto heavy_count = 0;
+    auto light_count = 0;
+    {
+        std::jthread a(record, std::ref(*heavy), std::ref(heavy_count));
+        std::jthread b(record, std::ref(*light), std::ref(light_count));
+    }
+    ASSERT_GT(light_count, 0);
+    auto ratio = heavy_count / static_cast<double>(light_count);
+    EXPECT_GT(ratio, 2.0);
+    EXPECT_LT(ratio, 4.5);
+}
+
+TEST(IoGovernorTest, ServesHigherPriorityFirst)
+{
+    xvc::IoGovernor governor({.writes = 1});
+    auto holder = governor.join("holder");
+    auto low = governor.join("low", {.priority = 0});
+    auto high = governor.join("high", {.priority = 1});
+    std::mutex mutex;
+    std::vector<std::string> order;
+    auto write = [&](xvc::IoGovernor::Queue &queue) {
+        auto grant = queue.write(1000);
+        std::lock_guard lock(mutex);
+        order.push_back(queue.camera());
+    };
+
+    {
+        auto grant = holder->write(1000);
+        std::jthread a(write, std::ref(*low));
+        std::this_thread::sleep_for(50ms);
+        std::jthread b(write, std::ref(*high));
+        std::this_thread::sleep_for(50ms);
+        grant.release();
+    }
+    EXPECT_EQ(order, (std::vector<std::string>{"high", "low"}));
+}
+
+TEST(IoGovernorTest, FinalizesOneFileAtATime)
+{
+    xvc::IoGovernor governor({.finalizers = 1, .finalize_gap = 20ms});
+    std::atomic<int> running{0};
+    std::atomic<int> most{0};
+    std::mutex mutex;
+    std::vector<std::chrono::steady_clock::time_point> starts;
+    {
+        std::vector<std::jthread> cameras;
+        for (auto i = 0; i < 4; ++i) {
+            cameras.emplace_back([&, i] {
+                auto queue = governor.join("camera" + std::to_string(i));
+                auto grant = queue->finalize();
+                {
+                    std::lock_guard lock(mutex);
+                    starts.push_back(std::chrono::steady_clock::now());
+                }
+                most = std::max(most.load(), ++running);
+                std::this_thread::sleep_for(5ms);
+                --running;
+            });
+        }
+    }
+
+    EXPECT_EQ(most, 1);
+    ASSERT_EQ(starts.size(), 4);
+    std::sort(starts.begin(), starts.end());
+    for (std::size_t i = 1; i < starts.size(); ++i) {
+        EXPECT_GE(starts[i] - starts[i - 1], 15ms);
+    }
+}
+
+TEST(IoGovernorTest, ReportsEveryCamera)
+{
+    xvc::IoGovernor governor({.writes = 1});
+    auto queue = governor.join("a", {.weight = 2});
+    queue->queued(1000);
+    queue->handed(400);
+    {
+        auto other = governor.join("b");
+        auto grant = other->write(10);
+        std::jthread waiting([&] { auto grant = queue->write(10); });
+        std::this_thread::sleep_for(20ms);
+        grant.release();
+    }
+    // The same queue, with the new share.
+    EXPECT_EQ(governor.join("a", {.weight = 5}), queue);
+
+    auto stats = governor.stats();
+    ASSERT_EQ(stats.size(), 1);
+    EXPECT_EQ(stats[0].camera, "a");
+    EXPECT_EQ(stats[0].share.weight, 5);
+    EXPECT_EQ(stats[0].backlog, 600);
+    EXPECT_EQ(stats[0].bytes, 400);
+    EXPECT_GE(stats[0].stalled, 10ms);
+    EXPECT_EQ(stats[0].finalized, 0);
+}
@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "jpeg_export.h"
+#include "temp_directory_test_base.h"
+
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+
+using Bytes = std::vector<std::uint8_t>;
+
+Bytes id(std::uint32_t value)
+{
+    Bytes bytes;
+    for (auto shift = 24; shift >= 0; shift -= 8) {
+        if (!bytes.empty() || (value >> shift) & 0xFF) bytes.push_back((value >> shift) & 0xFF);
+    }
+    return bytes;
+}
+
+Bytes element(std::uint32_t element_id, const Bytes &data)
+{
+    auto bytes = id(element_id);
+    bytes.push_back(0x01);
+    for (auto shift = 48; shift >= 0; shift -= 8) {
+        bytes.push_back((data.size() >> shift) & 0xFF);
+    }
+    bytes.insert(bytes.end(), data.begin(), data.end());
+    return bytes;
+}
+
+Bytes concat(std::initializer_list<Bytes> parts)
+{
+    Bytes bytes;
+    for (const auto &part : parts) bytes.insert(bytes.end(), part.begin(), part.end());
+    return bytes;
+}
+
+// A stand-in JPEG image: SOI, two identifying bytes, EOI.
+Bytes jpeg(std::uint8_t segment, std::uint8_t frame)
+{
+    return {0xFF, 0xD8, segment, frame, 0xFF, 0xD9};
+}
+
+// An M-JPEG Matroska file with one SimpleBlock per frame.
+void write_segment(const fs::path &path, const std::vector<Bytes> &frames)
+{
+    auto track = concat(
+        {element(0xD7, {1}), element(0x86, Bytes{'V', '_', 'M', 'J', 'P', 'E', 'G'})}
+    );
+    auto cluster = element(0xE7, {0});
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+        Bytes block{0x81, 0, static_cast<std::uint8_t>(i), 0x80};
+        block.insert(block.end(), frames[i].begin(), frames[i].end());
+        cluster = concat({cluster, element(0xA3, block)});
+    }
+    auto segment = concat(
+        {element(0x1549A966, element(0x2AD7B1, {0x0F, 0x42, 0x40})),
+         element(0x1654AE6B, element(0xAE, track)),
+         element(0x1F43B675, cluster)}
+    );
+    auto file = concat(
+        {element(0x1A45DFA3, element(0x4282, Bytes{'m', 'a', 't', 'r', 'o', 's', 'k', 'a'})),
+         element(0x18538067, segment)}
+    );
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(file.data()), file.size());
+}
+
+std::vector<Bytes> frames(std::uint8_t segment, int count)
+{
+    std::vector<Bytes> result;
+    for (auto i = 0; i < count; ++i) {
+        result.push_back(jpeg(segment, static_cast<std::uint8_t>(i)));
+    }
+    return result;
+}
+
+class JpegExportTest : public TempDirectoryTest
+{
+protected:
+    void SetUp() override
+    {
+        TempDirectoryTest::SetUp();
+        _segments = {_directory / "a.mkv", _directory / "b.mkv"};
+        write_segment(_segments[0], frames(0, 5));
+        write_segment(_segments[1], frames(1, 5));
+    }
+    std::vector<fs::path> _segments;
+};
+
+}  // namespace
+
+
+TEST_F(JpegExportTest, SelectsRangesWithStrideAcrossSegments)
+{
+    std::mutex mutex;
+    std::vector<std::pair<std::size_t, Bytes>> exported;
+    auto report = xvc::export_jpeg(
+        _segments,
+        [&](const xvc::JpegFrame &frame) {
+            std::lock_guard lock(mutex);
+            EXPECT_EQ(frame.jpeg[2], frame.segment);
+            EXPECT_EQ(frame.jpeg[3], frame.frame);
+            exported.push_back({frame.number, Bytes(frame.jpeg.begin(), frame.jpeg.end())});
+            return true;
+        },
+        {.first = 3, .count = 6, .stride = 2}
+    );
+    std::sort(exported.begin(), exported.end());
+
+    EXPECT_EQ(report.frames, 3);
+    EXPECT_EQ(report.failed, 0);
+    EXPECT_EQ(report.bytes, 18);
+    ASSERT_EQ(exported.size(), 3);
+    EXPECT_EQ(exported[0], std::make_pair(std::size_t(3), jpeg(0, 3)));
+    EXPECT_EQ(exported[1], std::make_pair(std::size_t(5), jpeg(1, 0)));
+    EXPECT_EQ(exported[2], std::make_pair(std::size_t(7), jpeg(1, 2)));
+}
+
+TEST_F(JpegExportTest, WritesTheImagesUnchanged)
+{
+    auto out = _directory / "out";
+    auto report = xvc::export_jpeg(_segments, out);
+    EXPECT_EQ(report.frames, 10);
+
+    std::ifstream file(out / "frame_000006.jpg", std::ios::binary);
+    Bytes content{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    EXPECT_EQ(content, jpeg(1, 1));
+    EXPECT_FALSE(fs::exists(out / "frame_000010.jpg"));
+}
+
+TEST_F(JpegExportTest, SkipsBlocksThatAreNotJpeg)
+{
+    auto broken = frames(0, 3);
+    broken[1] = {0x00, 0x01, 0x02, 0x03};
+    write_segment(_segments[0], broken);
+
+    auto report = xvc::export_jpeg(_segments, [](const xvc::JpegFrame &) { return true; });
+    EXPECT_EQ(report.frames, 7);
+    EXPECT_EQ(report.failed, 1);
+}
+
+TEST_F(JpegExportTest, StopsWhenTheSinkDeclines)
+{
+    auto calls = 0;
+    auto report = xvc::export_jpeg(
+        _segments,
+        [&](const xvc::JpegFrame &) { return ++calls < 3; },
+        {.workers = 1}
+    );
+    EXPECT_EQ(calls, 3);
+    EXPECT_EQ(report.frames, 2);
+}
+
+TEST_F(JpegExportTest, AbortsOnASegmentItCannotRead)
+{
+    std::ofstream(_segments[0], std::ios::binary) << "not a Matroska file";
+    auto calls = 0;
+    auto report = xvc::export_jpeg(_segments, [&](const xvc::JpegFrame &) { return ++calls > 0; });
+    EXPECT_TRUE(report.aborted);
+    EXPECT_EQ(report.failed_segments, 1);
+    EXPECT_EQ(report.frames, 0);
+    EXPECT_EQ(calls, 0);
+}
+
+TEST_F(JpegExportTest, RejectsAnInvalidPattern)
+{
+    for (const auto *pattern : {"frame_{:06", "frame_{:s}.jpg", "frame.jpg"}) {
+        auto report = xvc::export_jpeg(_segments, _directory / "out", {.pattern = pattern});
+        EXPECT_TRUE(report.aborted) << pattern;
+        EXPECT_EQ(report.frames, 0) << pattern;
+    }
+    EXPECT_FALSE(fs::exists(_directory / "out"));
+}
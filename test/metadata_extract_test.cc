@@ -0,0 +1,109 @@
+#include <gst/gst.h>
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include "metadata_extract.h"
+#include "temp_directory_test_base.h"
+
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+
+std::string read_file(const fs::path &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+bool has_elements(std::initializer_list<const char *> names)
+{
+    for (auto name : names) {
+        auto factory = gst_element_factory_find(name);
+        if (!factory) return false;
+        gst_object_unref(factory);
+    }
+    return true;
+}
+
+// The reference for scan_metadata() is MetadataExtractor, which demuxes with matroskademux and
+// parses with the codec's parser; `xvc_tool extract --verify` compares the two the same way.
+class MetadataExtractTest : public TempDirectoryTest
+{
+protected:
+    static void SetUpTestSuite() { gst_init(nullptr, nullptr); }
+
+    // A few frames of a test pattern, encoded by `encoder` into the Matroska file `name`.
+    fs::path record(const std::string &name, const std::string &encoder)
+    {
+        auto path = _directory / name;
+        auto description = "videotestsrc num-buffers=12 pattern=ball ! "
+                           "video/x-raw,width=320,height=240,framerate=30/1 ! " +
+                           encoder + " ! matroskamux ! filesink location=\"" +
+                           path.generic_string() + "\"";
+        GError *error = nullptr;
+        auto pipeline = gst_parse_launch_full(
+            description.c_str(), nullptr, GST_PARSE_FLAG_FATAL_ERRORS, &error
+        );
+        if (!pipeline) {
+            ADD_FAILURE() << (error ? error->message : "no pipeline");
+            g_clear_error(&error);
+            return {};
+        }
+        gst_element_set_state(pipeline, GST_STATE_PLAYING);
+        auto bus = gst_element_get_bus(pipeline);
+        auto message = gst_bus_timed_pop_filtered(
+            bus, 10 * GST_SECOND, GstMessageType(GST_MESSAGE_EOS | GST_MESSAGE_ERROR)
+        );
+        auto ok = message && GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS;
+        if (message) {
+            gst_message_unref(message);
+        }
+        gst_object_unref(bus);
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+        gst_object_unref(pipeline);
+        EXPECT_TRUE(ok) << "Could not record " << name;
+        return ok ? path : fs::path();
+    }
+
+    void expect_identical(const fs::path &video)
+    {
+        auto demuxed = _directory / "demuxed.bin";
+        auto scanned = _directory / "scanned.bin";
+        xvc::MetadataExtractor extractor;
+        ASSERT_TRUE(extractor.extract(video, demuxed));
+        ASSERT_TRUE(xvc::scan_metadata(video, scanned));
+        EXPECT_EQ(fs::file_size(scanned), fs::file_size(demuxed));
+        EXPECT_TRUE(read_file(scanned) == read_file(demuxed));
+    }
+};
+
+}  // namespace
+
+
+TEST_F(MetadataExtractTest, ScannerMatchesTheDemuxerOnJpeg)
+{
+    if (!has_elements({"videotestsrc", "jpegenc", "matroskamux", "matroskademux", "jpegparse"})) {
+        GTEST_SKIP() << "GStreamer plugins missing";
+    }
+    auto video = record("jpeg.mkv", "jpegenc");
+    ASSERT_FALSE(video.empty());
+    expect_identical(video);
+}
+
+TEST_F(MetadataExtractTest, ScannerMatchesTheDemuxerOnH265)
+{
+    if (!has_elements({"videotestsrc", "x265enc", "h265parse", "matroskamux", "matroskademux"})) {
+        GTEST_SKIP() << "GStreamer plugins missing";
+    }
+    // Keyframes every few frames, so parameter sets and delta units both occur.
+    auto video = record("h265.mkv", "x265enc key-int-max=5 ! h265parse");
+    ASSERT_FALSE(video.empty());
+    expect_identical(video);
+}
@@ -0,0 +1,54 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include "recording_test_base.h"
+#include "xdaqmetadata/xdaqmetadata.h"
+#include "xvc.h"
+
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+
+std::string read_file(const fs::path &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+}  // namespace
+
+
+// The sidecars written live, fragment by fragment, must be what the second pass over each
+// finished .mkv writes: every frame matched to its fragment by PTS, none left pending.
+TEST_F(RecordingTest, LiveSidecarsMatchTheSecondPass)
+{
+    if (!can_record() || !has_elements({"matroskademux"})) {
+        GTEST_SKIP() << "GStreamer plugins missing";
+    }
+    auto bin = play(jpeg_parse_saving_metadata);
+    ASSERT_NE(bin, nullptr);
+
+    auto result = record(bin, _directory / "clip-%02d.mkv", 2500ms, GST_SECOND);
+    ASSERT_TRUE(result.ok);
+    ASSERT_GE(result.files.size(), 2);
+
+    for (const auto &video : result.files) {
+        auto bin_path = fs::path(video).replace_extension(".bin");
+        ASSERT_TRUE(fs::exists(bin_path)) << bin_path;
+        auto live = read_file(bin_path);
+        EXPECT_FALSE(live.empty()) << bin_path;
+
+        fs::remove(bin_path);
+        xvc::parse_video_save_binary_jpeg(video.generic_string());
+        auto parsed = read_file(bin_path);
+        EXPECT_EQ(live.size(), parsed.size()) << video;
+        EXPECT_TRUE(live == parsed) << video;
+    }
+}
@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mkv_scanner.h"
+
+
+namespace
+{
+
+using Bytes = std::vector<std::uint8_t>;
+
+Bytes id(std::uint32_t value)
+{
+    Bytes bytes;
+    for (auto shift = 24; shift >= 0; shift -= 8) {
+        if (!bytes.empty() || (value >> shift) & 0xFF) bytes.push_back((value >> shift) & 0xFF);
+    }
+    return bytes;
+}
+
+// An element with an 8-byte size, or the reserved unknown size.
+Bytes element(std::uint32_t element_id, const Bytes &data, bool unknown_size = false)
+{
+    auto bytes = id(element_id);
+    bytes.push_back(0x01);
+    for (auto shift = 48; shift >= 0; shift -= 8) {
+        bytes.push_back(unknown_size ? 0xFF : (data.size() >> shift) & 0xFF);
+    }
+    bytes.insert(bytes.end(), data.begin(), data.end());
+    return bytes;
+}
+
+Bytes number(std::uint32_t element_id, std::uint64_t value)
+{
+    return element(element_id, {std::uint8_t(value >> 8), std::uint8_t(value)});
+}
+
+Bytes text(std::uint32_t element_id, const std::string &value)
+{
+    return element(element_id, Bytes(value.begin(), value.end()));
+}
+
+Bytes block(std::uint32_t element_id, std::int16_t timecode, std::uint8_t flags, const Bytes &frame)
+{
+    Bytes data{0x81, std::uint8_t(timecode >> 8), std::uint8_t(timecode), flags};
+    data.insert(data.end(), frame.begin(), frame.end());
+    return element(element_id, data);
+}
+
+Bytes concat(std::initializer_list<Bytes> parts)
+{
+    Bytes bytes;
+    for (const auto &part : parts) bytes.insert(bytes.end(), part.begin(), part.end());
+    return bytes;
+}
+
+Bytes header() { return element(0x1A45DFA3, text(0x4282, "matroska")); }
+
+Bytes tracks()
+{
+    auto video = element(0xE0, concat({number(0xB0, 1280), number(0xBA, 720)}));
+    auto entry = concat(
+        {number(0xD7, 1), text(0x86, "V_MJPEG"), element(0x63A2, {0xAB, 0xCD}), video}
+    );
+    auto info = element(0x1549A966, number(0x2AD7B1, 1000));
+    return concat({info, element(0x1654AE6B, element(0xAE, entry))});
+}
+
+// A file with one cluster of known size.
+Bytes file_with(const Bytes &cluster)
+{
+    auto segment = concat({tracks(), element(0x1F43B675, cluster)});
+    return concat({header(), element(0x18538067, segment)});
+}
+
+std::vector<xvc::MkvBlock> scan_all(const Bytes &file, bool *ok = nullptr)
+{
+    xvc::MkvScanner scanner(file);
+    EXPECT_TRUE(scanner.open());
+    std::vector<xvc::MkvBlock> blocks;
+    auto result = scanner.scan([&](const xvc::MkvBlock &b) {
+        blocks.push_back(b);
+        return true;
+    });
+    if (ok) *ok = result;
+    return blocks;
+}
+
+}  // namespace
+
+
+TEST(MkvScannerTest, ReadsTracksAndBlocks)
+{
+    auto cluster = concat(
+        {number(0xE7, 100),
+         block(0xA3, 0, 0x80, {1, 2, 3}),
+         block(0xA3, 40, 0x00, {4}),
+         element(0xA0, concat({block(0xA1, 80, 0x00, {5, 6}), number(0xFB, 40)}))}
+    );
+    auto file = file_with(cluster);
+
+    xvc::MkvScanner scanner(file);
+    ASSERT_TRUE(scanner.open());
+    EXPECT_EQ(scanner.timecode_scale(), 1000);
+    ASSERT_EQ(scanner.tracks().size(), 1);
+    EXPECT_EQ(scanner.tracks()[0].number, 1);
+    EXPECT_EQ(scanner.tracks()[0].codec_id, "V_MJPEG");
+    EXPECT_EQ(scanner.tracks()[0].codec_private.size(), 2);
+    EXPECT_EQ(scanner.tracks()[0].width, 1280);
+    EXPECT_EQ(scanner.tracks()[0].height, 720);
+
+    bool ok = false;
+    auto blocks = scan_all(file, &ok);
+    EXPECT_TRUE(ok);
+    ASSERT_EQ(blocks.size(), 3);
+    EXPECT_EQ(blocks[0].pts, 100'000);
+    EXPECT_TRUE(blocks[0].keyframe);
+    EXPECT_EQ(Bytes(blocks[0].payload.begin(), blocks[0].payload.end()), Bytes({1, 2, 3}));
+    EXPECT_EQ(file[blocks[0].offset], 1);
+    EXPECT_EQ(blocks[1].pts, 140'000);
+    EXPECT_FALSE(blocks[1].keyframe);
+    EXPECT_EQ(blocks[2].pts, 180'000);
+    EXPECT_FALSE(blocks[2].keyframe);
+    EXPECT_EQ(blocks[2].payload.size(), 2);
+}
+
+TEST(MkvScannerTest, UnknownSizeClustersEndAtTheNextCluster)
+{
+    auto first = element(0x1F43B675, concat({number(0xE7, 0), block(0xA3, 0, 0x80, {1})}), true);
+    auto second = element(0x1F43B675, concat({number(0xE7, 10), block(0xA3, 0, 0x80, {2})}), true);
+    auto file = concat({header(), element(0x18538067, concat({tracks(), first, second}), true)});
+
+    bool ok = false;
+    auto blocks = scan_all(file, &ok);
+    EXPECT_TRUE(ok);
+    ASSERT_EQ(blocks.size(), 2);
+    EXPECT_EQ(blocks[0].payload[0], 1);
+    EXPECT_EQ(blocks[1].payload[0], 2);
+    EXPECT_EQ(blocks[1].pts, 10'000);
+}
+
+TEST(MkvScannerTest, StopsAtTruncatedBlock)
+{
+    auto cluster =
+        concat({number(0xE7, 0), block(0xA3, 0, 0x80, {1}), block(0xA3, 1, 0, {2, 3, 4})});
+    auto file = file_with(cluster);
+    file.resize(file.size() - 2);
+
+    bool ok = true;
+    auto blocks = scan_all(file, &ok);
+    EXPECT_FALSE(ok);
+    EXPECT_EQ(blocks.size(), 1);
+}
+
+TEST(MkvScannerTest, RejectsOtherFiles)
+{
+    Bytes file{'R', 'I', 'F', 'F', 0, 0, 0, 0};
+    xvc::MkvScanner scanner(file);
+    EXPECT_FALSE(scanner.open());
+}
@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+
+#include "pretrigger_ring.h"
+
+
+using namespace std::chrono_literals;
+
+
+namespace
+{
+
+// One unit per millisecond, a keyframe every `gop` units.
+void push_units(xvc::PreTriggerRing &ring, std::uint64_t from, std::uint64_t to, int gop)
+{
+    for (auto i = from; i < to; ++i) {
+        xvc::SpillRecord record{i * 1'000'000, i * 1'000'000, 1'000'000, 0, "", {}};
+        if (i == 0) record.caps = "image/jpeg";
+        record.payload.assign(100, 0);
+        ring.push(std::move(record), i % gop == 0);
+    }
+}
+
+}  // namespace
+
+
+TEST(PreTriggerRingTest, StartsAtTheKeyframeCoveringTheWindow)
+{
+    xvc::PreTriggerRing ring(25ms, 1 << 20);
+    push_units(ring, 0, 100, 10);
+
+    auto records = ring.take();
+    // The newest unit is at 99 ms; the keyframe at 70 ms is the last one at least 25 ms older.
+    ASSERT_EQ(records.size(), 30);
+    EXPECT_EQ(records.front().pts, 70'000'000);
+    EXPECT_EQ(records.front().caps, "image/jpeg");
+    EXPECT_EQ(records.back().pts, 99'000'000);
+    EXPECT_EQ(ring.stats().frames, 0);
+}
+
+TEST(PreTriggerRingTest, MemoryLimitDropsWholeGops)
+{
+    xvc::PreTriggerRing ring(1s, 1'500);
+    push_units(ring, 0, 40, 10);
+
+    auto stats = ring.stats();
+    EXPECT_LE(stats.bytes, 1'500);
+    EXPECT_EQ(stats.dropped, 30);
+    auto records = ring.take();
+    ASSERT_FALSE(records.empty());
+    EXPECT_EQ(records.front().pts, 30'000'000);
+}
+
+TEST(PreTriggerRingTest, WaitsForAKeyframe)
+{
+    xvc::PreTriggerRing ring(1s, 250);
+    // A GOP larger than the limit leaves nothing to start from until the next keyframe.
+    push_units(ring, 0, 15, 10);
+    EXPECT_EQ(ring.stats().frames, 0);
+    push_units(ring, 15, 21, 10);
+    auto records = ring.take();
+    ASSERT_EQ(records.size(), 1);
+    EXPECT_EQ(records.front().pts, 20'000'000);
+    EXPECT_EQ(records.front().caps, "image/jpeg");
+}
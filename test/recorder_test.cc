@@ -0,0 +1,26 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+
+#include "recording_test_base.h"
+
+
+TEST_F(RecordingTest, StopsARecordingWhoseWriterFailed)
+{
+    if (!can_record()) {
+        GTEST_SKIP() << "GStreamer plugins missing";
+    }
+    auto bin = play();
+    ASSERT_NE(bin, nullptr);
+
+    // splitmuxsink cannot open the first file, so the writer fails while units keep coming.
+    auto failed = record(bin, _directory / "missing" / "clip-%02d.mkv", 500ms);
+    EXPECT_FALSE(failed.ok);
+    EXPECT_TRUE(failed.files.empty());
+
+    // The record branch itself is unaffected.
+    auto recorded = record(bin, _directory / "clip-%02d.mkv", 500ms);
+    EXPECT_TRUE(recorded.ok);
+    ASSERT_EQ(recorded.files.size(), 1);
+    EXPECT_TRUE(std::filesystem::exists(recorded.files.front()));
+}
@@ -0,0 +1,116 @@
+#include <gst/app/gstappsink.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "frame_source.h"
+#include "jpeg_decode.h"
+#include "recording_reader.h"
+#include "recording_test_base.h"
+
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+
+// Every frame of `video`, demuxed and decoded front to back with the decoder RecordingReader uses.
+std::vector<xvc::FramePtr> decode_sequentially(const fs::path &video)
+{
+    auto decoder = xvc::register_jpeg_decode_element() ? "xvcjpegdec" : "jpegdec";
+    auto description = "filesrc location=\"" + video.generic_string() +
+                       "\" ! matroskademux ! jpegparse ! " + decoder +
+                       " ! appsink name=sink sync=false";
+    GError *error = nullptr;
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> pipeline(
+        gst_parse_launch_full(description.c_str(), nullptr, GST_PARSE_FLAG_FATAL_ERRORS, &error),
+        gst_object_unref
+    );
+    if (!pipeline) {
+        ADD_FAILURE() << (error ? error->message : "no pipeline");
+        g_clear_error(&error);
+        return {};
+    }
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> sink(
+        gst_bin_get_by_name(GST_BIN(pipeline.get()), "sink"), gst_object_unref
+    );
+    gst_element_set_state(pipeline.get(), GST_STATE_PLAYING);
+    std::vector<xvc::FramePtr> frames;
+    while (auto sample = gst_app_sink_try_pull_sample(GST_APP_SINK(sink.get()), 5 * GST_SECOND)) {
+        frames.push_back(std::make_shared<xvc::Frame>(sample));
+    }
+    EXPECT_TRUE(gst_app_sink_is_eos(GST_APP_SINK(sink.get())));
+    gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+    return frames;
+}
+
+bool same_pixels(const xvc::Frame &a, const xvc::Frame &b)
+{
+    if (!a.valid() || !b.valid() || a.format() != b.format() || a.width() != b.width() ||
+        a.height() != b.height() || a.n_planes() != b.n_planes()) {
+        return false;
+    }
+    for (guint plane = 0; plane < a.n_planes(); ++plane) {
+        auto info = a.video_frame();
+        auto row_bytes = GST_VIDEO_FRAME_COMP_WIDTH(info, plane) *
+                         GST_VIDEO_FRAME_COMP_PSTRIDE(info, plane);
+        for (auto row = 0; row < GST_VIDEO_FRAME_COMP_HEIGHT(info, plane); ++row) {
+            if (std::memcmp(
+                    a.data(plane) + row * a.stride(plane),
+                    b.data(plane) + row * b.stride(plane),
+                    row_bytes
+                ) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+
+TEST_F(RecordingTest, ReaderMatchesASequentialDecode)
+{
+    if (!can_record() || !has_elements({"matroskademux", "jpegdec"})) {
+        GTEST_SKIP() << "GStreamer plugins missing";
+    }
+    auto bin = play();
+    ASSERT_NE(bin, nullptr);
+    auto result = record(bin, _directory / "clip-%02d.mkv", 1500ms);
+    ASSERT_TRUE(result.ok);
+    ASSERT_EQ(result.files.size(), 1);
+
+    auto sequential = decode_sequentially(result.files.front());
+    ASSERT_FALSE(sequential.empty());
+    xvc::RecordingReader reader(result.files);
+    ASSERT_TRUE(reader.open());
+    ASSERT_EQ(reader.size(), sequential.size());
+
+    // Backwards, then strided forwards, so both cache misses and prefetched frames are checked.
+    std::vector<std::size_t> order;
+    for (auto n = reader.size(); n-- > 0;) {
+        order.push_back(n);
+    }
+    for (std::size_t n = 0; n < reader.size(); n += 3) {
+        order.push_back(n);
+    }
+    for (auto n : order) {
+        auto frame = reader.frame(n);
+        ASSERT_NE(frame, nullptr) << "frame " << n;
+        EXPECT_TRUE(same_pixels(*frame, *sequential[n])) << "frame " << n;
+        EXPECT_EQ(
+            reader.pts(n) - reader.pts(0),
+            std::chrono::nanoseconds(sequential[n]->pts() - sequential[0]->pts())
+        ) << "frame " << n;
+    }
+    EXPECT_EQ(reader.frame(reader.size()), nullptr);
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <gst/gst.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <initializer_list>
+#include <string>
+#include <thread>
+
+#include "record_container.h"
+#include "recorder.h"
+#include "temp_directory_test_base.h"
+
+
+using namespace std::chrono_literals;
+
+
+// Records through the record branch of a live M-JPEG test stream: the RecordingBin and the writer
+// of setup_jpeg_srt_stream, fed by videotestsrc instead of an SRT source.
+class RecordingTest : public TempDirectoryTest
+{
+protected:
+    static void SetUpTestSuite() { gst_init(nullptr, nullptr); }
+
+    static bool has_elements(std::initializer_list<const char *> names)
+    {
+        for (auto name : names) {
+            auto factory = gst_element_factory_find(name);
+            if (!factory) return false;
+            gst_object_unref(factory);
+        }
+        return true;
+    }
+
+    static bool can_record()
+    {
+        return has_elements(
+            {"videotestsrc", "jpegenc", "jpegparse", "splitmuxsink", "matroskamux"}
+        );
+    }
+
+    void TearDown() override
+    {
+        if (_pipeline) {
+            gst_element_set_state(GST_ELEMENT(_pipeline), GST_STATE_NULL);
+            gst_object_unref(_pipeline);
+        }
+        TempDirectoryTest::TearDown();
+    }
+
+    // Plays the stream with its record branch. With `extract`, recordings write .bin sidecars.
+    xvc::RecordingBin *play(GstPadProbeCallback extract = nullptr)
+    {
+        GError *error = nullptr;
+        auto pipeline = gst_parse_launch_full(
+            "videotestsrc is-live=true pattern=ball ! "
+            "video/x-raw,width=320,height=240,framerate=30/1 ! jpegenc ! jpegparse ! "
+            "tee name=t allow-not-linked=true",
+            nullptr,
+            GST_PARSE_FLAG_FATAL_ERRORS,
+            &error
+        );
+        if (!pipeline) {
+            ADD_FAILURE() << (error ? error->message : "no pipeline");
+            g_clear_error(&error);
+            return nullptr;
+        }
+        _pipeline = GST_PIPELINE(pipeline);
+        auto bin = xvc::RecordingBin::attach(_pipeline, 0ns, 0, &build_writer, extract);
+        if (bin && gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+            ADD_FAILURE() << "The stream did not start";
+            return nullptr;
+        }
+        return bin;
+    }
+
+    // Records `duration` of the stream to `location`, splitmuxsink's pattern, in fragments of
+    // `fragment` (0 for a single file), and waits for the recording to finish.
+    xvc::RecordResult record(
+        xvc::RecordingBin *bin, const std::filesystem::path &location,
+        std::chrono::milliseconds duration, GstClockTime fragment = 0
+    )
+    {
+        std::shared_future<xvc::RecordResult> handed_over;
+        auto started = bin->start(
+            {},
+            (_directory / "camera").generic_string(),
+            [&](GstElement *filesink) {
+                // clang-format off
+                g_object_set(G_OBJECT(filesink),
+                    "location", location.generic_string().c_str(),
+                    "max-size-time", static_cast<guint64>(fragment),
+                    nullptr
+                );
+                // clang-format on
+            },
+            handed_over
+        );
+        EXPECT_TRUE(started);
+        if (!started) return {false, {}};
+        std::this_thread::sleep_for(duration);
+        auto result = bin->stop();
+        if (result.wait_for(20s) != std::future_status::ready) {
+            ADD_FAILURE() << "The recording did not finish";
+            return {false, {}};
+        }
+        return result.get();
+    }
+
+    GstPipeline *_pipeline = nullptr;
+
+private:
+    // As build_jpeg_writer in xvc.cc.
+    static bool build_writer(GstBin *writer, GstElement *src, xvc::RecordContainer container)
+    {
+        auto parser = gst_element_factory_make("jpegparse", "record_parser");
+        auto filesink = gst_element_factory_make("splitmuxsink", "filesink");
+        if (!parser || !filesink) return false;
+        g_object_set(G_OBJECT(filesink), "async-finalize", TRUE, nullptr);
+        gst_bin_add_many(writer, parser, filesink, nullptr);
+        return xvc::use_container(filesink, container) &&
+               gst_element_link_many(src, parser, filesink, nullptr);
+    }
+};
@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "retention.h"
+#include "temp_directory_test_base.h"
+
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+
+class RetentionTest : public TempDirectoryTest
+{
+protected:
+    // Writes video `n` of `camera` with a .bin sidecar and reports it opened.
+    fs::path open(xvc::RetentionManager &manager, const fs::path &camera, int n, std::size_t bytes)
+    {
+        auto video = fs::path(camera.string() + "-" + std::to_string(n) + ".mkv");
+        std::ofstream(video, std::ios::binary) << std::string(bytes, 'v');
+        std::ofstream(fs::path(video).replace_extension(".bin"), std::ios::binary) << "sidecar";
+        manager.opened(camera, video);
+        return video;
+    }
+};
+
+}  // namespace
+
+
+TEST_F(RetentionTest, KeepsTheNewestFilesOfACamera)
+{
+    xvc::RetentionManager manager;
+    auto camera = _directory / "camera";
+    manager.track(camera, {.max_files = 2});
+    std::vector<fs::path> videos;
+    for (auto i = 0; i < 4; ++i) {
+        videos.push_back(open(manager, camera, i, 100));
+        manager.closed(videos.back());
+    }
+    manager.flush();
+
+    EXPECT_FALSE(fs::exists(videos[0]));
+    EXPECT_FALSE(fs::exists(fs::path(videos[0]).replace_extension(".bin")));
+    EXPECT_FALSE(fs::exists(videos[1]));
+    EXPECT_TRUE(fs::exists(videos[2]));
+    EXPECT_TRUE(fs::exists(videos[3]));
+    EXPECT_EQ(manager.stats().deleted_files, 2);
+    EXPECT_EQ(manager.stats().deleted_bytes, 2 * (100 + 7));
+}
+
+TEST_F(RetentionTest, NeverDeletesFilesStillBeingWritten)
+{
+    xvc::RetentionManager manager;
+    auto camera = _directory / "camera";
+    manager.track(camera, {.max_files = 1});
+    auto first = open(manager, camera, 0, 100);
+    auto second = open(manager, camera, 1, 100);
+    manager.flush();
+    EXPECT_TRUE(fs::exists(first));
+
+    manager.closed(first);
+    manager.flush();
+    EXPECT_FALSE(fs::exists(first));
+    EXPECT_TRUE(fs::exists(second));
+}
+
+TEST_F(RetentionTest, LimitsTheBytesOfEachCamera)
+{
+    xvc::RetentionManager manager;
+    auto left = _directory / "left";
+    auto right = _directory / "right";
+    manager.track(left, {.max_bytes = 2500});
+    std::vector<fs::path> videos;
+    for (auto i = 0; i < 5; ++i) {
+        videos.push_back(open(manager, left, i, 1000));
+        manager.closed(videos.back());
+        manager.closed(open(manager, right, i, 1000));
+    }
+    manager.flush();
+
+    // 1007 bytes each with the sidecar: two fit.
+    EXPECT_FALSE(fs::exists(videos[2]));
+    EXPECT_TRUE(fs::exists(videos[3]));
+    EXPECT_TRUE(fs::exists(videos[4]));
+    EXPECT_EQ(manager.stats().deleted_files, 3);
+    EXPECT_TRUE(fs::exists(_directory / "right-0.mkv"));
+}
+
+TEST_F(RetentionTest, FreesSpaceOldestFirstAcrossCameras)
+{
+    xvc::RetentionManager manager;
+    auto left = _directory / "left";
+    auto right = _directory / "right";
+    // More than the volume can ever have free: everything closed goes.
+    auto impossible = fs::space(_directory).capacity + 1;
+    manager.track(left, {.min_free_bytes = impossible});
+    manager.track(right, {.min_free_bytes = impossible});
+    manager.closed(open(manager, left, 0, 10));
+    manager.closed(open(manager, right, 0, 10));
+    auto writing = open(manager, left, 1, 10);
+    manager.flush();
+
+    EXPECT_FALSE(fs::exists(_directory / "left-0.mkv"));
+    EXPECT_FALSE(fs::exists(_directory / "right-0.mkv"));
+    EXPECT_TRUE(fs::exists(writing));
+    EXPECT_EQ(manager.stats().deleted_files, 2);
+}
+
+TEST_F(RetentionTest, ARecordingReusingTheNamesKeepsItsFiles)
+{
+    xvc::RetentionManager manager;
+    auto camera = _directory / "camera";
+    manager.track(camera, {.max_files = 5});
+    for (auto i = 0; i < 5; ++i) {
+        manager.closed(open(manager, camera, i, 100));
+    }
+    manager.flush();
+
+    // A second recording with the same path and policy writes over the same names.
+    manager.track(camera, {.max_files = 5});
+    for (auto i = 0; i < 5; ++i) {
+        auto video = open(manager, camera, i, 200);
+        manager.flush();
+        EXPECT_TRUE(fs::exists(video));
+        manager.closed(video);
+    }
+    manager.flush();
+    EXPECT_EQ(manager.stats().deleted_files, 0);
+
+    // Its files are closed like any other, and the oldest goes first.
+    manager.closed(open(manager, camera, 5, 200));
+    manager.flush();
+    EXPECT_FALSE(fs::exists(_directory / "camera-0.mkv"));
+    EXPECT_TRUE(fs::exists(_directory / "camera-1.mkv"));
+    EXPECT_EQ(manager.stats().deleted_files, 1);
+}
@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+#include "spill_buffer.h"
+
+
+using namespace std::chrono_literals;
+
+
+namespace
+{
+
+xvc::SpillRecord make_record(std::uint64_t pts, std::size_t size)
+{
+    xvc::SpillRecord record{pts, pts, 1, 0, pts == 0 ? "video/x-h265" : "", {}};
+    record.payload.assign(size, static_cast<std::uint8_t>(pts));
+    return record;
+}
+
+}  // namespace
+
+
+TEST(SpillBufferTest, KeepsOrderAcrossTheJournal)
+{
+    xvc::SpillBuffer buffer(1000, std::filesystem::temp_directory_path());
+    for (std::uint64_t i = 0; i < 20; ++i) {
+        ASSERT_TRUE(buffer.push(make_record(i, 300)));
+    }
+    auto stats = buffer.stats();
+    EXPECT_LE(stats.memory_bytes, 1000);
+    EXPECT_GT(stats.spilled, 0);
+
+    // Memory is drained first, then the journal; records pushed meanwhile queue up behind it.
+    for (std::uint64_t i = 0; i < 10; ++i) {
+        auto record = buffer.pop(0ms);
+        ASSERT_TRUE(record.has_value());
+        EXPECT_EQ(record->pts, i);
+    }
+    ASSERT_TRUE(buffer.push(make_record(20, 300)));
+    for (std::uint64_t i = 10; i <= 20; ++i) {
+        auto record = buffer.pop(0ms);
+        ASSERT_TRUE(record.has_value());
+        EXPECT_EQ(record->pts, i);
+        EXPECT_EQ(record->payload.size(), 300);
+        EXPECT_EQ(record->payload.front(), static_cast<std::uint8_t>(i));
+    }
+    EXPECT_FALSE(buffer.pop(0ms).has_value());
+    EXPECT_EQ(buffer.stats().journal_bytes, 0);
+
+    // Once the journal is caught up, records stay in memory again.
+    auto spilled = buffer.stats().spilled;
+    ASSERT_TRUE(buffer.push(make_record(21, 300)));
+    EXPECT_EQ(buffer.stats().spilled, spilled);
+}
+
+TEST(SpillBufferTest, RoundTripsRecordFields)
+{
+    xvc::SpillBuffer buffer(0);
+    ASSERT_TRUE(buffer.push(make_record(0, 10)));
+    ASSERT_TRUE(buffer.push(make_record(1, 10)));
+
+    auto first = buffer.pop(0ms);
+    auto second = buffer.pop(0ms);
+    ASSERT_TRUE(first && second);
+    EXPECT_EQ(first->caps, "video/x-h265");
+    EXPECT_EQ(second->caps, "");
+    EXPECT_EQ(second->dts, 1);
+    EXPECT_EQ(second->duration, 1);
+    EXPECT_EQ(buffer.stats().spilled, 1);
+}
+
+TEST(SpillBufferTest, DrainsAfterClose)
+{
+    xvc::SpillBuffer buffer(500);
+    std::thread producer([&buffer] {
+        for (std::uint64_t i = 0; i < 200; ++i) {
+            buffer.push(make_record(i, 100));
+        }
+        buffer.close();
+    });
+
+    std::uint64_t expected = 0;
+    while (!buffer.drained()) {
+        if (auto record = buffer.pop(10ms)) {
+            EXPECT_EQ(record->pts, expected++);
+        }
+    }
+    producer.join();
+    EXPECT_EQ(expected, 200);
+    EXPECT_FALSE(buffer.push(make_record(200, 100)));
+}
+
+TEST(SpillBufferTest, WritesTheJournalInBatches)
+{
+    xvc::SpillBuffer buffer(0, std::filesystem::temp_directory_path());
+    // Several batches' worth, read back while more records are being spilled.
+    for (std::uint64_t i = 0; i < 40; ++i) {
+        ASSERT_TRUE(buffer.push(make_record(i, 100'000)));
+    }
+    for (std::uint64_t i = 0; i < 60; ++i) {
+        if (i < 20) {
+            ASSERT_TRUE(buffer.push(make_record(40 + i, 100'000)));
+        }
+        // Waits for the writer thread when the record is in a batch still being written.
+        auto record = buffer.pop(5s);
+        ASSERT_TRUE(record.has_value());
+        EXPECT_EQ(record->pts, i);
+        EXPECT_EQ(record->payload.size(), 100'000);
+        EXPECT_EQ(record->payload.back(), static_cast<std::uint8_t>(i));
+    }
+    EXPECT_FALSE(buffer.pop(0ms).has_value());
+    EXPECT_EQ(buffer.stats().spilled, 59);
+    EXPECT_EQ(buffer.stats().lost, 0);
+}
+
+TEST(SpillBufferTest, DropsTheJournalAfterAShortRead)
+{
+    auto directory = std::filesystem::temp_directory_path() / "xvc_spill_buffer_test";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    {
+        xvc::SpillBuffer buffer(0, directory);
+        // One record in memory, then a full batch for the writer thread.
+        for (std::uint64_t i = 0; i < 3; ++i) {
+            ASSERT_TRUE(buffer.push(make_record(i, 600'000)));
+        }
+        std::filesystem::path journal;
+        for (auto i = 0; i < 500 && journal.empty(); ++i) {
+            for (const auto &entry : std::filesystem::directory_iterator(directory)) {
+                if (entry.file_size() >= 1'200'000) journal = entry.path();
+            }
+            std::this_thread::sleep_for(10ms);
+        }
+        ASSERT_FALSE(journal.empty());
+        std::filesystem::resize_file(journal, 100);
+
+        EXPECT_EQ(buffer.pop(0ms)->pts, 0);
+        EXPECT_FALSE(buffer.pop(1s).has_value());
+        EXPECT_EQ(buffer.stats().lost, 2);
+        EXPECT_EQ(buffer.stats().journal_bytes, 0);
+        buffer.close();
+        EXPECT_TRUE(buffer.drained());
+    }
+    std::filesystem::remove_all(directory);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <string>
+
+
+// Gives every test a directory of its own, empty at the start and removed afterwards. Fixtures
+// that prepare files in it call TempDirectoryTest::SetUp() first.
+class TempDirectoryTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        auto test = ::testing::UnitTest::GetInstance()->current_test_info();
+        _directory = std::filesystem::temp_directory_path() /
+                     (std::string("xvc_") + test->test_suite_name() + "_" + test->name());
+        std::filesystem::remove_all(_directory);
+        std::filesystem::create_directories(_directory);
+    }
+    void TearDown() override { std::filesystem::remove_all(_directory); }
+
+    std::filesystem::path _directory;
+};
@@ -0,0 +1,169 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "elementary_stream.h"
+#include "sidecar.h"
+#include "temp_directory_test_base.h"
+#include "timestamp_index.h"
+
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+
+// `count` frames every 1000 timestamp ticks and 30 samples from `first`.
+std::vector<xvc::IndexEntry> frames(std::uint64_t first, int count)
+{
+    std::vector<xvc::IndexEntry> entries;
+    for (auto i = 0; i < count; ++i) {
+        auto timestamp = first + i * 1000;
+        auto sample = static_cast<std::uint32_t>(timestamp / 1000 * 30);
+        entries.push_back({timestamp, i * 33'333'333LL, 100u + i, sample, 0, 0, i % 10 == 0});
+    }
+    return entries;
+}
+
+class TimestampIndexTest : public TempDirectoryTest
+{
+protected:
+    // An elementary stream of 10 frames from timestamp `first` on, its frame index and sidecar.
+    fs::path write_segment(const std::string &name, std::uint64_t first)
+    {
+        auto path = _directory / name;
+        std::ofstream stream(path, std::ios::binary);
+        xvc::FrameIndexWriter index(xvc::frame_index_path(path), xvc::ElementaryCodec::Jpeg);
+        std::vector<xvc::SidecarRecord> records;
+        for (std::uint32_t i = 0; i < 10; ++i) {
+            stream << std::string(100, 'x');
+            EXPECT_TRUE(index.append({i * 100u, 100, i == 0, i * 33'333'333LL, i * 33'333'333LL}));
+            records.push_back({i * 33'333'333ull, first + i * 1000, 0, 0, 0, 0, 0});
+        }
+        EXPECT_TRUE(index.close());
+        std::ofstream(fs::path(path).replace_extension(".bin"), std::ios::binary)
+            .write(
+                reinterpret_cast<const char *>(records.data()),
+                records.size() * sizeof(xvc::SidecarRecord)
+            );
+        return path;
+    }
+};
+
+}  // namespace
+
+
+TEST_F(TimestampIndexTest, FindsTheFrameAtOrBeforeATimestamp)
+{
+    xvc::TimestampIndex index;
+    index.add_segment(_directory / "a.mkv", frames(0, 100));
+    index.add_segment(_directory / "b.mkv", frames(100'000, 100));
+
+    auto location = index.at_timestamp(150'500);
+    ASSERT_TRUE(location);
+    EXPECT_EQ(location->segment, _directory / "b.mkv");
+    EXPECT_EQ(location->entry.frame, 50);
+    EXPECT_EQ(location->entry.offset, 150);
+
+    location = index.at_sample(99 * 30 + 29);
+    ASSERT_TRUE(location);
+    EXPECT_EQ(location->segment, _directory / "a.mkv");
+    EXPECT_EQ(location->entry.frame, 99);
+
+    EXPECT_TRUE(index.at_timestamp(0));
+    xvc::TimestampIndex empty;
+    EXPECT_FALSE(empty.at_timestamp(1000));
+}
+
+TEST_F(TimestampIndexTest, MergesSegmentsAddedOutOfOrder)
+{
+    xvc::TimestampIndex index;
+    index.add_segment(_directory / "b.mkv", frames(100'000, 10));
+    index.add_segment(_directory / "a.mkv", frames(0, 10));
+
+    auto entries = index.entries();
+    ASSERT_EQ(entries.size(), 20);
+    EXPECT_TRUE(std::is_sorted(entries.begin(), entries.end(), [](auto &a, auto &b) {
+        return a.timestamp < b.timestamp;
+    }));
+    EXPECT_EQ(index.at_sample(30 * 9)->segment, _directory / "a.mkv");
+    EXPECT_EQ(index.at_sample(30 * 100)->segment, _directory / "b.mkv");
+}
+
+TEST_F(TimestampIndexTest, SavesAndMapsBack)
+{
+    xvc::TimestampIndex index;
+    index.add_segment(_directory / "a.mkv", frames(0, 100));
+    index.add_segment(_directory / "b.mkv", frames(100'000, 100));
+    ASSERT_TRUE(index.save(_directory / "session.idx"));
+
+    auto loaded = xvc::TimestampIndex::load(_directory / "session.idx");
+    ASSERT_TRUE(loaded);
+    EXPECT_EQ(loaded->segments(), index.segments());
+    EXPECT_EQ(loaded->entries().size(), 200);
+    EXPECT_EQ(loaded->at_timestamp(42'000)->entry.frame, 42);
+
+    // The first change copies the mapped arrays.
+    loaded->add_segment(_directory / "c.mkv", frames(200'000, 100));
+    EXPECT_EQ(loaded->at_sample(200 * 30)->segment, _directory / "c.mkv");
+}
+
+TEST_F(TimestampIndexTest, PruneDropsDeletedSegments)
+{
+    std::ofstream(_directory / "b.mkv") << "";
+    xvc::TimestampIndex index;
+    index.add_segment(_directory / "a.mkv", frames(0, 10));
+    index.add_segment(_directory / "b.mkv", frames(100'000, 10));
+
+    EXPECT_EQ(index.prune(), 1);
+    ASSERT_EQ(index.segments().size(), 1);
+    EXPECT_EQ(index.entries().size(), 10);
+    EXPECT_EQ(index.at_timestamp(105'000)->entry.segment, 0);
+    EXPECT_FALSE(index.at_timestamp(5'000));
+}
+
+TEST_F(TimestampIndexTest, UpdateAppendsToALog)
+{
+    auto path = _directory / "session.index";
+    auto log = fs::path(path) += ".log";
+    ASSERT_TRUE(xvc::TimestampIndex::update(path, write_segment("camera-0.mjpeg", 0)));
+    auto size = fs::file_size(path);
+    EXPECT_FALSE(fs::exists(log));
+
+    // The file stays as it is while the log takes the segments, and load() sees both.
+    for (auto i = 1; i < 10; ++i) {
+        auto segment = write_segment("camera-" + std::to_string(i) + ".mjpeg", i * 100'000);
+        ASSERT_TRUE(xvc::TimestampIndex::update(path, segment));
+        ASSERT_TRUE(xvc::TimestampIndex::update(path, segment));
+    }
+    EXPECT_EQ(fs::file_size(path), size);
+    ASSERT_TRUE(fs::exists(log));
+    auto index = xvc::TimestampIndex::load(path);
+    ASSERT_TRUE(index);
+    EXPECT_EQ(index->segments().size(), 10);
+    EXPECT_EQ(index->at_timestamp(905'500)->segment, _directory / "camera-9.mjpeg");
+    EXPECT_EQ(index->at_timestamp(905'500)->entry.frame, 5);
+    EXPECT_EQ(index->at_timestamp(905'500)->entry.offset, 500);
+
+    // A record cut short by a crash is ignored, then overwritten.
+    std::ofstream(log, std::ios::binary | std::ios::app) << "XVCISEG1 partial";
+    EXPECT_EQ(xvc::TimestampIndex::load(path)->segments().size(), 10);
+    ASSERT_TRUE(xvc::TimestampIndex::update(path, write_segment("camera-10.mjpeg", 1'000'000)));
+    EXPECT_EQ(xvc::TimestampIndex::load(path)->segments().size(), 11);
+
+    // Enough segments fold the log into the file, dropping deleted ones.
+    fs::remove(_directory / "camera-0.mjpeg");
+    for (auto i = 11; i < 40; ++i) {
+        auto segment = write_segment("camera-" + std::to_string(i) + ".mjpeg", i * 100'000);
+        ASSERT_TRUE(xvc::TimestampIndex::update(path, segment));
+    }
+    EXPECT_GT(fs::file_size(path), size);
+    index = xvc::TimestampIndex::load(path);
+    ASSERT_TRUE(index);
+    EXPECT_EQ(index->segments().size(), 39);
+    EXPECT_FALSE(index->contains(_directory / "camera-0.mjpeg"));
+    EXPECT_EQ(index->at_timestamp(3'905'500)->segment, _directory / "camera-39.mjpeg");
+}
@@ -0,0 +1,1828 @@
+#include <fmt/core.h>
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <boost/program_options.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "batch_loader.h"
+#include "color_convert.h"
+#include "decode_filter.h"
+#include "elementary_stream.h"
+#include "file_sink.h"
+#include "frame_source.h"
+#include "io_governor.h"
+#include "jpeg_decode.h"
+#include "mapped_file.h"
+#include "mkv_scanner.h"
+#include "parallel_decoder.h"
+#include "record_container.h"
+#include "recording_reader.h"
+#include "xvc.h"
+
+
+namespace po = boost::program_options;
+using namespace std::chrono_literals;
+
+
+namespace
+{
+
+// CPU time consumed by all threads of this process.
+std::chrono::microseconds process_cpu_time()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+    auto to_us = [](const FILETIME &t) {
+        return ((static_cast<long long>(t.dwHighDateTime) << 32) | t.dwLowDateTime) / 10;
+    };
+    return std::chrono::microseconds(to_us(kernel) + to_us(user));
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return std::chrono::seconds(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           std::chrono::microseconds(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+#endif
+}
+
+struct Measurement {
+    int frames;
+    std::chrono::microseconds cpu;
+    std::chrono::microseconds wall;
+};
+
+// Pulls `frames` frames from `source` after a short warm-up and measures the CPU and wall time
+// spent by the whole process meanwhile.
+Measurement measure(xvc::FrameSource &source, int frames)
+{
+    for (auto i = 0; i < 30 && source.pull(2s); ++i) {
+    }
+
+    auto cpu_start = process_cpu_time();
+    auto wall_start = std::chrono::steady_clock::now();
+    auto received = 0;
+    while (received < frames && source.pull(2s)) {
+        ++received;
+    }
+    return {
+        received,
+        process_cpu_time() - cpu_start,
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - wall_start
+        )
+    };
+}
+
+void print_measurement(const std::string &label, const Measurement &m)
+{
+    if (m.frames == 0) {
+        fmt::print("{:<12} no frames received\n", label);
+        return;
+    }
+    auto cpu_per_frame = m.cpu.count() / 1000.0 / m.frames;
+    auto fps = m.frames / (m.wall.count() / 1e6);
+    fmt::print("{:<12} {:>8} {:>16.3f} {:>10.1f}\n", label, m.frames, cpu_per_frame, fps);
+}
+
+int bench_output_format(const po::variables_map &vm)
+{
+    auto frames = vm["frames"].as<int>();
+
+    const std::vector<std::pair<std::string, xvc::StreamOptions>> modes = {
+        {"Native", {.format = xvc::PixelFormat::Native}},
+        {"NV12", {.format = xvc::PixelFormat::NV12}},
+        {"I420", {.format = xvc::PixelFormat::I420}},
+        {"RGBA", {.format = xvc::PixelFormat::RGBA}},
+        {"BGRx", {.format = xvc::PixelFormat::BGRx}},
+        {"RGB", {.format = xvc::PixelFormat::RGB}},
+        {"RGBA/vc", {.format = xvc::PixelFormat::RGBA, .builtin_converter = false}},
+        {"RGB/vc", {.format = xvc::PixelFormat::RGB, .builtin_converter = false}},
+    };
+
+    fmt::print("mock_camera 3840x2160 NV12, {} frames per mode (/vc: videoconvert)\n", frames);
+    fmt::print("{:<12} {:>8} {:>16} {:>10}\n", "format", "frames", "cpu ms/frame", "fps");
+    for (const auto &[label, options] : modes) {
+        xvc::FrameSource source(
+            [options](GstPipeline *pipeline, const std::string &uri) {
+                xvc::mock_camera(pipeline, uri, options);
+            },
+            ""
+        );
+        if (!source.start()) {
+            return EXIT_FAILURE;
+        }
+        print_measurement(label, measure(source, frames));
+        source.stop();
+    }
+    return EXIT_SUCCESS;
+}
+
+// Times the colour conversion kernels on a 4K frame and compares their output with
+// GstVideoConverter, the engine behind videoconvert, configured for nearest chroma and no dither.
+int bench_convert(const po::variables_map &vm)
+{
+    constexpr auto Width = 3840;
+    constexpr auto Height = 2160;
+    auto iterations = std::max(1, vm["frames"].as<int>() / 10);
+
+    std::unique_ptr<GstStructure, decltype(&gst_structure_free)> config(
+        gst_structure_new(
+            "config",
+            GST_VIDEO_CONVERTER_OPT_DITHER_METHOD,
+            GST_TYPE_VIDEO_DITHER_METHOD,
+            GST_VIDEO_DITHER_NONE,
+            GST_VIDEO_CONVERTER_OPT_CHROMA_RESAMPLER_METHOD,
+            GST_TYPE_VIDEO_RESAMPLER_METHOD,
+            GST_VIDEO_RESAMPLER_METHOD_NEAREST,
+            nullptr
+        ),
+        gst_structure_free
+    );
+
+    fmt::print(
+        "{}x{}, {} iterations, best kernel {}\n",
+        Width,
+        Height,
+        iterations,
+        xvc::simd_level_name(xvc::detect_simd_level())
+    );
+    fmt::print(
+        "{:<6} {:<6} {:<8} {:>10} {:>14} {:>14}\n",
+        "input",
+        "output",
+        "kernel",
+        "MPix/s",
+        "max |diff|",
+        "exact %"
+    );
+
+    const std::vector<std::pair<GstVideoFormat, xvc::RgbFormat>> outputs = {
+        {GST_VIDEO_FORMAT_RGB, xvc::RgbFormat::RGB},
+        {GST_VIDEO_FORMAT_RGBA, xvc::RgbFormat::RGBA},
+        {GST_VIDEO_FORMAT_BGRx, xvc::RgbFormat::BGRx},
+    };
+
+    for (auto in_format : {GST_VIDEO_FORMAT_NV12, GST_VIDEO_FORMAT_I420}) {
+        GstVideoInfo in_info;
+        gst_video_info_set_format(&in_info, in_format, Width, Height);
+        in_info.colorimetry.matrix = GST_VIDEO_COLOR_MATRIX_BT709;
+        std::unique_ptr<GstBuffer, decltype(&gst_buffer_unref)> in_buffer(
+            gst_buffer_new_allocate(nullptr, GST_VIDEO_INFO_SIZE(&in_info), nullptr),
+            gst_buffer_unref
+        );
+        {
+            GstMapInfo map;
+            gst_buffer_map(in_buffer.get(), &map, GST_MAP_WRITE);
+            for (gsize i = 0; i < map.size; ++i) {
+                map.data[i] = static_cast<guint8>((i * 2654435761u) >> 24);
+            }
+            gst_buffer_unmap(in_buffer.get(), &map);
+        }
+        GstVideoFrame in;
+        gst_video_frame_map(&in, &in_info, in_buffer.get(), GST_MAP_READ);
+
+        for (const auto &[gst_format, rgb_format] : outputs) {
+            GstVideoInfo out_info;
+            gst_video_info_set_format(&out_info, gst_format, Width, Height);
+            std::unique_ptr<GstBuffer, decltype(&gst_buffer_unref)> reference_buffer(
+                gst_buffer_new_allocate(nullptr, GST_VIDEO_INFO_SIZE(&out_info), nullptr),
+                gst_buffer_unref
+            );
+            GstVideoFrame reference;
+            gst_video_frame_map(&reference, &out_info, reference_buffer.get(), GST_MAP_WRITE);
+
+            auto converter =
+                gst_video_converter_new(&in_info, &out_info, gst_structure_copy(config.get()));
+            auto start = std::chrono::steady_clock::now();
+            for (auto i = 0; i < iterations; ++i) {
+                gst_video_converter_frame(converter, &in, &reference);
+            }
+            auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+            gst_video_converter_free(converter);
+            fmt::print(
+                "{:<6} {:<6} {:<8} {:>10.1f}\n",
+                gst_video_format_to_string(in_format),
+                gst_video_format_to_string(gst_format),
+                "gst",
+                Width * Height * iterations / elapsed.count() / 1e6
+            );
+
+            auto dst_stride = Width * xvc::bytes_per_pixel(rgb_format);
+            std::vector<std::uint8_t> out(static_cast<size_t>(dst_stride) * Height);
+            for (auto level :
+                 {xvc::SimdLevel::Scalar, xvc::SimdLevel::SSE41, xvc::SimdLevel::AVX2}) {
+                if (level > xvc::detect_simd_level()) continue;
+
+                auto convert = [&] {
+                    auto plane = [&](guint i) {
+                        return static_cast<const std::uint8_t *>(
+                            GST_VIDEO_FRAME_PLANE_DATA(&in, i)
+                        );
+                    };
+                    if (in_format == GST_VIDEO_FORMAT_NV12) {
+                        xvc::nv12_to_rgb(
+                            plane(0),
+                            GST_VIDEO_FRAME_PLANE_STRIDE(&in, 0),
+                            plane(1),
+                            GST_VIDEO_FRAME_PLANE_STRIDE(&in, 1),
+                            out.data(),
+                            dst_stride,
+                            Width,
+                            Height,
+                            rgb_format,
+                            xvc::ColorMatrix::BT709,
+                            level
+                        );
+                    } else {
+                        xvc::i420_to_rgb(
+                            plane(0),
+                            GST_VIDEO_FRAME_PLANE_STRIDE(&in, 0),
+                            plane(1),
+                            GST_VIDEO_FRAME_PLANE_STRIDE(&in, 1),
+                            plane(2),
+                            GST_VIDEO_FRAME_PLANE_STRIDE(&in, 2),
+                            out.data(),
+                            dst_stride,
+                            Width,
+                            Height,
+                            rgb_format,
+                            xvc::ColorMatrix::BT709,
+                            level
+                        );
+                    }
+                };
+                start = std::chrono::steady_clock::now();
+                for (auto i = 0; i < iterations; ++i) {
+                    convert();
+                }
+                elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+                auto max_diff = 0;
+                std::uint64_t exact = 0;
+                auto ref =
+                    static_cast<const std::uint8_t *>(GST_VIDEO_FRAME_PLANE_DATA(&reference, 0));
+                auto ref_stride = GST_VIDEO_FRAME_PLANE_STRIDE(&reference, 0);
+                for (auto row = 0; row < Height; ++row) {
+                    for (auto x = 0; x < dst_stride; ++x) {
+                        auto diff = std::abs(
+                            out[static_cast<size_t>(row) * dst_stride + x] -
+                            ref[static_cast<size_t>(row) * ref_stride + x]
+                        );
+                        max_diff = std::max(max_diff, diff);
+                        exact += diff == 0;
+                    }
+                }
+                fmt::print(
+                    "{:<6} {:<6} {:<8} {:>10.1f} {:>14} {:>14.2f}\n",
+                    gst_video_format_to_string(in_format),
+                    gst_video_format_to_string(gst_format),
+                    xvc::simd_level_name(level),
+                    Width * Height * iterations / elapsed.count() / 1e6,
+                    max_diff,
+                    100.0 * exact / (static_cast<double>(dst_stride) * Height)
+                );
+            }
+            gst_video_frame_unmap(&reference);
+        }
+        gst_video_frame_unmap(&in);
+    }
+    return EXIT_SUCCESS;
+}
+
+// Encodes `count` distinct test frames once with `encoder`, a gst-launch fragment, so that the
+// decode runs are not limited by the encoder.
+std::vector<GstSample *> encode_clip(int width, int height, int count, const std::string &encoder)
+{
+    std::vector<GstSample *> clip;
+    auto description = fmt::format(
+        "videotestsrc num-buffers={} pattern=ball ! video/x-raw,format=I420,width={},height={} ! "
+        "{} ! appsink name=sink sync=false",
+        count,
+        width,
+        height,
+        encoder
+    );
+    GError *error = nullptr;
+    auto pipeline = gst_parse_launch(description.c_str(), &error);
+    if (!pipeline) {
+        spdlog::error("Failed to create the encoder: {}", error->message);
+        g_error_free(error);
+        return clip;
+    }
+    auto sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    while (auto sample = gst_app_sink_pull_sample(GST_APP_SINK(sink))) {
+        clip.push_back(sample);
+    }
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(sink);
+    gst_object_unref(pipeline);
+    return clip;
+}
+
+// Builds the decode stage after `upstream` in `bin` and returns its last element.
+using DecodeStage = std::function<GstElement *(GstBin *bin, GstElement *upstream)>;
+
+struct DecodeRun {
+    Measurement measurement;
+    std::uint64_t lost;
+};
+
+// Decodes `frames` JPEG frames as fast as `stage` allows, or returns nothing when the pipeline
+// failed.
+std::optional<DecodeRun> decode_jpeg_clip(
+    const std::vector<GstSample *> &clip, int frames, const DecodeStage &stage
+)
+{
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> pipeline(
+        gst_pipeline_new("jpeg-decode"), gst_object_unref
+    );
+    auto bin = GST_BIN(pipeline.get());
+    auto src = gst_element_factory_make("appsrc", "src");
+    auto parser = gst_element_factory_make("jpegparse", "parser");
+    auto sink = gst_element_factory_make("fakesink", "sink");
+    // Live like the SRT source, so no element prerolls.
+    g_object_set(
+        G_OBJECT(src), "is-live", TRUE, "format", GST_FORMAT_TIME, "block", TRUE, nullptr
+    );
+    gst_app_src_set_caps(GST_APP_SRC(src), gst_sample_get_caps(clip.front()));
+    g_object_set(G_OBJECT(sink), "sync", FALSE, nullptr);
+    gst_bin_add_many(bin, src, parser, sink, nullptr);
+    gst_element_link(src, parser);
+
+    auto decoded = stage(bin, parser);
+    if (!decoded || !gst_element_link(decoded, sink)) {
+        spdlog::error("Failed to build the decode pipeline.");
+        return std::nullopt;
+    }
+
+    gst_element_set_state(pipeline.get(), GST_STATE_PLAYING);
+    auto cpu_start = process_cpu_time();
+    auto wall_start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < frames; ++i) {
+        auto original = gst_sample_get_buffer(clip[static_cast<size_t>(i) % clip.size()]);
+        auto buffer = gst_buffer_copy(original);
+        GST_BUFFER_PTS(buffer) = i * GST_SECOND / 60;
+        GST_BUFFER_DURATION(buffer) = GST_SECOND / 60;
+        if (gst_app_src_push_buffer(GST_APP_SRC(src), buffer) != GST_FLOW_OK) break;
+    }
+    gst_app_src_end_of_stream(GST_APP_SRC(src));
+
+    auto bus = gst_element_get_bus(pipeline.get());
+    auto message = gst_bus_timed_pop_filtered(
+        bus, 60 * GST_SECOND, static_cast<GstMessageType>(GST_MESSAGE_EOS | GST_MESSAGE_ERROR)
+    );
+    DecodeRun run{
+        {frames,
+         process_cpu_time() - cpu_start,
+         std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - wall_start
+         )},
+        0
+    };
+    auto ok = message && GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS;
+    if (message) gst_message_unref(message);
+    gst_object_unref(bus);
+
+    if (auto decoder = xvc::ParallelDecoder::find(bin)) {
+        auto stats = decoder->stats();
+        run.measurement.frames = static_cast<int>(stats.decoded);
+        run.lost = stats.lost;
+    }
+    gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+    if (!ok) {
+        spdlog::error("JPEG decode did not reach EOS.");
+        return std::nullopt;
+    }
+    return run;
+}
+
+GstElement *add_decoder(GstBin *bin, GstElement *upstream, GstElement *dec)
+{
+    gst_bin_add(bin, dec);
+    return gst_element_link(upstream, dec) ? dec : nullptr;
+}
+
+// Throughput of the M-JPEG display decoder with one jpegdec against the frame-parallel stage.
+int bench_jpeg_decode(const po::variables_map &vm)
+{
+    auto frames = vm["frames"].as<int>();
+    auto max_threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+
+    fmt::print("{} frames per run, {} hardware threads\n", frames, max_threads);
+    fmt::print(
+        "{:<10} {:>8} {:>10} {:>10} {:>8}\n", "size", "threads", "fps", "speedup", "lost"
+    );
+    for (const auto &[width, height] : {std::pair{1920, 1080}, std::pair{3840, 2160}}) {
+        auto clip = encode_clip(width, height, 60, "jpegenc");
+        if (clip.empty()) return EXIT_FAILURE;
+
+        auto baseline = 0.0;
+        for (auto threads = 1; threads <= max_threads; threads *= 2) {
+            auto run = decode_jpeg_clip(clip, frames, [threads](GstBin *bin, GstElement *upstream) {
+                if (threads == 1) {
+                    return add_decoder(bin, upstream, gst_element_factory_make("jpegdec", "dec"));
+                }
+                return xvc::ParallelDecoder::attach(bin, upstream, threads, 0, [](int worker) {
+                    return gst_element_factory_make(
+                        "jpegdec", fmt::format("worker_dec_{}", worker).c_str()
+                    );
+                });
+            });
+            if (!run) break;
+            const auto &m = run->measurement;
+            auto fps = m.frames / (m.wall.count() / 1e6);
+            if (threads == 1) baseline = fps;
+            fmt::print(
+                "{:<10} {:>8} {:>10.1f} {:>9.2f}x {:>8}\n",
+                fmt::format("{}x{}", width, height),
+                threads,
+                fps,
+                baseline > 0 ? fps / baseline : 0.0,
+                run->lost
+            );
+        }
+        for (auto sample : clip) {
+            gst_sample_unref(sample);
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+// CPU cost of the M-JPEG preview: full-size jpegdec plus colour conversion against xvcjpegdec
+// decoding straight to RGB at 1/2, 1/4 and 1/8 scale.
+int bench_jpeg_scale(const po::variables_map &vm)
+{
+    auto frames = vm["frames"].as<int>();
+    if (!xvc::register_jpeg_decode_element()) return EXIT_FAILURE;
+
+    fmt::print("{} frames per run, RGB output\n", frames);
+    fmt::print(
+        "{:<10} {:<12} {:>10} {:>16} {:>10} {:>10}\n",
+        "camera",
+        "decoder",
+        "preview",
+        "cpu ms/frame",
+        "fps",
+        "cpu saved"
+    );
+    for (const auto &[width, height] : {std::pair{1920, 1080}, std::pair{3840, 2160}}) {
+        auto clip = encode_clip(width, height, 60, "jpegenc");
+        if (clip.empty()) return EXIT_FAILURE;
+
+        auto baseline = 0.0;
+        for (auto denom : {0, 1, 2, 4, 8}) {
+            // 0: the existing display branch, jpegdec ! videoconvert.
+            auto run = decode_jpeg_clip(clip, frames, [denom](GstBin *bin, GstElement *upstream) {
+                GstElement *last = nullptr;
+                if (denom == 0) {
+                    last = add_decoder(bin, upstream, gst_element_factory_make("jpegdec", "dec"));
+                    if (last) {
+                        last = add_decoder(
+                            bin, last, gst_element_factory_make("videoconvert", "conv")
+                        );
+                    }
+                } else {
+                    auto dec = gst_element_factory_make("xvcjpegdec", "dec");
+                    g_object_set(G_OBJECT(dec), "scale-denom", denom, nullptr);
+                    last = add_decoder(bin, upstream, dec);
+                }
+                if (!last) return last;
+                auto cf = gst_element_factory_make("capsfilter", "cf");
+                auto caps = gst_caps_from_string("video/x-raw,format=RGB");
+                g_object_set(G_OBJECT(cf), "caps", caps, nullptr);
+                gst_caps_unref(caps);
+                return add_decoder(bin, last, cf);
+            });
+            if (!run) break;
+            const auto &m = run->measurement;
+            auto cpu_per_frame = m.cpu.count() / 1000.0 / m.frames;
+            if (denom == 0) baseline = cpu_per_frame;
+            auto scale = std::max(denom, 1);
+            fmt::print(
+                "{:<10} {:<12} {:>10} {:>16.3f} {:>10.1f} {:>9.1f}%\n",
+                fmt::format("{}x{}", width, height),
+                denom == 0 ? "jpegdec" : "xvcjpegdec",
+                fmt::format("{}x{}", (width + scale - 1) / scale, (height + scale - 1) / scale),
+                cpu_per_frame,
+                m.frames / (m.wall.count() / 1e6),
+                baseline > 0 ? 100.0 * (1.0 - cpu_per_frame / baseline) : 0.0
+            );
+        }
+        for (auto sample : clip) {
+            gst_sample_unref(sample);
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+// Arrival time of every frame at the sink, against the time its access unit was pushed.
+struct LatencyLog {
+    std::mutex mutex;
+    std::map<GstClockTime, std::chrono::steady_clock::time_point> pushed;
+    std::vector<double> latencies_ms;
+};
+
+GstPadProbeReturn log_latency(GstPad *, GstPadProbeInfo *info, gpointer data)
+{
+    auto log = static_cast<LatencyLog *>(data);
+    auto now = std::chrono::steady_clock::now();
+    auto pts = GST_BUFFER_PTS(gst_pad_probe_info_get_buffer(info));
+
+    std::lock_guard lock(log->mutex);
+    auto pushed = log->pushed.find(pts);
+    if (pushed != log->pushed.end()) {
+        log->latencies_ms.push_back(
+            std::chrono::duration<double, std::milli>(now - pushed->second).count()
+        );
+        log->pushed.erase(pushed);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+// CPU load and decode latency of the H.265 display branch in each DecodeMode, with access units
+// pushed at the camera frame rate.
+int bench_h265_preview(const po::variables_map &vm)
+{
+    constexpr auto Width = 1920;
+    constexpr auto Height = 1080;
+    constexpr auto Fps = 30;
+    constexpr auto Gop = 30;
+    auto frames = vm["frames"].as<int>();
+    auto duration = std::chrono::nanoseconds(std::chrono::seconds(1)) / Fps;
+
+    auto clip = encode_clip(
+        Width,
+        Height,
+        2 * Gop,
+        fmt::format(
+            "x265enc speed-preset=ultrafast tune=zerolatency key-int-max={} ! h265parse ! "
+            "video/x-h265,stream-format=byte-stream,alignment=au",
+            Gop
+        )
+    );
+    if (clip.empty()) return EXIT_FAILURE;
+
+    const std::vector<std::tuple<std::string, xvc::DecodeMode, int>> modes = {
+        {"All", xvc::DecodeMode::All, 1},
+        {"Keyframes", xvc::DecodeMode::Keyframes, 1},
+        {"GopPrefix/5", xvc::DecodeMode::GopPrefix, 5},
+        {"GopPrefix/15", xvc::DecodeMode::GopPrefix, 15},
+    };
+
+    fmt::print("{}x{}@{}, GOP {}, {} access units per mode\n", Width, Height, Fps, Gop, frames);
+    fmt::print(
+        "{:<14} {:>8} {:>8} {:>8} {:>14} {:>14}\n",
+        "mode",
+        "decoded",
+        "dropped",
+        "cpu %",
+        "latency ms",
+        "max ms"
+    );
+    for (const auto &[label, mode, prefix] : modes) {
+        std::unique_ptr<GstElement, decltype(&gst_object_unref)> pipeline(
+            gst_pipeline_new("h265-preview"), gst_object_unref
+        );
+        auto bin = GST_BIN(pipeline.get());
+        auto src = gst_element_factory_make("appsrc", "src");
+        auto parser = gst_element_factory_make("h265parse", "parser");
+        auto queue_display = gst_element_factory_make("queue", "queue_display");
+        auto dec = gst_element_factory_make("avdec_h265", "dec");
+        auto sink = gst_element_factory_make("fakesink", "sink");
+        g_object_set(G_OBJECT(src), "is-live", TRUE, "format", GST_FORMAT_TIME, nullptr);
+        gst_app_src_set_caps(GST_APP_SRC(src), gst_sample_get_caps(clip.front()));
+        g_object_set(G_OBJECT(sink), "sync", FALSE, nullptr);
+        gst_bin_add_many(bin, src, parser, queue_display, dec, sink, nullptr);
+        if (!gst_element_link_many(src, parser, queue_display, dec, sink, nullptr)) {
+            spdlog::error("Failed to build the H.265 decode pipeline.");
+            return EXIT_FAILURE;
+        }
+        auto filter = xvc::DecodeFilter::attach(bin, queue_display, mode, prefix);
+
+        LatencyLog log;
+        auto sink_pad = gst_element_get_static_pad(sink, "sink");
+        gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, log_latency, &log, nullptr);
+        gst_object_unref(sink_pad);
+
+        gst_element_set_state(pipeline.get(), GST_STATE_PLAYING);
+        auto cpu_start = process_cpu_time();
+        auto wall_start = std::chrono::steady_clock::now();
+        for (auto i = 0; i < frames; ++i) {
+            auto buffer =
+                gst_buffer_copy(gst_sample_get_buffer(clip[static_cast<size_t>(i) % clip.size()]));
+            GST_BUFFER_PTS(buffer) = GST_BUFFER_DTS(buffer) = i * GST_SECOND / Fps;
+            GST_BUFFER_DURATION(buffer) = GST_SECOND / Fps;
+            {
+                std::lock_guard lock(log.mutex);
+                log.pushed[GST_BUFFER_PTS(buffer)] = std::chrono::steady_clock::now();
+            }
+            if (gst_app_src_push_buffer(GST_APP_SRC(src), buffer) != GST_FLOW_OK) break;
+            std::this_thread::sleep_until(wall_start + (i + 1) * duration);
+        }
+        gst_app_src_end_of_stream(GST_APP_SRC(src));
+
+        auto bus = gst_element_get_bus(pipeline.get());
+        auto message = gst_bus_timed_pop_filtered(
+            bus, 10 * GST_SECOND, static_cast<GstMessageType>(GST_MESSAGE_EOS | GST_MESSAGE_ERROR)
+        );
+        auto cpu = process_cpu_time() - cpu_start;
+        auto wall = std::chrono::steady_clock::now() - wall_start;
+        if (message) gst_message_unref(message);
+        gst_object_unref(bus);
+        gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+
+        auto stats = filter->stats();
+        std::lock_guard lock(log.mutex);
+        auto &latencies = log.latencies_ms;
+        auto mean = latencies.empty()
+                        ? 0.0
+                        : std::accumulate(latencies.begin(), latencies.end(), 0.0) /
+                              static_cast<double>(latencies.size());
+        auto max = latencies.empty() ? 0.0 : *std::max_element(latencies.begin(), latencies.end());
+        fmt::print(
+            "{:<14} {:>8} {:>8} {:>8.1f} {:>14.2f} {:>14.2f}\n",
+            label,
+            latencies.size(),
+            stats.dropped,
+            100.0 * std::chrono::duration<double>(cpu).count() /
+                std::chrono::duration<double>(wall).count(),
+            mean,
+            max
+        );
+    }
+    for (auto sample : clip) {
+        gst_sample_unref(sample);
+    }
+    return EXIT_SUCCESS;
+}
+
+// Streams `clip` at `fps` to SRT callers on `port`, like a camera, until the thread is stopped.
+std::jthread stream_clip(const std::vector<GstSample *> &clip, int port, int fps)
+{
+    return std::jthread([&clip, port, fps](std::stop_token stop) {
+        auto description = fmt::format(
+            "appsrc name=src is-live=true format=time ! srtsink uri=srt://:{}?mode=listener "
+            "wait-for-connection=false sync=false",
+            port
+        );
+        GError *error = nullptr;
+        std::unique_ptr<GstElement, decltype(&gst_object_unref)> pipeline(
+            gst_parse_launch(description.c_str(), &error), gst_object_unref
+        );
+        if (!pipeline) {
+            spdlog::error("Failed to create the SRT sender: {}", error->message);
+            g_error_free(error);
+            return;
+        }
+        auto src = gst_bin_get_by_name(GST_BIN(pipeline.get()), "src");
+        gst_app_src_set_caps(GST_APP_SRC(src), gst_sample_get_caps(clip.front()));
+        gst_element_set_state(pipeline.get(), GST_STATE_PLAYING);
+
+        auto duration = std::chrono::nanoseconds(std::chrono::seconds(1)) / fps;
+        auto start = std::chrono::steady_clock::now();
+        for (std::uint64_t i = 0; !stop.stop_requested(); ++i) {
+            auto buffer = gst_buffer_copy(gst_sample_get_buffer(clip[i % clip.size()]));
+            GST_BUFFER_PTS(buffer) = GST_BUFFER_DTS(buffer) = i * GST_SECOND / fps;
+            GST_BUFFER_DURATION(buffer) = GST_SECOND / fps;
+            gst_app_src_push_buffer(GST_APP_SRC(src), buffer);
+            std::this_thread::sleep_until(start + (i + 1) * duration);
+        }
+
+        gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+        gst_object_unref(src);
+    });
+}
+
+// Process CPU load and delivered frame rate of a running source over `period`.
+void print_load(
+    const std::string &codec, const std::string &phase, xvc::FrameSource &source,
+    std::chrono::milliseconds period
+)
+{
+    std::this_thread::sleep_for(1s);
+    auto received = source.stats().received;
+    auto cpu_start = process_cpu_time();
+    auto wall_start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(period);
+    auto cpu = std::chrono::duration<double>(process_cpu_time() - cpu_start).count();
+    auto wall =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    fmt::print(
+        "{:<8} {:<12} {:>8.1f} {:>10.1f}\n",
+        codec,
+        phase,
+        100.0 * cpu / wall,
+        (source.stats().received - received) / wall
+    );
+}
+
+// CPU per camera with and without the display branch: built with it, detached and re-attached at
+// runtime, and built headless. The in-process SRT sender is included in every figure.
+int bench_display_branch(const po::variables_map &vm)
+{
+    constexpr auto Width = 1920;
+    constexpr auto Height = 1080;
+    constexpr auto Fps = 30;
+    auto period = std::chrono::milliseconds(1000 * vm["frames"].as<int>() / Fps);
+
+    using Setup = void (*)(GstPipeline *, const std::string &, const xvc::StreamOptions &);
+    const std::vector<std::tuple<std::string, std::string, Setup>> codecs = {
+        {"H.265",
+         "x265enc speed-preset=ultrafast tune=zerolatency key-int-max=30 ! h265parse ! "
+         "video/x-h265,stream-format=byte-stream,alignment=au",
+         xvc::setup_h265_srt_stream},
+        {"M-JPEG", "jpegenc", xvc::setup_jpeg_srt_stream},
+    };
+
+    fmt::print(
+        "{}x{}@{} over SRT on localhost, {} ms per phase\n", Width, Height, Fps, period.count()
+    );
+    fmt::print("{:<8} {:<12} {:>8} {:>10}\n", "codec", "display", "cpu %", "fps");
+    auto port = 7001;
+    for (const auto &[codec, encoder, setup] : codecs) {
+        auto clip = encode_clip(Width, Height, 2 * Fps, encoder);
+        if (clip.empty()) return EXIT_FAILURE;
+        auto sender = stream_clip(clip, port, Fps);
+        auto uri = fmt::format("127.0.0.1:{}", port);
+
+        for (auto display : {true, false}) {
+            xvc::FrameSource source(
+                [setup, display](GstPipeline *pipeline, const std::string &uri) {
+                    setup(pipeline, uri, {.display = display});
+                },
+                uri
+            );
+            if (!source.start()) return EXIT_FAILURE;
+            if (display) {
+                print_load(codec, "attached", source, period);
+                xvc::detach_display(source.pipeline());
+                print_load(codec, "detached", source, period);
+                xvc::attach_display(source.pipeline());
+                print_load(codec, "re-attached", source, period);
+            } else {
+                print_load(codec, "headless", source, period);
+            }
+            source.stop();
+        }
+
+        sender.request_stop();
+        sender.join();
+        for (auto sample : clip) {
+            gst_sample_unref(sample);
+        }
+        ++port;
+    }
+    return EXIT_SUCCESS;
+}
+
+// How long start_jpeg_recording and stop_jpeg_recording block with several cameras recording at
+// once, and how long after stop each recording's last file is closed. Two rounds, so the second
+// one starts on writers prepared in the background.
+int bench_record_stop(const po::variables_map &vm)
+{
+    constexpr auto Width = 1280;
+    constexpr auto Height = 720;
+    constexpr auto Fps = 30;
+    constexpr auto Cameras = 4;
+    auto period = std::chrono::milliseconds(1000 * vm["frames"].as<int>() / Fps);
+
+    auto clip = encode_clip(Width, Height, 2 * Fps, "jpegenc");
+    if (clip.empty()) return EXIT_FAILURE;
+    auto port = 7101;
+    auto sender = stream_clip(clip, port, Fps);
+    auto uri = fmt::format("127.0.0.1:{}", port);
+
+    std::vector<std::unique_ptr<xvc::FrameSource>> sources;
+    for (auto i = 0; i < Cameras; ++i) {
+        sources.push_back(std::make_unique<xvc::FrameSource>(
+            [](GstPipeline *pipeline, const std::string &uri) {
+                xvc::setup_jpeg_srt_stream(pipeline, uri, {.display = false});
+            },
+            uri
+        ));
+        if (!sources.back()->start()) return EXIT_FAILURE;
+    }
+    std::this_thread::sleep_for(1s);
+
+    auto directory = std::filesystem::temp_directory_path() / "xvc-bench-record";
+    std::filesystem::create_directories(directory);
+    using Clock = std::chrono::steady_clock;
+    auto ms = [](Clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+
+    fmt::print(
+        "{} cameras, M-JPEG {}x{}@{}, {} ms per recording\n",
+        Cameras,
+        Width,
+        Height,
+        Fps,
+        period.count()
+    );
+    fmt::print(
+        "{:<6} {:<7} {:>9} {:>9} {:>12} {:>6}\n",
+        "round",
+        "camera",
+        "start ms",
+        "stop ms",
+        "closed ms",
+        "files"
+    );
+    for (auto round = 1; round <= 2; ++round) {
+        std::vector<double> start_ms;
+        for (auto i = 0; i < Cameras; ++i) {
+            auto path = directory / fmt::format("camera{}-round{}", i, round);
+            auto begin = Clock::now();
+            xvc::start_jpeg_recording(sources[i]->pipeline(), path, true, 0, 10);
+            start_ms.push_back(ms(Clock::now() - begin));
+        }
+        std::this_thread::sleep_for(period);
+
+        std::vector<std::shared_future<xvc::RecordResult>> results;
+        std::vector<double> stop_ms;
+        auto stopped = Clock::now();
+        for (auto i = 0; i < Cameras; ++i) {
+            auto begin = Clock::now();
+            results.push_back(xvc::stop_jpeg_recording(sources[i]->pipeline()));
+            stop_ms.push_back(ms(Clock::now() - begin));
+        }
+        for (auto i = 0; i < Cameras; ++i) {
+            const auto &result = results[i].get();
+            fmt::print(
+                "{:<6} {:<7} {:>9.2f} {:>9.2f} {:>12.1f} {:>6}\n",
+                round,
+                i,
+                start_ms[i],
+                stop_ms[i],
+                ms(Clock::now() - stopped),
+                result.ok ? std::to_string(result.files.size()) : "error"
+            );
+        }
+    }
+
+    for (auto &source : sources) {
+        source->stop();
+    }
+    sender.request_stop();
+    sender.join();
+    for (auto sample : clip) {
+        gst_sample_unref(sample);
+    }
+    std::filesystem::remove_all(directory);
+    return EXIT_SUCCESS;
+}
+
+
+// Runs `description`, a gst-launch pipeline ending in a filesink, to EOS.
+bool run_to_eos(const std::string &description)
+{
+    GError *error = nullptr;
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> pipeline(
+        gst_parse_launch(description.c_str(), &error), gst_object_unref
+    );
+    if (!pipeline) {
+        spdlog::error("Failed to create the pipeline: {}", error->message);
+        g_error_free(error);
+        return false;
+    }
+    gst_element_set_state(pipeline.get(), GST_STATE_PLAYING);
+    auto bus = gst_element_get_bus(pipeline.get());
+    auto message = gst_bus_timed_pop_filtered(
+        bus, GST_CLOCK_TIME_NONE, static_cast<GstMessageType>(GST_MESSAGE_EOS | GST_MESSAGE_ERROR)
+    );
+    auto ok = message && GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS;
+    if (message) gst_message_unref(message);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+    return ok;
+}
+
+// Encodes `frames` test frames with `encoder`, a gst-launch fragment, into the Matroska file
+// `path`.
+bool write_recording(
+    const std::filesystem::path &path, int width, int height, int fps, int frames,
+    const std::string &encoder
+)
+{
+    return run_to_eos(fmt::format(
+        "videotestsrc num-buffers={} pattern=ball ! "
+        "video/x-raw,format=I420,width={},height={},framerate={}/1 ! {} ! matroskamux ! "
+        "filesink location=\"{}\"",
+        frames,
+        width,
+        height,
+        fps,
+        encoder,
+        path.generic_string()
+    ));
+}
+
+struct Latencies {
+    double p50;
+    double p99;
+    double max;
+};
+
+Latencies summarize(std::vector<double> ms)
+{
+    if (ms.empty()) return {0, 0, 0};
+    std::sort(ms.begin(), ms.end());
+    auto at = [&](double q) { return ms[static_cast<size_t>(q * (ms.size() - 1))]; };
+    return {at(0.5), at(0.99), ms.back()};
+}
+
+// How long it takes to get a decoded frame of a recording by frame number: seeking the demuxer as
+// a player does, against RecordingReader with nothing cached, and RecordingReader stepping forward
+// and backward at 60 frames/s with its prefetch thread, then jumping around what it has cached.
+int bench_seek(const po::variables_map &vm)
+{
+    constexpr auto Width = 1920;
+    constexpr auto Height = 1080;
+    constexpr auto Fps = 30;
+    constexpr auto Gop = 30;
+    constexpr auto StepPeriod = std::chrono::microseconds(1'000'000 / 60);
+    auto frames = vm["frames"].as<int>();
+    auto seeks = std::min(frames, 200);
+
+    auto directory = std::filesystem::temp_directory_path() / "xvc-bench-seek";
+    std::filesystem::create_directories(directory);
+    const std::vector<std::tuple<std::string, std::string, std::string>> codecs = {
+        {"M-JPEG", "jpegenc", "jpegparse ! jpegdec"},
+        {"H.265",
+         fmt::format(
+             "x265enc speed-preset=ultrafast tune=zerolatency key-int-max={} ! h265parse", Gop
+         ),
+         "h265parse ! avdec_h265"},
+    };
+
+    fmt::print("{}x{}@{}, {} frames, H.265 GOP {}\n", Width, Height, Fps, frames, Gop);
+    fmt::print(
+        "{:<8} {:<16} {:>7} {:>9} {:>9} {:>9} {:>7} {:>7} {:>7}\n",
+        "codec",
+        "mode",
+        "seeks",
+        "p50 ms",
+        "p99 ms",
+        "max ms",
+        "hits",
+        "misses",
+        "waits"
+    );
+    using Clock = std::chrono::steady_clock;
+    auto ms = [](Clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+    auto print = [](const std::string &codec,
+                    const std::string &mode,
+                    const std::vector<double> &latencies,
+                    const xvc::RecordingReader::Stats &stats) {
+        auto summary = summarize(latencies);
+        fmt::print(
+            "{:<8} {:<16} {:>7} {:>9.2f} {:>9.2f} {:>9.2f} {:>7} {:>7} {:>7}\n",
+            codec,
+            mode,
+            latencies.size(),
+            summary.p50,
+            summary.p99,
+            summary.max,
+            stats.hits,
+            stats.misses,
+            stats.waits
+        );
+    };
+
+    for (const auto &entry : codecs) {
+        const auto &codec = std::get<0>(entry);
+        const auto &encoder = std::get<1>(entry);
+        const auto &decoder = std::get<2>(entry);
+        auto path = directory / (codec == "H.265" ? "h265.mkv" : "mjpeg.mkv");
+        auto written = write_recording(path, Width, Height, Fps, frames, encoder);
+        if (!written) {
+            spdlog::error("Failed to write the {} recording.", codec);
+            return EXIT_FAILURE;
+        }
+
+        std::mt19937 random(1);
+        std::uniform_int_distribution<int> pick(0, frames - 1);
+        std::vector<int> targets(seeks);
+        std::generate(targets.begin(), targets.end(), [&] { return pick(random); });
+
+        // What a player does: an accurate flushing seek, then the preroll frame.
+        {
+            GError *error = nullptr;
+            std::unique_ptr<GstElement, decltype(&gst_object_unref)> pipeline(
+                gst_parse_launch(
+                    fmt::format(
+                        "filesrc location=\"{}\" ! matroskademux ! {} ! appsink name=sink "
+                        "sync=false",
+                        path.generic_string(),
+                        decoder
+                    )
+                        .c_str(),
+                    &error
+                ),
+                gst_object_unref
+            );
+            if (!pipeline) {
+                spdlog::error("Failed to create the demuxer: {}", error->message);
+                g_error_free(error);
+                return EXIT_FAILURE;
+            }
+            auto sink = gst_bin_get_by_name(GST_BIN(pipeline.get()), "sink");
+            gst_element_set_state(pipeline.get(), GST_STATE_PAUSED);
+            gst_element_get_state(pipeline.get(), nullptr, nullptr, 10 * GST_SECOND);
+            std::vector<double> latencies;
+            for (auto target : targets) {
+                auto begin = Clock::now();
+                gst_element_seek_simple(
+                    pipeline.get(),
+                    GST_FORMAT_TIME,
+                    static_cast<GstSeekFlags>(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_ACCURATE),
+                    target * GST_SECOND / Fps
+                );
+                auto sample = gst_app_sink_try_pull_preroll(GST_APP_SINK(sink), 10 * GST_SECOND);
+                latencies.push_back(ms(Clock::now() - begin));
+                if (sample) gst_sample_unref(sample);
+            }
+            gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+            gst_object_unref(sink);
+            print(codec, "demuxer seek", latencies, {});
+        }
+
+        {
+            xvc::RecordingReader reader({path}, {.cache_bytes = 0, .prefetch_frames = 0});
+            if (!reader.open()) return EXIT_FAILURE;
+            std::vector<double> latencies;
+            for (auto target : targets) {
+                auto begin = Clock::now();
+                reader.frame(target);
+                latencies.push_back(ms(Clock::now() - begin));
+            }
+            print(codec, "reader cold", latencies, reader.stats());
+        }
+
+        xvc::RecordingReader reader({path});
+        if (!reader.open()) return EXIT_FAILURE;
+        auto step = [&](const std::string &mode, int first, int direction) {
+            auto before = reader.stats();
+            std::vector<double> latencies;
+            auto next = Clock::now();
+            for (auto n = first; n >= 0 && n < frames; n += direction) {
+                std::this_thread::sleep_until(next);
+                next += StepPeriod;
+                auto begin = Clock::now();
+                reader.frame(n);
+                latencies.push_back(ms(Clock::now() - begin));
+            }
+            auto after = reader.stats();
+            after.hits -= before.hits;
+            after.misses -= before.misses;
+            after.waits -= before.waits;
+            print(codec, mode, latencies, after);
+        };
+        step("reader forward", 0, 1);
+        step("reader backward", frames - 1, -1);
+
+        auto before = reader.stats();
+        std::vector<double> latencies;
+        for (auto target : targets) {
+            auto begin = Clock::now();
+            reader.frame(target);
+            latencies.push_back(ms(Clock::now() - begin));
+        }
+        auto after = reader.stats();
+        after.hits -= before.hits;
+        after.misses -= before.misses;
+        after.waits -= before.waits;
+        print(codec, "reader cached", latencies, after);
+    }
+    std::filesystem::remove_all(directory);
+    return EXIT_SUCCESS;
+}
+
+
+// Flushes every file under `directory` to the disk, so buffered writes are paid for.
+void flush_files(const std::filesystem::path &directory)
+{
+#ifndef _WIN32
+    for (const auto &entry : std::filesystem::directory_iterator(directory)) {
+        auto fd = ::open(entry.path().c_str(), O_RDONLY);
+        if (fd < 0) continue;
+        fsync(fd);
+        ::close(fd);
+    }
+#endif
+}
+
+struct SinkRun {
+    std::uint64_t bytes;
+    double seconds;     // Until every file is closed and on the disk.
+    Latencies push_ms;  // Blocked in appsrc by a writer that fell behind.
+};
+
+// Pushes `frames` buffers of `frame_bytes` at `fps` of stream time, as fast as the writer takes
+// them, through appsrc ! splitmuxsink like the record branch's writer, with 2 s files. With a
+// `meter`, splitmuxsink writes through xvcfilesink.
+std::optional<SinkRun> write_through_sink(
+    const std::filesystem::path &directory, int frames, std::size_t frame_bytes, int fps,
+    xvc::WriteMeter *meter
+)
+{
+    GError *error = nullptr;
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> pipeline(
+        gst_parse_launch(
+            fmt::format(
+                "appsrc name=src format=time block=true max-bytes={} "
+                "caps=image/jpeg,width=3840,height=2160,framerate={}/1 ! "
+                "splitmuxsink name=mux async-finalize=true muxer-factory=matroskamux "
+                "max-size-time={} location=\"{}\"",
+                8 << 20,
+                fps,
+                2 * GST_SECOND,
+                (directory / "sink-%02d.mkv").generic_string()
+            )
+                .c_str(),
+            &error
+        ),
+        gst_object_unref
+    );
+    if (!pipeline) {
+        spdlog::error("Failed to create the writer: {}", error->message);
+        g_error_free(error);
+        return std::nullopt;
+    }
+    auto src = gst_bin_get_by_name(GST_BIN(pipeline.get()), "src");
+    auto mux = gst_bin_get_by_name(GST_BIN(pipeline.get()), "mux");
+    if (meter) xvc::use_file_sink(mux, {}, meter);
+    gst_object_unref(mux);
+
+    // A few distinct frames of noise, which no layer can compress or deduplicate.
+    std::mt19937 random(1);
+    std::vector<std::vector<std::uint8_t>> payloads(8, std::vector<std::uint8_t>(frame_bytes));
+    for (auto &payload : payloads) {
+        std::generate(payload.begin(), payload.end(), [&] { return random() & 0xFF; });
+    }
+
+    std::vector<double> push_ms;
+    auto begin = std::chrono::steady_clock::now();
+    gst_element_set_state(pipeline.get(), GST_STATE_PLAYING);
+    for (auto i = 0; i < frames; ++i) {
+        auto &payload = payloads[i % payloads.size()];
+        auto buffer = gst_buffer_new_wrapped_full(
+            GST_MEMORY_FLAG_READONLY, payload.data(), payload.size(), 0, payload.size(), nullptr,
+            nullptr
+        );
+        GST_BUFFER_PTS(buffer) = i * GST_SECOND / fps;
+        GST_BUFFER_DURATION(buffer) = GST_SECOND / fps;
+        auto pushed = std::chrono::steady_clock::now();
+        if (gst_app_src_push_buffer(GST_APP_SRC(src), buffer) != GST_FLOW_OK) break;
+        push_ms.push_back(
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pushed)
+                .count()
+        );
+    }
+    gst_app_src_end_of_stream(GST_APP_SRC(src));
+    gst_object_unref(src);
+    auto bus = gst_element_get_bus(pipeline.get());
+    auto message = gst_bus_timed_pop_filtered(
+        bus, GST_CLOCK_TIME_NONE, static_cast<GstMessageType>(GST_MESSAGE_EOS | GST_MESSAGE_ERROR)
+    );
+    auto ok = message && GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS;
+    if (message) gst_message_unref(message);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+    flush_files(directory);
+    if (!ok) return std::nullopt;
+    return SinkRun{
+        static_cast<std::uint64_t>(push_ms.size()) * frame_bytes,
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(),
+        summarize(push_ms)
+    };
+}
+
+// Sustained MB/s and write latency of the record branch's writer at 4K M-JPEG rates, with
+// splitmuxsink's filesink and with xvcfilesink. The files go to the system temporary directory;
+// point TMPDIR at the recording disk.
+int bench_record_sink(const po::variables_map &vm)
+{
+    constexpr auto Fps = 500;
+    constexpr std::size_t FrameBytes = 1 << 20;
+    auto frames = vm["frames"].as<int>();
+    auto directory = std::filesystem::temp_directory_path() / "xvc-bench-sink";
+
+    fmt::print(
+        "{} frames of {} KiB, 3840x2160@{}, to {}\n",
+        frames,
+        FrameBytes >> 10,
+        Fps,
+        directory.string()
+    );
+    fmt::print(
+        "{:<8} {:>8} {:>10} {:>10} {:>10} {:>10} {:>12} {:>10}\n",
+        "sink",
+        "MB/s",
+        "push p50",
+        "push p99",
+        "push max",
+        "disk MB/s",
+        "write max",
+        "stall max"
+    );
+    for (auto direct : {false, true}) {
+        std::filesystem::remove_all(directory);
+        std::filesystem::create_directories(directory);
+        xvc::WriteMeter meter;
+        auto run =
+            write_through_sink(directory, frames, FrameBytes, Fps, direct ? &meter : nullptr);
+        if (!run) {
+            spdlog::error("The writer failed.");
+            return EXIT_FAILURE;
+        }
+        auto writes = meter.stats();
+        auto ms = [&](std::chrono::microseconds us) {
+            return direct ? fmt::format("{:.2f} ms", us.count() / 1000.0) : std::string("-");
+        };
+        fmt::print(
+            "{:<8} {:>8.1f} {:>7.2f} ms {:>7.2f} ms {:>7.2f} ms {:>10} {:>12} {:>10}\n",
+            direct ? "xvc" : "filesink",
+            run->bytes / run->seconds / 1e6,
+            run->push_ms.p50,
+            run->push_ms.p99,
+            run->push_ms.max,
+            direct ? fmt::format("{:.1f}", writes.mb_per_s()) : std::string("-"),
+            ms(writes.max_latency),
+            ms(writes.max_stall)
+        );
+    }
+    std::filesystem::remove_all(directory);
+    return EXIT_SUCCESS;
+}
+
+// How cameras writing to one disk at once share it, each with its own DirectFileWriter as
+// RecordSink::Direct has, and every one of them starting a new file at the same frame. Without the
+// governor the file system decides; with it, camera 0 has 4 times the weight of the others and
+// only one file is finalized at a time. Point TMPDIR at the recording disk.
+int bench_io_share(const po::variables_map &vm)
+{
+    constexpr auto Cameras = 6;
+    constexpr std::size_t FrameBytes = 1 << 20;
+    constexpr auto FramesPerFile = 100;
+    using Clock = std::chrono::steady_clock;
+    auto ms = [](Clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+    auto frames = vm["frames"].as<int>();
+    auto directory = std::filesystem::temp_directory_path() / "xvc-bench-share";
+
+    std::mt19937 random(1);
+    std::vector<std::uint8_t> payload(FrameBytes);
+    std::generate(payload.begin(), payload.end(), [&] { return random() & 0xFF; });
+
+    fmt::print(
+        "{} cameras, {} frames of {} KiB each, a new file every {} frames, to {}\n",
+        Cameras,
+        frames,
+        FrameBytes >> 10,
+        FramesPerFile,
+        directory.string()
+    );
+    fmt::print(
+        "{:<10} {:<8} {:>6} {:>8} {:>11} {:>11} {:>12}\n",
+        "mode",
+        "camera",
+        "weight",
+        "MB/s",
+        "stall max",
+        "close max",
+        "governed"
+    );
+    for (auto governed : {false, true}) {
+        std::filesystem::remove_all(directory);
+        std::filesystem::create_directories(directory);
+        xvc::IoGovernor governor;
+        struct Camera {
+            xvc::WriteMeter meter;
+            double seconds = 0;
+            double close_ms = 0;
+            bool ok = true;
+        };
+        std::vector<Camera> cameras(Cameras);
+        std::vector<std::shared_ptr<xvc::IoGovernor::Queue>> queues;
+        for (auto c = 0; c < Cameras; ++c) {
+            auto weight = static_cast<std::uint32_t>(c == 0 ? 4 : 1);
+            queues.push_back(governor.join(fmt::format("camera{}", c), {weight}));
+        }
+        {
+            std::vector<std::jthread> threads;
+            for (auto c = 0; c < Cameras; ++c) {
+                threads.emplace_back([&, c] {
+                    auto &camera = cameras[c];
+                    xvc::DirectFileWriter writer(
+                        {}, &camera.meter, governed ? queues[c].get() : nullptr
+                    );
+                    auto begin = Clock::now();
+                    for (auto i = 0; i < frames && camera.ok; ++i) {
+                        if (i % FramesPerFile == 0) {
+                            auto closing = Clock::now();
+                            if (writer.is_open()) camera.ok &= writer.close();
+                            camera.close_ms = std::max(camera.close_ms, ms(Clock::now() - closing));
+                            camera.ok &= writer.open(
+                                directory / fmt::format("camera{}-{}.bin", c, i / FramesPerFile)
+                            );
+                        }
+                        auto offset = static_cast<std::uint64_t>(i % FramesPerFile) * FrameBytes;
+                        camera.ok &= writer.write(offset, payload);
+                    }
+                    camera.ok &= writer.close();
+                    camera.seconds = ms(Clock::now() - begin) / 1000.0;
+                });
+            }
+        }
+        auto stats = governor.stats();
+        for (auto c = 0; c < Cameras; ++c) {
+            const auto &camera = cameras[c];
+            if (!camera.ok) {
+                spdlog::error("The writer of camera {} failed.", c);
+                return EXIT_FAILURE;
+            }
+            fmt::print(
+                "{:<10} {:<8} {:>6} {:>8.1f} {:>8.2f} ms {:>8.2f} ms {:>9.2f} ms\n",
+                governed ? "governed" : "free",
+                c,
+                stats[c].share.weight,
+                frames * static_cast<double>(FrameBytes) / camera.seconds / 1e6,
+                camera.meter.stats().max_stall.count() / 1000.0,
+                camera.close_ms,
+                stats[c].stalled.count() / 1000.0
+            );
+        }
+    }
+    std::filesystem::remove_all(directory);
+    return EXIT_SUCCESS;
+}
+
+// Frames/s of decoding whole recordings to RGB: each segment through its own demuxer pipeline in
+// turn, as a player does, against BatchLoader with a growing number of workers.
+int bench_batch_load(const po::variables_map &vm)
+{
+    constexpr auto Width = 1920;
+    constexpr auto Height = 1080;
+    constexpr auto Fps = 30;
+    constexpr auto Segments = 4;
+    auto frames = vm["frames"].as<int>();
+
+    auto directory = std::filesystem::temp_directory_path() / "xvc-bench-batch";
+    std::filesystem::create_directories(directory);
+    const std::vector<std::tuple<std::string, std::string, std::string>> codecs = {
+        {"M-JPEG", "jpegenc", "jpegparse ! jpegdec"},
+        {"H.265",
+         "x265enc speed-preset=ultrafast tune=zerolatency key-int-max=30 ! h265parse",
+         "h265parse ! avdec_h265"},
+    };
+    auto hardware = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<int> worker_counts;
+    for (auto workers : {1, 2, 4, hardware}) {
+        auto seen = std::find(worker_counts.begin(), worker_counts.end(), workers);
+        if (workers <= hardware && seen == worker_counts.end()) {
+            worker_counts.push_back(workers);
+        }
+    }
+
+    fmt::print("{} segments of {} frames, {}x{} to RGB\n", Segments, frames, Width, Height);
+    fmt::print(
+        "{:<8} {:<12} {:>8} {:>8} {:>10} {:>10} {:>8}\n",
+        "codec",
+        "mode",
+        "workers",
+        "frames",
+        "frames/s",
+        "MB/s",
+        "cpu %"
+    );
+    for (const auto &entry : codecs) {
+        const auto &codec = std::get<0>(entry);
+        const auto &encoder = std::get<1>(entry);
+        const auto &decoder = std::get<2>(entry);
+        std::vector<std::filesystem::path> paths;
+        std::uintmax_t bytes = 0;
+        for (auto i = 0; i < Segments; ++i) {
+            auto name = fmt::format("{}-{}.mkv", codec == "H.265" ? "h265" : "mjpeg", i);
+            paths.push_back(directory / name);
+            if (!write_recording(paths.back(), Width, Height, Fps, frames, encoder)) {
+                spdlog::error("Failed to write the {} recording.", codec);
+                return EXIT_FAILURE;
+            }
+            bytes += std::filesystem::file_size(paths.back());
+        }
+        auto print = [&](const std::string &mode, int workers, const Measurement &m) {
+            auto seconds = std::chrono::duration<double>(m.wall).count();
+            fmt::print(
+                "{:<8} {:<12} {:>8} {:>8} {:>10.1f} {:>10.1f} {:>8.1f}\n",
+                codec,
+                mode,
+                workers,
+                m.frames,
+                m.frames / seconds,
+                bytes / seconds / 1e6,
+                100.0 * std::chrono::duration<double>(m.cpu).count() / seconds
+            );
+        };
+
+        {
+            auto cpu_start = process_cpu_time();
+            auto wall_start = std::chrono::steady_clock::now();
+            auto decoded = 0;
+            for (const auto &path : paths) {
+                GError *error = nullptr;
+                std::unique_ptr<GstElement, decltype(&gst_object_unref)> pipeline(
+                    gst_parse_launch(
+                        fmt::format(
+                            "filesrc location=\"{}\" ! matroskademux ! {} ! videoconvert ! "
+                            "video/x-raw,format=RGB ! appsink name=sink sync=false",
+                            path.generic_string(),
+                            decoder
+                        )
+                            .c_str(),
+                        &error
+                    ),
+                    gst_object_unref
+                );
+                if (!pipeline) {
+                    spdlog::error("Failed to create the demuxer: {}", error->message);
+                    g_error_free(error);
+                    return EXIT_FAILURE;
+                }
+                auto sink = gst_bin_get_by_name(GST_BIN(pipeline.get()), "sink");
+                gst_element_set_state(pipeline.get(), GST_STATE_PLAYING);
+                while (auto sample = gst_app_sink_pull_sample(GST_APP_SINK(sink))) {
+                    ++decoded;
+                    gst_sample_unref(sample);
+                }
+                gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+                gst_object_unref(sink);
+            }
+            print(
+                "demuxer",
+                1,
+                {decoded,
+                 process_cpu_time() - cpu_start,
+                 std::chrono::duration_cast<std::chrono::microseconds>(
+                     std::chrono::steady_clock::now() - wall_start
+                 )}
+            );
+        }
+
+        for (auto workers : worker_counts) {
+            auto cpu_start = process_cpu_time();
+            auto wall_start = std::chrono::steady_clock::now();
+            xvc::BatchLoader loader(paths, {.workers = workers});
+            if (!loader.start()) return EXIT_FAILURE;
+            while (loader.next()) {
+            }
+            auto stats = loader.stats();
+            if (stats.failed > 0) {
+                spdlog::warn("{} frames failed to decode.", stats.failed);
+            }
+            print(
+                "BatchLoader",
+                workers,
+                {static_cast<int>(stats.frames),
+                 process_cpu_time() - cpu_start,
+                 std::chrono::duration_cast<std::chrono::microseconds>(
+                     std::chrono::steady_clock::now() - wall_start
+                 )}
+            );
+        }
+    }
+    std::filesystem::remove_all(directory);
+    return EXIT_SUCCESS;
+}
+
+// Pushes the samples of `clip` at `fps` of stream time, as fast as the writer takes them, through
+// appsrc ! `parser` ! splitmuxsink in `container`, like the record branch's writer, into a single
+// file `path`. Measures the CPU and wall time of the whole process until it is closed.
+std::optional<Measurement> mux_clip(
+    const std::vector<GstSample *> &clip, const std::string &parser,
+    xvc::RecordContainer container, const std::filesystem::path &path, int fps
+)
+{
+    GError *error = nullptr;
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> pipeline(
+        gst_parse_launch(
+            fmt::format(
+                "appsrc name=src format=time block=true max-bytes={} ! {} ! "
+                "splitmuxsink name=mux async-finalize=true location=\"{}\"",
+                8 << 20,
+                parser,
+                path.generic_string()
+            )
+                .c_str(),
+            &error
+        ),
+        gst_object_unref
+    );
+    if (!pipeline) {
+        spdlog::error("Failed to create the writer: {}", error->message);
+        g_error_free(error);
+        return std::nullopt;
+    }
+    auto src = gst_bin_get_by_name(GST_BIN(pipeline.get()), "src");
+    auto mux = gst_bin_get_by_name(GST_BIN(pipeline.get()), "mux");
+    auto ok = xvc::use_container(mux, container);
+    gst_object_unref(mux);
+    gst_app_src_set_caps(GST_APP_SRC(src), gst_sample_get_caps(clip.front()));
+
+    auto cpu_start = process_cpu_time();
+    auto wall_start = std::chrono::steady_clock::now();
+    gst_element_set_state(pipeline.get(), GST_STATE_PLAYING);
+    for (std::size_t i = 0; ok && i < clip.size(); ++i) {
+        auto buffer = gst_buffer_copy(gst_sample_get_buffer(clip[i]));
+        GST_BUFFER_PTS(buffer) = i * GST_SECOND / fps;
+        GST_BUFFER_DTS(buffer) = GST_BUFFER_PTS(buffer);
+        GST_BUFFER_DURATION(buffer) = GST_SECOND / fps;
+        ok = gst_app_src_push_buffer(GST_APP_SRC(src), buffer) == GST_FLOW_OK;
+    }
+    gst_app_src_end_of_stream(GST_APP_SRC(src));
+    gst_object_unref(src);
+    auto bus = gst_element_get_bus(pipeline.get());
+    auto message = gst_bus_timed_pop_filtered(
+        bus, GST_CLOCK_TIME_NONE, static_cast<GstMessageType>(GST_MESSAGE_EOS | GST_MESSAGE_ERROR)
+    );
+    ok = ok && message && GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS;
+    if (message) gst_message_unref(message);
+    gst_object_unref(bus);
+    gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+    if (!ok) return std::nullopt;
+    return Measurement{
+        static_cast<int>(clip.size()),
+        process_cpu_time() - cpu_start,
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - wall_start
+        )
+    };
+}
+
+// Pulls every frame out of `description`, a gst-launch pipeline ending in an appsink named "sink".
+std::optional<Measurement> pull_all(const std::string &description)
+{
+    GError *error = nullptr;
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> pipeline(
+        gst_parse_launch(description.c_str(), &error), gst_object_unref
+    );
+    if (!pipeline) {
+        spdlog::error("Failed to create the reader: {}", error->message);
+        g_error_free(error);
+        return std::nullopt;
+    }
+    auto cpu_start = process_cpu_time();
+    auto wall_start = std::chrono::steady_clock::now();
+    auto sink = gst_bin_get_by_name(GST_BIN(pipeline.get()), "sink");
+    gst_element_set_state(pipeline.get(), GST_STATE_PLAYING);
+    auto pulled = 0;
+    while (auto sample = gst_app_sink_pull_sample(GST_APP_SINK(sink))) {
+        ++pulled;
+        gst_sample_unref(sample);
+    }
+    gst_element_set_state(pipeline.get(), GST_STATE_NULL);
+    gst_object_unref(sink);
+    return Measurement{
+        pulled,
+        process_cpu_time() - cpu_start,
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - wall_start
+        )
+    };
+}
+
+// Reads every frame of `path` through the index of its format, without GStreamer, and sums its
+// bytes so that all of them are touched. Nothing for fragmented MP4, which has no native reader.
+std::optional<Measurement> scan_all(
+    const std::filesystem::path &path, xvc::RecordContainer container
+)
+{
+    auto cpu_start = process_cpu_time();
+    auto wall_start = std::chrono::steady_clock::now();
+    auto frames = 0;
+    std::uint64_t sum = 0;
+    auto visit = [&](std::span<const std::uint8_t> frame) {
+        sum = std::accumulate(frame.begin(), frame.end(), sum);
+        ++frames;
+    };
+    if (container == xvc::RecordContainer::Matroska) {
+        xvc::MappedFile file(path);
+        xvc::MkvScanner scanner(file.data());
+        if (!scanner.open()) return std::nullopt;
+        scanner.scan([&](const xvc::MkvBlock &block) {
+            visit(block.payload);
+            return true;
+        });
+    } else if (container == xvc::RecordContainer::Elementary) {
+        xvc::ElementaryReader reader(path);
+        if (!reader.is_open()) return std::nullopt;
+        for (std::size_t i = 0; i < reader.size(); ++i) {
+            visit(reader.frame(i));
+        }
+    } else {
+        return std::nullopt;
+    }
+    spdlog::debug("Checksum {}", sum);
+    return Measurement{
+        frames,
+        process_cpu_time() - cpu_start,
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - wall_start
+        )
+    };
+}
+
+// CPU cost of writing each RecordContainer, and how fast the files read back: whole, through the
+// demuxer and parser a player would use, and through the native index of the formats that have
+// one. The frames are encoded once up front; the files are read back from the page cache.
+int bench_container(const po::variables_map &vm)
+{
+    constexpr auto Width = 1920;
+    constexpr auto Height = 1080;
+    constexpr auto Fps = 60;
+    auto frames = vm["frames"].as<int>();
+    auto directory = std::filesystem::temp_directory_path() / "xvc-bench-container";
+
+    struct Codec {
+        std::string name;
+        std::string encoder;
+        bool h265;
+    };
+    const std::vector<Codec> codecs = {
+        {"M-JPEG", "jpegenc", false},
+        {"H.265",
+         "x265enc speed-preset=ultrafast tune=zerolatency key-int-max=30 ! h265parse",
+         true},
+    };
+    const std::vector<std::pair<std::string, xvc::RecordContainer>> containers = {
+        {"mkv", xvc::RecordContainer::Matroska},
+        {"fmp4", xvc::RecordContainer::FragmentedMp4},
+        {"es+idx", xvc::RecordContainer::Elementary},
+    };
+
+    fmt::print("{} frames, {}x{}@{}\n", frames, Width, Height, Fps);
+    fmt::print(
+        "{:<8} {:<8} {:>8} {:>12} {:>10} {:>12} {:>10} {:>12} {:>10}\n",
+        "codec",
+        "format",
+        "MB",
+        "mux cpu/fr",
+        "mux fr/s",
+        "demux fr/s",
+        "MB/s",
+        "native fr/s",
+        "MB/s"
+    );
+    for (const auto &codec : codecs) {
+        auto clip = encode_clip(Width, Height, frames, codec.encoder);
+        if (clip.empty()) {
+            spdlog::error("Failed to encode the {} clip.", codec.name);
+            return EXIT_FAILURE;
+        }
+        for (const auto &[name, container] : containers) {
+            std::filesystem::remove_all(directory);
+            std::filesystem::create_directories(directory);
+            auto elementary = container == xvc::RecordContainer::Elementary;
+            auto path = directory / ("recording" + xvc::container_extension(container, codec.h265));
+            // As the record branch parses for each container.
+            auto parser = std::string("jpegparse");
+            if (codec.h265) {
+                parser = fmt::format(
+                    "h265parse{} ! video/x-h265,stream-format={},alignment=au",
+                    elementary ? " config-interval=-1" : "",
+                    elementary ? "byte-stream" : "hvc1"
+                );
+            }
+            auto muxed = mux_clip(clip, parser, container, path, Fps);
+            if (!muxed) {
+                spdlog::error("Failed to write {} {}.", codec.name, name);
+                return EXIT_FAILURE;
+            }
+            std::uintmax_t bytes = 0;
+            for (const auto &entry : std::filesystem::directory_iterator(directory)) {
+                bytes += entry.file_size();
+            }
+
+            auto demuxer = container == xvc::RecordContainer::Matroska        ? "matroskademux ! "
+                           : container == xvc::RecordContainer::FragmentedMp4 ? "qtdemux ! "
+                                                                               : "";
+            auto demuxed = pull_all(fmt::format(
+                "filesrc location=\"{}\" ! {}{} ! appsink name=sink sync=false",
+                path.generic_string(),
+                demuxer,
+                codec.h265 ? "h265parse ! video/x-h265,alignment=au" : "jpegparse"
+            ));
+            auto scanned = scan_all(path, container);
+
+            auto rate = [&](const std::optional<Measurement> &m) {
+                if (!m || m->frames == 0) return fmt::format("{:>12} {:>10}", "-", "-");
+                auto seconds = std::chrono::duration<double>(m->wall).count();
+                return fmt::format(
+                    "{:>12.1f} {:>10.1f}", m->frames / seconds, bytes / seconds / 1e6
+                );
+            };
+            fmt::print(
+                "{:<8} {:<8} {:>8.1f} {:>9.3f} ms {:>10.1f} {} {}\n",
+                codec.name,
+                name,
+                bytes / 1e6,
+                muxed->cpu.count() / 1000.0 / muxed->frames,
+                muxed->frames / std::chrono::duration<double>(muxed->wall).count(),
+                rate(demuxed),
+                rate(scanned)
+            );
+        }
+        for (auto sample : clip) {
+            gst_sample_unref(sample);
+        }
+    }
+    std::filesystem::remove_all(directory);
+    return EXIT_SUCCESS;
+}
+
+}  // namespace
+
+
+int main(int argc, char *argv[])
+{
+    const std::map<std::string, std::function<int(const po::variables_map &)>> benches = {
+        {"output-format", bench_output_format},
+        {"convert", bench_convert},
+        {"jpeg-decode", bench_jpeg_decode},
+        {"jpeg-scale", bench_jpeg_scale},
+        {"h265-preview", bench_h265_preview},
+        {"display-branch", bench_display_branch},
+        {"record-stop", bench_record_stop},
+        {"seek", bench_seek},
+        {"batch-load", bench_batch_load},
+        {"record-sink", bench_record_sink},
+        {"io-share", bench_io_share},
+        {"container", bench_container},
+    };
+
+    po::options_description desc("Usage");
+
+    // clang-format off
+    desc.add_options()
+        ("help,h", "Show help options")
+        ("bench,b", po::value<std::string>(),
+            "Benchmark to run: output-format, convert, jpeg-decode, jpeg-scale, h265-preview, "
+            "display-branch, record-stop, seek, batch-load, record-sink, io-share, container")
+        ("frames,n", po::value<int>()->default_value(500), "Frames measured per mode")
+    ;
+    // clang-format on
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    } catch (const po::error &e) {
+        spdlog::error("Command line error: {}", e.what());
+        std::cerr << desc << "\n";
+        return EXIT_FAILURE;
+    }
+
+    if (vm.count("help") || !vm.count("bench")) {
+        desc.print(std::cout);
+        return EXIT_SUCCESS;
+    }
+
+    auto bench = benches.find(vm["bench"].as<std::string>());
+    if (bench == benches.end()) {
+        spdlog::error("Unknown benchmark: {}", vm["bench"].as<std::string>());
+        return EXIT_FAILURE;
+    }
+
+    gst_init(&argc, &argv);
+    return bench->second(vm);
+}
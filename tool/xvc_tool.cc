@@ -7,13 +7,158 @@
 #include <spdlog/spdlog.h>
 
 #include <boost/program_options.hpp>
+#include <chrono>
 #include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <string>
+#include <vector>
 
+#include "compact_sidecar.h"
+#include "jpeg_export.h"
+#include "metadata_extract.h"
 #include "server.h"
 
 
+namespace
+{
+
+constexpr auto CommandUsage =
+    "xvc_tool extract <directory or .mkv> [-j N] [--force] [--demux | --verify]\n"
+    "xvc_tool compact <directory or .bin>\n"
+    "xvc_tool export <directory or .mkv> --out DIR [--first N] [--count N] [--stride N] [-j N]";
+
+std::string read_file(const std::filesystem::path &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+// Extracts every video both through matroskademux and with the native scanner and compares the
+// sidecars byte for byte. Which one reads a file first alternates, so the page cache favours
+// neither.
+int verify(const std::vector<std::filesystem::path> &videos)
+{
+    namespace fs = std::filesystem;
+    using clock = std::chrono::steady_clock;
+
+    auto demuxed = fs::temp_directory_path() / "xvc-verify-demux.bin";
+    auto scanned = fs::temp_directory_path() / "xvc-verify-scan.bin";
+    xvc::MetadataExtractor extractor;
+    clock::duration demux_time{0};
+    clock::duration scan_time{0};
+    std::uintmax_t bytes = 0;
+    auto identical = 0;
+    for (std::size_t i = 0; i < videos.size(); ++i) {
+        const auto &video = videos[i];
+        auto demux = [&] {
+            auto begin = clock::now();
+            auto ok = extractor.extract(video, demuxed);
+            demux_time += clock::now() - begin;
+            return ok;
+        };
+        auto scan = [&] {
+            auto begin = clock::now();
+            auto ok = xvc::scan_metadata(video, scanned);
+            scan_time += clock::now() - begin;
+            return ok;
+        };
+        auto ok = i % 2 ? scan() && demux() : demux() && scan();
+        if (ok && read_file(demuxed) == read_file(scanned)) {
+            ++identical;
+        } else {
+            fmt::print("{}: sidecars differ\n", video.string());
+        }
+        std::error_code ec;
+        bytes += fs::file_size(video, ec);
+    }
+    std::error_code ec;
+    fs::remove(demuxed, ec);
+    fs::remove(scanned, ec);
+
+    auto mb_per_s = [&](clock::duration time) {
+        auto seconds = std::chrono::duration<double>(time).count();
+        return seconds > 0 ? bytes / seconds / 1e6 : 0.0;
+    };
+    auto speedup = scan_time.count() > 0 ? double(demux_time.count()) / scan_time.count() : 0.0;
+    fmt::print(
+        "{} of {} identical. matroskademux {:.1f} MB/s, scanner {:.1f} MB/s ({:.1f}x)\n",
+        identical,
+        videos.size(),
+        mb_per_s(demux_time),
+        mb_per_s(scan_time),
+        speedup
+    );
+    return identical == static_cast<int>(videos.size()) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Writes a compact .xbin next to every .bin under `root`.
+int compact(const std::filesystem::path &root)
+{
+    namespace fs = std::filesystem;
+    std::vector<fs::path> sidecars;
+    std::error_code ec;
+    if (fs::is_regular_file(root, ec)) {
+        sidecars.push_back(root);
+    } else {
+        fs::recursive_directory_iterator it(root, ec);
+        for (; !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            if (it->path().extension() == ".bin") sidecars.push_back(it->path());
+        }
+    }
+
+    std::uintmax_t before = 0;
+    std::uintmax_t after = 0;
+    auto failed = 0;
+    for (const auto &bin : sidecars) {
+        auto xbin = fs::path(bin).replace_extension(".xbin");
+        if (!xvc::compact_sidecar(bin, xbin)) {
+            fmt::print(stderr, "{}: could not be converted\n", bin.string());
+            ++failed;
+            continue;
+        }
+        before += fs::file_size(bin, ec);
+        after += fs::file_size(xbin, ec);
+    }
+    fmt::print(
+        "{} converted, {} failed: {:.1f} MB to {:.1f} MB ({:.1f}x)\n",
+        sidecars.size() - failed,
+        failed,
+        before / 1e6,
+        after / 1e6,
+        after ? double(before) / after : 0.0
+    );
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Copies the JPEG images of the M-JPEG recordings under `root` into `out`, numbered across them.
+int export_frames(
+    const std::filesystem::path &root,
+    const std::filesystem::path &out,
+    const xvc::JpegExportOptions &options
+)
+{
+    auto report = xvc::export_jpeg(xvc::find_recordings(root), out, options);
+    auto seconds = report.seconds > 0 ? report.seconds : 1.0;
+    fmt::print(
+        "{} exported, {} failed in {:.2f} s: {:.1f} frames/s, {:.1f} MB/s\n",
+        report.frames,
+        report.failed,
+        report.seconds,
+        report.frames / seconds,
+        report.bytes / seconds / 1e6
+    );
+    if (report.failed_segments) {
+        fmt::print("{} segments could not be read, nothing exported\n", report.failed_segments);
+    }
+    return report.aborted || report.failed || !report.frames ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+}  // namespace
+
+
 int main(int argc, char *argv[])
 {
     namespace po = boost::program_options;
@@ -24,18 +169,77 @@ int main(int argc, char *argv[])
         ("help,h", "Show help options")
         ("file,f", po::value<std::string>(), "file to write or verify")
         ("logs", "List server logs")
+        ("jobs,j", po::value<int>()->default_value(0), "extract, export: parallel files, 0 for all")
+        ("force", "extract: also rewrite up-to-date sidecars")
+        ("demux", "extract: read through matroskademux instead of the native scanner")
+        ("verify", "extract: compare both readers byte for byte and time them")
+        ("out", po::value<std::string>(), "export: directory to write the images to")
+        ("first", po::value<std::size_t>()->default_value(0), "export: first frame")
+        ("count", po::value<std::size_t>(), "export: frames in the range, all by default")
+        ("stride", po::value<std::size_t>()->default_value(1), "export: every Nth frame")
+    ;
+    po::options_description hidden;
+    hidden.add_options()
+        ("command", po::value<std::string>())
+        ("path", po::value<std::string>())
     ;
     // clang-format on
+    po::options_description all;
+    all.add(desc).add(hidden);
+    po::positional_options_description positional;
+    positional.add("command", 1).add("path", 1);
 
     po::variables_map vm;
-    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::store(po::command_line_parser(argc, argv).options(all).positional(positional).run(), vm);
     po::notify(vm);
 
     if (vm.count("help")) {
+        fmt::print("xvc_tool [options]\n{}\n", CommandUsage);
         desc.print(std::cout);
         return EXIT_SUCCESS;
     }
 
+    if (vm.count("command")) {
+        auto command = vm["command"].as<std::string>();
+        auto known = command == "extract" || command == "compact" || command == "export";
+        if (!known || !vm.count("path") || (command == "export" && !vm.count("out"))) {
+            fmt::print(stderr, "Usage:\n{}\n", CommandUsage);
+            return EXIT_FAILURE;
+        }
+        if (command == "compact") return compact(vm["path"].as<std::string>());
+        if (command == "export") {
+            xvc::JpegExportOptions options{
+                .first = vm["first"].as<std::size_t>(),
+                .stride = vm["stride"].as<std::size_t>(),
+                .workers = vm["jobs"].as<int>(),
+            };
+            if (vm.count("count")) options.count = vm["count"].as<std::size_t>();
+            return export_frames(
+                vm["path"].as<std::string>(), vm["out"].as<std::string>(), options
+            );
+        }
+        gst_init(&argc, &argv);
+        auto videos = xvc::find_recordings(vm["path"].as<std::string>());
+        if (vm.count("verify")) return verify(videos);
+        auto report = xvc::extract_metadata(
+            videos,
+            {.workers = vm["jobs"].as<int>(),
+             .force = vm.count("force") > 0,
+             .demux = vm.count("demux") > 0}
+        );
+        auto seconds = report.seconds > 0 ? report.seconds : 1.0;
+        fmt::print(
+            "{} extracted, {} up to date, {} failed in {:.2f} s: {:.1f} files/s, {:.1f} MB/s\n",
+            report.files,
+            report.skipped,
+            report.failed,
+            report.seconds,
+            report.files / seconds,
+            report.bytes / seconds / 1e6
+        );
+        return report.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
     if (vm.count("logs")) {
         if (vm.count("file")) {
             auto filename = vm["file"].as<std::string>();
@@ -0,0 +1,274 @@
+#include "admission.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <system_error>
+#include <vector>
+
+#include "direct_file_writer.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+constexpr auto ScratchName = ".xvc-storage-benchmark";
+constexpr std::size_t ChunkBytes = 4 << 20;
+constexpr std::size_t SyncBytes = 4096;
+
+std::chrono::microseconds since(Clock::time_point begin)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin);
+}
+
+fs::path directory_of(const fs::path &camera)
+{
+    return camera.has_parent_path() ? camera.parent_path() : fs::path(".");
+}
+
+// The same for every spelling of a directory.
+fs::path key_of(const fs::path &directory)
+{
+    std::error_code ec;
+    auto key = fs::weakly_canonical(directory, ec);
+    return ec ? directory : key;
+}
+
+struct Syncs {
+    std::chrono::microseconds flush;                   // Of what was written before.
+    std::vector<std::chrono::microseconds> latencies;  // Sorted.
+};
+
+// Makes what was written to `path` durable, then times `count` small writes each made durable in
+// turn. Nothing if the file cannot be written.
+std::optional<Syncs> sync_writes(const fs::path &path, int count)
+{
+    std::vector<std::uint8_t> block(SyncBytes, 0x5A);
+    Syncs syncs{};
+    auto flushing = Clock::now();
+#ifdef _WIN32
+    auto handle = CreateFileW(
+        path.c_str(),
+        GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr
+    );
+    if (handle == INVALID_HANDLE_VALUE) return std::nullopt;
+    auto ok = FlushFileBuffers(handle) != FALSE;
+    syncs.flush = since(flushing);
+    for (auto i = 0; ok && i < count; ++i) {
+        auto begin = Clock::now();
+        DWORD written = 0;
+        ok = WriteFile(handle, block.data(), SyncBytes, &written, nullptr) &&
+             written == SyncBytes && FlushFileBuffers(handle);
+        syncs.latencies.push_back(since(begin));
+    }
+    CloseHandle(handle);
+#else
+    auto fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+    if (fd < 0) return std::nullopt;
+    auto ok = fsync(fd) == 0;
+    syncs.flush = since(flushing);
+    for (auto i = 0; ok && i < count; ++i) {
+        auto begin = Clock::now();
+        ok = ::write(fd, block.data(), SyncBytes) == static_cast<ssize_t>(SyncBytes) &&
+             fsync(fd) == 0;
+        syncs.latencies.push_back(since(begin));
+    }
+    ::close(fd);
+#endif
+    if (!ok || syncs.latencies.empty()) return std::nullopt;
+    std::sort(syncs.latencies.begin(), syncs.latencies.end());
+    return syncs;
+}
+
+}  // namespace
+
+
+namespace xvc
+{
+
+std::optional<StorageBenchmark> benchmark_storage(
+    const fs::path &directory, std::uint64_t bytes, int syncs, IoGovernor::Queue *queue
+)
+{
+    auto path = directory / ScratchName;
+    std::vector<std::uint8_t> chunk(ChunkBytes);
+    for (std::size_t i = 0; i < chunk.size(); ++i) {
+        // Nothing a file system could compress or deduplicate.
+        chunk[i] = static_cast<std::uint8_t>((i * 2654435761u) >> 13);
+    }
+
+    auto begin = Clock::now();
+    DirectFileWriter writer({}, nullptr, queue);
+    auto ok = writer.open(path);
+    for (std::uint64_t offset = 0; ok && offset < bytes; offset += chunk.size()) {
+        auto length = std::min<std::uint64_t>(chunk.size(), bytes - offset);
+        ok = writer.write(offset, {chunk.data(), static_cast<std::size_t>(length)});
+    }
+    ok = writer.close() && ok;
+    auto written = std::chrono::duration<double>(Clock::now() - begin);
+    std::optional<Syncs> durable;
+    if (ok) {
+        IoGovernor::Grant syncing;
+        if (queue) syncing = queue->finalize();
+        durable = sync_writes(path, std::max(syncs, 1));
+    }
+
+    std::optional<StorageBenchmark> benchmark;
+    if (durable) {
+        auto seconds = std::chrono::duration<double>(written + durable->flush).count();
+        benchmark = StorageBenchmark{
+            seconds > 0 ? bytes / seconds / 1e6 : 0.0,
+            durable->latencies[durable->latencies.size() / 2],
+            durable->latencies.back(),
+            std::chrono::system_clock::now()
+        };
+    }
+    std::error_code ec;
+    fs::remove(path, ec);
+    if (!benchmark) {
+        spdlog::warn("Storage: {} could not be benchmarked.", directory.string());
+        return std::nullopt;
+    }
+    spdlog::info(
+        "Storage: {} writes {:.1f} MB/s, fsync p50 {} us, max {} us",
+        directory.string(),
+        benchmark->write_mb_per_s,
+        benchmark->fsync_p50.count(),
+        benchmark->fsync_max.count()
+    );
+    return benchmark;
+}
+
+StorageCache &StorageCache::instance()
+{
+    static StorageCache cache;
+    return cache;
+}
+
+std::optional<StorageBenchmark> StorageCache::get(
+    const fs::path &directory, std::chrono::seconds max_age, IoGovernor *governor
+)
+{
+    auto key = key_of(directory);
+    std::promise<std::optional<StorageBenchmark>> measured;
+    {
+        std::unique_lock lock(_mutex);
+        auto cached = _benchmarks.find(key);
+        if (cached != _benchmarks.end() &&
+            std::chrono::system_clock::now() - cached->second.measured < max_age) {
+            return cached->second;
+        }
+        if (auto pending = _pending.find(key); pending != _pending.end()) {
+            auto benchmark = pending->second;
+            lock.unlock();
+            return benchmark.get();
+        }
+        _pending.emplace(key, measured.get_future().share());
+    }
+
+    std::optional<StorageBenchmark> benchmark;
+    {
+        std::lock_guard measuring(_measuring);
+        std::shared_ptr<IoGovernor::Queue> queue;
+        if (governor) {
+            queue = governor->join((directory / ScratchName).generic_string());
+        }
+        benchmark = benchmark_storage(directory, 128 << 20, 16, queue.get());
+    }
+    {
+        std::lock_guard lock(_mutex);
+        if (benchmark) {
+            _benchmarks[key] = *benchmark;
+        }
+        _pending.erase(key);
+    }
+    measured.set_value(benchmark);
+    return benchmark;
+}
+
+void StorageCache::put(const fs::path &directory, const StorageBenchmark &benchmark)
+{
+    std::lock_guard lock(_mutex);
+    _benchmarks[key_of(directory)] = benchmark;
+}
+
+void StorageCache::forget(const fs::path &directory)
+{
+    std::lock_guard lock(_mutex);
+    _benchmarks.erase(key_of(directory));
+}
+
+double estimate_mb_per_s(std::string_view media_type, int width, int height, double fps)
+{
+    auto bits_per_pixel = 1.0;
+    if (media_type == "image/jpeg") {
+        bits_per_pixel = 1.5;
+    } else if (media_type == "video/x-h265") {
+        bits_per_pixel = 0.15;
+    } else if (media_type == "video/x-raw") {
+        bits_per_pixel = 16;
+    }
+    return static_cast<double>(width) * height * fps * bits_per_pixel / 8 / 1e6;
+}
+
+bool same_volume(const fs::path &a, const fs::path &b)
+{
+#ifdef _WIN32
+    wchar_t volume_a[MAX_PATH];
+    wchar_t volume_b[MAX_PATH];
+    if (!GetVolumePathNameW(fs::absolute(a).c_str(), volume_a, MAX_PATH) ||
+        !GetVolumePathNameW(fs::absolute(b).c_str(), volume_b, MAX_PATH)) {
+        return false;
+    }
+    return _wcsicmp(volume_a, volume_b) == 0;
+#else
+    struct stat stat_a;
+    struct stat stat_b;
+    if (stat(a.c_str(), &stat_a) != 0 || stat(b.c_str(), &stat_b) != 0) return false;
+    return stat_a.st_dev == stat_b.st_dev;
+#endif
+}
+
+std::optional<AdmissionCheck> check_admission(
+    const fs::path &camera,
+    double needed_mb_per_s,
+    double headroom,
+    IoGovernor &governor,
+    StorageCache &cache
+)
+{
+    auto directory = directory_of(camera);
+    auto storage = cache.get(directory, 24h, &governor);
+    if (!storage) return std::nullopt;
+
+    auto active = 0.0;
+    for (const auto &other : governor.stats()) {
+        if (other.camera == camera.generic_string()) continue;
+        if (!same_volume(directory_of(other.camera), directory)) continue;
+        active += std::max(other.expected_mb_per_s, other.mb_per_s);
+    }
+    auto budget = storage->write_mb_per_s * headroom;
+    return AdmissionCheck{
+        needed_mb_per_s + active <= budget, needed_mb_per_s, active, budget, *storage
+    };
+}
+
+}  // namespace xvc
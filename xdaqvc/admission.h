@@ -0,0 +1,94 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string_view>
+
+#include "io_governor.h"
+
+
+namespace xvc
+{
+
+using namespace std::chrono_literals;
+
+// How fast a directory's volume takes recordings.
+struct StorageBenchmark {
+    double write_mb_per_s;  // Sequential writes until they are on the disk.
+    // Of a small write followed by fsync, as a muxer finalizing a file does.
+    std::chrono::microseconds fsync_p50;
+    std::chrono::microseconds fsync_max;
+    std::chrono::system_clock::time_point measured;
+};
+
+// Writes `bytes` to a scratch file in `directory` the way RecordSink::Direct does, then times
+// `syncs` small synchronous writes. The file is removed afterwards. Nothing if it cannot be
+// written. With a `queue`, the writes take their turn with the recordings and the synchronous
+// ones hold a finalize grant, so a benchmark neither starves the recordings nor cuts in on them.
+std::optional<StorageBenchmark> benchmark_storage(
+    const std::filesystem::path &directory,
+    std::uint64_t bytes = 128 << 20,
+    int syncs = 16,
+    IoGovernor::Queue *queue = nullptr
+);
+
+// The benchmarks of the directories recorded to, each measured once and then kept for a while.
+class StorageCache
+{
+public:
+    // The one start_*_recording uses.
+    static StorageCache &instance();
+
+    // Benchmarks `directory` unless a benchmark younger than `max_age` is cached, through
+    // `governor` if given. Callers asking for a directory being measured wait for that benchmark;
+    // the others are not held up. A single directory is measured at a time, as measuring two at
+    // once would skew both.
+    std::optional<StorageBenchmark> get(
+        const std::filesystem::path &directory,
+        std::chrono::seconds max_age = 24h,
+        IoGovernor *governor = nullptr
+    );
+    void put(const std::filesystem::path &directory, const StorageBenchmark &benchmark);
+    void forget(const std::filesystem::path &directory);
+
+private:
+    using Pending = std::shared_future<std::optional<StorageBenchmark>>;
+
+    std::mutex _mutex;
+    std::map<std::filesystem::path, StorageBenchmark> _benchmarks;
+    std::map<std::filesystem::path, Pending> _pending;
+    std::mutex _measuring;
+};
+
+// Rough MB/s of a camera stream from its caps, for when it has not been measured: M-JPEG at 1.5
+// bits per pixel, H.265 at 0.15 and raw video at 16, which errs on the high side for both codecs.
+double estimate_mb_per_s(std::string_view media_type, int width, int height, double fps);
+
+// Whether both paths, which must exist, are on the same volume.
+bool same_volume(const std::filesystem::path &a, const std::filesystem::path &b);
+
+struct AdmissionCheck {
+    bool within_budget;
+    double needed_mb_per_s;  // By the camera to admit.
+    double active_mb_per_s;  // By the other cameras recording to the same volume.
+    double budget_mb_per_s;  // `headroom` of what the volume sustains.
+    StorageBenchmark storage;
+};
+
+// Whether the volume of `camera`, the base path its files start with, keeps up with
+// `needed_mb_per_s` on top of the other cameras of `governor` recording to it. Each of those counts
+// with the larger of its expected and its measured rate. Nothing if the volume cannot be measured.
+std::optional<AdmissionCheck> check_admission(
+    const std::filesystem::path &camera,
+    double needed_mb_per_s,
+    double headroom,
+    IoGovernor &governor,
+    StorageCache &cache
+);
+
+}  // namespace xvc
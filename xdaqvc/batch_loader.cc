@@ -0,0 +1,611 @@
+#include "batch_loader.h"
+
+#include <gst/app/gstappsink.h>
+#include <spdlog/spdlog.h>
+#include <turbojpeg.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <system_error>
+#include <utility>
+
+#include "frame_source.h"
+#include "hevc.h"
+#include "mapped_file.h"
+#include "mkv_scanner.h"
+#include "sidecar.h"
+
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+
+// An M-JPEG frame to decode.
+struct Job {
+    std::uint32_t segment;
+    std::uint32_t frame;
+    std::uint64_t offset;
+    std::uint32_t size;
+    std::int64_t pts;
+};
+
+GstElement *create_element(const gchar *factoryname, const gchar *name)
+{
+    auto element = gst_element_factory_make(factoryname, name);
+    if (!element) {
+        spdlog::error("Element {} could not be created.", factoryname);
+    }
+    return element;
+}
+
+const gchar *gst_format(xvc::BatchLoader::Format format)
+{
+    switch (format) {
+    case xvc::BatchLoader::Format::BGR: return "BGR";
+    case xvc::BatchLoader::Format::Gray: return "GRAY8";
+    default: return "RGB";
+    }
+}
+
+int tj_format(xvc::BatchLoader::Format format)
+{
+    switch (format) {
+    case xvc::BatchLoader::Format::BGR: return TJPF_BGR;
+    case xvc::BatchLoader::Format::Gray: return TJPF_GRAY;
+    default: return TJPF_RGB;
+    }
+}
+
+// parser ! decoder ! videoconvert ! videoscale ! appsink at the batch format and size, fed from a
+// pad of our own so that the frames reach the appsink on the worker's thread as it pushes. Each
+// segment starts with a flush, so one pipeline decodes all the segments of a worker.
+class SegmentDecoder
+{
+public:
+    SegmentDecoder(const gchar *format, int width, int height)
+        : _pipeline(gst_pipeline_new("batch")), _sink(nullptr)
+    {
+        auto parser = create_element("h265parse", "parser");
+#ifdef _WIN32
+        auto dec = create_element("d3d11h265dec", "dec");
+#elif __APPLE__
+        auto dec = create_element("vtdec", "dec");
+#else
+        auto dec = create_element("avdec_h265", "dec");
+#endif
+        auto conv = create_element("videoconvert", "conv");
+        auto scale = create_element("videoscale", "scale");
+        auto cf_out = create_element("capsfilter", "cf_out");
+        _sink = create_element("appsink", "sink");
+        if (!parser || !dec || !conv || !scale || !cf_out || !_sink) {
+            _sink = nullptr;
+            return;
+        }
+
+        // clang-format off
+        std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> out_caps(
+            gst_caps_new_simple(
+            "video/x-raw",
+            "format", G_TYPE_STRING, format,
+            "width", G_TYPE_INT, width,
+            "height", G_TYPE_INT, height,
+            nullptr),
+            gst_caps_unref
+        );
+        std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> caps(
+            gst_caps_new_simple(
+            "video/x-h265",
+            "stream-format", G_TYPE_STRING, "byte-stream",
+            "alignment", G_TYPE_STRING, "au",
+            nullptr),
+            gst_caps_unref
+        );
+        // clang-format on
+        g_object_set(G_OBJECT(cf_out), "caps", out_caps.get(), nullptr);
+        g_object_set(G_OBJECT(_sink), "sync", FALSE, "async", FALSE, nullptr);
+        gst_bin_add_many(GST_BIN(_pipeline), parser, dec, conv, scale, cf_out, _sink, nullptr);
+        if (!gst_element_link_many(parser, dec, conv, scale, cf_out, _sink, nullptr)) {
+            spdlog::error("Failed to link the batch decoder.");
+            _sink = nullptr;
+            return;
+        }
+
+        _pad = gst_pad_new("src", GST_PAD_SRC);
+        std::unique_ptr<GstPad, decltype(&gst_object_unref)> sink_pad(
+            gst_element_get_static_pad(parser, "sink"), gst_object_unref
+        );
+        gst_pad_link(_pad, sink_pad.get());
+        gst_pad_set_active(_pad, TRUE);
+        if (gst_element_set_state(_pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+            spdlog::error("Failed to start the batch decoder.");
+            _sink = nullptr;
+            return;
+        }
+        gst_pad_push_event(_pad, gst_event_new_stream_start("batch"));
+        gst_pad_push_event(_pad, gst_event_new_caps(caps.get()));
+    }
+
+    ~SegmentDecoder()
+    {
+        gst_element_set_state(_pipeline, GST_STATE_NULL);
+        if (_pad) gst_object_unref(_pad);
+        gst_object_unref(_pipeline);
+    }
+
+    SegmentDecoder(const SegmentDecoder &) = delete;
+    SegmentDecoder &operator=(const SegmentDecoder &) = delete;
+
+    [[nodiscard]] bool ok() const { return _sink != nullptr; }
+
+    void begin()
+    {
+        gst_pad_push_event(_pad, gst_event_new_flush_start());
+        gst_pad_push_event(_pad, gst_event_new_flush_stop(TRUE));
+        GstSegment segment;
+        gst_segment_init(&segment, GST_FORMAT_TIME);
+        gst_pad_push_event(_pad, gst_event_new_segment(&segment));
+    }
+
+    // Takes ownership of `buffer`.
+    bool push(GstBuffer *buffer) { return gst_pad_push(_pad, buffer) == GST_FLOW_OK; }
+
+    // Drains the decoder; every remaining frame is in the appsink when this returns.
+    void end() { gst_pad_push_event(_pad, gst_event_new_eos()); }
+
+    // A decoded frame, or null when none is waiting.
+    GstSample *pull() { return gst_app_sink_try_pull_sample(GST_APP_SINK(_sink), 0); }
+
+private:
+    GstElement *_pipeline;
+    GstElement *_sink;
+    GstPad *_pad = nullptr;
+};
+
+}  // namespace
+
+
+namespace xvc
+{
+
+struct BatchLoader::Input {
+    fs::path path;
+    MappedFile file;
+    std::uint64_t track;
+    std::optional<HevcConfig> config;
+    std::vector<SidecarRecord> records;
+};
+
+// Shared with the batches handed out, which come back to `free` when the caller drops them.
+struct BatchLoader::State {
+    std::mutex mutex;
+    std::condition_variable free_cv;   // A batch came back, or stopping.
+    std::condition_variable ready_cv;  // A batch is ready, or the workers are done.
+    std::vector<std::unique_ptr<Batch>> batches;
+    std::vector<Batch *> free;
+    std::map<std::uint64_t, Batch *> ready;
+    Batch *filling = nullptr;
+    std::uint64_t next_sequence = 0;
+    std::uint64_t delivered = 0;
+    std::vector<Job> jobs;
+    std::size_t next_job = 0;
+    std::atomic<std::uint64_t> bytes = 0;
+    std::size_t next_segment = 0;
+    int running = 0;
+    bool stopping = false;
+    bool done = false;
+    Stats stats{};
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point finished;
+};
+
+BatchLoader::BatchLoader(std::vector<fs::path> segments)
+    : BatchLoader(std::move(segments), Options{})
+{
+}
+
+BatchLoader::BatchLoader(std::vector<fs::path> segments, Options options)
+    : _paths(std::move(segments)),
+      _options(options),
+      _h265(false),
+      _width(0),
+      _height(0),
+      _channels(0),
+      _state(std::make_shared<State>())
+{
+}
+
+BatchLoader::~BatchLoader()
+{
+    {
+        std::lock_guard lock(_state->mutex);
+        _state->stopping = true;
+    }
+    _state->free_cv.notify_all();
+    _workers.clear();
+}
+
+bool BatchLoader::start()
+{
+    if (!_workers.empty()) return false;
+    auto denom = _options.scale_denom;
+    if (denom != 1 && denom != 2 && denom != 4 && denom != 8) {
+        spdlog::error("BatchLoader: scale_denom must be 1, 2, 4 or 8, not {}.", denom);
+        return false;
+    }
+    if (_options.batch_size == 0) return false;
+
+    std::optional<bool> h265;
+    std::uint32_t width = 0;
+    std::uint32_t height = 0;
+    for (const auto &path : _paths) {
+        MappedFile file(path);
+        if (!file.is_open()) return false;
+        MkvScanner scanner(file.data());
+        if (!scanner.open()) {
+            spdlog::error("{}: {}", path.string(), scanner.error());
+            return false;
+        }
+        const auto &tracks = scanner.tracks();
+        auto track = std::find_if(tracks.begin(), tracks.end(), [](const MkvTrack &t) {
+            return t.codec_id == HevcCodecId || t.codec_id == JpegCodecId;
+        });
+        if (track == tracks.end()) {
+            spdlog::error("{}: no H.265 or M-JPEG track.", path.string());
+            return false;
+        }
+        auto is_h265 = track->codec_id == HevcCodecId;
+        if ((h265 && *h265 != is_h265) || (width && track->width && track->width != width) ||
+            (height && track->height && track->height != height)) {
+            spdlog::error("{}: not the codec or size of the other segments.", path.string());
+            return false;
+        }
+        h265 = is_h265;
+        width = std::max(width, track->width);
+        height = std::max(height, track->height);
+
+        Input input{path, std::move(file), track->number, std::nullopt, {}};
+        if (is_h265 && !(input.config = parse_hvcc(track->codec_private))) {
+            spdlog::error("{}: invalid HEVC codec private data.", path.string());
+            return false;
+        }
+        std::error_code ec;
+        auto sidecar = find_sidecar(path);
+        if (fs::exists(sidecar, ec)) {
+            input.records = read_sidecar(sidecar);
+        }
+        _inputs.push_back(std::move(input));
+    }
+    _h265 = h265.value_or(false);
+
+    auto &state = *_state;
+    if (!_h265) {
+        for (std::uint32_t s = 0; s < _inputs.size(); ++s) {
+            MkvScanner scanner(_inputs[s].file.data());
+            scanner.open();
+            std::uint32_t frame = 0;
+            scanner.scan([&](const MkvBlock &block) {
+                if (block.track != _inputs[s].track) return true;
+                state.jobs.push_back(
+                    {s,
+                     frame++,
+                     block.offset,
+                     static_cast<std::uint32_t>(block.payload.size()),
+                     block.pts}
+                );
+                return true;
+            });
+        }
+        // M-JPEG tracks do not always carry their size; the first frame does.
+        if ((width == 0 || height == 0) && !state.jobs.empty()) {
+            const auto &job = state.jobs.front();
+            auto jpeg = _inputs[job.segment].file.data().subspan(job.offset, job.size);
+            std::unique_ptr<void, decltype(&tj3Destroy)> handle(
+                tj3Init(TJINIT_DECOMPRESS), tj3Destroy
+            );
+            if (handle && tj3DecompressHeader(handle.get(), jpeg.data(), jpeg.size()) == 0) {
+                width = tj3Get(handle.get(), TJPARAM_JPEGWIDTH);
+                height = tj3Get(handle.get(), TJPARAM_JPEGHEIGHT);
+            }
+        }
+    }
+    if (width == 0 || height == 0) {
+        spdlog::error("BatchLoader: the recordings do not give their frame size.");
+        return false;
+    }
+    // Rounded up, as TurboJPEG scales.
+    _width = static_cast<int>((width + denom - 1) / denom);
+    _height = static_cast<int>((height + denom - 1) / denom);
+    _channels = _options.format == Format::Gray ? 1 : 3;
+
+    auto frame_bytes = static_cast<std::size_t>(_width) * _height * _channels;
+    for (std::size_t i = 0; i <= _options.prefetch; ++i) {
+        auto batch = std::make_unique<Batch>();
+        batch->_data.resize(_options.batch_size * frame_bytes);
+        batch->_info.resize(_options.batch_size);
+        batch->_valid.resize(_options.batch_size);
+        batch->_width = _width;
+        batch->_height = _height;
+        batch->_channels = _channels;
+        batch->_frame_bytes = frame_bytes;
+        state.free.push_back(batch.get());
+        state.batches.push_back(std::move(batch));
+    }
+
+    auto hardware = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    auto workers = _options.workers > 0 ? _options.workers
+                   : _h265              ? std::max(1, hardware / 4)
+                                        : hardware;
+    if (_h265) {
+        workers = std::min(workers, static_cast<int>(_inputs.size()));
+    }
+    state.running = std::max(workers, 0);
+    state.done = workers <= 0;
+    state.started = state.finished = std::chrono::steady_clock::now();
+    for (auto i = 0; i < workers; ++i) {
+        _workers.emplace_back([this] { _h265 ? decode_h265() : decode_jpeg(); });
+    }
+    return true;
+}
+
+BatchLoader::BatchPtr BatchLoader::next()
+{
+    auto &state = *_state;
+    std::unique_lock lock(state.mutex);
+    while (true) {
+        state.ready_cv.wait(lock, [&] {
+            return state.ready.contains(state.delivered) || state.done || state.stopping;
+        });
+        auto it = state.ready.find(state.delivered);
+        if (it == state.ready.end()) return nullptr;
+        auto batch = it->second;
+        state.ready.erase(it);
+        ++state.delivered;
+        if (batch->_size == 0) {
+            state.free.push_back(batch);
+            state.free_cv.notify_one();
+            continue;
+        }
+        ++state.stats.batches;
+        return BatchPtr(batch, [shared = _state](const Batch *returned) {
+            {
+                std::lock_guard lock(shared->mutex);
+                shared->free.push_back(const_cast<Batch *>(returned));
+            }
+            shared->free_cv.notify_one();
+        });
+    }
+}
+
+BatchLoader::Stats BatchLoader::stats() const
+{
+    std::lock_guard lock(_state->mutex);
+    auto stats = _state->stats;
+    stats.bytes = _state->bytes;
+    auto end = _state->done ? _state->finished : std::chrono::steady_clock::now();
+    stats.elapsed = end - _state->started;
+    return stats;
+}
+
+std::optional<BatchLoader::Slot> BatchLoader::claim(std::size_t *job)
+{
+    auto &state = *_state;
+    std::unique_lock lock(state.mutex);
+    // Taking the job with the slot keeps M-JPEG frames in order across the batches.
+    if (job && state.next_job >= state.jobs.size()) return std::nullopt;
+
+    auto filling = state.filling;
+    if (filling && filling->_claimed == _options.batch_size) {
+        state.filling = nullptr;
+        if (filling->_completed == filling->_claimed) publish(filling);
+    }
+    if (!state.filling) {
+        state.free_cv.wait(lock, [&] { return !state.free.empty() || state.stopping; });
+        if (state.stopping) return std::nullopt;
+        filling = state.free.back();
+        state.free.pop_back();
+        filling->_size = 0;
+        filling->_claimed = 0;
+        filling->_completed = 0;
+        filling->_sequence = state.next_sequence++;
+        state.filling = filling;
+    }
+    if (job) *job = state.next_job++;
+    return Slot{state.filling, state.filling->_claimed++};
+}
+
+void BatchLoader::complete(const Slot &slot, const FrameInfo &info, bool ok)
+{
+    auto &state = *_state;
+    std::lock_guard lock(state.mutex);
+    auto batch = slot.batch;
+    batch->_info[slot.position] = info;
+    batch->_valid[slot.position] = ok;
+    ++batch->_completed;
+    ++(ok ? state.stats.frames : state.stats.failed);
+    if (batch != state.filling && batch->_completed == batch->_claimed) {
+        publish(batch);
+    }
+}
+
+void BatchLoader::publish(Batch *batch)
+{
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < batch->_claimed; ++i) {
+        if (!batch->_valid[i]) continue;
+        if (kept != i) {
+            std::memmove(
+                batch->_data.data() + kept * batch->_frame_bytes,
+                batch->_data.data() + i * batch->_frame_bytes,
+                batch->_frame_bytes
+            );
+            batch->_info[kept] = batch->_info[i];
+        }
+        ++kept;
+    }
+    batch->_size = kept;
+    _state->ready.emplace(batch->_sequence, batch);
+    _state->ready_cv.notify_all();
+}
+
+void BatchLoader::finish_worker()
+{
+    auto &state = *_state;
+    std::lock_guard lock(state.mutex);
+    if (--state.running > 0) return;
+    // Every claimed frame is complete once the last worker is out.
+    if (auto batch = std::exchange(state.filling, nullptr)) {
+        publish(batch);
+    }
+    state.done = true;
+    state.finished = std::chrono::steady_clock::now();
+    state.ready_cv.notify_all();
+}
+
+void BatchLoader::decode_jpeg()
+{
+    std::unique_ptr<void, decltype(&tj3Destroy)> handle(tj3Init(TJINIT_DECOMPRESS), tj3Destroy);
+    if (!handle) {
+        spdlog::error("BatchLoader: failed to create a TurboJPEG decompressor.");
+        finish_worker();
+        return;
+    }
+    tj3Set(handle.get(), TJPARAM_FASTDCT, 1);
+    tj3Set(handle.get(), TJPARAM_FASTUPSAMPLE, 1);
+    tjscalingfactor factor{1, _options.scale_denom};
+    tj3SetScalingFactor(handle.get(), factor);
+    auto format = tj_format(_options.format);
+
+    std::size_t index = 0;
+    while (auto slot = claim(&index)) {
+        const auto &job = _state->jobs[index];
+        const auto &input = _inputs[job.segment];
+        auto jpeg = input.file.data().subspan(job.offset, job.size);
+        auto out = slot->batch->_data.data() + slot->position * slot->batch->_frame_bytes;
+
+        auto ok = tj3DecompressHeader(handle.get(), jpeg.data(), jpeg.size()) == 0 &&
+                  TJSCALED(tj3Get(handle.get(), TJPARAM_JPEGWIDTH), factor) == _width &&
+                  TJSCALED(tj3Get(handle.get(), TJPARAM_JPEGHEIGHT), factor) == _height;
+        // Warnings, such as a few corrupt bytes, still produce the image.
+        ok = ok && (tj3Decompress8(
+                        handle.get(), jpeg.data(), jpeg.size(), out, _width * _channels, format
+                    ) == 0 ||
+                    tj3GetErrorCode(handle.get()) == TJERR_WARNING);
+
+        FrameInfo info{job.pts, 0, 0, job.segment, job.frame};
+        if (job.frame < input.records.size()) {
+            info.timestamp = input.records[job.frame].fpga_timestamp;
+            info.sample = input.records[job.frame].rhythm_timestamp;
+        }
+        _state->bytes += job.size;
+        complete(*slot, info, ok);
+    }
+    finish_worker();
+}
+
+void BatchLoader::decode_h265()
+{
+    SegmentDecoder decoder(gst_format(_options.format), _width, _height);
+    auto row_bytes = static_cast<std::size_t>(_width) * _channels;
+
+    struct Pending {
+        std::int64_t pts;
+        std::uint32_t frame;
+    };
+    std::deque<Pending> pending;
+    std::uint32_t segment = 0;
+    auto stopped = false;
+
+    // Copies every frame waiting in the appsink into the batches.
+    auto drain = [&] {
+        while (auto sample = decoder.pull()) {
+            Frame frame(sample);
+            auto pts = static_cast<std::int64_t>(frame.pts());
+            while (pending.size() > 1 && pending.front().pts != pts) {
+                pending.pop_front();
+                std::lock_guard lock(_state->mutex);
+                ++_state->stats.failed;
+            }
+            if (pending.empty()) continue;
+            auto number = pending.front().frame;
+            pending.pop_front();
+
+            auto slot = claim();
+            if (!slot) {
+                stopped = true;
+                return;
+            }
+            auto ok = frame.valid() && frame.width() == _width && frame.height() == _height;
+            if (ok) {
+                auto out = slot->batch->_data.data() + slot->position * slot->batch->_frame_bytes;
+                for (auto row = 0; row < _height; ++row) {
+                    auto in = frame.data() + static_cast<std::size_t>(row) * frame.stride();
+                    std::memcpy(out + row * row_bytes, in, row_bytes);
+                }
+            }
+            const auto &input = _inputs[segment];
+            FrameInfo info{pts, 0, 0, segment, number};
+            if (number < input.records.size()) {
+                info.timestamp = input.records[number].fpga_timestamp;
+                info.sample = input.records[number].rhythm_timestamp;
+            }
+            complete(*slot, info, ok);
+        }
+    };
+
+    while (decoder.ok() && !stopped) {
+        {
+            std::lock_guard lock(_state->mutex);
+            if (_state->next_segment >= _inputs.size()) break;
+            segment = static_cast<std::uint32_t>(_state->next_segment++);
+        }
+        const auto &input = _inputs[segment];
+        MkvScanner scanner(input.file.data());
+        scanner.open();
+        decoder.begin();
+        pending.clear();
+
+        std::vector<std::uint8_t> au;
+        std::uint32_t number = 0;
+        auto parameter_sets_sent = false;
+        scanner.scan([&](const MkvBlock &block) {
+            if (block.track != input.track) return true;
+            au.clear();
+            if (!parameter_sets_sent) {
+                au = input.config->parameter_sets;
+                parameter_sets_sent = true;
+            }
+            if (!append_byte_stream(block.payload, input.config->length_size, au)) {
+                spdlog::error(
+                    "{}: malformed access unit at {}", input.path.string(), block.offset
+                );
+                return false;
+            }
+            auto buffer = gst_buffer_new_allocate(nullptr, au.size(), nullptr);
+            gst_buffer_fill(buffer, 0, au.data(), au.size());
+            GST_BUFFER_PTS(buffer) = block.pts >= 0 ? block.pts : GST_CLOCK_TIME_NONE;
+            if (!block.keyframe) {
+                GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+            }
+            pending.push_back({static_cast<std::int64_t>(GST_BUFFER_PTS(buffer)), number++});
+            _state->bytes += block.payload.size();
+            if (!decoder.push(buffer)) return false;
+            drain();
+            return !stopped;
+        });
+        decoder.end();
+        drain();
+        std::lock_guard lock(_state->mutex);
+        _state->stats.failed += pending.size();
+    }
+    finish_worker();
+}
+
+}  // namespace xvc
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <thread>
+#include <vector>
+
+
+namespace xvc
+{
+
+// Decodes whole recordings into fixed-size batches of frames for training and offline analysis,
+// as fast as the disk and the cores allow. The segments are mapped and their blocks read straight
+// from the Matroska structure. M-JPEG frames are decoded frame-parallel with TurboJPEG directly
+// into the batch; H.265 segments are decoded segment-parallel, one decoder per worker. Every
+// batch is one preallocated allocation of `size()` frames back to back, recycled once the caller
+// drops it, so at most `prefetch` batches are decoded ahead of the caller.
+//
+// M-JPEG batches hold consecutive frames in segment order. H.265 batches mix the frames of the
+// segments being decoded at the same time; each frame's FrameInfo says where it came from.
+class BatchLoader
+{
+public:
+    enum class Format { RGB, BGR, Gray };
+
+    struct Options {
+        std::size_t batch_size = 32;
+        Format format = Format::RGB;
+        // Decode at 1/2, 1/4 or 1/8 of the recorded size.
+        int scale_denom = 1;
+        // 0: one per hardware thread for M-JPEG, one per four for H.265, whose decoders are
+        // threaded themselves.
+        int workers = 0;
+        // Batches decoded ahead of the one the caller holds.
+        std::size_t prefetch = 4;
+    };
+
+    struct FrameInfo {
+        std::int64_t pts;          // In the segment, nanoseconds.
+        std::uint64_t timestamp;   // Hardware timestamp from the sidecar; 0 without one.
+        std::uint32_t sample;      // Ephys sample number from the sidecar.
+        std::uint32_t segment;     // Index into the segments given.
+        std::uint32_t frame;       // In the segment.
+    };
+
+    class Batch
+    {
+    public:
+        [[nodiscard]] std::size_t size() const { return _size; }
+        [[nodiscard]] std::uint64_t sequence() const { return _sequence; }
+        [[nodiscard]] int width() const { return _width; }
+        [[nodiscard]] int height() const { return _height; }
+        [[nodiscard]] int channels() const { return _channels; }
+        // Rows are packed, without padding.
+        [[nodiscard]] std::size_t frame_bytes() const { return _frame_bytes; }
+
+        [[nodiscard]] std::span<const std::uint8_t> data() const
+        {
+            return {_data.data(), _size * _frame_bytes};
+        }
+        [[nodiscard]] std::span<const std::uint8_t> frame(std::size_t i) const
+        {
+            return data().subspan(i * _frame_bytes, _frame_bytes);
+        }
+        [[nodiscard]] std::span<const FrameInfo> info() const { return {_info.data(), _size}; }
+
+    private:
+        friend class BatchLoader;
+
+        std::vector<std::uint8_t> _data;
+        std::vector<FrameInfo> _info;
+        std::vector<bool> _valid;
+        std::size_t _size;
+        std::size_t _claimed;
+        std::size_t _completed;
+        std::uint64_t _sequence;
+        int _width;
+        int _height;
+        int _channels;
+        std::size_t _frame_bytes;
+    };
+
+    using BatchPtr = std::shared_ptr<const Batch>;
+
+    struct Stats {
+        std::uint64_t frames;
+        std::uint64_t failed;   // Frames that did not decode, or not to the size of the others.
+        std::uint64_t batches;
+        std::uint64_t bytes;    // Compressed bytes read.
+        std::chrono::duration<double> elapsed;
+
+        [[nodiscard]] double frames_per_second() const
+        {
+            return elapsed.count() > 0 ? static_cast<double>(frames) / elapsed.count() : 0.0;
+        }
+    };
+
+    explicit BatchLoader(std::vector<std::filesystem::path> segments);
+    BatchLoader(std::vector<std::filesystem::path> segments, Options options);
+    ~BatchLoader();
+
+    BatchLoader(const BatchLoader &) = delete;
+    BatchLoader &operator=(const BatchLoader &) = delete;
+
+    // Maps the segments, allocates the batches and starts the workers. False if a segment is not
+    // an M-JPEG or H.265 recording, or the segments differ in codec or size.
+    bool start();
+
+    // Blocks for the next batch; the last one may be short. Null once every frame has been
+    // delivered. Batches may outlive the loader.
+    BatchPtr next();
+
+    // Of the frames in the batches, after scaling.
+    [[nodiscard]] int width() const { return _width; }
+    [[nodiscard]] int height() const { return _height; }
+    [[nodiscard]] Stats stats() const;
+
+private:
+    struct Input;
+    struct State;
+    struct Slot {
+        Batch *batch;
+        std::size_t position;
+    };
+
+    // Reserves the next position in the batch being filled, waiting for a free batch, and with
+    // `job` the next M-JPEG frame. Nothing once stopping or out of frames.
+    std::optional<Slot> claim(std::size_t *job = nullptr);
+    void complete(const Slot &slot, const FrameInfo &info, bool ok);
+    // Drops the frames that failed and queues the batch for next(). Called with the lock held.
+    void publish(Batch *batch);
+    void finish_worker();
+
+    void decode_jpeg();
+    void decode_h265();
+
+    std::vector<std::filesystem::path> _paths;
+    Options _options;
+    std::vector<Input> _inputs;
+    bool _h265;
+    int _width;
+    int _height;
+    int _channels;
+
+    std::shared_ptr<State> _state;
+    std::vector<std::jthread> _workers;
+};
+
+}  // namespace xvc
@@ -0,0 +1,477 @@
+#include "color_convert.h"
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define XVC_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(XVC_X86) && !defined(_MSC_VER)
+#define XVC_TARGET(isa) __attribute__((target(isa)))
+#else
+#define XVC_TARGET(isa)
+#endif
+
+
+namespace
+{
+
+using xvc::ColorMatrix;
+using xvc::RgbFormat;
+using xvc::SimdLevel;
+
+// Luma in Q14 and chroma in Q13, applied with a high multiply to luma shifted left by 7 and
+// chroma by 8, so every term lands in Q5 in a signed 16-bit lane and no sum can overflow. This
+// keeps the SIMD kernels bit-exact with the scalar one and every channel within 1 of the exact
+// conversion.
+struct Coefficients {
+    short y_offset;
+    short y;
+    short rv;
+    short gu;
+    short gv;
+    short bu;
+};
+
+constexpr Coefficients BT601{16, 19077, 13075, 3209, 6660, 16525};
+constexpr Coefficients BT709{16, 19077, 14686, 1747, 4366, 17305};
+constexpr Coefficients BT601Full{0, 16384, 11485, 2819, 5850, 14516};
+constexpr Coefficients BT709Full{0, 16384, 12901, 1535, 3835, 15201};
+
+const Coefficients &coefficients(ColorMatrix matrix)
+{
+    switch (matrix) {
+    case ColorMatrix::BT709: return BT709;
+    case ColorMatrix::BT601Full: return BT601Full;
+    case ColorMatrix::BT709Full: return BT709Full;
+    case ColorMatrix::BT601: break;
+    }
+    return BT601;
+}
+
+// _mm_mulhi_epi16 of a single lane.
+inline int mulhi(int a, short b)
+{
+    return (a * b) >> 16;
+}
+
+inline std::uint8_t clamp_u8(int value)
+{
+    return static_cast<std::uint8_t>(std::clamp(value, 0, 255));
+}
+
+// Converts pixels [begin, width) of one row. `u` and `v` point to the chroma row shared by this
+// row, with `chroma_step` bytes between horizontally adjacent samples (1 for I420, 2 for NV12).
+void row_scalar(
+    const std::uint8_t *y, const std::uint8_t *u, const std::uint8_t *v, int chroma_step,
+    std::uint8_t *dst, int begin, int width, RgbFormat format, const Coefficients &k
+)
+{
+    auto bpp = xvc::bytes_per_pixel(format);
+    for (auto x = begin; x < width; ++x) {
+        auto c = mulhi((y[x] - k.y_offset) << 7, k.y) + 16;
+        auto cu = (u[(x / 2) * chroma_step] - 128) << 8;
+        auto cv = (v[(x / 2) * chroma_step] - 128) << 8;
+        auto r = clamp_u8((c + mulhi(cv, k.rv)) >> 5);
+        auto g = clamp_u8((c - mulhi(cu, k.gu) - mulhi(cv, k.gv)) >> 5);
+        auto b = clamp_u8((c + mulhi(cu, k.bu)) >> 5);
+
+        auto out = dst + x * bpp;
+        switch (format) {
+        case RgbFormat::RGB:
+            out[0] = r;
+            out[1] = g;
+            out[2] = b;
+            break;
+        case RgbFormat::RGBA:
+            out[0] = r;
+            out[1] = g;
+            out[2] = b;
+            out[3] = 255;
+            break;
+        case RgbFormat::BGRx:
+            out[0] = b;
+            out[1] = g;
+            out[2] = r;
+            out[3] = 255;
+            break;
+        }
+    }
+}
+
+#ifdef XVC_X86
+
+using ShuffleMasks = std::array<std::array<std::array<char, 16>, 3>, 3>;
+
+// pshufb masks scattering 16 R, G and B bytes into three 16-byte blocks of packed RGB, indexed by
+// [block][channel].
+constexpr ShuffleMasks make_rgb_shuffle()
+{
+    ShuffleMasks masks{};
+    for (auto block = 0; block < 3; ++block) {
+        for (auto channel = 0; channel < 3; ++channel) {
+            for (auto i = 0; i < 16; ++i) {
+                auto p = block * 16 + i;
+                masks[block][channel][i] = p % 3 == channel ? static_cast<char>(p / 3) : -128;
+            }
+        }
+    }
+    return masks;
+}
+
+alignas(16) constexpr ShuffleMasks RgbShuffle = make_rgb_shuffle();
+
+XVC_TARGET("sse4.1")
+__m128i load_mask(int block, int channel)
+{
+    return _mm_load_si128(reinterpret_cast<const __m128i *>(RgbShuffle[block][channel].data()));
+}
+
+// Interleaves 16 pixels worth of R, G and B bytes into `dst`.
+XVC_TARGET("sse4.1")
+void store16(std::uint8_t *dst, __m128i r, __m128i g, __m128i b, RgbFormat format)
+{
+    if (format == RgbFormat::RGB) {
+        for (auto block = 0; block < 3; ++block) {
+            auto out = _mm_or_si128(
+                _mm_or_si128(
+                    _mm_shuffle_epi8(r, load_mask(block, 0)),
+                    _mm_shuffle_epi8(g, load_mask(block, 1))
+                ),
+                _mm_shuffle_epi8(b, load_mask(block, 2))
+            );
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + block * 16), out);
+        }
+        return;
+    }
+
+    if (format == RgbFormat::BGRx) {
+        std::swap(r, b);
+    }
+    auto a = _mm_set1_epi8(-1);
+    auto rg_lo = _mm_unpacklo_epi8(r, g);
+    auto rg_hi = _mm_unpackhi_epi8(r, g);
+    auto ba_lo = _mm_unpacklo_epi8(b, a);
+    auto ba_hi = _mm_unpackhi_epi8(b, a);
+    auto out = reinterpret_cast<__m128i *>(dst);
+    _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(rg_lo, ba_lo));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rg_lo, ba_lo));
+    _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rg_hi, ba_hi));
+    _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rg_hi, ba_hi));
+}
+
+// Loads the 8 U and 8 V samples covering 16 pixels starting at pixel `x`.
+XVC_TARGET("sse4.1")
+void load_chroma8(
+    const std::uint8_t *u, const std::uint8_t *v, int chroma_step, int x, __m128i &u8, __m128i &v8
+)
+{
+    if (chroma_step == 2) {
+        auto deinterleave = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+        auto uv = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(u + x)), deinterleave
+        );
+        u8 = uv;
+        v8 = _mm_srli_si128(uv, 8);
+    } else {
+        u8 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(u + x / 2));
+        v8 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(v + x / 2));
+    }
+}
+
+XVC_TARGET("sse4.1")
+void yuv_to_rgb_epi16(
+    __m128i y, __m128i u, __m128i v, const Coefficients &k, __m128i &r, __m128i &g, __m128i &b
+)
+{
+    auto c = _mm_add_epi16(
+        _mm_mulhi_epi16(
+            _mm_slli_epi16(_mm_sub_epi16(y, _mm_set1_epi16(k.y_offset)), 7), _mm_set1_epi16(k.y)
+        ),
+        _mm_set1_epi16(16)
+    );
+    u = _mm_slli_epi16(u, 8);
+    v = _mm_slli_epi16(v, 8);
+    r = _mm_srai_epi16(_mm_add_epi16(c, _mm_mulhi_epi16(v, _mm_set1_epi16(k.rv))), 5);
+    g = _mm_srai_epi16(
+        _mm_sub_epi16(
+            _mm_sub_epi16(c, _mm_mulhi_epi16(u, _mm_set1_epi16(k.gu))),
+            _mm_mulhi_epi16(v, _mm_set1_epi16(k.gv))
+        ),
+        5
+    );
+    b = _mm_srai_epi16(_mm_add_epi16(c, _mm_mulhi_epi16(u, _mm_set1_epi16(k.bu))), 5);
+}
+
+// Returns the first pixel left for the next kernel.
+XVC_TARGET("sse4.1")
+int row_sse41(
+    const std::uint8_t *y, const std::uint8_t *u, const std::uint8_t *v, int chroma_step,
+    std::uint8_t *dst, int begin, int width, RgbFormat format, const Coefficients &k
+)
+{
+    auto bpp = xvc::bytes_per_pixel(format);
+    auto bias = _mm_set1_epi16(128);
+    auto x = begin;
+    for (; x + 16 <= width; x += 16) {
+        __m128i u8, v8;
+        load_chroma8(u, v, chroma_step, x, u8, v8);
+        auto ud = _mm_unpacklo_epi8(u8, u8);
+        auto vd = _mm_unpacklo_epi8(v8, v8);
+        auto yy = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + x));
+
+        __m128i r_lo, g_lo, b_lo, r_hi, g_hi, b_hi;
+        yuv_to_rgb_epi16(
+            _mm_cvtepu8_epi16(yy),
+            _mm_sub_epi16(_mm_cvtepu8_epi16(ud), bias),
+            _mm_sub_epi16(_mm_cvtepu8_epi16(vd), bias),
+            k,
+            r_lo,
+            g_lo,
+            b_lo
+        );
+        yuv_to_rgb_epi16(
+            _mm_cvtepu8_epi16(_mm_srli_si128(yy, 8)),
+            _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(ud, 8)), bias),
+            _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_srli_si128(vd, 8)), bias),
+            k,
+            r_hi,
+            g_hi,
+            b_hi
+        );
+        store16(
+            dst + x * bpp,
+            _mm_packus_epi16(r_lo, r_hi),
+            _mm_packus_epi16(g_lo, g_hi),
+            _mm_packus_epi16(b_lo, b_hi),
+            format
+        );
+    }
+    return x;
+}
+
+XVC_TARGET("avx2")
+void yuv_to_rgb_epi16(
+    __m256i y, __m256i u, __m256i v, const Coefficients &k, __m256i &r, __m256i &g, __m256i &b
+)
+{
+    auto c = _mm256_add_epi16(
+        _mm256_mulhi_epi16(
+            _mm256_slli_epi16(_mm256_sub_epi16(y, _mm256_set1_epi16(k.y_offset)), 7),
+            _mm256_set1_epi16(k.y)
+        ),
+        _mm256_set1_epi16(16)
+    );
+    u = _mm256_slli_epi16(u, 8);
+    v = _mm256_slli_epi16(v, 8);
+    r = _mm256_srai_epi16(_mm256_add_epi16(c, _mm256_mulhi_epi16(v, _mm256_set1_epi16(k.rv))), 5);
+    g = _mm256_srai_epi16(
+        _mm256_sub_epi16(
+            _mm256_sub_epi16(c, _mm256_mulhi_epi16(u, _mm256_set1_epi16(k.gu))),
+            _mm256_mulhi_epi16(v, _mm256_set1_epi16(k.gv))
+        ),
+        5
+    );
+    b = _mm256_srai_epi16(_mm256_add_epi16(c, _mm256_mulhi_epi16(u, _mm256_set1_epi16(k.bu))), 5);
+}
+
+// Packs two vectors of 16 words into 32 bytes in pixel order.
+XVC_TARGET("avx2")
+__m256i pack_pixels(__m256i lo, __m256i hi)
+{
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+}
+
+XVC_TARGET("avx2")
+int row_avx2(
+    const std::uint8_t *y, const std::uint8_t *u, const std::uint8_t *v, int chroma_step,
+    std::uint8_t *dst, int begin, int width, RgbFormat format, const Coefficients &k
+)
+{
+    auto bpp = xvc::bytes_per_pixel(format);
+    auto bias = _mm256_set1_epi16(128);
+    auto x = begin;
+    for (; x + 32 <= width; x += 32) {
+        __m128i u_lo, v_lo, u_hi, v_hi;
+        load_chroma8(u, v, chroma_step, x, u_lo, v_lo);
+        load_chroma8(u, v, chroma_step, x + 16, u_hi, v_hi);
+        auto u16 = _mm_unpacklo_epi64(u_lo, u_hi);
+        auto v16 = _mm_unpacklo_epi64(v_lo, v_hi);
+
+        auto y0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + x));
+        auto y1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + x + 16));
+
+        __m256i r0, g0, b0, r1, g1, b1;
+        yuv_to_rgb_epi16(
+            _mm256_cvtepu8_epi16(y0),
+            _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(u16, u16)), bias),
+            _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(v16, v16)), bias),
+            k,
+            r0,
+            g0,
+            b0
+        );
+        yuv_to_rgb_epi16(
+            _mm256_cvtepu8_epi16(y1),
+            _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpackhi_epi8(u16, u16)), bias),
+            _mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_unpackhi_epi8(v16, v16)), bias),
+            k,
+            r1,
+            g1,
+            b1
+        );
+
+        auto r = pack_pixels(r0, r1);
+        auto g = pack_pixels(g0, g1);
+        auto b = pack_pixels(b0, b1);
+        store16(
+            dst + x * bpp,
+            _mm256_castsi256_si128(r),
+            _mm256_castsi256_si128(g),
+            _mm256_castsi256_si128(b),
+            format
+        );
+        store16(
+            dst + (x + 16) * bpp,
+            _mm256_extracti128_si256(r, 1),
+            _mm256_extracti128_si256(g, 1),
+            _mm256_extracti128_si256(b, 1),
+            format
+        );
+    }
+    return x;
+}
+
+#endif  // XVC_X86
+
+SimdLevel probe_simd_level()
+{
+#ifdef XVC_X86
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    auto max_leaf = info[0];
+    __cpuid(info, 1);
+    auto sse41 = (info[2] & (1 << 19)) != 0;
+    auto os_avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 &&
+                  (_xgetbv(0) & 0x6) == 0x6;
+    auto avx2 = false;
+    if (max_leaf >= 7 && os_avx) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    auto sse41 = __builtin_cpu_supports("sse4.1") != 0;
+    auto avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+    if (avx2) return SimdLevel::AVX2;
+    if (sse41) return SimdLevel::SSE41;
+#endif
+    return SimdLevel::Scalar;
+}
+
+void convert(
+    const std::uint8_t *y, int y_stride, const std::uint8_t *u, int u_stride,
+    const std::uint8_t *v, int v_stride, int chroma_step, std::uint8_t *dst, int dst_stride,
+    int width, int height, RgbFormat format, ColorMatrix matrix, SimdLevel level
+)
+{
+    level = std::min(level, xvc::detect_simd_level());
+    const auto &k = coefficients(matrix);
+
+    for (auto row = 0; row < height; ++row) {
+        auto y_row = y + static_cast<std::ptrdiff_t>(row) * y_stride;
+        auto u_row = u + static_cast<std::ptrdiff_t>(row / 2) * u_stride;
+        auto v_row = v + static_cast<std::ptrdiff_t>(row / 2) * v_stride;
+        auto dst_row = dst + static_cast<std::ptrdiff_t>(row) * dst_stride;
+
+        auto x = 0;
+#ifdef XVC_X86
+        if (level == SimdLevel::AVX2) {
+            x = row_avx2(y_row, u_row, v_row, chroma_step, dst_row, x, width, format, k);
+        }
+        if (level >= SimdLevel::SSE41) {
+            x = row_sse41(y_row, u_row, v_row, chroma_step, dst_row, x, width, format, k);
+        }
+#endif
+        row_scalar(y_row, u_row, v_row, chroma_step, dst_row, x, width, format, k);
+    }
+}
+
+}  // namespace
+
+
+namespace xvc
+{
+
+SimdLevel detect_simd_level()
+{
+    static const auto level = probe_simd_level();
+    return level;
+}
+
+const char *simd_level_name(SimdLevel level)
+{
+    switch (level) {
+    case SimdLevel::AVX2: return "AVX2";
+    case SimdLevel::SSE41: return "SSE4.1";
+    case SimdLevel::Scalar: break;
+    }
+    return "scalar";
+}
+
+void nv12_to_rgb(
+    const std::uint8_t *y, int y_stride, const std::uint8_t *uv, int uv_stride, std::uint8_t *dst,
+    int dst_stride, int width, int height, RgbFormat format, ColorMatrix matrix, SimdLevel level
+)
+{
+    convert(
+        y,
+        y_stride,
+        uv,
+        uv_stride,
+        uv + 1,
+        uv_stride,
+        2,
+        dst,
+        dst_stride,
+        width,
+        height,
+        format,
+        matrix,
+        level
+    );
+}
+
+void i420_to_rgb(
+    const std::uint8_t *y, int y_stride, const std::uint8_t *u, int u_stride,
+    const std::uint8_t *v, int v_stride, std::uint8_t *dst, int dst_stride, int width, int height,
+    RgbFormat format, ColorMatrix matrix, SimdLevel level
+)
+{
+    convert(
+        y,
+        y_stride,
+        u,
+        u_stride,
+        v,
+        v_stride,
+        1,
+        dst,
+        dst_stride,
+        width,
+        height,
+        format,
+        matrix,
+        level
+    );
+}
+
+}  // namespace xvc
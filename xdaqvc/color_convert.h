@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+
+namespace xvc
+{
+
+// Packed output layouts of the YUV 4:2:0 to RGB kernels.
+enum class RgbFormat { RGB, RGBA, BGRx };
+
+// YUV matrices, for limited-range (16-235) input unless marked full-range (0-255).
+enum class ColorMatrix { BT601, BT709, BT601Full, BT709Full };
+
+enum class SimdLevel { Scalar, SSE41, AVX2 };
+
+// Best kernel supported by the running CPU. Evaluated once.
+[[nodiscard]] SimdLevel detect_simd_level();
+[[nodiscard]] const char *simd_level_name(SimdLevel level);
+
+// All kernels produce bit-identical output; `level` is clamped to what the CPU supports.
+void nv12_to_rgb(
+    const std::uint8_t *y, int y_stride, const std::uint8_t *uv, int uv_stride, std::uint8_t *dst,
+    int dst_stride, int width, int height, RgbFormat format, ColorMatrix matrix,
+    SimdLevel level = detect_simd_level()
+);
+
+void i420_to_rgb(
+    const std::uint8_t *y, int y_stride, const std::uint8_t *u, int u_stride,
+    const std::uint8_t *v, int v_stride, std::uint8_t *dst, int dst_stride, int width, int height,
+    RgbFormat format, ColorMatrix matrix, SimdLevel level = detect_simd_level()
+);
+
+[[nodiscard]] constexpr int bytes_per_pixel(RgbFormat format)
+{
+    return format == RgbFormat::RGB ? 3 : 4;
+}
+
+}  // namespace xvc
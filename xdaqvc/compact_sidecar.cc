@@ -0,0 +1,369 @@
+#include "compact_sidecar.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <boost/crc.hpp>
+#include <cstring>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+
+constexpr char FileMagic[8] = {'X', 'V', 'C', 'M', 'E', 'T', 'A', '1'};
+constexpr char EndMagic[8] = {'X', 'V', 'C', 'M', 'E', 'N', 'D', '1'};
+constexpr std::uint32_t BlockMagic = 0x4B4C4258;  // "XBLK"
+constexpr std::uint32_t Version = 1;
+
+struct FileHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t record_size;
+};
+
+// Followed by one column of `count` varints per field, `size` bytes in all.
+struct BlockHeader {
+    std::uint32_t magic;
+    std::uint32_t count;
+    std::uint32_t size;
+    std::uint32_t crc;
+};
+
+// Follows the block index: an offset and a first record number per block.
+struct Trailer {
+    std::uint64_t index_offset;
+    std::uint64_t records;
+    std::uint32_t blocks;
+    std::uint32_t crc;
+    char magic[8];
+};
+
+std::uint32_t crc32(const void *data, std::size_t size)
+{
+    boost::crc_32_type crc;
+    crc.process_bytes(data, size);
+    return crc.checksum();
+}
+
+// Calls `f` with a pointer to each field of SidecarRecord, in the order of the columns.
+template <typename F>
+void for_each_field(F &&f)
+{
+    f(&xvc::SidecarRecord::pts);
+    f(&xvc::SidecarRecord::fpga_timestamp);
+    f(&xvc::SidecarRecord::rhythm_timestamp);
+    f(&xvc::SidecarRecord::ttl_in);
+    f(&xvc::SidecarRecord::ttl_out);
+    f(&xvc::SidecarRecord::spi_perf_counter);
+    f(&xvc::SidecarRecord::reserved);
+}
+
+void put_varint(std::vector<std::uint8_t> &out, std::uint64_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(static_cast<std::uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(static_cast<std::uint8_t>(value));
+}
+
+// Every field takes a varint of at least one byte, which bounds the records a block can hold.
+constexpr std::size_t FieldCount = 7;
+
+bool plausible(const BlockHeader &header)
+{
+    return header.magic == BlockMagic && std::uint64_t(header.count) * FieldCount <= header.size;
+}
+
+bool get_varints(const std::uint8_t *&p, const std::uint8_t *end, std::uint64_t *out, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; ++i) {
+        // Deltas of a single byte are the common case.
+        if (p < end && *p < 0x80) {
+            out[i] = *p++;
+            continue;
+        }
+        std::uint64_t value = 0;
+        for (auto shift = 0;; shift += 7) {
+            if (p == end || shift > 63) return false;
+            auto byte = *p++;
+            value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) break;
+        }
+        out[i] = value;
+    }
+    return true;
+}
+
+}  // namespace
+
+
+namespace xvc
+{
+
+CompactSidecarWriter::CompactSidecarWriter(const fs::path &path, std::size_t block_records)
+    : _out(path, std::ios::binary | std::ios::trunc),
+      _block_records(std::max<std::size_t>(block_records, 1)),
+      _records(0),
+      _offset(sizeof(FileHeader)),
+      _failed(false)
+{
+    FileHeader header{};
+    std::memcpy(header.magic, FileMagic, sizeof(FileMagic));
+    header.version = Version;
+    header.record_size = sizeof(SidecarRecord);
+    _out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    _failed = !_out;
+    if (_failed) {
+        spdlog::error("{}: could not be created", path.string());
+    }
+    _block.reserve(_block_records);
+}
+
+CompactSidecarWriter::~CompactSidecarWriter() { close(); }
+
+bool CompactSidecarWriter::append(const SidecarRecord &record)
+{
+    if (!is_open()) return false;
+    _block.push_back(record);
+    return _block.size() < _block_records || flush_block();
+}
+
+bool CompactSidecarWriter::close()
+{
+    if (!_out.is_open()) return !_failed;
+    if (!_failed && flush_block()) {
+        std::vector<std::uint64_t> index;
+        for (const auto &block : _blocks) {
+            index.push_back(block.offset);
+            index.push_back(block.first_record);
+        }
+        auto index_bytes = index.size() * sizeof(std::uint64_t);
+        Trailer trailer{
+            _offset,
+            _records,
+            static_cast<std::uint32_t>(_blocks.size()),
+            crc32(index.data(), index_bytes),
+            {}
+        };
+        std::memcpy(trailer.magic, EndMagic, sizeof(EndMagic));
+        _out.write(reinterpret_cast<const char *>(index.data()), index_bytes);
+        _out.write(reinterpret_cast<const char *>(&trailer), sizeof(trailer));
+    }
+    _out.close();
+    _failed = _failed || !_out;
+    return !_failed;
+}
+
+bool CompactSidecarWriter::flush_block()
+{
+    if (_block.empty()) return !_failed;
+
+    _encoded.clear();
+    for_each_field([&](auto member) {
+        using T = std::remove_cvref_t<decltype(_block.front().*member)>;
+        T previous = 0;
+        for (const auto &record : _block) {
+            auto delta = static_cast<std::make_signed_t<T>>(record.*member - previous);
+            auto wide = static_cast<std::int64_t>(delta);
+            put_varint(_encoded, (static_cast<std::uint64_t>(wide) << 1) ^ (wide >> 63));
+            previous = record.*member;
+        }
+    });
+    BlockHeader header{
+        BlockMagic,
+        static_cast<std::uint32_t>(_block.size()),
+        static_cast<std::uint32_t>(_encoded.size()),
+        crc32(_encoded.data(), _encoded.size())
+    };
+    _out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    _out.write(reinterpret_cast<const char *>(_encoded.data()), _encoded.size());
+    // Complete blocks reach the file, so a crash loses at most the one being filled.
+    _out.flush();
+    _failed = !_out;
+
+    _blocks.push_back({_offset, _records});
+    _records += _block.size();
+    _offset += sizeof(header) + _encoded.size();
+    _block.clear();
+    return !_failed;
+}
+
+CompactSidecarReader::CompactSidecarReader(const fs::path &path)
+    : _file(path, MappedFile::Access::Random), _records(0), _open(false), _recovered(false)
+{
+    auto data = _file.data();
+    FileHeader header;
+    if (data.size() < sizeof(header)) return;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, FileMagic, sizeof(FileMagic)) != 0 ||
+        header.version != Version || header.record_size != sizeof(SidecarRecord)) {
+        spdlog::error("{}: not a compact sidecar", path.string());
+        return;
+    }
+    _open = true;
+    if (!load_index()) {
+        walk_blocks();
+        _recovered = true;
+    }
+}
+
+bool CompactSidecarReader::read(
+    std::uint64_t first, std::size_t count, std::vector<SidecarRecord> &out
+) const
+{
+    out.clear();
+    auto end = std::min<std::uint64_t>(first + count, _records);
+    if (first >= end) return true;
+    out.reserve(end - first);
+
+    auto block = std::upper_bound(
+        _blocks.begin(),
+        _blocks.end(),
+        first,
+        [](std::uint64_t record, const Block &b) { return record < b.first_record; }
+    );
+    std::vector<SidecarRecord> decoded;
+    for (--block; block != _blocks.end() && block->first_record < end; ++block) {
+        if (!decode(*block, decoded)) return false;
+        auto from = std::max(first, block->first_record) - block->first_record;
+        auto to = std::min<std::uint64_t>(end - block->first_record, block->count);
+        out.insert(out.end(), decoded.begin() + from, decoded.begin() + to);
+    }
+    return true;
+}
+
+bool CompactSidecarReader::load_index()
+{
+    auto data = _file.data();
+    Trailer trailer;
+    if (data.size() < sizeof(FileHeader) + sizeof(trailer)) return false;
+    std::memcpy(&trailer, data.data() + data.size() - sizeof(trailer), sizeof(trailer));
+    auto index_bytes = std::uint64_t(trailer.blocks) * 2 * sizeof(std::uint64_t);
+    if (std::memcmp(trailer.magic, EndMagic, sizeof(EndMagic)) != 0 ||
+        trailer.index_offset > data.size() ||
+        trailer.index_offset + index_bytes + sizeof(trailer) != data.size() ||
+        crc32(data.data() + trailer.index_offset, index_bytes) != trailer.crc) {
+        return false;
+    }
+
+    std::vector<Block> blocks;
+    std::uint64_t records = 0;
+    for (std::uint32_t i = 0; i < trailer.blocks; ++i) {
+        std::uint64_t entry[2];
+        std::memcpy(entry, data.data() + trailer.index_offset + i * sizeof(entry), sizeof(entry));
+        BlockHeader header;
+        if (entry[0] < sizeof(FileHeader) || entry[0] + sizeof(header) > trailer.index_offset ||
+            entry[1] != records) {
+            return false;
+        }
+        std::memcpy(&header, data.data() + entry[0], sizeof(header));
+        if (!plausible(header) ||
+            header.size > trailer.index_offset - entry[0] - sizeof(header)) {
+            return false;
+        }
+        blocks.push_back({static_cast<std::size_t>(entry[0]), entry[1], header.count});
+        records += header.count;
+    }
+    if (records != trailer.records) return false;
+    _blocks = std::move(blocks);
+    _records = records;
+    return true;
+}
+
+void CompactSidecarReader::walk_blocks()
+{
+    auto data = _file.data();
+    std::size_t pos = sizeof(FileHeader);
+    while (pos + sizeof(BlockHeader) <= data.size()) {
+        BlockHeader header;
+        std::memcpy(&header, data.data() + pos, sizeof(header));
+        if (!plausible(header) || header.size > data.size() - pos - sizeof(header)) break;
+        _blocks.push_back({pos, _records, header.count});
+        _records += header.count;
+        pos += sizeof(header) + header.size;
+    }
+}
+
+bool CompactSidecarReader::decode(const Block &block, std::vector<SidecarRecord> &records) const
+{
+    auto data = _file.data();
+    BlockHeader header;
+    if (block.offset + sizeof(header) > data.size()) return false;
+    std::memcpy(&header, data.data() + block.offset, sizeof(header));
+    if (header.count != block.count || !plausible(header) ||
+        header.size > data.size() - block.offset - sizeof(header)) {
+        spdlog::error("Compact sidecar: malformed block at {}", block.offset);
+        return false;
+    }
+    auto p = data.data() + block.offset + sizeof(header);
+    auto end = p + header.size;
+    if (crc32(p, header.size) != header.crc) {
+        spdlog::error("Compact sidecar: checksum mismatch in the block at {}", block.offset);
+        return false;
+    }
+
+    records.resize(block.count);
+    std::vector<std::uint64_t> column(block.count);
+    auto ok = true;
+    for_each_field([&](auto member) {
+        using T = std::remove_cvref_t<decltype(records.front().*member)>;
+        if (!ok || !(ok = get_varints(p, end, column.data(), column.size()))) return;
+        // Undoing the zigzag is branch-free and vectorizes; the prefix sum is one add per record.
+        for (auto &value : column) {
+            value = (value >> 1) ^ (0 - (value & 1));
+        }
+        T previous = 0;
+        for (std::size_t i = 0; i < column.size(); ++i) {
+            previous = static_cast<T>(previous + static_cast<T>(column[i]));
+            records[i].*member = previous;
+        }
+    });
+    return ok && p == end;
+}
+
+bool compact_sidecar(const fs::path &bin, const fs::path &compact)
+{
+    std::error_code ec;
+    if (!fs::exists(bin, ec)) return false;
+    std::vector<SidecarRecord> records;
+    {
+        // The .bin is deleted once compacted, so anything but whole records keeps it.
+        MappedFile file(bin);
+        auto data = file.data();
+        if (!file.is_open() || data.size() % sizeof(SidecarRecord) != 0) {
+            spdlog::error("{}: not a complete sidecar, not compacted", bin.string());
+            return false;
+        }
+        records.resize(data.size() / sizeof(SidecarRecord));
+        if (!records.empty()) {
+            std::memcpy(records.data(), data.data(), data.size());
+        }
+    }
+
+    auto partial = fs::path(compact) += ".part";
+    CompactSidecarWriter writer(partial);
+    for (const auto &record : records) {
+        writer.append(record);
+    }
+    if (!writer.close() || CompactSidecarReader(partial).size() != records.size()) {
+        spdlog::error("{}: could not be compacted", bin.string());
+        fs::remove(partial, ec);
+        return false;
+    }
+    fs::rename(partial, compact, ec);
+    if (ec) {
+        spdlog::error("{}: {}", compact.string(), ec.message());
+        fs::remove(partial, ec);
+        return false;
+    }
+    return true;
+}
+
+}  // namespace xvc
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "mapped_file.h"
+#include "sidecar.h"
+
+
+namespace xvc
+{
+
+// A sidecar encoded in blocks of records. Each field is stored as a column of zigzag varints of
+// the difference to the previous record of the block, so the nearly monotonic timestamps and
+// sample numbers take a byte or two and constant fields a single byte. Every block carries a
+// CRC-32 and decodes on its own; a block index at the end of the file maps record numbers to
+// blocks. A file whose writer never closed it is still read, block by block, up to its last
+// complete block.
+//
+//   header | block ... | block index | trailer
+//
+// Compact sidecars use the .xbin extension.
+
+class CompactSidecarWriter
+{
+public:
+    explicit CompactSidecarWriter(
+        const std::filesystem::path &path, std::size_t block_records = 4096
+    );
+    // Closes the file if close() was not called.
+    ~CompactSidecarWriter();
+
+    CompactSidecarWriter(const CompactSidecarWriter &) = delete;
+    CompactSidecarWriter &operator=(const CompactSidecarWriter &) = delete;
+
+    [[nodiscard]] bool is_open() const { return _out.is_open() && !_failed; }
+
+    // Records are buffered until a block is full.
+    bool append(const SidecarRecord &record);
+    // Writes the last block and the block index.
+    bool close();
+
+private:
+    struct BlockEntry {
+        std::uint64_t offset;
+        std::uint64_t first_record;
+    };
+
+    bool flush_block();
+
+    std::ofstream _out;
+    std::size_t _block_records;
+    std::vector<SidecarRecord> _block;
+    std::vector<std::uint8_t> _encoded;
+    std::vector<BlockEntry> _blocks;
+    std::uint64_t _records;
+    std::uint64_t _offset;
+    bool _failed;
+};
+
+class CompactSidecarReader
+{
+public:
+    explicit CompactSidecarReader(const std::filesystem::path &path);
+
+    [[nodiscard]] bool is_open() const { return _open; }
+    [[nodiscard]] std::uint64_t size() const { return _records; }
+    // The block index was missing and rebuilt from the blocks.
+    [[nodiscard]] bool recovered() const { return _recovered; }
+
+    // Decodes records [first, first + count) into `out`; false if a block fails its checksum.
+    bool read(std::uint64_t first, std::size_t count, std::vector<SidecarRecord> &out) const;
+    bool read_all(std::vector<SidecarRecord> &out) const { return read(0, _records, out); }
+
+private:
+    struct Block {
+        std::size_t offset;
+        std::uint64_t first_record;
+        std::uint32_t count;
+    };
+
+    bool load_index();
+    void walk_blocks();
+    bool decode(const Block &block, std::vector<SidecarRecord> &records) const;
+
+    MappedFile _file;
+    std::vector<Block> _blocks;
+    std::uint64_t _records;
+    bool _open;
+    bool _recovered;
+};
+
+// Rewrites the .bin sidecar `bin` as the compact sidecar `compact`, atomically. False, with
+// nothing written, if `bin` cannot be read or ends in a partial record, or if `compact` does not
+// read back with as many records; `bin` is only safe to delete on true.
+bool compact_sidecar(const std::filesystem::path &bin, const std::filesystem::path &compact);
+
+}  // namespace xvc
@@ -0,0 +1,88 @@
+#include "decode_filter.h"
+
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+
+
+namespace
+{
+
+auto constexpr DataKey = "xvc-decode-filter";
+
+}  // namespace
+
+
+namespace xvc
+{
+
+DecodeFilter::DecodeFilter(DecodeMode mode, int prefix) : _mode(mode), _prefix(std::max(prefix, 1))
+{
+}
+
+DecodeFilter *DecodeFilter::attach(GstBin *bin, GstElement *element, DecodeMode mode, int prefix)
+{
+    auto pad = gst_element_get_static_pad(element, "sink");
+    if (!pad) {
+        spdlog::error("Decode filter: element has no sink pad.");
+        return nullptr;
+    }
+
+    auto self = new DecodeFilter(mode, prefix);
+    g_object_set_data_full(G_OBJECT(bin), DataKey, self, [](gpointer data) {
+        delete static_cast<DecodeFilter *>(data);
+    });
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, &DecodeFilter::on_buffer, self, nullptr);
+    gst_object_unref(pad);
+    return self;
+}
+
+DecodeFilter *DecodeFilter::find(GstBin *bin)
+{
+    return static_cast<DecodeFilter *>(g_object_get_data(G_OBJECT(bin), DataKey));
+}
+
+void DecodeFilter::set_mode(DecodeMode mode, int prefix)
+{
+    _prefix = std::max(prefix, 1);
+    _mode = mode;
+}
+
+DecodeFilter::Stats DecodeFilter::stats() const { return {_passed, _dropped}; }
+
+GstPadProbeReturn DecodeFilter::on_buffer(GstPad *, GstPadProbeInfo *info, gpointer data)
+{
+    auto self = static_cast<DecodeFilter *>(data);
+    auto buffer = gst_pad_probe_info_get_buffer(info);
+
+    if (!GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+        self->_since_keyframe = 0;
+        self->_gop_intact = true;
+    } else {
+        ++self->_since_keyframe;
+        // Whatever was lost before a discontinuity may be what this unit references.
+        if (GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DISCONT)) {
+            self->_gop_intact = false;
+        }
+    }
+
+    auto keep = false;
+    if (self->_gop_intact) {
+        switch (self->_mode.load()) {
+        case DecodeMode::All: keep = true; break;
+        case DecodeMode::Keyframes: keep = self->_since_keyframe == 0; break;
+        case DecodeMode::GopPrefix: keep = self->_since_keyframe < self->_prefix; break;
+        }
+    }
+
+    if (!keep) {
+        self->_gop_intact = false;
+        ++self->_dropped;
+        return GST_PAD_PROBE_DROP;
+    }
+    ++self->_passed;
+    return GST_PAD_PROBE_OK;
+}
+
+}  // namespace xvc
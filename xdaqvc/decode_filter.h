@@ -0,0 +1,56 @@
+#pragma once
+
+#include <gst/gstbin.h>
+#include <gst/gstpad.h>
+
+#include <atomic>
+#include <cstdint>
+
+#include "xvc.h"
+
+
+namespace xvc
+{
+
+// Drops access units in front of a decoder according to a DecodeMode that can be changed while
+// the pipeline runs. A frame is only let through when every frame since the last keyframe was, and
+// none went missing upstream (a DISCONT delta unit), so the decoder never sees a picture whose
+// references are missing; switching to a denser mode takes effect at the next keyframe.
+class DecodeFilter
+{
+public:
+    struct Stats {
+        std::uint64_t passed;
+        std::uint64_t dropped;
+    };
+
+    // Filters the buffers entering the sink pad of `element`, which must be in `bin`. The filter is
+    // owned by `bin`.
+    static DecodeFilter *attach(GstBin *bin, GstElement *element, DecodeMode mode, int prefix);
+
+    // Returns nullptr when `bin` has no decode filter.
+    static DecodeFilter *find(GstBin *bin);
+
+    void set_mode(DecodeMode mode, int prefix);
+    [[nodiscard]] Stats stats() const;
+
+    DecodeFilter(const DecodeFilter &) = delete;
+    DecodeFilter &operator=(const DecodeFilter &) = delete;
+
+private:
+    DecodeFilter(DecodeMode mode, int prefix);
+    ~DecodeFilter() = default;
+
+    static GstPadProbeReturn on_buffer(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+
+    std::atomic<DecodeMode> _mode;
+    std::atomic<int> _prefix;
+    std::atomic<std::uint64_t> _passed{0};
+    std::atomic<std::uint64_t> _dropped{0};
+
+    // Streaming thread only.
+    int _since_keyframe = 0;
+    bool _gop_intact = false;
+};
+
+}  // namespace xvc
@@ -0,0 +1,468 @@
+#include "direct_file_writer.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+#include <malloc.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+std::uint64_t align_up(std::uint64_t value, std::uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void keep_max(std::atomic<std::int64_t> &maximum, std::int64_t value)
+{
+    auto current = maximum.load();
+    while (value > current && !maximum.compare_exchange_weak(current, value)) {
+    }
+}
+
+std::chrono::microseconds since(Clock::time_point begin)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin);
+}
+
+std::uint8_t *aligned_allocate(std::size_t size)
+{
+#ifdef _WIN32
+    return static_cast<std::uint8_t *>(_aligned_malloc(size, xvc::DirectFileWriter::Alignment));
+#else
+    return static_cast<std::uint8_t *>(std::aligned_alloc(xvc::DirectFileWriter::Alignment, size));
+#endif
+}
+
+void aligned_free(std::uint8_t *data)
+{
+#ifdef _WIN32
+    _aligned_free(data);
+#else
+    std::free(data);
+#endif
+}
+
+}  // namespace
+
+
+namespace xvc
+{
+
+void WriteMeter::add_write(std::uint64_t bytes, std::chrono::microseconds latency)
+{
+    _bytes += bytes;
+    ++_writes;
+    _busy += latency.count();
+    keep_max(_max_latency, latency.count());
+}
+
+void WriteMeter::add_stall(std::chrono::microseconds stall) { keep_max(_max_stall, stall.count()); }
+
+WriteMeter::Stats WriteMeter::stats() const
+{
+    return {
+        _bytes.load(),
+        _writes.load(),
+        _patches.load(),
+        std::chrono::microseconds(_busy.load()),
+        std::chrono::microseconds(_max_latency.load()),
+        std::chrono::microseconds(_max_stall.load())
+    };
+}
+
+// One handle on the file, unbuffered or not.
+class DirectFileWriter::File
+{
+public:
+    ~File();
+
+    // Truncates the file if `create`. Without unbuffered I/O on the file system, falls back to
+    // the page cache.
+    bool open(const std::filesystem::path &path, bool create, bool direct);
+    [[nodiscard]] bool direct() const { return _direct; }
+
+    bool write(std::uint64_t offset, const std::uint8_t *data, std::size_t length);
+    // Allocates [0, end) without changing the size of the file.
+    bool reserve(std::uint64_t end);
+    // Sets the size of the file and frees what was reserved past it.
+    bool trim(std::uint64_t size, std::uint64_t reserved);
+
+private:
+    bool _direct = false;
+#ifdef _WIN32
+    HANDLE _handle = INVALID_HANDLE_VALUE;
+#else
+    int _fd = -1;
+#endif
+};
+
+#ifdef _WIN32
+
+DirectFileWriter::File::~File()
+{
+    if (_handle != INVALID_HANDLE_VALUE) CloseHandle(_handle);
+}
+
+bool DirectFileWriter::File::open(const std::filesystem::path &path, bool create, bool direct)
+{
+    auto flags = FILE_ATTRIBUTE_NORMAL | (direct ? FILE_FLAG_NO_BUFFERING : 0);
+    _handle = CreateFileW(
+        path.c_str(),
+        GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr,
+        create ? CREATE_ALWAYS : OPEN_EXISTING,
+        flags,
+        nullptr
+    );
+    if (_handle == INVALID_HANDLE_VALUE) {
+        spdlog::error("Failed to open {}: error {}", path.string(), GetLastError());
+        return false;
+    }
+    _direct = direct;
+    return true;
+}
+
+bool DirectFileWriter::File::write(
+    std::uint64_t offset, const std::uint8_t *data, std::size_t length
+)
+{
+    while (length > 0) {
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD written = 0;
+        auto chunk = static_cast<DWORD>(std::min<std::size_t>(length, 1 << 30));
+        if (!WriteFile(_handle, data, chunk, &written, &overlapped) || written == 0) return false;
+        offset += written;
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+bool DirectFileWriter::File::reserve(std::uint64_t end)
+{
+    FILE_ALLOCATION_INFO info{};
+    info.AllocationSize.QuadPart = static_cast<LONGLONG>(end);
+    return SetFileInformationByHandle(_handle, FileAllocationInfo, &info, sizeof(info));
+}
+
+bool DirectFileWriter::File::trim(std::uint64_t size, std::uint64_t)
+{
+    FILE_END_OF_FILE_INFO info{};
+    info.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+    if (!SetFileInformationByHandle(_handle, FileEndOfFileInfo, &info, sizeof(info))) return false;
+    // Shrinks the allocation to the end of the file.
+    FILE_ALLOCATION_INFO allocation{};
+    allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+    SetFileInformationByHandle(_handle, FileAllocationInfo, &allocation, sizeof(allocation));
+    return true;
+}
+
+#else
+
+DirectFileWriter::File::~File()
+{
+    if (_fd >= 0) ::close(_fd);
+}
+
+bool DirectFileWriter::File::open(const std::filesystem::path &path, bool create, bool direct)
+{
+    auto flags = O_WRONLY | O_CLOEXEC | (create ? O_CREAT | O_TRUNC : 0);
+#ifdef O_DIRECT
+    if (direct) {
+        _fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+        // EINVAL: the file system does not support it, as tmpfs.
+        _direct = _fd >= 0;
+    }
+#endif
+    if (_fd < 0) {
+        _fd = ::open(path.c_str(), flags, 0644);
+    }
+    if (_fd < 0) {
+        spdlog::error("Failed to open {}: {}", path.string(), std::strerror(errno));
+        return false;
+    }
+#ifdef __APPLE__
+    _direct = direct && fcntl(_fd, F_NOCACHE, 1) == 0;
+#endif
+    return true;
+}
+
+bool DirectFileWriter::File::write(
+    std::uint64_t offset, const std::uint8_t *data, std::size_t length
+)
+{
+    while (length > 0) {
+        auto written = pwrite(_fd, data, length, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        offset += written;
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+bool DirectFileWriter::File::reserve(std::uint64_t end)
+{
+#ifdef __linux__
+    return fallocate(_fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(end)) == 0;
+#elif __APPLE__
+    fstore_t store{F_ALLOCATEALL, F_PEOFPOSMODE, 0, static_cast<off_t>(end), 0};
+    struct stat st {};
+    if (fstat(_fd, &st) != 0) return false;
+    // Relative to the physical end of the file.
+    store.fst_length = static_cast<off_t>(end) - st.st_blocks * 512;
+    return store.fst_length <= 0 || fcntl(_fd, F_PREALLOCATE, &store) != -1;
+#else
+    return false;
+#endif
+}
+
+bool DirectFileWriter::File::trim(std::uint64_t size, std::uint64_t reserved)
+{
+    if (ftruncate(_fd, static_cast<off_t>(size)) != 0) return false;
+#ifdef __linux__
+    // Blocks reserved past the end of the file are not freed by every file system on truncation.
+    auto from = align_up(size, Alignment);
+    if (reserved > from) {
+        fallocate(
+            _fd,
+            FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+            static_cast<off_t>(from),
+            static_cast<off_t>(reserved - from)
+        );
+    }
+#else
+    (void)reserved;
+#endif
+    return true;
+}
+
+#endif
+
+DirectFileWriter::DirectFileWriter(
+    const Options &options, WriteMeter *meter, IoGovernor::Queue *queue
+)
+    : _options(options),
+      _meter(meter ? meter : &_own_meter),
+      _queue(queue),
+      _current(0),
+      _base(0),
+      _filled(0),
+      _end(0),
+      _closing(false),
+      _failed(false),
+      _reserved(0),
+      _reserving(false)
+{
+    _options.block_size = align_up(std::max<std::size_t>(_options.block_size, 1), Alignment);
+    _options.blocks = std::max<std::size_t>(_options.blocks, 2);
+    for (std::size_t i = 0; i < _options.blocks; ++i) {
+        _blocks.push_back({{aligned_allocate(_options.block_size), aligned_free}});
+    }
+}
+
+DirectFileWriter::~DirectFileWriter()
+{
+    if (is_open()) close();
+}
+
+bool DirectFileWriter::direct() const { return _direct && _direct->direct(); }
+
+bool DirectFileWriter::open(const std::filesystem::path &path)
+{
+    if (is_open()) close();
+
+    _direct = std::make_unique<File>();
+    _buffered = std::make_unique<File>();
+    if (!_direct->open(path, true, _options.direct) || !_buffered->open(path, false, false)) {
+        _direct.reset();
+        _buffered.reset();
+        return false;
+    }
+    if (_options.direct && !_direct->direct()) {
+        spdlog::debug("{}: no unbuffered writes, going through the page cache.", path.string());
+    }
+
+    _current = 0;
+    _base = 0;
+    _filled = 0;
+    _end = 0;
+    _jobs.clear();
+    _free.clear();
+    for (std::size_t i = 1; i < _blocks.size(); ++i) {
+        _free.push_back(i);
+    }
+    _closing = false;
+    _failed = false;
+    _reserved = 0;
+    _reserving = _options.preallocate > 0;
+    _thread = std::jthread(&DirectFileWriter::run, this);
+    return true;
+}
+
+bool DirectFileWriter::write(std::uint64_t offset, std::span<const std::uint8_t> data)
+{
+    if (!is_open() || _failed) return false;
+
+    auto block_size = _options.block_size;
+    _end = std::max<std::uint64_t>(_end, offset + data.size());
+    while (!data.empty()) {
+        if (offset < _base) {
+            // Already handed to the writer thread.
+            auto length =
+                static_cast<std::size_t>(std::min<std::uint64_t>(data.size(), _base - offset));
+            {
+                std::lock_guard lock(_mutex);
+                _jobs.push_back({offset, 0, 0, {data.begin(), data.begin() + length}});
+            }
+            _changed.notify_all();
+            _meter->add_patch();
+            offset += length;
+            data = data.subspan(length);
+        } else if (offset >= _base + block_size) {
+            // Past the block being filled; the gap reads as zeros.
+            std::memset(_blocks[_current].data.get() + _filled, 0, block_size - _filled);
+            submit(block_size);
+        } else {
+            auto at = static_cast<std::size_t>(offset - _base);
+            auto block = _blocks[_current].data.get();
+            if (at > _filled) std::memset(block + _filled, 0, at - _filled);
+            auto length = std::min(data.size(), block_size - at);
+            std::memcpy(block + at, data.data(), length);
+            _filled = std::max(_filled, at + length);
+            offset += length;
+            data = data.subspan(length);
+            if (_filled == block_size) submit(block_size);
+        }
+    }
+    return !_failed;
+}
+
+bool DirectFileWriter::close()
+{
+    if (!is_open()) return false;
+
+    IoGovernor::Grant finalizing;
+    if (_queue) finalizing = _queue->finalize();
+
+    if (_filled > 0) {
+        // Unbuffered writes cover whole sectors; trim() cuts the padding off again.
+        auto length = static_cast<std::size_t>(align_up(_filled, Alignment));
+        std::memset(_blocks[_current].data.get() + _filled, 0, length - _filled);
+        submit(length, true);
+    }
+    {
+        std::lock_guard lock(_mutex);
+        _closing = true;
+    }
+    _changed.notify_all();
+    _thread.join();
+
+    auto ok = !_failed && _direct->trim(_end, _reserved);
+    if (!ok) {
+        spdlog::error("Failed to write a recording file.");
+    }
+    _direct.reset();
+    _buffered.reset();
+    return ok;
+}
+
+void DirectFileWriter::submit(std::size_t length, bool last)
+{
+    {
+        std::lock_guard lock(_mutex);
+        _jobs.push_back({_base, _current, length, {}});
+    }
+    _changed.notify_all();
+    _base += _options.block_size;
+    _filled = 0;
+    if (last) return;
+
+    std::unique_lock lock(_mutex);
+    if (_free.empty()) {
+        auto begin = Clock::now();
+        _changed.wait(lock, [this] { return !_free.empty(); });
+        _meter->add_stall(since(begin));
+    }
+    _current = _free.back();
+    _free.pop_back();
+}
+
+void DirectFileWriter::run()
+{
+    reserve(_options.preallocate);
+    IoGovernor::Grant grant;
+    while (true) {
+        std::unique_lock lock(_mutex);
+        if (_jobs.empty()) {
+            // Not held while idle.
+            grant.release();
+        }
+        _changed.wait(lock, [this] { return !_jobs.empty() || _closing; });
+        if (_jobs.empty()) break;
+        auto job = std::move(_jobs.front());
+        _jobs.pop_front();
+        lock.unlock();
+
+        if (!_failed) {
+            if (_queue) {
+                auto bytes = job.length > 0 ? job.length : job.patch.size();
+                grant = _queue->write(bytes, std::move(grant));
+            }
+            auto ok = true;
+            if (job.length == 0) {
+                ok = _buffered->write(job.offset, job.patch.data(), job.patch.size());
+            } else {
+                reserve(job.offset + job.length);
+                auto begin = Clock::now();
+                ok = _direct->write(job.offset, _blocks[job.block].data.get(), job.length);
+                _meter->add_write(job.length, since(begin));
+            }
+            if (!ok) {
+                spdlog::error("Recording write failed: {}", std::strerror(errno));
+                _failed = true;
+            }
+        }
+        if (job.length > 0) {
+            lock.lock();
+            _free.push_back(job.block);
+            lock.unlock();
+            _changed.notify_all();
+        }
+    }
+}
+
+bool DirectFileWriter::reserve(std::uint64_t end)
+{
+    if (end <= _reserved || !_reserving) return true;
+    auto target = align_up(end, _options.preallocate);
+    if (!_direct->reserve(target)) {
+        // Not supported, or the disk is full: the writes will tell.
+        _reserving = false;
+        return false;
+    }
+    _reserved = target;
+    return true;
+}
+
+}  // namespace xvc
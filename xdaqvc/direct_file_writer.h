@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "io_governor.h"
+
+namespace xvc
+{
+
+// Write statistics, shared by every writer given the same meter.
+class WriteMeter
+{
+public:
+    struct Stats {
+        std::uint64_t bytes;    // Written to disk, padding included.
+        std::uint64_t writes;   // Blocks written.
+        std::uint64_t patches;  // Rewrites of data already handed to the writer thread.
+        std::chrono::microseconds busy;         // Spent in writes.
+        std::chrono::microseconds max_latency;  // Slowest single write.
+        std::chrono::microseconds max_stall;    // Longest a caller waited for a free block.
+
+        // What the disk sustained while it was being written to.
+        [[nodiscard]] double mb_per_s() const
+        {
+            return busy.count() > 0 ? bytes / static_cast<double>(busy.count()) : 0.0;
+        }
+    };
+
+    void add_write(std::uint64_t bytes, std::chrono::microseconds latency);
+    void add_patch() { ++_patches; }
+    void add_stall(std::chrono::microseconds stall);
+    [[nodiscard]] Stats stats() const;
+
+private:
+    std::atomic<std::uint64_t> _bytes{0};
+    std::atomic<std::uint64_t> _writes{0};
+    std::atomic<std::uint64_t> _patches{0};
+    std::atomic<std::int64_t> _busy{0};
+    std::atomic<std::int64_t> _max_latency{0};
+    std::atomic<std::int64_t> _max_stall{0};
+};
+
+// Writes one file at a time in large blocks aligned for unbuffered I/O, from a write-behind thread,
+// so the caller only ever copies into memory. The file is preallocated ahead of the data, and the
+// page cache is bypassed (O_DIRECT, F_NOCACHE or FILE_FLAG_NO_BUFFERING) where the file system
+// allows it, which keeps a recording from piling up dirty pages that are then flushed all at once.
+//
+// Writes may go anywhere, as a muxer seeking back to fill in sizes does: data behind the block
+// being filled is rewritten by the writer thread after the blocks queued before it.
+//
+// With an IoGovernor queue, every write waits for its grant, and close() for a finalize grant.
+class DirectFileWriter
+{
+public:
+    // Of offsets, lengths and buffers of unbuffered writes.
+    static constexpr std::size_t Alignment = 4096;
+
+    struct Options {
+        std::size_t block_size = 4 << 20;  // Rounded up to the alignment.
+        std::size_t blocks = 8;            // Filled or being written, at most.
+        // Reserved on open, and by as much again whenever the data reaches the end of it.
+        std::uint64_t preallocate = 256 << 20;
+        bool direct = true;  // Bypass the page cache.
+    };
+
+    explicit DirectFileWriter(
+        const Options &options, WriteMeter *meter = nullptr, IoGovernor::Queue *queue = nullptr
+    );
+    // Closes the file if it is open.
+    ~DirectFileWriter();
+
+    DirectFileWriter(const DirectFileWriter &) = delete;
+    DirectFileWriter &operator=(const DirectFileWriter &) = delete;
+
+    bool open(const std::filesystem::path &path);
+    // False once a write failed.
+    bool write(std::uint64_t offset, std::span<const std::uint8_t> data);
+    // Writes what is left, trims the file to the data and releases the rest of the reservation.
+    bool close();
+
+    [[nodiscard]] bool is_open() const { return _thread.joinable(); }
+    // The page cache is bypassed for the open file.
+    [[nodiscard]] bool direct() const;
+    [[nodiscard]] WriteMeter::Stats stats() const { return _meter->stats(); }
+
+private:
+    class File;
+
+    struct Block {
+        std::unique_ptr<std::uint8_t, void (*)(std::uint8_t *)> data;
+    };
+
+    struct Job {
+        std::uint64_t offset;
+        std::size_t block;                // Index into _blocks, for a block write.
+        std::size_t length;               // Of the block write.
+        std::vector<std::uint8_t> patch;  // Otherwise, written through the page cache.
+    };
+
+    // Hands the block being filled to the writer thread, padded to `length`, and takes a free one.
+    void submit(std::size_t length, bool last = false);
+    void run();
+    bool reserve(std::uint64_t end);
+
+    Options _options;
+    WriteMeter _own_meter;
+    WriteMeter *_meter;
+    IoGovernor::Queue *_queue;
+    std::vector<Block> _blocks;
+    std::unique_ptr<File> _direct;    // Block writes.
+    std::unique_ptr<File> _buffered;  // Patches.
+
+    // Caller only.
+    std::size_t _current;    // Block being filled.
+    std::uint64_t _base;     // Its offset in the file.
+    std::size_t _filled;
+    std::uint64_t _end;      // Of the data.
+
+    std::mutex _mutex;
+    std::condition_variable _changed;
+    std::deque<Job> _jobs;
+    std::vector<std::size_t> _free;
+    bool _closing;
+    std::atomic<bool> _failed;
+
+    // Writer thread only.
+    std::uint64_t _reserved;
+    bool _reserving;  // Until the file system refuses.
+
+    std::jthread _thread;
+};
+
+}  // namespace xvc
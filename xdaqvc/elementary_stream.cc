@@ -0,0 +1,109 @@
+#include "elementary_stream.h"
+
+#include <spdlog/spdlog.h>
+
+#include <cstring>
+
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+
+constexpr char FileMagic[8] = {'X', 'V', 'C', 'F', 'I', 'D', 'X', '1'};
+
+struct FileHeader {
+    char magic[8];
+    std::uint32_t codec;
+    std::uint32_t record_size;
+};
+
+static_assert(sizeof(FileHeader) == 16);
+static_assert(sizeof(xvc::FrameRecord) == 32);
+
+}  // namespace
+
+
+namespace xvc
+{
+
+fs::path frame_index_path(const fs::path &stream)
+{
+    return fs::path(stream).replace_extension(".idx");
+}
+
+FrameIndexWriter::FrameIndexWriter(const fs::path &path, ElementaryCodec codec)
+    : _out(path, std::ios::binary | std::ios::trunc), _failed(false)
+{
+    FileHeader header{};
+    std::memcpy(header.magic, FileMagic, sizeof(FileMagic));
+    header.codec = static_cast<std::uint32_t>(codec);
+    header.record_size = sizeof(FrameRecord);
+    _out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    _out.flush();
+    _failed = !_out;
+    if (_failed) {
+        spdlog::error("{}: could not be created", path.string());
+    }
+}
+
+FrameIndexWriter::~FrameIndexWriter() { close(); }
+
+bool FrameIndexWriter::append(const FrameRecord &record)
+{
+    if (!is_open()) return false;
+    _out.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    if (record.keyframe) {
+        _out.flush();
+    }
+    _failed = !_out;
+    return !_failed;
+}
+
+bool FrameIndexWriter::close()
+{
+    if (!_out.is_open()) return !_failed;
+    _out.close();
+    _failed = _failed || !_out;
+    return !_failed;
+}
+
+ElementaryReader::ElementaryReader(const fs::path &stream)
+    : _stream(stream, MappedFile::Access::Random),
+      _index(frame_index_path(stream)),
+      _codec(ElementaryCodec::H265),
+      _open(false)
+{
+    auto index = _index.data();
+    FileHeader header;
+    if (!_stream.is_open() || index.size() < sizeof(header)) return;
+    std::memcpy(&header, index.data(), sizeof(header));
+    if (std::memcmp(header.magic, FileMagic, sizeof(FileMagic)) != 0 ||
+        header.record_size != sizeof(FrameRecord)) {
+        return;
+    }
+    _codec = static_cast<ElementaryCodec>(header.codec);
+
+    // A record cut short by a crash is dropped, as are frames past the end of the stream.
+    auto records = std::span(
+        reinterpret_cast<const FrameRecord *>(index.data() + sizeof(header)),
+        (index.size() - sizeof(header)) / sizeof(FrameRecord)
+    );
+    auto stream_size = _stream.data().size();
+    auto complete = records.size();
+    while (complete > 0 &&
+           records[complete - 1].offset + records[complete - 1].size > stream_size) {
+        --complete;
+    }
+    _records = records.first(complete);
+    _open = true;
+}
+
+std::span<const std::uint8_t> ElementaryReader::frame(std::size_t n) const
+{
+    const auto &record = _records[n];
+    return _stream.data().subspan(record.offset, record.size);
+}
+
+}  // namespace xvc
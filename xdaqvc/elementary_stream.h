@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <span>
+
+#include "mapped_file.h"
+
+
+namespace xvc
+{
+
+// A recording written with RecordContainer::Elementary: the bare elementary stream, H.265 access
+// units in Annex-B byte-stream form with their parameter sets before every keyframe, or JPEG
+// frames back to back, and a frame index next to it. The index is a header followed by one
+// fixed-size record per frame, so frame n is at a known offset and the index of a file that was
+// still being written is read up to its last complete record.
+//
+//   header | record ...
+//
+// Frame indexes use the .idx extension.
+
+enum class ElementaryCodec : std::uint32_t { H265 = 1, Jpeg = 2 };
+
+struct FrameRecord {
+    std::uint64_t offset;  // Of the frame in the stream.
+    std::uint32_t size;
+    std::uint32_t keyframe;
+    std::int64_t pts;  // Nanoseconds, -1 if unknown.
+    std::int64_t dts;
+};
+
+// The frame index of the elementary stream `stream`.
+std::filesystem::path frame_index_path(const std::filesystem::path &stream);
+
+class FrameIndexWriter
+{
+public:
+    FrameIndexWriter(const std::filesystem::path &path, ElementaryCodec codec);
+    // Closes the file if close() was not called.
+    ~FrameIndexWriter();
+
+    FrameIndexWriter(const FrameIndexWriter &) = delete;
+    FrameIndexWriter &operator=(const FrameIndexWriter &) = delete;
+
+    [[nodiscard]] bool is_open() const { return _out.is_open() && !_failed; }
+
+    // Records reach the file at every keyframe, so a crash loses at most the last GOP.
+    bool append(const FrameRecord &record);
+    bool close();
+
+private:
+    std::ofstream _out;
+    bool _failed;
+};
+
+class ElementaryReader
+{
+public:
+    explicit ElementaryReader(const std::filesystem::path &stream);
+
+    // False if either file is missing or the index is not a frame index.
+    [[nodiscard]] bool is_open() const { return _open; }
+    [[nodiscard]] ElementaryCodec codec() const { return _codec; }
+    // Frames whose bytes are all in the stream; an index may run ahead of a stream cut short.
+    [[nodiscard]] std::size_t size() const { return _records.size(); }
+    [[nodiscard]] const FrameRecord &record(std::size_t n) const { return _records[n]; }
+    [[nodiscard]] std::span<const std::uint8_t> frame(std::size_t n) const;
+
+private:
+    MappedFile _stream;
+    MappedFile _index;
+    std::span<const FrameRecord> _records;
+    ElementaryCodec _codec;
+    bool _open;
+};
+
+}  // namespace xvc
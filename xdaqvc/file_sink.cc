@@ -0,0 +1,377 @@
+#include "file_sink.h"
+
+#include <gst/base/gstbasesink.h>
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+#include <mutex>
+
+
+// GObject boilerplate for the "xvcfilesink" element.
+
+struct XvcFileSink {
+    GstBaseSink parent;
+    gchar *location;
+    guint64 block_size;
+    guint blocks;
+    guint64 preallocate;
+    gboolean direct;
+    xvc::WriteMeter *meter;
+    xvc::IoGovernor::Queue *queue;
+    // Between start and stop.
+    xvc::DirectFileWriter *writer;
+    guint64 position;
+};
+
+struct XvcFileSinkClass {
+    GstBaseSinkClass parent_class;
+};
+
+G_DEFINE_TYPE(XvcFileSink, xvc_file_sink, GST_TYPE_BASE_SINK)
+
+namespace
+{
+
+enum {
+    PROP_0,
+    PROP_LOCATION,
+    PROP_BLOCK_SIZE,
+    PROP_BLOCKS,
+    PROP_PREALLOCATE,
+    PROP_DIRECT,
+    PROP_METER,
+    PROP_QUEUE,
+};
+
+GstStaticPadTemplate sink_template =
+    GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS_ANY);
+
+XvcFileSink *self_of(GstBaseSink *sink) { return reinterpret_cast<XvcFileSink *>(sink); }
+
+gboolean start(GstBaseSink *sink)
+{
+    auto self = self_of(sink);
+    if (!self->location) {
+        GST_ELEMENT_ERROR(self, RESOURCE, NOT_FOUND, ("No file name specified."), (nullptr));
+        return FALSE;
+    }
+    self->writer = new xvc::DirectFileWriter(
+        {.block_size = static_cast<std::size_t>(self->block_size),
+         .blocks = self->blocks,
+         .preallocate = self->preallocate,
+         .direct = self->direct != FALSE},
+        self->meter,
+        self->queue
+    );
+    self->position = 0;
+    if (!self->writer->open(self->location)) {
+        GST_ELEMENT_ERROR(
+            self, RESOURCE, OPEN_WRITE, ("Could not open %s.", self->location), (nullptr)
+        );
+        delete self->writer;
+        self->writer = nullptr;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// Writes out what is left; the file is complete afterwards.
+bool finish(XvcFileSink *self)
+{
+    if (!self->writer || !self->writer->is_open()) return true;
+    if (self->writer->close()) return true;
+    GST_ELEMENT_ERROR(self, RESOURCE, WRITE, ("Could not write %s.", self->location), (nullptr));
+    return false;
+}
+
+gboolean stop(GstBaseSink *sink)
+{
+    auto self = self_of(sink);
+    auto ok = finish(self);
+    delete self->writer;
+    self->writer = nullptr;
+    return ok;
+}
+
+GstFlowReturn render(GstBaseSink *sink, GstBuffer *buffer)
+{
+    auto self = self_of(sink);
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) return GST_FLOW_ERROR;
+    auto ok = self->writer->write(self->position, {map.data, map.size});
+    self->position += map.size;
+    gst_buffer_unmap(buffer, &map);
+    if (!ok) {
+        GST_ELEMENT_ERROR(
+            self, RESOURCE, WRITE, ("Could not write %s.", self->location), (nullptr)
+        );
+        return GST_FLOW_ERROR;
+    }
+    return GST_FLOW_OK;
+}
+
+gboolean event(GstBaseSink *sink, GstEvent *event)
+{
+    auto self = self_of(sink);
+    switch (GST_EVENT_TYPE(event)) {
+    case GST_EVENT_SEGMENT: {
+        // A muxer seeking back to fill in a header.
+        const GstSegment *segment = nullptr;
+        gst_event_parse_segment(event, &segment);
+        if (segment->format == GST_FORMAT_BYTES) {
+            self->position = segment->start;
+        }
+        break;
+    }
+    case GST_EVENT_EOS:
+        if (!finish(self)) {
+            gst_event_unref(event);
+            return FALSE;
+        }
+        break;
+    default: break;
+    }
+    return GST_BASE_SINK_CLASS(xvc_file_sink_parent_class)->event(sink, event);
+}
+
+gboolean query(GstBaseSink *sink, GstQuery *query)
+{
+    auto self = self_of(sink);
+    GstFormat format;
+    switch (GST_QUERY_TYPE(query)) {
+    case GST_QUERY_SEEKING:
+        gst_query_parse_seeking(query, &format, nullptr, nullptr, nullptr);
+        gst_query_set_seeking(query, format, format == GST_FORMAT_BYTES, 0, -1);
+        return TRUE;
+    case GST_QUERY_POSITION:
+        gst_query_parse_position(query, &format, nullptr);
+        if (format != GST_FORMAT_BYTES && format != GST_FORMAT_DEFAULT) return FALSE;
+        gst_query_set_position(query, GST_FORMAT_BYTES, self->position);
+        return TRUE;
+    case GST_QUERY_FORMATS:
+        gst_query_set_formats(query, 2, GST_FORMAT_DEFAULT, GST_FORMAT_BYTES);
+        return TRUE;
+    default: return GST_BASE_SINK_CLASS(xvc_file_sink_parent_class)->query(sink, query);
+    }
+}
+
+void set_property(GObject *object, guint id, const GValue *value, GParamSpec *pspec)
+{
+    auto self = reinterpret_cast<XvcFileSink *>(object);
+    GST_OBJECT_LOCK(self);
+    switch (id) {
+    case PROP_LOCATION:
+        g_free(self->location);
+        self->location = g_value_dup_string(value);
+        break;
+    case PROP_BLOCK_SIZE: self->block_size = g_value_get_uint64(value); break;
+    case PROP_BLOCKS: self->blocks = g_value_get_uint(value); break;
+    case PROP_PREALLOCATE: self->preallocate = g_value_get_uint64(value); break;
+    case PROP_DIRECT: self->direct = g_value_get_boolean(value); break;
+    case PROP_METER:
+        self->meter = static_cast<xvc::WriteMeter *>(g_value_get_pointer(value));
+        break;
+    case PROP_QUEUE:
+        self->queue = static_cast<xvc::IoGovernor::Queue *>(g_value_get_pointer(value));
+        break;
+    default: G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, pspec); break;
+    }
+    GST_OBJECT_UNLOCK(self);
+}
+
+void get_property(GObject *object, guint id, GValue *value, GParamSpec *pspec)
+{
+    auto self = reinterpret_cast<XvcFileSink *>(object);
+    switch (id) {
+    case PROP_LOCATION: g_value_set_string(value, self->location); break;
+    case PROP_BLOCK_SIZE: g_value_set_uint64(value, self->block_size); break;
+    case PROP_BLOCKS: g_value_set_uint(value, self->blocks); break;
+    case PROP_PREALLOCATE: g_value_set_uint64(value, self->preallocate); break;
+    case PROP_DIRECT: g_value_set_boolean(value, self->direct); break;
+    case PROP_METER: g_value_set_pointer(value, self->meter); break;
+    case PROP_QUEUE: g_value_set_pointer(value, self->queue); break;
+    default: G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, pspec); break;
+    }
+}
+
+void finalize(GObject *object)
+{
+    auto self = reinterpret_cast<XvcFileSink *>(object);
+    g_free(self->location);
+    delete self->writer;
+    G_OBJECT_CLASS(xvc_file_sink_parent_class)->finalize(object);
+}
+
+}  // namespace
+
+static void xvc_file_sink_class_init(XvcFileSinkClass *klass)
+{
+    auto gobject_class = G_OBJECT_CLASS(klass);
+    auto element_class = GST_ELEMENT_CLASS(klass);
+    auto sink_class = GST_BASE_SINK_CLASS(klass);
+    auto flags = static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+    xvc::DirectFileWriter::Options defaults;
+
+    gobject_class->set_property = set_property;
+    gobject_class->get_property = get_property;
+    gobject_class->finalize = finalize;
+    g_object_class_install_property(
+        gobject_class,
+        PROP_LOCATION,
+        g_param_spec_string(
+            "location", "File Location", "Location of the file to write", nullptr, flags
+        )
+    );
+    g_object_class_install_property(
+        gobject_class,
+        PROP_BLOCK_SIZE,
+        g_param_spec_uint64(
+            "block-size",
+            "Block size",
+            "Bytes per write, rounded up to 4096",
+            xvc::DirectFileWriter::Alignment,
+            G_MAXUINT32,
+            defaults.block_size,
+            flags
+        )
+    );
+    g_object_class_install_property(
+        gobject_class,
+        PROP_BLOCKS,
+        g_param_spec_uint(
+            "blocks", "Blocks", "Blocks being filled or written", 2, 1024, defaults.blocks, flags
+        )
+    );
+    g_object_class_install_property(
+        gobject_class,
+        PROP_PREALLOCATE,
+        g_param_spec_uint64(
+            "preallocate",
+            "Preallocate",
+            "Bytes reserved ahead of the data, 0 for none",
+            0,
+            G_MAXUINT64,
+            defaults.preallocate,
+            flags
+        )
+    );
+    g_object_class_install_property(
+        gobject_class,
+        PROP_DIRECT,
+        g_param_spec_boolean(
+            "direct", "Direct", "Bypass the page cache where supported", defaults.direct, flags
+        )
+    );
+    g_object_class_install_property(
+        gobject_class,
+        PROP_METER,
+        g_param_spec_pointer("meter", "Meter", "xvc::WriteMeter to report the writes to", flags)
+    );
+    g_object_class_install_property(
+        gobject_class,
+        PROP_QUEUE,
+        g_param_spec_pointer("queue", "Queue", "xvc::IoGovernor::Queue to write through", flags)
+    );
+
+    gst_element_class_set_static_metadata(
+        element_class,
+        "libxvc file sink",
+        "Sink/File",
+        "Writes to a preallocated file in large aligned blocks from a write-behind thread",
+        "KonteX Neuroscience"
+    );
+    gst_element_class_add_static_pad_template(element_class, &sink_template);
+
+    sink_class->start = start;
+    sink_class->stop = stop;
+    sink_class->render = render;
+    sink_class->event = event;
+    sink_class->query = query;
+}
+
+static void xvc_file_sink_init(XvcFileSink *self)
+{
+    xvc::DirectFileWriter::Options defaults;
+    self->location = nullptr;
+    self->block_size = defaults.block_size;
+    self->blocks = static_cast<guint>(defaults.blocks);
+    self->preallocate = defaults.preallocate;
+    self->direct = defaults.direct;
+    self->meter = nullptr;
+    self->queue = nullptr;
+    self->writer = nullptr;
+    self->position = 0;
+    // Files are written as fast as buffers arrive, like filesink.
+    gst_base_sink_set_sync(GST_BASE_SINK(self), FALSE);
+}
+
+
+namespace xvc
+{
+
+bool register_file_sink_element()
+{
+    static std::once_flag once;
+    static auto registered = false;
+    std::call_once(once, [] {
+        registered =
+            gst_element_register(nullptr, "xvcfilesink", GST_RANK_NONE, xvc_file_sink_get_type());
+        if (!registered) {
+            spdlog::error("Failed to register the xvcfilesink element.");
+        }
+    });
+    return registered;
+}
+
+bool use_file_sink(
+    GstElement *splitmuxsink, const DirectFileWriter::Options &options, WriteMeter *meter
+)
+{
+    // Older splitmuxsinks would silently write through the stock filesink.
+    if (!g_object_class_find_property(G_OBJECT_GET_CLASS(splitmuxsink), "sink-factory")) {
+        spdlog::error(
+            "splitmuxsink has no sink-factory property, RecordSink::Direct needs GStreamer 1.22."
+        );
+        return false;
+    }
+    if (!register_file_sink_element()) return false;
+    // clang-format off
+    auto properties = gst_structure_new("properties",
+        "block-size", G_TYPE_UINT64, static_cast<guint64>(options.block_size),
+        "blocks", G_TYPE_UINT, static_cast<guint>(options.blocks),
+        "preallocate", G_TYPE_UINT64, static_cast<guint64>(options.preallocate),
+        "direct", G_TYPE_BOOLEAN, static_cast<gboolean>(options.direct),
+        "meter", G_TYPE_POINTER, meter,
+        nullptr
+    );
+    // clang-format on
+    g_object_set(G_OBJECT(splitmuxsink), "sink-factory", "xvcfilesink", nullptr);
+    g_object_set(G_OBJECT(splitmuxsink), "sink-properties", properties, nullptr);
+    gst_structure_free(properties);
+    return true;
+}
+
+void write_through(GstElement *splitmuxsink, IoGovernor::Queue *queue)
+{
+    // The sink of the first fragment already exists.
+    auto elements = gst_bin_iterate_recurse(GST_BIN(splitmuxsink));
+    GValue item = G_VALUE_INIT;
+    while (gst_iterator_next(elements, &item) == GST_ITERATOR_OK) {
+        auto element = g_value_get_object(&item);
+        if (G_TYPE_CHECK_INSTANCE_TYPE(element, xvc_file_sink_get_type())) {
+            g_object_set(element, "queue", queue, nullptr);
+        }
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+    gst_iterator_free(elements);
+
+    GstStructure *properties = nullptr;
+    g_object_get(G_OBJECT(splitmuxsink), "sink-properties", &properties, nullptr);
+    if (!properties) return;
+    gst_structure_set(properties, "queue", G_TYPE_POINTER, queue, nullptr);
+    g_object_set(G_OBJECT(splitmuxsink), "sink-properties", properties, nullptr);
+    gst_structure_free(properties);
+}
+
+}  // namespace xvc
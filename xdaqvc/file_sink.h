@@ -0,0 +1,28 @@
+#pragma once
+
+#include <gst/gstelement.h>
+
+#include "direct_file_writer.h"
+
+
+namespace xvc
+{
+
+// Registers the "xvcfilesink" element, a seekable file sink on DirectFileWriter: each file is
+// preallocated and written in large aligned blocks from a write-behind thread, bypassing the page
+// cache. Properties: "location", "block-size", "blocks", "preallocate", "direct", "meter", a
+// WriteMeter, and "queue", the IoGovernor::Queue to write through; both outlive the element. Safe
+// to call more than once.
+bool register_file_sink_element();
+
+// Makes `splitmuxsink`, which must have async-finalize set, write every fragment through its own
+// xvcfilesink, all reporting to `meter`. Call before it goes to READY. False if its GStreamer is
+// older than 1.22, whose splitmuxsink cannot be given a sink factory.
+bool use_file_sink(
+    GstElement *splitmuxsink, const DirectFileWriter::Options &options, WriteMeter *meter
+);
+// Makes the xvcfilesinks of `splitmuxsink`, set up by use_file_sink, write through `queue`, the
+// one already created for the first fragment included. Call before it goes to PAUSED.
+void write_through(GstElement *splitmuxsink, IoGovernor::Queue *queue);
+
+}  // namespace xvc
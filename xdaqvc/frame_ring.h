@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <utility>
+
+
+namespace xvc
+{
+
+// Bounded single-producer/single-consumer ring. push() is only called from the producer thread
+// and pop() only from the consumer thread; neither takes a lock.
+template <typename T>
+class FrameRing
+{
+public:
+    explicit FrameRing(std::size_t capacity)
+        : _capacity(capacity == 0 ? 1 : capacity),
+          _slots(std::make_unique<std::optional<T>[]>(_capacity + 1))
+    {
+    }
+
+    FrameRing(const FrameRing &) = delete;
+    FrameRing &operator=(const FrameRing &) = delete;
+
+    // Returns false and leaves `value` untouched when the ring is full.
+    bool push(T &value)
+    {
+        auto tail = _tail.load(std::memory_order_relaxed);
+        auto next = increment(tail);
+        if (next == _head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        _slots[tail].emplace(std::move(value));
+        _tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    std::optional<T> pop()
+    {
+        auto head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire)) {
+            return std::nullopt;
+        }
+        std::optional<T> value(std::move(_slots[head]));
+        _slots[head].reset();
+        _head.store(increment(head), std::memory_order_release);
+        return value;
+    }
+
+    [[nodiscard]] std::size_t capacity() const { return _capacity; }
+
+    // Approximate when called concurrently with push()/pop().
+    [[nodiscard]] std::size_t size() const
+    {
+        auto head = _head.load(std::memory_order_acquire);
+        auto tail = _tail.load(std::memory_order_acquire);
+        return tail >= head ? tail - head : tail + _capacity + 1 - head;
+    }
+
+    [[nodiscard]] bool empty() const { return size() == 0; }
+    [[nodiscard]] bool full() const { return size() == _capacity; }
+
+private:
+    [[nodiscard]] std::size_t increment(std::size_t index) const
+    {
+        return index == _capacity ? 0 : index + 1;
+    }
+
+    // One slot is kept free to tell a full ring from an empty one.
+    std::size_t _capacity;
+    std::unique_ptr<std::optional<T>[]> _slots;
+
+    static constexpr std::size_t CacheLine = 64;
+    alignas(CacheLine) std::atomic<std::size_t> _head{0};
+    alignas(CacheLine) std::atomic<std::size_t> _tail{0};
+};
+
+}  // namespace xvc
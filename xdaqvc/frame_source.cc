@@ -0,0 +1,233 @@
+#include "frame_source.h"
+
+#include <gst/app/gstappsink.h>
+#include <gst/gst.h>
+#include <gst/gstbin.h>
+#include <gst/gstelement.h>
+#include <gst/gstobject.h>
+#include <gst/video/video-info.h>
+#include <spdlog/spdlog.h>
+
+
+namespace
+{
+
+auto constexpr DataKey = "xvc-frame-source";
+
+}  // namespace
+
+
+namespace xvc
+{
+
+Frame::Frame(GstSample *sample) : _sample(sample), _frame(), _mapped(false)
+{
+    GstVideoInfo info;
+    auto caps = gst_sample_get_caps(_sample);
+    auto buffer = gst_sample_get_buffer(_sample);
+    if (!caps || !buffer || !gst_video_info_from_caps(&info, caps)) {
+        spdlog::error("Sample does not carry raw video caps.");
+        return;
+    }
+    _mapped = gst_video_frame_map(&_frame, &info, buffer, GST_MAP_READ);
+    if (!_mapped) {
+        spdlog::error("Failed to map video frame.");
+    }
+}
+
+Frame::~Frame()
+{
+    if (_mapped) {
+        gst_video_frame_unmap(&_frame);
+    }
+    gst_sample_unref(_sample);
+}
+
+const guint8 *Frame::data(guint plane) const
+{
+    if (!_mapped || plane >= n_planes()) return nullptr;
+    return static_cast<const guint8 *>(GST_VIDEO_FRAME_PLANE_DATA(&_frame, plane));
+}
+
+int Frame::stride(guint plane) const
+{
+    if (!_mapped || plane >= n_planes()) return 0;
+    return GST_VIDEO_FRAME_PLANE_STRIDE(&_frame, plane);
+}
+
+guint Frame::n_planes() const { return _mapped ? GST_VIDEO_FRAME_N_PLANES(&_frame) : 0; }
+
+int Frame::width() const { return _mapped ? GST_VIDEO_FRAME_WIDTH(&_frame) : 0; }
+
+int Frame::height() const { return _mapped ? GST_VIDEO_FRAME_HEIGHT(&_frame) : 0; }
+
+GstVideoFormat Frame::format() const
+{
+    return _mapped ? GST_VIDEO_FRAME_FORMAT(&_frame) : GST_VIDEO_FORMAT_UNKNOWN;
+}
+
+GstClockTime Frame::pts() const
+{
+    auto buffer = gst_sample_get_buffer(_sample);
+    return buffer ? GST_BUFFER_PTS(buffer) : GST_CLOCK_TIME_NONE;
+}
+
+
+FrameSource::FrameSource(
+    Setup setup, const std::string &uri, std::size_t capacity, Backpressure backpressure
+)
+    : _pipeline(GST_PIPELINE(gst_object_ref_sink(gst_pipeline_new(nullptr)))),
+      _appsink(nullptr),
+      _backpressure(backpressure),
+      _ring(capacity)
+{
+    setup(_pipeline, uri);
+
+    _appsink = gst_bin_get_by_name(GST_BIN(_pipeline), "appsink");
+    if (!_appsink) {
+        spdlog::error("Pipeline has no element named 'appsink'.");
+        return;
+    }
+
+    GstAppSinkCallbacks callbacks{};
+    callbacks.new_sample = &FrameSource::on_new_sample;
+    gst_app_sink_set_callbacks(GST_APP_SINK(_appsink), &callbacks, this, nullptr);
+    g_object_set_data(G_OBJECT(_appsink), DataKey, this);
+}
+
+FrameSource::~FrameSource()
+{
+    stop();
+    _delivery = {};
+    if (_appsink) {
+        GstAppSinkCallbacks callbacks{};
+        gst_app_sink_set_callbacks(GST_APP_SINK(_appsink), &callbacks, nullptr, nullptr);
+        g_object_set_data(G_OBJECT(_appsink), DataKey, nullptr);
+        gst_object_unref(_appsink);
+    }
+    gst_object_unref(_pipeline);
+}
+
+bool FrameSource::start()
+{
+    if (!_appsink) return false;
+
+    _running = true;
+    if (gst_element_set_state(GST_ELEMENT(_pipeline), GST_STATE_PLAYING) ==
+        GST_STATE_CHANGE_FAILURE) {
+        spdlog::error("Failed to start the frame source pipeline.");
+        _running = false;
+        return false;
+    }
+    return true;
+}
+
+void FrameSource::stop()
+{
+    _running = false;
+    {
+        // Wake up any consumer in pull() and a producer blocked on a full ring.
+        std::lock_guard lock(_wait_mutex);
+        _wait_cv.notify_all();
+    }
+    gst_element_set_state(GST_ELEMENT(_pipeline), GST_STATE_NULL);
+}
+
+FramePtr FrameSource::try_pull()
+{
+    auto frame = _ring.pop();
+    if (!frame) return nullptr;
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_backpressure == Backpressure::Block && _waiters.load() > 0) {
+        std::lock_guard lock(_wait_mutex);
+        _wait_cv.notify_all();
+    }
+    return std::move(*frame);
+}
+
+FramePtr FrameSource::pull(std::chrono::milliseconds timeout)
+{
+    if (auto frame = try_pull()) return frame;
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::unique_lock lock(_wait_mutex);
+    ++_waiters;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    FramePtr frame;
+    _wait_cv.wait_until(lock, deadline, [&] {
+        if (!_running) return true;
+        auto popped = _ring.pop();
+        if (!popped) return false;
+        frame = std::move(*popped);
+        return true;
+    });
+    --_waiters;
+    if (frame && _backpressure == Backpressure::Block) {
+        _wait_cv.notify_all();
+    }
+    return frame;
+}
+
+void FrameSource::set_callback(Callback callback)
+{
+    _delivery = {};
+    if (!callback) return;
+
+    _delivery = std::jthread([this, callback = std::move(callback)](std::stop_token stop) {
+        while (!stop.stop_requested()) {
+            if (auto frame = pull()) {
+                callback(std::move(frame));
+            } else if (!_running) {
+                std::this_thread::sleep_for(10ms);
+            }
+        }
+    });
+}
+
+FrameSource *FrameSource::find(GstElement *appsink)
+{
+    return static_cast<FrameSource *>(g_object_get_data(G_OBJECT(appsink), DataKey));
+}
+
+FrameSource::Stats FrameSource::stats() const
+{
+    return {_ring.capacity(), _ring.size(), _received.load(), _dropped.load()};
+}
+
+GstFlowReturn FrameSource::on_new_sample(GstAppSink *appsink, gpointer user_data)
+{
+    auto self = static_cast<FrameSource *>(user_data);
+    auto sample = gst_app_sink_pull_sample(appsink);
+    if (!sample) return GST_FLOW_EOS;
+
+    self->push(std::make_shared<const Frame>(sample));
+    return GST_FLOW_OK;
+}
+
+void FrameSource::push(FramePtr frame)
+{
+    ++_received;
+
+    if (_ring.push(frame)) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_waiters.load() > 0) {
+            std::lock_guard lock(_wait_mutex);
+            _wait_cv.notify_all();
+        }
+        return;
+    }
+
+    if (_backpressure == Backpressure::Block) {
+        std::unique_lock lock(_wait_mutex);
+        ++_waiters;
+        _wait_cv.wait(lock, [&] { return !_running || _ring.push(frame); });
+        --_waiters;
+        _wait_cv.notify_all();
+        if (frame == nullptr) return;
+    }
+
+    ++_dropped;
+}
+
+}  // namespace xvc
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <gst/app/gstappsink.h>
+#include <gst/gstpipeline.h>
+#include <gst/gstsample.h>
+#include <gst/video/video-frame.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "frame_ring.h"
+
+
+using namespace std::chrono_literals;
+
+
+namespace xvc
+{
+
+// A decoded video frame pulled from an appsink. The GstBuffer stays mapped for the lifetime of the
+// frame, so the planes can be read in place without copying.
+class Frame
+{
+public:
+    // Takes ownership of `sample`.
+    explicit Frame(GstSample *sample);
+    ~Frame();
+
+    Frame(const Frame &) = delete;
+    Frame &operator=(const Frame &) = delete;
+
+    [[nodiscard]] bool valid() const { return _mapped; }
+    [[nodiscard]] const guint8 *data(guint plane = 0) const;
+    [[nodiscard]] int stride(guint plane = 0) const;
+    [[nodiscard]] guint n_planes() const;
+    [[nodiscard]] int width() const;
+    [[nodiscard]] int height() const;
+    [[nodiscard]] GstVideoFormat format() const;
+    [[nodiscard]] GstClockTime pts() const;
+    [[nodiscard]] const GstVideoInfo &info() const { return _frame.info; }
+    [[nodiscard]] const GstVideoFrame *video_frame() const { return &_frame; }
+    [[nodiscard]] GstSample *sample() const { return _sample; }
+
+private:
+    GstSample *_sample;
+    GstVideoFrame _frame;
+    bool _mapped;
+};
+
+using FramePtr = std::shared_ptr<const Frame>;
+
+
+// Owns a stream pipeline and hands out the frames reaching its "appsink" through a bounded ring.
+// Frames are consumed either by pulling (pull/try_pull) or by a callback running on a dedicated
+// delivery thread (set_callback), never both.
+class FrameSource
+{
+public:
+    // What the streaming thread does when the ring is full.
+    enum class Backpressure {
+        Drop,  // Discard the incoming frame and count it as dropped.
+        Block  // Wait for the consumer, stalling the display branch.
+    };
+
+    struct Stats {
+        std::size_t capacity;
+        std::size_t occupancy;
+        std::uint64_t received;
+        std::uint64_t dropped;
+    };
+
+    using Setup = std::function<void(GstPipeline *, const std::string &)>;
+    using Callback = std::function<void(FramePtr)>;
+
+    FrameSource(
+        Setup setup, const std::string &uri, std::size_t capacity = 4,
+        Backpressure backpressure = Backpressure::Drop
+    );
+    ~FrameSource();
+
+    FrameSource(const FrameSource &) = delete;
+    FrameSource &operator=(const FrameSource &) = delete;
+
+    // The FrameSource receiving the frames of `appsink`, or nullptr.
+    static FrameSource *find(GstElement *appsink);
+
+    [[nodiscard]] GstPipeline *pipeline() const { return _pipeline; }
+
+    bool start();
+    void stop();
+
+    // Returns nullptr when no frame is available.
+    [[nodiscard]] FramePtr try_pull();
+    // Returns nullptr on timeout or once the source is stopped.
+    [[nodiscard]] FramePtr pull(std::chrono::milliseconds timeout = 100ms);
+
+    // Switches to push mode. Passing an empty callback switches back to pull mode.
+    void set_callback(Callback callback);
+
+    [[nodiscard]] Stats stats() const;
+
+private:
+    static GstFlowReturn on_new_sample(GstAppSink *appsink, gpointer user_data);
+    void push(FramePtr frame);
+
+    GstPipeline *_pipeline;
+    GstElement *_appsink;
+    Backpressure _backpressure;
+    FrameRing<FramePtr> _ring;
+
+    std::atomic<bool> _running{false};
+    std::atomic<std::uint64_t> _received{0};
+    std::atomic<std::uint64_t> _dropped{0};
+
+    // Only used to park a thread waiting on an empty or full ring; frames never pass through it.
+    std::mutex _wait_mutex;
+    std::condition_variable _wait_cv;
+    std::atomic<int> _waiters{0};
+
+    std::jthread _delivery;
+};
+
+}  // namespace xvc
@@ -0,0 +1,57 @@
+#include "hevc.h"
+
+#include <iterator>
+
+
+namespace
+{
+
+constexpr std::uint8_t StartCode[] = {0, 0, 0, 1};
+
+}  // namespace
+
+
+namespace xvc
+{
+
+std::optional<HevcConfig> parse_hvcc(std::span<const std::uint8_t> hvcc)
+{
+    if (hvcc.size() < 23) return std::nullopt;
+    HevcConfig config{static_cast<std::size_t>(hvcc[21] & 3) + 1, {}};
+    std::size_t pos = 23;
+    for (auto array = 0; array < hvcc[22]; ++array) {
+        if (pos + 3 > hvcc.size()) return std::nullopt;
+        auto count = (hvcc[pos + 1] << 8) | hvcc[pos + 2];
+        pos += 3;
+        for (auto i = 0; i < count; ++i) {
+            if (pos + 2 > hvcc.size()) return std::nullopt;
+            std::size_t length = (hvcc[pos] << 8) | hvcc[pos + 1];
+            pos += 2;
+            if (pos + length > hvcc.size()) return std::nullopt;
+            auto &out = config.parameter_sets;
+            out.insert(out.end(), std::begin(StartCode), std::end(StartCode));
+            out.insert(out.end(), hvcc.begin() + pos, hvcc.begin() + pos + length);
+            pos += length;
+        }
+    }
+    return config;
+}
+
+bool append_byte_stream(
+    std::span<const std::uint8_t> au, std::size_t length_size, std::vector<std::uint8_t> &out
+)
+{
+    std::size_t pos = 0;
+    while (pos + length_size <= au.size()) {
+        std::size_t length = 0;
+        for (std::size_t i = 0; i < length_size; ++i) length = (length << 8) | au[pos + i];
+        pos += length_size;
+        if (pos + length > au.size()) return false;
+        out.insert(out.end(), std::begin(StartCode), std::end(StartCode));
+        out.insert(out.end(), au.begin() + pos, au.begin() + pos + length);
+        pos += length;
+    }
+    return pos == au.size();
+}
+
+}  // namespace xvc
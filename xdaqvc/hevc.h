@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+
+namespace xvc
+{
+
+// What it takes to turn the length-prefixed access units of an H.265 Matroska track back into the
+// byte-stream the parsers and decoders expect.
+struct HevcConfig {
+    std::size_t length_size;                   // Of the NAL unit length prefixes.
+    std::vector<std::uint8_t> parameter_sets;  // VPS, SPS and PPS with start codes.
+};
+
+// The HEVCDecoderConfigurationRecord in the track's CodecPrivate.
+std::optional<HevcConfig> parse_hvcc(std::span<const std::uint8_t> hvcc);
+
+// Appends the length-prefixed NAL units of `au` to `out` with start codes instead.
+bool append_byte_stream(
+    std::span<const std::uint8_t> au, std::size_t length_size, std::vector<std::uint8_t> &out
+);
+
+}  // namespace xvc
@@ -0,0 +1,248 @@
+#include "io_governor.h"
+
+#include <algorithm>
+#include <utility>
+
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+constexpr auto RateWindow = std::chrono::seconds(1);
+
+double mb_per_s(std::uint64_t bytes, Clock::duration elapsed)
+{
+    auto seconds = std::chrono::duration<double>(elapsed).count();
+    return seconds > 0 ? bytes / seconds / 1e6 : 0.0;
+}
+
+}  // namespace
+
+
+namespace xvc
+{
+
+IoGovernor::Grant::Grant(Grant &&other) noexcept
+    : _governor(std::exchange(other._governor, nullptr)), _lane(other._lane)
+{
+}
+
+IoGovernor::Grant &IoGovernor::Grant::operator=(Grant &&other) noexcept
+{
+    if (this != &other) {
+        release();
+        _governor = std::exchange(other._governor, nullptr);
+        _lane = other._lane;
+    }
+    return *this;
+}
+
+void IoGovernor::Grant::release()
+{
+    if (auto governor = std::exchange(_governor, nullptr)) {
+        governor->release(_lane);
+    }
+}
+
+IoGovernor::Queue::Queue(IoGovernor &governor, std::string camera, const IoShare &share)
+    : _governor(governor),
+      _camera(std::move(camera)),
+      _share(share),
+      _finish(0),
+      _backlog(0),
+      _bytes(0),
+      _stalled(0),
+      _finalized(0),
+      _window_begin(Clock::now()),
+      _window_bytes(0),
+      _rate(0),
+      _expected(0)
+{
+}
+
+IoGovernor::Grant IoGovernor::Queue::write(std::uint64_t bytes, Grant previous)
+{
+    return _governor.acquire(*this, Write, bytes, std::move(previous));
+}
+
+IoGovernor::Grant IoGovernor::Queue::finalize()
+{
+    auto grant = _governor.acquire(*this, Finalize, 0);
+    std::lock_guard lock(_mutex);
+    ++_finalized;
+    return grant;
+}
+
+void IoGovernor::Queue::queued(std::uint64_t bytes)
+{
+    std::lock_guard lock(_mutex);
+    _backlog += bytes;
+}
+
+void IoGovernor::Queue::handed(std::uint64_t bytes)
+{
+    auto now = Clock::now();
+    std::lock_guard lock(_mutex);
+    _backlog -= std::min(_backlog, bytes);
+    _bytes += bytes;
+    if (now - _window_begin >= RateWindow) {
+        _rate = mb_per_s(_window_bytes, now - _window_begin);
+        _window_begin = now;
+        _window_bytes = 0;
+    }
+    _window_bytes += bytes;
+}
+
+void IoGovernor::Queue::stalled(std::chrono::microseconds duration)
+{
+    std::lock_guard lock(_mutex);
+    _stalled += duration;
+}
+
+void IoGovernor::Queue::expect(double mb_per_s)
+{
+    std::lock_guard lock(_mutex);
+    _expected = mb_per_s;
+}
+
+IoGovernor &IoGovernor::instance()
+{
+    static IoGovernor governor;
+    return governor;
+}
+
+IoGovernor::IoGovernor() : IoGovernor(Options{}) {}
+
+IoGovernor::IoGovernor(const Options &options) : _options(options), _virtual(0), _tickets(0) {}
+
+void IoGovernor::configure(const Options &options)
+{
+    {
+        std::lock_guard lock(_mutex);
+        _options = options;
+    }
+    _changed.notify_all();
+}
+
+IoGovernor::Options IoGovernor::options() const
+{
+    std::lock_guard lock(_mutex);
+    return _options;
+}
+
+std::shared_ptr<IoGovernor::Queue> IoGovernor::join(const std::string &camera, const IoShare &share)
+{
+    std::lock_guard lock(_mutex);
+    std::erase_if(_queues, [](const auto &entry) { return entry.second.expired(); });
+    auto &entry = _queues[camera];
+    auto queue = entry.lock();
+    if (queue) {
+        queue->_share = share;
+    } else {
+        queue = std::make_shared<Queue>(*this, camera, share);
+        entry = queue;
+    }
+    return queue;
+}
+
+std::vector<IoGovernor::CameraStats> IoGovernor::stats() const
+{
+    auto now = Clock::now();
+    std::vector<CameraStats> stats;
+    std::lock_guard lock(_mutex);
+    for (const auto &[camera, entry] : _queues) {
+        auto queue = entry.lock();
+        if (!queue) continue;
+        std::lock_guard queue_lock(queue->_mutex);
+        // An idle camera decays towards 0 instead of keeping the rate of its last window.
+        auto elapsed = now - queue->_window_begin;
+        stats.push_back(
+            {camera,
+             queue->_share,
+             queue->_backlog,
+             queue->_bytes,
+             elapsed >= RateWindow ? mb_per_s(queue->_window_bytes, elapsed) : queue->_rate,
+             queue->_expected,
+             queue->_stalled,
+             queue->_finalized}
+        );
+    }
+    return stats;
+}
+
+IoGovernor::Grant IoGovernor::acquire(
+    Queue &queue, Lane lane, std::uint64_t bytes, Grant previous
+)
+{
+    auto begin = Clock::now();
+    std::unique_lock lock(_mutex);
+    auto &state = _lanes[lane];
+    Request request{queue._share.priority, 0, _tickets++};
+    if (lane == Write) {
+        // Tagged on arrival: a camera that was idle starts from now, without credit.
+        auto weight = std::max(queue._share.weight, std::uint32_t{1});
+        request.start = std::max(_virtual, queue._finish);
+        queue._finish = request.start + bytes / static_cast<double>(weight);
+    }
+    state.waiting.push_back(&request);
+    if (previous._governor) {
+        // Released while the lock is held, after the request is in line.
+        --_lanes[previous._lane].busy;
+        previous._governor = nullptr;
+        _changed.notify_all();
+    }
+    auto waited = false;
+
+    while (true) {
+        auto capacity = lane == Write ? _options.writes : _options.finalizers;
+        if (state.busy < std::max<std::size_t>(capacity, 1) && next(state) == &request) {
+            auto gap = lane == Finalize ? _options.finalize_gap : std::chrono::milliseconds(0);
+            auto earliest = state.last_start + gap;
+            if (gap.count() == 0 || Clock::now() >= earliest) break;
+            _changed.wait_until(lock, earliest);
+        } else {
+            _changed.wait(lock);
+        }
+        waited = true;
+    }
+    std::erase(state.waiting, &request);
+    ++state.busy;
+    state.last_start = Clock::now();
+    if (lane == Write) {
+        _virtual = std::max(_virtual, request.start);
+    }
+    lock.unlock();
+    // With room for more than one, the request after this one may go as well.
+    _changed.notify_all();
+
+    if (waited) {
+        queue.stalled(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - begin));
+    }
+    return Grant(this, lane);
+}
+
+void IoGovernor::release(std::size_t lane)
+{
+    {
+        std::lock_guard lock(_mutex);
+        --_lanes[lane].busy;
+    }
+    _changed.notify_all();
+}
+
+const IoGovernor::Request *IoGovernor::next(const LaneState &lane) const
+{
+    auto best = std::min_element(
+        lane.waiting.begin(),
+        lane.waiting.end(),
+        [](const Request *a, const Request *b) {
+            if (a->priority != b->priority) return a->priority > b->priority;
+            if (a->start != b->start) return a->start < b->start;
+            return a->ticket < b->ticket;
+        }
+    );
+    return best == lane.waiting.end() ? nullptr : *best;
+}
+
+}  // namespace xvc
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+namespace xvc
+{
+
+// How a camera shares the disk with the others.
+struct IoShare {
+    std::uint32_t weight = 1;  // Share of the writes among cameras of the same priority.
+    int priority = 0;          // Higher goes first whenever both wait.
+
+    bool operator==(const IoShare &) const = default;
+};
+
+// Shares the disk between the recordings of a process. Every camera gets a Queue; its writers ask
+// it for a grant before each write, and at most `writes` of them hold one at a time. Whenever
+// writes wait, the one of the highest priority goes next, and cameras of the same priority are
+// served in proportion to their weights, in bytes (start-time fair queueing). A camera that was
+// idle gets no credit for it, and with a single camera writing, grants never wait.
+//
+// Finalizing a file (writing out its last blocks and trimming it, compacting and indexing its
+// sidecar) goes through a second, narrower gate, so that cameras splitting at the same time do not
+// all do it at once.
+class IoGovernor
+{
+public:
+    struct Options {
+        std::size_t writes = 2;      // In flight across every camera.
+        std::size_t finalizers = 1;  // Files being finalized at once.
+        // Least time between the start of two finalizations.
+        std::chrono::milliseconds finalize_gap{0};
+    };
+
+    struct CameraStats {
+        std::string camera;
+        IoShare share;
+        std::uint64_t backlog;  // Recorded, not yet handed on to the writer.
+        std::uint64_t bytes;    // Handed on to the writer.
+        double mb_per_s;        // Over the last second or so.
+        double expected_mb_per_s;  // Queue::expect.
+        std::chrono::microseconds stalled;  // Waiting for the writer or for a grant, in total.
+        std::uint64_t finalized;
+    };
+
+    class Queue;
+
+    // Held for the duration of a write or finalization. Empty when default-constructed.
+    class Grant
+    {
+    public:
+        Grant() : _governor(nullptr), _lane(0) {}
+        ~Grant() { release(); }
+        Grant(Grant &&other) noexcept;
+        Grant &operator=(Grant &&other) noexcept;
+
+        void release();
+
+    private:
+        friend class IoGovernor;
+        Grant(IoGovernor *governor, std::size_t lane) : _governor(governor), _lane(lane) {}
+
+        IoGovernor *_governor;
+        std::size_t _lane;
+    };
+
+    // The writers of one camera. Thread-safe.
+    class Queue
+    {
+    public:
+        Queue(IoGovernor &governor, std::string camera, const IoShare &share);
+
+        Queue(const Queue &) = delete;
+        Queue &operator=(const Queue &) = delete;
+
+        // Waits for the turn of a write of `bytes`. A writer with more to write hands in the grant
+        // of its previous write, which is released only once the next request is queued, so the
+        // camera does not lose its place to whoever waits at that moment.
+        [[nodiscard]] Grant write(std::uint64_t bytes, Grant previous = {});
+        // Waits until the camera may finalize a file.
+        [[nodiscard]] Grant finalize();
+
+        // `bytes` were recorded, and later handed on to the writer.
+        void queued(std::uint64_t bytes);
+        void handed(std::uint64_t bytes);
+        // The writer kept the camera waiting.
+        void stalled(std::chrono::microseconds duration);
+        // What the camera is expected to record at, before its rate is measured.
+        void expect(double mb_per_s);
+
+        [[nodiscard]] const std::string &camera() const { return _camera; }
+
+    private:
+        friend class IoGovernor;
+
+        IoGovernor &_governor;
+        std::string _camera;
+
+        // Under the governor's mutex.
+        IoShare _share;
+        double _finish;  // Virtual time of the end of its last write.
+
+        mutable std::mutex _mutex;
+        std::uint64_t _backlog;
+        std::uint64_t _bytes;
+        std::chrono::microseconds _stalled;
+        std::uint64_t _finalized;
+        std::chrono::steady_clock::time_point _window_begin;
+        std::uint64_t _window_bytes;
+        double _rate;  // Of the last complete window.
+        double _expected;
+    };
+
+    // The one the recordings of this process use.
+    static IoGovernor &instance();
+
+    IoGovernor();
+    explicit IoGovernor(const Options &options);
+
+    IoGovernor(const IoGovernor &) = delete;
+    IoGovernor &operator=(const IoGovernor &) = delete;
+
+    // Applies to grants handed out from now on.
+    void configure(const Options &options);
+    [[nodiscard]] Options options() const;
+
+    // The queue of `camera`, shared by everything recording it at the same time. Updates its share.
+    std::shared_ptr<Queue> join(const std::string &camera, const IoShare &share = {});
+
+    // Of the cameras with a queue, by name.
+    [[nodiscard]] std::vector<CameraStats> stats() const;
+
+private:
+    enum Lane : std::size_t { Write, Finalize, Lanes };
+
+    struct Request {
+        int priority;
+        double start;  // Virtual time, of writes.
+        std::uint64_t ticket;
+    };
+
+    struct LaneState {
+        std::size_t busy = 0;
+        std::vector<const Request *> waiting;
+        std::chrono::steady_clock::time_point last_start;
+    };
+
+    Grant acquire(Queue &queue, Lane lane, std::uint64_t bytes, Grant previous = {});
+    void release(std::size_t lane);
+    // The waiting request served next, or nullptr.
+    const Request *next(const LaneState &lane) const;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _changed;
+    Options _options;
+    LaneState _lanes[Lanes];
+    double _virtual;  // Latest start of a write granted.
+    std::uint64_t _tickets;
+    std::map<std::string, std::weak_ptr<Queue>> _queues;
+};
+
+}  // namespace xvc
@@ -0,0 +1,341 @@
+#include "jpeg_decode.h"
+
+#include <gst/gst.h>
+#include <gst/video/gstvideodecoder.h>
+#include <gst/video/video.h>
+#include <spdlog/spdlog.h>
+#include <turbojpeg.h>
+
+#include <array>
+#include <mutex>
+
+
+// GObject boilerplate for the "xvcjpegdec" element.
+
+struct XvcJpegDec {
+    GstVideoDecoder parent;
+    tjhandle handle;
+    gint scale_denom;
+    GstVideoCodecState *input_state;
+    // Geometry of the current output state, renegotiated when the stream or the scale changes.
+    // negotiated_denom is 0 until the first negotiation.
+    gint coded_width;
+    gint coded_height;
+    gint subsampling;
+    gint negotiated_denom;
+};
+
+struct XvcJpegDecClass {
+    GstVideoDecoderClass parent_class;
+};
+
+G_DEFINE_TYPE(XvcJpegDec, xvc_jpeg_dec, GST_TYPE_VIDEO_DECODER)
+
+namespace
+{
+
+enum { PROP_0, PROP_SCALE_DENOM };
+
+GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
+    "sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS("image/jpeg, parsed = (boolean) true")
+);
+
+GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
+    "src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE("{ I420, RGB, RGBA, BGRx }"))
+);
+
+XvcJpegDec *self_of(GstVideoDecoder *decoder) { return reinterpret_cast<XvcJpegDec *>(decoder); }
+
+int pixel_format(GstVideoFormat format)
+{
+    switch (format) {
+    case GST_VIDEO_FORMAT_RGB: return TJPF_RGB;
+    case GST_VIDEO_FORMAT_RGBA: return TJPF_RGBA;
+    case GST_VIDEO_FORMAT_BGRx: return TJPF_BGRX;
+    default: return TJPF_UNKNOWN;
+    }
+}
+
+// Picks the cheapest format downstream accepts: planar output skips colour conversion entirely but
+// is only offered for 4:2:0 JPEGs, everything else is decoded straight to packed RGB.
+GstVideoFormat choose_format(GstVideoDecoder *decoder, int subsampling)
+{
+    auto allowed = gst_pad_get_allowed_caps(GST_VIDEO_DECODER_SRC_PAD(decoder));
+    const std::array candidates = {
+        GST_VIDEO_FORMAT_I420, GST_VIDEO_FORMAT_RGB, GST_VIDEO_FORMAT_RGBA, GST_VIDEO_FORMAT_BGRx
+    };
+
+    auto chosen = GST_VIDEO_FORMAT_UNKNOWN;
+    for (auto format : candidates) {
+        if (format == GST_VIDEO_FORMAT_I420 && subsampling != TJSAMP_420) continue;
+        if (!allowed) {
+            chosen = format;
+            break;
+        }
+        auto caps = gst_caps_new_simple(
+            "video/x-raw", "format", G_TYPE_STRING, gst_video_format_to_string(format), nullptr
+        );
+        auto accepted = gst_caps_can_intersect(allowed, caps);
+        gst_caps_unref(caps);
+        if (accepted) {
+            chosen = format;
+            break;
+        }
+    }
+    if (allowed) gst_caps_unref(allowed);
+    return chosen;
+}
+
+bool negotiate(GstVideoDecoder *decoder, int width, int height, int subsampling)
+{
+    auto self = self_of(decoder);
+    GST_OBJECT_LOCK(self);
+    auto denom = self->scale_denom;
+    GST_OBJECT_UNLOCK(self);
+    if (denom == self->negotiated_denom && width == self->coded_width &&
+        height == self->coded_height && subsampling == self->subsampling) {
+        return true;
+    }
+
+    auto format = choose_format(decoder, subsampling);
+    if (format == GST_VIDEO_FORMAT_UNKNOWN) {
+        spdlog::error("xvcjpegdec: downstream accepts none of I420, RGB, RGBA or BGRx.");
+        return false;
+    }
+
+    tjscalingfactor factor{1, denom};
+    if (tj3SetScalingFactor(self->handle, factor) != 0) {
+        spdlog::error("xvcjpegdec: {}", tj3GetErrorStr(self->handle));
+        return false;
+    }
+
+    auto state = gst_video_decoder_set_output_state(
+        decoder, format, TJSCALED(width, factor), TJSCALED(height, factor), self->input_state
+    );
+    // JFIF: full-range BT.601.
+    state->info.colorimetry.range = GST_VIDEO_COLOR_RANGE_0_255;
+    state->info.colorimetry.matrix = GST_VIDEO_COLOR_MATRIX_BT601;
+    gst_video_codec_state_unref(state);
+    if (!gst_video_decoder_negotiate(decoder)) {
+        return false;
+    }
+
+    self->coded_width = width;
+    self->coded_height = height;
+    self->subsampling = subsampling;
+    self->negotiated_denom = denom;
+    return true;
+}
+
+bool decompress(XvcJpegDec *self, const GstMapInfo &jpeg, GstVideoFrame *out)
+{
+    if (GST_VIDEO_FRAME_FORMAT(out) == GST_VIDEO_FORMAT_I420) {
+        std::array<unsigned char *, 3> planes{};
+        std::array<int, 3> strides{};
+        for (guint i = 0; i < 3; ++i) {
+            planes[i] = static_cast<unsigned char *>(GST_VIDEO_FRAME_PLANE_DATA(out, i));
+            strides[i] = GST_VIDEO_FRAME_PLANE_STRIDE(out, i);
+        }
+        return tj3DecompressToYUVPlanes8(
+                   self->handle, jpeg.data, jpeg.size, planes.data(), strides.data()
+               ) == 0;
+    }
+    return tj3Decompress8(
+               self->handle,
+               jpeg.data,
+               jpeg.size,
+               static_cast<unsigned char *>(GST_VIDEO_FRAME_PLANE_DATA(out, 0)),
+               GST_VIDEO_FRAME_PLANE_STRIDE(out, 0),
+               pixel_format(GST_VIDEO_FRAME_FORMAT(out))
+           ) == 0;
+}
+
+gboolean start(GstVideoDecoder *decoder)
+{
+    auto self = self_of(decoder);
+    self->handle = tj3Init(TJINIT_DECOMPRESS);
+    if (!self->handle) {
+        spdlog::error("xvcjpegdec: failed to create a TurboJPEG decompressor.");
+        return FALSE;
+    }
+    // The element exists for previews, so trade the last bit of accuracy for speed.
+    tj3Set(self->handle, TJPARAM_FASTDCT, 1);
+    tj3Set(self->handle, TJPARAM_FASTUPSAMPLE, 1);
+    self->negotiated_denom = 0;
+    return TRUE;
+}
+
+gboolean stop(GstVideoDecoder *decoder)
+{
+    auto self = self_of(decoder);
+    if (self->handle) {
+        tj3Destroy(self->handle);
+        self->handle = nullptr;
+    }
+    g_clear_pointer(&self->input_state, gst_video_codec_state_unref);
+    return TRUE;
+}
+
+gboolean set_format(GstVideoDecoder *decoder, GstVideoCodecState *state)
+{
+    auto self = self_of(decoder);
+    g_clear_pointer(&self->input_state, gst_video_codec_state_unref);
+    self->input_state = gst_video_codec_state_ref(state);
+    self->negotiated_denom = 0;
+    return TRUE;
+}
+
+GstFlowReturn handle_frame(GstVideoDecoder *decoder, GstVideoCodecFrame *frame)
+{
+    auto self = self_of(decoder);
+
+    GstMapInfo jpeg;
+    if (!gst_buffer_map(frame->input_buffer, &jpeg, GST_MAP_READ)) {
+        return gst_video_decoder_drop_frame(decoder, frame);
+    }
+
+    auto fail = [&](const char *what) {
+        spdlog::warn("xvcjpegdec: {}: {}", what, tj3GetErrorStr(self->handle));
+        gst_buffer_unmap(frame->input_buffer, &jpeg);
+        return gst_video_decoder_drop_frame(decoder, frame);
+    };
+
+    if (tj3DecompressHeader(self->handle, jpeg.data, jpeg.size) != 0) {
+        return fail("invalid JPEG header");
+    }
+    auto width = tj3Get(self->handle, TJPARAM_JPEGWIDTH);
+    auto height = tj3Get(self->handle, TJPARAM_JPEGHEIGHT);
+    auto subsampling = tj3Get(self->handle, TJPARAM_SUBSAMP);
+    if (!negotiate(decoder, width, height, subsampling)) {
+        gst_buffer_unmap(frame->input_buffer, &jpeg);
+        gst_video_decoder_drop_frame(decoder, frame);
+        return GST_FLOW_NOT_NEGOTIATED;
+    }
+
+    auto ret = gst_video_decoder_allocate_output_frame(decoder, frame);
+    if (ret != GST_FLOW_OK) {
+        gst_buffer_unmap(frame->input_buffer, &jpeg);
+        gst_video_decoder_drop_frame(decoder, frame);
+        return ret;
+    }
+
+    auto state = gst_video_decoder_get_output_state(decoder);
+    GstVideoFrame out;
+    auto mapped = gst_video_frame_map(&out, &state->info, frame->output_buffer, GST_MAP_WRITE);
+    gst_video_codec_state_unref(state);
+    if (!mapped) {
+        return fail("cannot map the output buffer");
+    }
+    auto decoded = decompress(self, jpeg, &out);
+    gst_video_frame_unmap(&out);
+    if (!decoded) {
+        return fail("decode failed");
+    }
+
+    gst_buffer_unmap(frame->input_buffer, &jpeg);
+    return gst_video_decoder_finish_frame(decoder, frame);
+}
+
+void set_property(GObject *object, guint id, const GValue *value, GParamSpec *pspec)
+{
+    auto self = reinterpret_cast<XvcJpegDec *>(object);
+    switch (id) {
+    case PROP_SCALE_DENOM: {
+        auto denom = g_value_get_int(value);
+        if (denom != 1 && denom != 2 && denom != 4 && denom != 8) {
+            spdlog::warn("xvcjpegdec: scale-denom must be 1, 2, 4 or 8, not {}.", denom);
+            break;
+        }
+        GST_OBJECT_LOCK(self);
+        self->scale_denom = denom;
+        GST_OBJECT_UNLOCK(self);
+        break;
+    }
+    default: G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, pspec); break;
+    }
+}
+
+void get_property(GObject *object, guint id, GValue *value, GParamSpec *pspec)
+{
+    auto self = reinterpret_cast<XvcJpegDec *>(object);
+    switch (id) {
+    case PROP_SCALE_DENOM: g_value_set_int(value, self->scale_denom); break;
+    default: G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, pspec); break;
+    }
+}
+
+}  // namespace
+
+static void xvc_jpeg_dec_class_init(XvcJpegDecClass *klass)
+{
+    auto gobject_class = G_OBJECT_CLASS(klass);
+    auto element_class = GST_ELEMENT_CLASS(klass);
+    auto decoder_class = GST_VIDEO_DECODER_CLASS(klass);
+
+    gobject_class->set_property = set_property;
+    gobject_class->get_property = get_property;
+    g_object_class_install_property(
+        gobject_class,
+        PROP_SCALE_DENOM,
+        g_param_spec_int(
+            "scale-denom",
+            "Scale denominator",
+            "Decode at 1/N of the coded size (1, 2, 4 or 8)",
+            1,
+            8,
+            1,
+            static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)
+        )
+    );
+
+    gst_element_class_set_static_metadata(
+        element_class,
+        "libxvc JPEG decoder",
+        "Codec/Decoder/Image",
+        "Decodes JPEG images, optionally at 1/2, 1/4 or 1/8 scale",
+        "KonteX Neuroscience"
+    );
+    gst_element_class_add_static_pad_template(element_class, &sink_template);
+    gst_element_class_add_static_pad_template(element_class, &src_template);
+
+    decoder_class->start = start;
+    decoder_class->stop = stop;
+    decoder_class->set_format = set_format;
+    decoder_class->handle_frame = handle_frame;
+}
+
+static void xvc_jpeg_dec_init(XvcJpegDec *self)
+{
+    self->handle = nullptr;
+    self->scale_denom = 1;
+    self->input_state = nullptr;
+    self->coded_width = 0;
+    self->coded_height = 0;
+    self->subsampling = TJSAMP_UNKNOWN;
+    self->negotiated_denom = 0;
+    // One JPEG in, one image out.
+    gst_video_decoder_set_packetized(GST_VIDEO_DECODER(self), TRUE);
+}
+
+
+namespace xvc
+{
+
+bool register_jpeg_decode_element()
+{
+    static std::once_flag once;
+    static auto registered = false;
+    std::call_once(once, [] {
+        registered =
+            gst_element_register(nullptr, "xvcjpegdec", GST_RANK_NONE, xvc_jpeg_dec_get_type());
+        if (!registered) {
+            spdlog::error("Failed to register the xvcjpegdec element.");
+        }
+    });
+    return registered;
+}
+
+}  // namespace xvc
@@ -0,0 +1,13 @@
+#pragma once
+
+
+namespace xvc
+{
+
+// Registers the "xvcjpegdec" element, a JPEG decoder built on TurboJPEG that can decode at 1/2,
+// 1/4 or 1/8 of the coded size through the scaled inverse DCT (property "scale-denom"), so the
+// full-resolution image is never reconstructed. It outputs I420 for 4:2:0 JPEGs, or RGB, RGBA or
+// BGRx when downstream asks for them. Safe to call more than once.
+bool register_jpeg_decode_element();
+
+}  // namespace xvc
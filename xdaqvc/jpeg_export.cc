@@ -0,0 +1,202 @@
+#include "jpeg_export.h"
+
+#include <fmt/core.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <system_error>
+#include <thread>
+
+#include "mapped_file.h"
+#include "mkv_scanner.h"
+
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+
+struct Block {
+    std::uint64_t offset;
+    std::uint32_t size;
+    std::int64_t pts;
+};
+
+struct Segment {
+    xvc::MappedFile file;
+    std::vector<Block> blocks;
+    std::size_t first;  // Session frame number of its first frame.
+};
+
+// Runs `work(index)` for every index below `count` on up to `workers` threads.
+void parallel_for(std::size_t count, int workers, const std::function<void(std::size_t)> &work)
+{
+    workers = workers > 0 ? workers : static_cast<int>(std::thread::hardware_concurrency());
+    workers = std::clamp(workers, 1, static_cast<int>(std::max<std::size_t>(count, 1)));
+    std::atomic<std::size_t> next{0};
+    std::vector<std::jthread> pool;
+    for (auto i = 0; i < workers; ++i) {
+        pool.emplace_back([&] {
+            for (auto index = next++; index < count; index = next++) {
+                work(index);
+            }
+        });
+    }
+}
+
+// SOI at the start; the end is not checked, since some cameras pad after EOI.
+bool is_jpeg(std::span<const std::uint8_t> data)
+{
+    return data.size() >= 4 && data[0] == 0xFF && data[1] == 0xD8;
+}
+
+}  // namespace
+
+
+namespace xvc
+{
+
+JpegExportReport export_jpeg(
+    const std::vector<fs::path> &segments, const JpegSink &sink, const JpegExportOptions &options
+)
+{
+    auto begin = std::chrono::steady_clock::now();
+    std::atomic<std::size_t> frames{0};
+    std::atomic<std::size_t> failed{0};
+    std::atomic<std::uintmax_t> bytes{0};
+    std::atomic<std::size_t> failed_segments{0};
+    auto report = [&](bool aborted = false) {
+        auto seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        return JpegExportReport{frames, failed, bytes, seconds, failed_segments, aborted};
+    };
+    if (options.stride == 0) {
+        spdlog::error("JPEG export: the stride must be at least 1.");
+        return report(true);
+    }
+
+    // Only the block headers are read here; the numbering across segments needs every
+    // segment's frame count before any frame is exported.
+    std::vector<Segment> inputs(segments.size());
+    parallel_for(segments.size(), options.workers, [&](std::size_t s) {
+        auto &input = inputs[s];
+        input.file = MappedFile(segments[s]);
+        MkvScanner scanner(input.file.data());
+        if (!scanner.open()) {
+            spdlog::error("{}: {}", segments[s].string(), scanner.error());
+            ++failed_segments;
+            return;
+        }
+        const auto &tracks = scanner.tracks();
+        auto track = std::find_if(tracks.begin(), tracks.end(), [](const MkvTrack &t) {
+            return t.codec_id == JpegCodecId;
+        });
+        if (track == tracks.end()) {
+            spdlog::error("{}: no M-JPEG track.", segments[s].string());
+            ++failed_segments;
+            return;
+        }
+        auto complete = scanner.scan([&](const MkvBlock &block) {
+            if (block.track == track->number) {
+                auto size = static_cast<std::uint32_t>(block.payload.size());
+                input.blocks.push_back({block.offset, size, block.pts});
+            }
+            return true;
+        });
+        // Cut short by a crash: the frames before the damage are still numbered right.
+        if (!complete) {
+            spdlog::warn("{}: {}", segments[s].string(), scanner.error());
+        }
+    });
+    if (failed_segments > 0) {
+        spdlog::error("JPEG export: {} segments could not be read.", failed_segments.load());
+        return report(true);
+    }
+    std::size_t total = 0;
+    for (auto &input : inputs) {
+        input.first = total;
+        total += input.blocks.size();
+    }
+
+    auto first = options.first;
+    auto last = first + std::min(options.count, total - std::min(first, total));
+    std::atomic<bool> stopped{false};
+    parallel_for(inputs.size(), options.workers, [&](std::size_t s) {
+        const auto &input = inputs[s];
+        auto begin_frame = std::max(first, input.first);
+        auto end_frame = std::min(last, input.first + input.blocks.size());
+        if (begin_frame >= end_frame) return;
+        // The first selected frame at or after the start of the segment.
+        begin_frame += (options.stride - (begin_frame - first) % options.stride) % options.stride;
+
+        auto data = input.file.data();
+        for (auto n = begin_frame; n < end_frame && !stopped; n += options.stride) {
+            auto frame = static_cast<std::uint32_t>(n - input.first);
+            const auto &block = input.blocks[frame];
+            auto jpeg = data.subspan(block.offset, block.size);
+            if (!is_jpeg(jpeg)) {
+                ++failed;
+                continue;
+            }
+            if (!sink({n, static_cast<std::uint32_t>(s), frame, block.pts, jpeg})) {
+                stopped = true;
+                break;
+            }
+            ++frames;
+            bytes += jpeg.size();
+        }
+    });
+    return report();
+}
+
+JpegExportReport export_jpeg(
+    const std::vector<fs::path> &segments, const fs::path &directory,
+    const JpegExportOptions &options
+)
+{
+    // Formatted on the worker threads, where an exception would end the process.
+    try {
+        auto name = [&](std::size_t number) {
+            return fmt::format(fmt::runtime(options.pattern), number);
+        };
+        if (name(0) == name(1)) {
+            throw fmt::format_error("every frame gets the same name");
+        }
+    } catch (const fmt::format_error &error) {
+        spdlog::error("JPEG export: invalid pattern \"{}\": {}", options.pattern, error.what());
+        return {0, 0, 0, 0.0, 0, true};
+    }
+    std::error_code ec;
+    fs::create_directories(directory, ec);
+    if (ec) {
+        spdlog::error("{}: {}", directory.string(), ec.message());
+        return {0, 0, 0, 0.0, 0, true};
+    }
+    std::atomic<std::size_t> unwritten{0};
+    std::atomic<std::uintmax_t> unwritten_bytes{0};
+    auto report = export_jpeg(
+        segments,
+        [&](const JpegFrame &frame) {
+            auto path = directory / fmt::format(fmt::runtime(options.pattern), frame.number);
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char *>(frame.jpeg.data()), frame.jpeg.size());
+            if (!out.flush()) {
+                spdlog::error("{}: could not be written", path.string());
+                ++unwritten;
+                unwritten_bytes += frame.jpeg.size();
+            }
+            return true;
+        },
+        options
+    );
+    report.frames -= unwritten;
+    report.failed += unwritten;
+    report.bytes -= unwritten_bytes;
+    return report;
+}
+
+}  // namespace xvc
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <span>
+#include <string>
+#include <vector>
+
+
+namespace xvc
+{
+
+struct JpegExportOptions {
+    // Frames [first, first + count) of the session, numbered across its segments, every
+    // `stride`-th of them.
+    std::size_t first = 0;
+    std::size_t count = std::numeric_limits<std::size_t>::max();
+    std::size_t stride = 1;
+    int workers = 0;  // Segments exported in parallel; 0 picks one per hardware thread.
+    // File names in the output directory, formatted with the frame number.
+    std::string pattern = "frame_{:06}.jpg";
+};
+
+struct JpegExportReport {
+    std::size_t frames;    // Exported.
+    std::size_t failed;    // Blocks that were not a JPEG image, or could not be written.
+    std::uintmax_t bytes;  // Of the exported images.
+    double seconds;
+    // Segments that could not be opened or have no M-JPEG track. Any of them aborts the export,
+    // as the frames after it could not be numbered.
+    std::size_t failed_segments;
+    bool aborted;  // Nothing was exported: invalid options, unreadable segments or directory.
+};
+
+struct JpegFrame {
+    std::size_t number;      // In the session.
+    std::uint32_t segment;   // Index into the segments given.
+    std::uint32_t frame;     // In the segment.
+    std::int64_t pts;        // In the segment, nanoseconds.
+    std::span<const std::uint8_t> jpeg;
+};
+
+// Called on the worker threads, several segments at once but in frame order within a segment.
+// `jpeg` points into the mapped recording and is only valid during the call. Returning false
+// stops the export.
+using JpegSink = std::function<bool(const JpegFrame &frame)>;
+
+// Copies the frames of M-JPEG recordings out as they are stored. The camera's JPEG images are
+// muxed as they came, one per Matroska block, so nothing is decoded or re-encoded and the images
+// are bit-exact. `segments` are the session's .mkv files in order; each is mapped and walked
+// with MkvScanner on its own worker.
+JpegExportReport export_jpeg(
+    const std::vector<std::filesystem::path> &segments, const JpegSink &sink,
+    const JpegExportOptions &options = {}
+);
+// Writes the frames as image files in `directory`, which is created if needed. Aborts if
+// `options.pattern` cannot format a frame number.
+JpegExportReport export_jpeg(
+    const std::vector<std::filesystem::path> &segments, const std::filesystem::path &directory,
+    const JpegExportOptions &options = {}
+);
+
+}  // namespace xvc
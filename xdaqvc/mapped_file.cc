@@ -0,0 +1,130 @@
+#include "mapped_file.h"
+
+#include <spdlog/spdlog.h>
+
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace xvc
+{
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::filesystem::path &path, Access access)
+{
+    auto hint = access == Access::Sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS;
+    _file = CreateFileW(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_DELETE,
+        nullptr,
+        OPEN_EXISTING,
+        hint,
+        nullptr
+    );
+    if (_file == INVALID_HANDLE_VALUE) {
+        _file = nullptr;
+        spdlog::error("Failed to open {}: error {}", path.string(), GetLastError());
+        return;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(_file, &size)) {
+        close();
+        return;
+    }
+    _open = true;
+    if (size.QuadPart == 0) return;
+
+    _mapping = CreateFileMappingW(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    auto view = _mapping ? MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        spdlog::error("Failed to map {}: error {}", path.string(), GetLastError());
+        close();
+        return;
+    }
+    _data = static_cast<const std::uint8_t *>(view);
+    _size = static_cast<std::size_t>(size.QuadPart);
+}
+
+void MappedFile::close()
+{
+    if (_data) UnmapViewOfFile(_data);
+    if (_mapping) CloseHandle(_mapping);
+    if (_file) CloseHandle(_file);
+    _open = false;
+    _data = nullptr;
+    _size = 0;
+    _mapping = nullptr;
+    _file = nullptr;
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path &path, Access access)
+{
+    auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        spdlog::error("Failed to open {}: {}", path.string(), std::strerror(errno));
+        return;
+    }
+    struct stat st {};
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return;
+    }
+    _open = true;
+    if (st.st_size > 0) {
+        auto view = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view == MAP_FAILED) {
+            spdlog::error("Failed to map {}: {}", path.string(), std::strerror(errno));
+            _open = false;
+        } else {
+            madvise(view, st.st_size, access == Access::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+            _data = static_cast<const std::uint8_t *>(view);
+            _size = static_cast<std::size_t>(st.st_size);
+        }
+    }
+    // The mapping keeps the file referenced.
+    ::close(fd);
+}
+
+void MappedFile::close()
+{
+    if (_data) munmap(const_cast<std::uint8_t *>(_data), _size);
+    _open = false;
+    _data = nullptr;
+    _size = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile() { close(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept { *this = std::move(other); }
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+    if (this != &other) {
+        close();
+        _open = std::exchange(other._open, false);
+        _data = std::exchange(other._data, nullptr);
+        _size = std::exchange(other._size, 0);
+#ifdef _WIN32
+        _file = std::exchange(other._file, nullptr);
+        _mapping = std::exchange(other._mapping, nullptr);
+#endif
+    }
+    return *this;
+}
+
+}  // namespace xvc
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+
+namespace xvc
+{
+
+// A whole file mapped read-only into memory. An empty or unreadable file maps to an empty span;
+// is_open() tells them apart.
+class MappedFile
+{
+public:
+    enum class Access { Sequential, Random };
+
+    MappedFile() = default;
+    explicit MappedFile(const std::filesystem::path &path, Access access = Access::Sequential);
+    ~MappedFile();
+
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    [[nodiscard]] bool is_open() const { return _open; }
+    [[nodiscard]] std::span<const std::uint8_t> data() const { return {_data, _size}; }
+
+private:
+    void close();
+
+    bool _open = false;
+    const std::uint8_t *_data = nullptr;
+    std::size_t _size = 0;
+#ifdef _WIN32
+    void *_file = nullptr;
+    void *_mapping = nullptr;
+#endif
+};
+
+}  // namespace xvc
@@ -0,0 +1,392 @@
+#include "metadata_extract.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <system_error>
+#include <thread>
+
+#include "hevc.h"
+#include "mapped_file.h"
+#include "mkv_scanner.h"
+#include "sidecar.h"
+#include "xdaqmetadata/key_value_store.h"
+#include "xdaqmetadata/xdaqmetadata.h"
+
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+
+GstElement *create_element(const gchar *factoryname, const gchar *name)
+{
+    auto element = gst_element_factory_make(factoryname, name);
+    if (!element) {
+        spdlog::error("Element {} could not be created.", factoryname);
+    }
+    return element;
+}
+
+// parser ! [capsfilter] ! fakesink, with the extractor probe on the parser's source pad.
+GstElement *create_branch(
+    const gchar *name, const gchar *parser_factory, GstCaps *caps, GstPadProbeCallback probe,
+    gpointer user_data
+)
+{
+    auto bin = gst_bin_new(name);
+    auto parser = create_element(parser_factory, "parser");
+    auto sink = create_element("fakesink", "sink");
+    g_object_set(G_OBJECT(sink), "sync", FALSE, nullptr);
+    gst_bin_add_many(GST_BIN(bin), parser, sink, nullptr);
+
+    auto last = parser;
+    if (caps) {
+        auto cf_parser = create_element("capsfilter", "cf_parser");
+        g_object_set(G_OBJECT(cf_parser), "caps", caps, nullptr);
+        gst_bin_add(GST_BIN(bin), cf_parser);
+        gst_element_link(parser, cf_parser);
+        last = cf_parser;
+    }
+    gst_element_link(last, sink);
+
+    std::unique_ptr<GstPad, decltype(&gst_object_unref)> sink_pad(
+        gst_element_get_static_pad(parser, "sink"), gst_object_unref
+    );
+    gst_element_add_pad(bin, gst_ghost_pad_new("sink", sink_pad.get()));
+    std::unique_ptr<GstPad, decltype(&gst_object_unref)> src_pad(
+        gst_element_get_static_pad(parser, "src"), gst_object_unref
+    );
+    gst_pad_add_probe(src_pad.get(), GST_PAD_PROBE_TYPE_BUFFER, probe, user_data, nullptr);
+    return GST_ELEMENT(gst_object_ref_sink(bin));
+}
+
+fs::path sidecar_path(const fs::path &video, const fs::path &sidecar)
+{
+    return sidecar.empty() ? fs::path(video).replace_extension(".bin") : sidecar;
+}
+
+// Moves a complete `partial` sidecar into place, or removes it.
+bool commit_sidecar(const fs::path &partial, const fs::path &sidecar, bool ok)
+{
+    std::error_code ec;
+    if (ok) {
+        fs::rename(partial, sidecar, ec);
+        if (ec) {
+            spdlog::error("{}: {}", sidecar.string(), ec.message());
+            ok = false;
+        }
+    }
+    if (!ok) {
+        fs::remove(partial, ec);
+    }
+    return ok;
+}
+
+}  // namespace
+
+
+namespace xvc
+{
+
+MetadataExtractor::MetadataExtractor() : _branch(nullptr), _store(nullptr)
+{
+    _pipeline = gst_pipeline_new("extract");
+    _src = create_element("filesrc", "src");
+    _demux = create_element("matroskademux", "demux");
+    gst_bin_add_many(GST_BIN(_pipeline), _src, _demux, nullptr);
+    gst_element_link(_src, _demux);
+    g_signal_connect(_demux, "pad-added", G_CALLBACK(&MetadataExtractor::on_pad_added), this);
+
+    // clang-format off
+    std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> byte_stream(
+        gst_caps_new_simple(
+        "video/x-h265",
+        "stream-format", G_TYPE_STRING, "byte-stream",
+        "alignment", G_TYPE_STRING, "au",
+        nullptr),
+        gst_caps_unref
+    );
+    // clang-format on
+    _h265 = create_branch(
+        "h265", "h265parse", byte_stream.get(), &MetadataExtractor::on_h265, this
+    );
+    _jpeg = create_branch("jpeg", "jpegparse", nullptr, &MetadataExtractor::on_jpeg, this);
+}
+
+MetadataExtractor::~MetadataExtractor()
+{
+    gst_element_set_state(_pipeline, GST_STATE_NULL);
+    gst_object_unref(_pipeline);
+    gst_object_unref(_h265);
+    gst_object_unref(_jpeg);
+}
+
+bool MetadataExtractor::extract(const fs::path &video, const fs::path &sidecar)
+{
+    auto target = sidecar_path(video, sidecar);
+    auto partial = fs::path(target) += ".part";
+
+    KeyValueStore store(partial.string());
+    store.openFile();
+    _store = &store;
+
+    g_object_set(G_OBJECT(_src), "location", video.string().c_str(), nullptr);
+    gst_element_set_state(_pipeline, GST_STATE_PLAYING);
+
+    std::unique_ptr<GstBus, decltype(&gst_object_unref)> bus(
+        gst_element_get_bus(_pipeline), gst_object_unref
+    );
+    std::unique_ptr<GstMessage, decltype(&gst_message_unref)> message(
+        gst_bus_timed_pop_filtered(
+            bus.get(), GST_CLOCK_TIME_NONE, GstMessageType(GST_MESSAGE_EOS | GST_MESSAGE_ERROR)
+        ),
+        gst_message_unref
+    );
+    auto ok = message && GST_MESSAGE_TYPE(message.get()) == GST_MESSAGE_EOS && _branch;
+    if (message && GST_MESSAGE_TYPE(message.get()) == GST_MESSAGE_ERROR) {
+        GError *error = nullptr;
+        gst_message_parse_error(message.get(), &error, nullptr);
+        spdlog::error("{}: {}", video.string(), error ? error->message : "unknown error");
+        g_clear_error(&error);
+    } else if (!_branch) {
+        spdlog::error("{}: no H.265 or M-JPEG track.", video.string());
+    }
+
+    gst_element_set_state(_pipeline, GST_STATE_NULL);
+    if (_branch) {
+        gst_bin_remove(GST_BIN(_pipeline), _branch);
+        _branch = nullptr;
+    }
+    _store = nullptr;
+    store.closeFile();
+    return commit_sidecar(partial, target, ok);
+}
+
+void MetadataExtractor::on_pad_added(GstElement *, GstPad *pad, gpointer user_data)
+{
+    auto self = static_cast<MetadataExtractor *>(user_data);
+    if (self->_branch) return;
+
+    std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> caps(
+        gst_pad_query_caps(pad, nullptr), gst_caps_unref
+    );
+    if (!caps || gst_caps_is_empty(caps.get())) return;
+    std::string_view name = gst_structure_get_name(gst_caps_get_structure(caps.get(), 0));
+    GstElement *branch = nullptr;
+    if (name == "video/x-h265") {
+        branch = self->_h265;
+    } else if (name == "image/jpeg") {
+        branch = self->_jpeg;
+    } else {
+        return;
+    }
+
+    gst_bin_add(GST_BIN(self->_pipeline), branch);
+    gst_element_sync_state_with_parent(branch);
+    std::unique_ptr<GstPad, decltype(&gst_object_unref)> sink_pad(
+        gst_element_get_static_pad(branch, "sink"), gst_object_unref
+    );
+    if (GST_PAD_LINK_FAILED(gst_pad_link(pad, sink_pad.get()))) {
+        spdlog::error("Failed to link the demuxer to the {} parser.", name);
+        return;
+    }
+    self->_branch = branch;
+}
+
+GstPadProbeReturn MetadataExtractor::on_h265(
+    GstPad *pad, GstPadProbeInfo *info, gpointer user_data
+)
+{
+    auto self = static_cast<MetadataExtractor *>(user_data);
+    if (!self->_store) return GST_PAD_PROBE_OK;
+    return h265_parse_saving_metadata(pad, info, self->_store);
+}
+
+GstPadProbeReturn MetadataExtractor::on_jpeg(
+    GstPad *pad, GstPadProbeInfo *info, gpointer user_data
+)
+{
+    auto self = static_cast<MetadataExtractor *>(user_data);
+    if (!self->_store) return GST_PAD_PROBE_OK;
+    return jpeg_parse_saving_metadata(pad, info, self->_store);
+}
+
+bool scan_metadata(const fs::path &video, const fs::path &sidecar)
+{
+    MappedFile file(video);
+    if (!file.is_open()) return false;
+    MkvScanner scanner(file.data());
+    if (!scanner.open()) {
+        spdlog::error("{}: {}", video.string(), scanner.error());
+        return false;
+    }
+    const auto &tracks = scanner.tracks();
+    auto track = std::find_if(tracks.begin(), tracks.end(), [](const MkvTrack &t) {
+        return t.codec_id == HevcCodecId || t.codec_id == JpegCodecId;
+    });
+    if (track == tracks.end()) {
+        spdlog::error("{}: no H.265 or M-JPEG track.", video.string());
+        return false;
+    }
+    auto h265 = track->codec_id == HevcCodecId;
+    std::optional<HevcConfig> config;
+    if (h265 && !(config = parse_hvcc(track->codec_private))) {
+        spdlog::error("{}: invalid HEVC codec private data.", video.string());
+        return false;
+    }
+
+    // The extractors are pad probes; give them a pad with the caps the parser would have set.
+    std::unique_ptr<GstPad, decltype(&gst_object_unref)> pad(
+        gst_pad_new("src", GST_PAD_SRC), gst_object_unref
+    );
+    // clang-format off
+    std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> caps(
+        h265 ? gst_caps_new_simple(
+                   "video/x-h265",
+                   "stream-format", G_TYPE_STRING, "byte-stream",
+                   "alignment", G_TYPE_STRING, "au",
+                   nullptr)
+             : gst_caps_new_simple("image/jpeg", "parsed", G_TYPE_BOOLEAN, TRUE, nullptr),
+        gst_caps_unref
+    );
+    // clang-format on
+    gst_pad_set_active(pad.get(), TRUE);
+    gst_pad_push_event(pad.get(), gst_event_new_stream_start(video.filename().string().c_str()));
+    gst_pad_push_event(pad.get(), gst_event_new_caps(caps.get()));
+    auto extract = h265 ? h265_parse_saving_metadata : jpeg_parse_saving_metadata;
+
+    auto target = sidecar_path(video, sidecar);
+    auto partial = fs::path(target) += ".part";
+    KeyValueStore store(partial.string());
+    store.openFile();
+
+    std::vector<std::uint8_t> au;
+    auto parameter_sets_sent = false;
+    auto converted = true;
+    auto scanned = scanner.scan([&](const MkvBlock &block) {
+        if (block.track != track->number) return true;
+
+        GstBuffer *buffer;
+        if (h265) {
+            au.clear();
+            if (block.keyframe && !parameter_sets_sent) {
+                au = config->parameter_sets;
+                parameter_sets_sent = true;
+            }
+            if (!append_byte_stream(block.payload, config->length_size, au)) {
+                spdlog::error("{}: malformed access unit at {}", video.string(), block.offset);
+                converted = false;
+                return false;
+            }
+            buffer = gst_buffer_new_allocate(nullptr, au.size(), nullptr);
+            gst_buffer_fill(buffer, 0, au.data(), au.size());
+        } else {
+            // A view of the mapping, released before the file is unmapped.
+            auto data = const_cast<std::uint8_t *>(block.payload.data());
+            auto size = block.payload.size();
+            buffer = gst_buffer_new_wrapped_full(
+                GST_MEMORY_FLAG_READONLY, data, size, 0, size, nullptr, nullptr
+            );
+        }
+        GST_BUFFER_PTS(buffer) = block.pts >= 0 ? block.pts : GST_CLOCK_TIME_NONE;
+        if (!block.keyframe) {
+            GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+        }
+
+        GstPadProbeInfo info{};
+        info.type = GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_PUSH);
+        info.data = buffer;
+        info.size = gst_buffer_get_size(buffer);
+        extract(pad.get(), &info, &store);
+        gst_buffer_unref(GST_PAD_PROBE_INFO_BUFFER(&info));
+        return true;
+    });
+    if (!scanned) {
+        spdlog::error("{}: {}", video.string(), scanner.error());
+    }
+    store.closeFile();
+    gst_pad_set_active(pad.get(), FALSE);
+    return commit_sidecar(partial, target, scanned && converted);
+}
+
+std::vector<fs::path> find_recordings(const fs::path &root)
+{
+    std::vector<fs::path> videos;
+    std::error_code ec;
+    if (fs::is_regular_file(root, ec)) {
+        videos.push_back(root);
+        return videos;
+    }
+    for (fs::recursive_directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_regular_file(ec) && it->path().extension() == ".mkv") {
+            videos.push_back(it->path());
+        }
+    }
+    std::sort(videos.begin(), videos.end());
+    return videos;
+}
+
+bool sidecar_up_to_date(const fs::path &video)
+{
+    std::error_code ec;
+    auto sidecar = fs::last_write_time(find_sidecar(video), ec);
+    if (ec) return false;
+    auto recording = fs::last_write_time(video, ec);
+    return !ec && sidecar >= recording;
+}
+
+ExtractReport extract_metadata(const std::vector<fs::path> &videos, const ExtractOptions &options)
+{
+    auto begin = std::chrono::steady_clock::now();
+    auto workers = options.workers > 0 ? options.workers
+                                       : static_cast<int>(std::thread::hardware_concurrency());
+    workers = std::clamp(workers, 1, static_cast<int>(std::max<std::size_t>(videos.size(), 1)));
+
+    std::atomic<std::size_t> next{0};
+    std::atomic<std::size_t> files{0};
+    std::atomic<std::size_t> skipped{0};
+    std::atomic<std::size_t> failed{0};
+    std::atomic<std::uintmax_t> bytes{0};
+    {
+        std::vector<std::jthread> pool;
+        for (auto i = 0; i < workers; ++i) {
+            pool.emplace_back([&] {
+                // Only built for files the scanner cannot read.
+                std::optional<MetadataExtractor> extractor;
+                for (auto index = next++; index < videos.size(); index = next++) {
+                    const auto &video = videos[index];
+                    if (!options.force && sidecar_up_to_date(video)) {
+                        ++skipped;
+                        continue;
+                    }
+                    std::error_code ec;
+                    auto size = fs::file_size(video, ec);
+                    auto ok = !options.demux && scan_metadata(video);
+                    if (!ok) {
+                        if (!extractor) extractor.emplace();
+                        ok = extractor->extract(video);
+                    }
+                    if (ok) {
+                        ++files;
+                        bytes += ec ? 0 : size;
+                    } else {
+                        ++failed;
+                    }
+                }
+            });
+        }
+    }
+    auto seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return {files, skipped, failed, bytes, seconds};
+}
+
+}  // namespace xvc
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <gst/gst.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+
+class KeyValueStore;
+
+
+namespace xvc
+{
+
+struct ExtractOptions {
+    int workers = 0;     // Files extracted in parallel; 0 picks one per hardware thread.
+    bool force = false;  // Also rewrite sidecars that are newer than their video.
+    bool demux = false;  // Always go through matroskademux instead of scan_metadata().
+};
+
+struct ExtractReport {
+    std::size_t files;    // Sidecars written.
+    std::size_t skipped;  // Already up to date.
+    std::size_t failed;
+    std::uintmax_t bytes;  // Video read.
+    double seconds;
+};
+
+// Writes the .bin sidecar of finished .mkv recordings, H.265 or M-JPEG, with the xdaqmetadata
+// extractor of their codec. One demux pipeline is reused for consecutive files; only the parser
+// branch matching the codec is swapped in. The sidecar is written next to the video under a
+// temporary name and renamed once complete, so an interrupted run never leaves a partial .bin.
+class MetadataExtractor
+{
+public:
+    MetadataExtractor();
+    ~MetadataExtractor();
+
+    MetadataExtractor(const MetadataExtractor &) = delete;
+    MetadataExtractor &operator=(const MetadataExtractor &) = delete;
+
+    // `sidecar` defaults to the video's path with a .bin extension.
+    bool extract(const std::filesystem::path &video, const std::filesystem::path &sidecar = {});
+
+private:
+    static void on_pad_added(GstElement *demux, GstPad *pad, gpointer user_data);
+    static GstPadProbeReturn on_h265(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+    static GstPadProbeReturn on_jpeg(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+
+    GstElement *_pipeline;
+    GstElement *_src;
+    GstElement *_demux;
+    GstElement *_h265;  // Parser branches, owned here and only in the pipeline while used.
+    GstElement *_jpeg;
+    GstElement *_branch;
+    KeyValueStore *_store;
+};
+
+// Writes the same sidecar as MetadataExtractor from a memory-mapped walk of the Matroska blocks,
+// with neither demuxing nor parsing through GStreamer. H.265 access units are rewritten from hvc1
+// to the byte-stream form h265parse hands the extractor, parameter sets ahead of the first
+// keyframe; M-JPEG frames are handed over in place.
+bool scan_metadata(const std::filesystem::path &video, const std::filesystem::path &sidecar = {});
+
+// The .mkv files under `root`, recursively, or `root` itself if it is one.
+std::vector<std::filesystem::path> find_recordings(const std::filesystem::path &root);
+// The sidecar, .bin or .xbin, exists and is not older than the video.
+bool sidecar_up_to_date(const std::filesystem::path &video);
+// Extracts `videos` on a pool of workers with scan_metadata(), falling back to a MetadataExtractor
+// per worker for files the scanner cannot read.
+ExtractReport extract_metadata(
+    const std::vector<std::filesystem::path> &videos, const ExtractOptions &options = {}
+);
+
+}  // namespace xvc
@@ -0,0 +1,251 @@
+#include "metadata_sidecar.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <utility>
+
+#include "xdaqmetadata/key_value_store.h"
+
+
+namespace
+{
+
+constexpr std::size_t MaxPending = 1024;
+
+// The source pad of the multiqueue inside splitmuxsink. splitmuxsink switches fragments in its own
+// probe on that pad, which runs before any probe added later.
+GstPad *find_muxed_pad(GstElement *filesink)
+{
+    GstPad *pad = nullptr;
+    auto elements = gst_bin_iterate_elements(GST_BIN(filesink));
+    GValue item = G_VALUE_INIT;
+    while (!pad && gst_iterator_next(elements, &item) == GST_ITERATOR_OK) {
+        auto element = GST_ELEMENT(g_value_get_object(&item));
+        auto factory = gst_element_get_factory(element);
+        if (factory &&
+            g_strcmp0(gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory)), "multiqueue") == 0) {
+            auto pads = gst_element_iterate_src_pads(element);
+            GValue src = G_VALUE_INIT;
+            if (gst_iterator_next(pads, &src) == GST_ITERATOR_OK) {
+                pad = GST_PAD(g_value_dup_object(&src));
+            }
+            g_value_unset(&src);
+            gst_iterator_free(pads);
+        }
+        g_value_reset(&item);
+    }
+    g_value_unset(&item);
+    gst_iterator_free(elements);
+    return pad;
+}
+
+}  // namespace
+
+
+namespace xvc
+{
+
+MetadataSidecar::MetadataSidecar(GstElement *writer, GstPadProbeCallback extract, Closed closed)
+    : _extract(extract),
+      _closed(std::move(closed)),
+      _stream_pad(nullptr),
+      _muxed_pad(nullptr),
+      _stream_probe(0),
+      _muxed_probe(0),
+      _finishing(false),
+      _current(nullptr)
+{
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> parser(
+        gst_bin_get_by_name(GST_BIN(writer), "record_parser"), gst_object_unref
+    );
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> filesink(
+        gst_bin_get_by_name(GST_BIN(writer), "filesink"), gst_object_unref
+    );
+    _stream_pad = gst_element_get_static_pad(parser.get(), "sink");
+    _muxed_pad = find_muxed_pad(filesink.get());
+    if (!_muxed_pad) {
+        // Sidecars may then be cut a GOP early or late.
+        spdlog::warn("Metadata sidecar: splitmuxsink has no multiqueue, using its sink pad.");
+        auto pads = gst_element_iterate_sink_pads(filesink.get());
+        GValue sink = G_VALUE_INIT;
+        if (gst_iterator_next(pads, &sink) == GST_ITERATOR_OK) {
+            _muxed_pad = GST_PAD(g_value_dup_object(&sink));
+        }
+        g_value_unset(&sink);
+        gst_iterator_free(pads);
+    }
+
+    _worker = std::jthread(&MetadataSidecar::run, this);
+    _stream_probe = gst_pad_add_probe(
+        _stream_pad, GST_PAD_PROBE_TYPE_BUFFER, &MetadataSidecar::on_stream, this, nullptr
+    );
+    if (_muxed_pad) {
+        _muxed_probe = gst_pad_add_probe(
+            _muxed_pad, GST_PAD_PROBE_TYPE_BUFFER, &MetadataSidecar::on_muxed, this, nullptr
+        );
+    }
+}
+
+MetadataSidecar::~MetadataSidecar()
+{
+    gst_pad_remove_probe(_stream_pad, _stream_probe);
+    gst_object_unref(_stream_pad);
+    if (_muxed_pad) {
+        gst_pad_remove_probe(_muxed_pad, _muxed_probe);
+        gst_object_unref(_muxed_pad);
+    }
+    finish();
+}
+
+void MetadataSidecar::finish()
+{
+    {
+        std::lock_guard lock(_mutex);
+        _finishing = true;
+    }
+    _posted.notify_one();
+    if (_worker.joinable()) {
+        _worker.join();
+    }
+}
+
+MetadataSidecar::Stats MetadataSidecar::stats() const
+{
+    return {_frames.load(), _files.load(), _batches.load()};
+}
+
+GstPadProbeReturn MetadataSidecar::on_stream(GstPad *, GstPadProbeInfo *info, gpointer user_data)
+{
+    auto buffer = gst_pad_probe_info_get_buffer(info);
+    static_cast<MetadataSidecar *>(user_data)->post(
+        {Event::Type::Stream, gst_buffer_ref(buffer), 0, {}}
+    );
+    return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn MetadataSidecar::on_muxed(GstPad *, GstPadProbeInfo *info, gpointer user_data)
+{
+    auto buffer = gst_pad_probe_info_get_buffer(info);
+    static_cast<MetadataSidecar *>(user_data)->post(
+        {Event::Type::Muxed, nullptr, GST_BUFFER_PTS(buffer), {}}
+    );
+    return GST_PAD_PROBE_OK;
+}
+
+void MetadataSidecar::message(GstMessage *message)
+{
+    if (GST_MESSAGE_TYPE(message) != GST_MESSAGE_ELEMENT) return;
+    auto structure = gst_message_get_structure(message);
+    auto location = structure ? gst_structure_get_string(structure, "location") : nullptr;
+    if (!location) return;
+
+    if (gst_structure_has_name(structure, "splitmuxsink-fragment-opened")) {
+        post({Event::Type::Opened, nullptr, 0, location});
+    } else if (gst_structure_has_name(structure, "splitmuxsink-fragment-closed")) {
+        post({Event::Type::Closed, nullptr, 0, location});
+    }
+}
+
+void MetadataSidecar::post(Event event)
+{
+    {
+        std::lock_guard lock(_mutex);
+        _events.push_back(std::move(event));
+    }
+    _posted.notify_one();
+}
+
+void MetadataSidecar::run()
+{
+    std::vector<Event> batch;
+    while (true) {
+        {
+            std::unique_lock lock(_mutex);
+            _posted.wait(lock, [this] { return !_events.empty() || _finishing; });
+            if (_events.empty()) break;
+            batch.swap(_events);
+        }
+        ++_batches;
+        for (auto &event : batch) {
+            handle(event);
+        }
+        batch.clear();
+    }
+
+    for (auto &[path, store] : _stores) {
+        close(path, *store);
+    }
+    _stores.clear();
+    _current = nullptr;
+    for (auto buffer : _pending) {
+        gst_buffer_unref(buffer);
+    }
+    _pending.clear();
+}
+
+void MetadataSidecar::handle(Event &event)
+{
+    switch (event.type) {
+    case Event::Type::Stream:
+        _pending.push_back(event.buffer);
+        // Nothing reaches the muxer; do not hold on to the whole recording.
+        if (_pending.size() > MaxPending) {
+            gst_buffer_unref(_pending.front());
+            _pending.pop_front();
+        }
+        break;
+    case Event::Type::Muxed: {
+        // Buffers reach the muxer in the order they entered the parser; anything skipped in
+        // between never made it into a fragment.
+        auto match = std::find_if(_pending.begin(), _pending.end(), [&](GstBuffer *buffer) {
+            return GST_BUFFER_PTS(buffer) == event.pts;
+        });
+        if (match == _pending.end()) break;
+        auto buffer = *match;
+        std::for_each(_pending.begin(), match, [](GstBuffer *skipped) {
+            gst_buffer_unref(skipped);
+        });
+        _pending.erase(_pending.begin(), match + 1);
+        if (_current) {
+            GstPadProbeInfo info{};
+            info.type = GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_PUSH);
+            info.data = buffer;
+            _extract(_stream_pad, &info, _current);
+            ++_frames;
+        }
+        gst_buffer_unref(buffer);
+        break;
+    }
+    case Event::Type::Opened: {
+        auto bin_path = std::filesystem::path(event.path).replace_extension(".bin");
+        auto store = std::make_unique<KeyValueStore>(bin_path.string());
+        store->openFile();
+        _current = store.get();
+        _stores[event.path] = std::move(store);
+        break;
+    }
+    case Event::Type::Closed: {
+        auto store = _stores.find(event.path);
+        if (store == _stores.end()) break;
+        if (_current == store->second.get()) {
+            _current = nullptr;
+        }
+        close(store->first, *store->second);
+        _stores.erase(store);
+        break;
+    }
+    }
+}
+
+void MetadataSidecar::close(const std::string &path, KeyValueStore &store)
+{
+    store.closeFile();
+    ++_files;
+    if (_closed) {
+        _closed(path);
+    }
+}
+
+}  // namespace xvc
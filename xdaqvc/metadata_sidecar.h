@@ -0,0 +1,98 @@
+#pragma once
+
+#include <gst/gst.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+class KeyValueStore;
+
+
+namespace xvc
+{
+
+// Writes the .bin metadata sidecar of every fragment while a recording is written, instead of a
+// second pass over the finished .mkv. Two probes feed it: one where buffers are still in the form
+// the xdaqmetadata extractor expects (the sink pad of "record_parser"), and one behind the point
+// where splitmuxsink assigns them to a fragment (its multiqueue). Fragment boundaries come from the
+// splitmuxsink-fragment-opened/closed messages, handed over by the writer's bus sync handler. The
+// extractor and the sidecar files are run on a worker thread in batches, so neither probe blocks.
+class MetadataSidecar
+{
+public:
+    struct Stats {
+        std::uint64_t frames;    // Handed to the extractor.
+        std::uint64_t files;     // Sidecars closed.
+        std::uint64_t batches;   // Worker wake-ups.
+    };
+
+    // Called on the worker thread with the .mkv of every sidecar once it is closed.
+    using Closed = std::function<void(const std::filesystem::path &video)>;
+
+    // `writer` must contain the "record_parser" and the splitmuxsink "filesink".
+    MetadataSidecar(GstElement *writer, GstPadProbeCallback extract, Closed closed = {});
+    // Closes every sidecar still open.
+    ~MetadataSidecar();
+
+    MetadataSidecar(const MetadataSidecar &) = delete;
+    MetadataSidecar &operator=(const MetadataSidecar &) = delete;
+
+    // Processes everything queued and closes the remaining sidecars; call after the writer's EOS.
+    void finish();
+    // Call with every message of the writer from its bus sync handler, in the posting thread.
+    void message(GstMessage *message);
+
+    [[nodiscard]] Stats stats() const;
+
+private:
+    struct Event {
+        enum class Type { Stream, Muxed, Opened, Closed } type;
+        GstBuffer *buffer;    // Stream
+        std::uint64_t pts;    // Muxed
+        std::string path;     // Opened, Closed: the .mkv
+    };
+
+    static GstPadProbeReturn on_stream(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+    static GstPadProbeReturn on_muxed(GstPad *pad, GstPadProbeInfo *info, gpointer user_data);
+
+    void post(Event event);
+    void run();
+    void handle(Event &event);
+    void close(const std::string &path, KeyValueStore &store);
+
+    GstPadProbeCallback _extract;
+    Closed _closed;
+    GstPad *_stream_pad;
+    GstPad *_muxed_pad;
+    gulong _stream_probe;
+    gulong _muxed_probe;
+
+    std::mutex _mutex;
+    std::condition_variable _posted;
+    std::vector<Event> _events;
+    bool _finishing;
+
+    // Worker thread only.
+    std::deque<GstBuffer *> _pending;  // Seen on the stream pad, not yet by the muxer.
+    std::map<std::string, std::unique_ptr<KeyValueStore>> _stores;
+    KeyValueStore *_current;
+
+    std::atomic<std::uint64_t> _frames{0};
+    std::atomic<std::uint64_t> _files{0};
+    std::atomic<std::uint64_t> _batches{0};
+
+    std::jthread _worker;
+};
+
+}  // namespace xvc
@@ -0,0 +1,299 @@
+#include "mkv_scanner.h"
+
+#include <bit>
+#include <optional>
+#include <string_view>
+
+#include <fmt/core.h>
+
+
+namespace
+{
+
+constexpr std::uint32_t EbmlId = 0x1A45DFA3;
+constexpr std::uint32_t DocTypeId = 0x4282;
+constexpr std::uint32_t SegmentId = 0x18538067;
+constexpr std::uint32_t SeekHeadId = 0x114D9B74;
+constexpr std::uint32_t InfoId = 0x1549A966;
+constexpr std::uint32_t TimecodeScaleId = 0x2AD7B1;
+constexpr std::uint32_t TracksId = 0x1654AE6B;
+constexpr std::uint32_t TrackEntryId = 0xAE;
+constexpr std::uint32_t TrackNumberId = 0xD7;
+constexpr std::uint32_t CodecId = 0x86;
+constexpr std::uint32_t CodecPrivateId = 0x63A2;
+constexpr std::uint32_t VideoId = 0xE0;
+constexpr std::uint32_t PixelWidthId = 0xB0;
+constexpr std::uint32_t PixelHeightId = 0xBA;
+constexpr std::uint32_t ClusterId = 0x1F43B675;
+constexpr std::uint32_t TimecodeId = 0xE7;
+constexpr std::uint32_t SimpleBlockId = 0xA3;
+constexpr std::uint32_t BlockGroupId = 0xA0;
+constexpr std::uint32_t BlockId = 0xA1;
+constexpr std::uint32_t ReferenceBlockId = 0xFB;
+constexpr std::uint32_t CuesId = 0x1C53BB6B;
+constexpr std::uint32_t ChaptersId = 0x1043A770;
+constexpr std::uint32_t TagsId = 0x1254C367;
+constexpr std::uint32_t AttachmentsId = 0x1941A469;
+
+using Bytes = std::span<const std::uint8_t>;
+
+struct Element {
+    std::uint32_t id;
+    std::size_t begin;  // Of the data.
+    std::size_t end;    // Clamped to the parent.
+    bool unknown_size;
+    bool truncated;     // Declares more data than the parent holds.
+};
+
+// An EBML variable-length integer at `pos`. IDs keep their length marker; sizes drop it, and the
+// reserved all-ones size comes back as nothing.
+bool read_vint(Bytes data, std::size_t &pos, bool keep_marker, std::optional<std::uint64_t> &value)
+{
+    if (pos >= data.size() || data[pos] == 0) return false;
+    auto length = static_cast<std::size_t>(std::countl_zero(data[pos])) + 1;
+    if (pos + length > data.size()) return false;
+
+    std::uint64_t v = keep_marker ? data[pos] : data[pos] & (0xFF >> length);
+    auto all_ones = v == (0xFFu >> length);
+    for (std::size_t i = 1; i < length; ++i) {
+        v = (v << 8) | data[pos + i];
+        all_ones = all_ones && data[pos + i] == 0xFF;
+    }
+    pos += length;
+    value = !keep_marker && all_ones ? std::nullopt : std::optional(v);
+    return true;
+}
+
+bool read_element(Bytes data, std::size_t &pos, std::size_t limit, Element &element)
+{
+    auto bounded = data.first(limit);
+    std::optional<std::uint64_t> id, size;
+    if (!read_vint(bounded, pos, true, id) || *id > 0xFFFFFFFF) return false;
+    if (!read_vint(bounded, pos, false, size)) return false;
+
+    element.id = static_cast<std::uint32_t>(*id);
+    element.begin = pos;
+    element.unknown_size = !size;
+    element.truncated = size && *size > limit - pos;
+    element.end = !size || element.truncated ? limit : pos + static_cast<std::size_t>(*size);
+    return true;
+}
+
+std::uint64_t read_uint(Bytes data, const Element &element)
+{
+    std::uint64_t value = 0;
+    for (auto i = element.begin; i < element.end && i < element.begin + 8; ++i) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+std::string_view read_string(Bytes data, const Element &element)
+{
+    std::string_view text(
+        reinterpret_cast<const char *>(data.data() + element.begin), element.end - element.begin
+    );
+    return text.substr(0, text.find('\0'));
+}
+
+bool is_top_level(std::uint32_t id)
+{
+    switch (id) {
+    case EbmlId:
+    case SegmentId:
+    case SeekHeadId:
+    case InfoId:
+    case TracksId:
+    case ClusterId:
+    case CuesId:
+    case ChaptersId:
+    case TagsId:
+    case AttachmentsId: return true;
+    default: return false;
+    }
+}
+
+}  // namespace
+
+
+namespace xvc
+{
+
+MkvScanner::MkvScanner(std::span<const std::uint8_t> data)
+    : _data(data), _timecode_scale(1'000'000), _clusters(0), _segment_end(0)
+{
+}
+
+bool MkvScanner::open()
+{
+    std::size_t pos = 0;
+    Element header;
+    if (!read_element(_data, pos, _data.size(), header) || header.id != EbmlId) {
+        _error = "not an EBML file";
+        return false;
+    }
+    auto matroska = false;
+    for (auto p = header.begin; p < header.end;) {
+        Element child;
+        if (!read_element(_data, p, header.end, child)) break;
+        if (child.id == DocTypeId) {
+            auto doc_type = read_string(_data, child);
+            matroska = doc_type == "matroska" || doc_type == "webm";
+        }
+        p = child.end;
+    }
+    if (!matroska) {
+        _error = "not a Matroska file";
+        return false;
+    }
+
+    pos = header.end;
+    Element segment;
+    if (!read_element(_data, pos, _data.size(), segment) || segment.id != SegmentId) {
+        _error = "no segment";
+        return false;
+    }
+    _segment_end = segment.end;
+    _clusters = _segment_end;
+
+    for (auto p = segment.begin; p < _segment_end;) {
+        auto start = p;
+        Element child;
+        if (!read_element(_data, p, _segment_end, child)) break;
+        if (child.id == ClusterId) {
+            _clusters = start;
+            break;
+        }
+        if (child.id == InfoId) {
+            for (auto q = child.begin; q < child.end;) {
+                Element info;
+                if (!read_element(_data, q, child.end, info)) break;
+                if (info.id == TimecodeScaleId) _timecode_scale = read_uint(_data, info);
+                q = info.end;
+            }
+        } else if (child.id == TracksId) {
+            for (auto q = child.begin; q < child.end;) {
+                Element entry;
+                if (!read_element(_data, q, child.end, entry)) break;
+                q = entry.end;
+                if (entry.id != TrackEntryId) continue;
+
+                MkvTrack track{0, {}, {}, 0, 0};
+                for (auto r = entry.begin; r < entry.end;) {
+                    Element field;
+                    if (!read_element(_data, r, entry.end, field)) break;
+                    if (field.id == TrackNumberId) {
+                        track.number = read_uint(_data, field);
+                    } else if (field.id == CodecId) {
+                        track.codec_id = read_string(_data, field);
+                    } else if (field.id == CodecPrivateId) {
+                        track.codec_private = _data.subspan(field.begin, field.end - field.begin);
+                    } else if (field.id == VideoId) {
+                        for (auto v = field.begin; v < field.end;) {
+                            Element video;
+                            if (!read_element(_data, v, field.end, video)) break;
+                            if (video.id == PixelWidthId) {
+                                track.width = static_cast<std::uint32_t>(read_uint(_data, video));
+                            } else if (video.id == PixelHeightId) {
+                                track.height = static_cast<std::uint32_t>(read_uint(_data, video));
+                            }
+                            v = video.end;
+                        }
+                    }
+                    r = field.end;
+                }
+                _tracks.push_back(std::move(track));
+            }
+        }
+        p = child.end;
+    }
+    return true;
+}
+
+bool MkvScanner::scan(const std::function<bool(const MkvBlock &)> &visit) const
+{
+    // A Block or SimpleBlock: track number, timecode relative to the cluster, flags, frame.
+    auto parse_block = [&](const Element &block, std::int64_t cluster_timecode, bool keyframe,
+                           MkvBlock &out) {
+        auto pos = block.begin;
+        auto bounded = _data.first(block.end);
+        std::optional<std::uint64_t> track;
+        if (!read_vint(bounded, pos, false, track) || !track || pos + 3 > block.end) return false;
+        auto relative = static_cast<std::int16_t>((_data[pos] << 8) | _data[pos + 1]);
+        auto flags = _data[pos + 2];
+        pos += 3;
+        if ((flags & 0x06) != 0) {
+            _error = fmt::format("laced block at offset {}", block.begin);
+            return false;
+        }
+        out.track = *track;
+        out.pts = (cluster_timecode + relative) * static_cast<std::int64_t>(_timecode_scale);
+        out.keyframe = keyframe || (block.id == SimpleBlockId && (flags & 0x80));
+        out.offset = pos;
+        out.payload = _data.subspan(pos, block.end - pos);
+        return true;
+    };
+
+    _error.clear();
+    for (auto p = _clusters; p < _segment_end;) {
+        Element cluster;
+        if (!read_element(_data, p, _segment_end, cluster)) {
+            _error = fmt::format("truncated element at offset {}", p);
+            return false;
+        }
+        if (cluster.id != ClusterId) {
+            p = cluster.end;
+            continue;
+        }
+
+        std::int64_t timecode = 0;
+        auto q = cluster.begin;
+        while (q < cluster.end) {
+            auto start = q;
+            Element child;
+            if (!read_element(_data, q, cluster.end, child)) {
+                _error = fmt::format("truncated element at offset {}", start);
+                return false;
+            }
+            if (cluster.unknown_size && is_top_level(child.id)) {
+                q = start;
+                break;
+            }
+            if (child.truncated) {
+                _error = fmt::format("truncated element at offset {}", start);
+                return false;
+            }
+
+            MkvBlock block{};
+            if (child.id == TimecodeId) {
+                timecode = static_cast<std::int64_t>(read_uint(_data, child));
+            } else if (child.id == SimpleBlockId) {
+                if (!parse_block(child, timecode, false, block)) return false;
+                if (!visit(block)) return true;
+            } else if (child.id == BlockGroupId) {
+                std::optional<Element> payload;
+                auto referenced = false;
+                for (auto r = child.begin; r < child.end;) {
+                    Element field;
+                    if (!read_element(_data, r, child.end, field)) break;
+                    if (field.id == BlockId) payload = field;
+                    if (field.id == ReferenceBlockId) referenced = true;
+                    r = field.end;
+                }
+                if (payload) {
+                    if (!parse_block(*payload, timecode, !referenced, block)) return false;
+                    if (!visit(block)) return true;
+                }
+            }
+            q = child.end;
+        }
+        if (cluster.truncated) {
+            _error = fmt::format("truncated cluster at offset {}", cluster.begin);
+            return false;
+        }
+        p = cluster.unknown_size ? q : cluster.end;
+    }
+    return true;
+}
+
+}  // namespace xvc
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace xvc
+{
+
+// The codec ids of the tracks the recorders write.
+constexpr std::string_view HevcCodecId = "V_MPEGH/ISO/HEVC";
+constexpr std::string_view JpegCodecId = "V_MJPEG";
+
+struct MkvTrack {
+    std::uint64_t number;
+    std::string codec_id;                       // "V_MPEGH/ISO/HEVC", "V_MJPEG", ...
+    std::span<const std::uint8_t> codec_private;  // hvcC for H.265.
+    std::uint32_t width;                          // Of video tracks; 0 if not given.
+    std::uint32_t height;
+};
+
+struct MkvBlock {
+    std::uint64_t track;
+    std::int64_t pts;       // Nanoseconds.
+    bool keyframe;
+    std::uint64_t offset;   // Of the payload in the file.
+    std::span<const std::uint8_t> payload;
+};
+
+// Walks the EBML structure of a Matroska file in memory without copying it: the EBML header,
+// the segment's Info and Tracks, then the SimpleBlocks and BlockGroups of every cluster in file
+// order. Clusters of unknown size, as written by a muxer that could not seek back, are bounded
+// by the next top-level element. Laced blocks are not supported; the recorders never write them.
+class MkvScanner
+{
+public:
+    explicit MkvScanner(std::span<const std::uint8_t> data);
+
+    // Parses everything up to the first cluster. False if the data is not Matroska.
+    bool open();
+    // Calls `visit` for every frame until it returns false. Returns false on malformed or
+    // truncated data, after visiting the frames before it.
+    bool scan(const std::function<bool(const MkvBlock &)> &visit) const;
+
+    [[nodiscard]] const std::vector<MkvTrack> &tracks() const { return _tracks; }
+    // Nanoseconds per block timecode unit.
+    [[nodiscard]] std::uint64_t timecode_scale() const { return _timecode_scale; }
+    [[nodiscard]] const std::string &error() const { return _error; }
+
+private:
+    std::span<const std::uint8_t> _data;
+    std::vector<MkvTrack> _tracks;
+    std::uint64_t _timecode_scale;
+    std::size_t _clusters;     // Offset of the first cluster.
+    std::size_t _segment_end;
+    mutable std::string _error;
+};
+
+}  // namespace xvc
@@ -0,0 +1,311 @@
+#include "parallel_decoder.h"
+
+#include <fmt/format.h>
+#include <gst/base/gstbasesink.h>
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+
+using namespace std::chrono_literals;
+
+
+namespace
+{
+
+auto constexpr DataKey = "xvc-parallel-decoder";
+
+// Decoded frames queued in "reorder_src". Later ones stay in their window slots, so a slow
+// consumer holds up the decoders and, through the window, the upstream thread.
+constexpr guint64 OutputMaxBuffers = 2;
+
+GstElement *create_element(const gchar *factoryname, const gchar *name)
+{
+    auto element = gst_element_factory_make(factoryname, name);
+    if (!element) {
+        spdlog::error("Element {} could not be created.", factoryname);
+    }
+    return element;
+}
+
+// Internal appsrc/appsink pairs behave like a live source: no preroll, no clock sync, and the
+// queueing is bounded by the decode window instead of by the elements, except for the output.
+void configure_internal_src(GstElement *src)
+{
+    g_object_set(G_OBJECT(src), "is-live", TRUE, "format", GST_FORMAT_TIME, nullptr);
+    gst_app_src_set_max_bytes(GST_APP_SRC(src), 0);
+}
+
+void configure_internal_sink(GstElement *sink)
+{
+    g_object_set(G_OBJECT(sink), "sync", FALSE, "async", FALSE, nullptr);
+}
+
+}  // namespace
+
+
+namespace xvc
+{
+
+ParallelDecoder::ParallelDecoder(int window)
+    : _window(static_cast<std::size_t>(window)),
+      _dispatch(nullptr),
+      _output(nullptr),
+      _next_seq(0),
+      _decoded(0),
+      _lost(0),
+      _output_eos(false)
+{
+}
+
+ParallelDecoder::~ParallelDecoder() { reset(); }
+
+GstElement *ParallelDecoder::attach(
+    GstBin *bin, GstElement *upstream, int workers, int window, DecoderFactory make_decoder,
+    GstCaps *output_caps
+)
+{
+    workers = std::max(workers, 1);
+    window = std::max(window > 0 ? window : 2 * workers, workers);
+
+    auto self = new ParallelDecoder(window);
+    g_object_set_data_full(G_OBJECT(bin), DataKey, self, [](gpointer data) {
+        delete static_cast<ParallelDecoder *>(data);
+    });
+
+    auto dispatch = create_element("appsink", "dispatch");
+    auto output = create_element("appsrc", "reorder_src");
+    if (!dispatch || !output) return nullptr;
+
+    configure_internal_sink(dispatch);
+    configure_internal_src(output);
+    gst_bin_add_many(bin, dispatch, output, nullptr);
+    if (!gst_element_link(upstream, dispatch)) {
+        spdlog::error("Failed to link the parallel decoder dispatcher.");
+        return nullptr;
+    }
+    self->_dispatch = GST_APP_SINK(dispatch);
+    self->_output = GST_APP_SRC(output);
+    // Never full: flush_in_order() stops at the limit and continues once the queue has run dry,
+    // so no thread blocks in the push while holding _mutex.
+    gst_app_src_set_max_buffers(self->_output, OutputMaxBuffers);
+    GstAppSrcCallbacks output_callbacks{};
+    output_callbacks.need_data = &ParallelDecoder::on_output_drained;
+    gst_app_src_set_callbacks(self->_output, &output_callbacks, self, nullptr);
+
+    // Callbacks keep pointers into _workers, so it must never reallocate.
+    self->_workers.reserve(static_cast<std::size_t>(workers));
+    for (auto i = 0; i < workers; ++i) {
+        auto src = create_element("appsrc", fmt::format("worker_src_{}", i).c_str());
+        auto dec = make_decoder(i);
+        auto sink = create_element("appsink", fmt::format("worker_sink_{}", i).c_str());
+        if (!src || !dec || !sink) return nullptr;
+
+        configure_internal_src(src);
+        configure_internal_sink(sink);
+        if (output_caps) {
+            g_object_set(G_OBJECT(sink), "caps", output_caps, nullptr);
+        }
+        gst_bin_add_many(bin, src, dec, sink, nullptr);
+        if (!gst_element_link_many(src, dec, sink, nullptr)) {
+            spdlog::error("Failed to link parallel decoder worker {}.", i);
+            return nullptr;
+        }
+
+        auto &worker = self->_workers.emplace_back(Worker{self, i, GST_APP_SRC(src), {}, false});
+
+        GstAppSinkCallbacks callbacks{};
+        callbacks.new_sample = &ParallelDecoder::on_decoded;
+        callbacks.eos = &ParallelDecoder::on_decoded_eos;
+        gst_app_sink_set_callbacks(GST_APP_SINK(sink), &callbacks, &worker, nullptr);
+    }
+
+    GstAppSinkCallbacks callbacks{};
+    callbacks.new_sample = &ParallelDecoder::on_encoded;
+    callbacks.eos = &ParallelDecoder::on_encoded_eos;
+    gst_app_sink_set_callbacks(self->_dispatch, &callbacks, self, nullptr);
+
+    gst_pad_add_probe(
+        GST_BASE_SINK_PAD(dispatch),
+        GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+        &ParallelDecoder::on_dispatch_event,
+        self,
+        nullptr
+    );
+
+    spdlog::info("Parallel decoder with {} workers and a window of {} frames", workers, window);
+    return output;
+}
+
+ParallelDecoder *ParallelDecoder::find(GstBin *bin)
+{
+    return static_cast<ParallelDecoder *>(g_object_get_data(G_OBJECT(bin), DataKey));
+}
+
+ParallelDecoder::Stats ParallelDecoder::stats()
+{
+    std::lock_guard lock(_mutex);
+    return {_decoded, _lost, _slots.size()};
+}
+
+GstFlowReturn ParallelDecoder::on_encoded(GstAppSink *appsink, gpointer user_data)
+{
+    auto self = static_cast<ParallelDecoder *>(user_data);
+    std::unique_ptr<GstSample, decltype(&gst_sample_unref)> sample(
+        gst_app_sink_pull_sample(appsink), gst_sample_unref
+    );
+    if (!sample) return GST_FLOW_EOS;
+
+    std::unique_lock lock(self->_mutex);
+    while (self->_slots.size() >= self->_window) {
+        self->_space.wait_for(lock, 50ms);
+        if (GST_PAD_IS_FLUSHING(GST_BASE_SINK_PAD(appsink))) {
+            return GST_FLOW_FLUSHING;
+        }
+    }
+
+    auto seq = self->_next_seq++;
+    self->_slots.push_back({seq, nullptr, false});
+    auto &worker = self->_workers[seq % self->_workers.size()];
+    worker.queued.push_back({seq, GST_BUFFER_PTS(gst_sample_get_buffer(sample.get()))});
+    lock.unlock();
+
+    // Only this streaming thread feeds the workers, so pushing outside the lock keeps the order.
+    auto ret = gst_app_src_push_sample(worker.src, sample.get());
+    if (ret != GST_FLOW_OK) {
+        lock.lock();
+        if (!worker.queued.empty() && worker.queued.back().seq == seq) {
+            worker.queued.pop_back();
+        }
+        for (auto &slot : self->_slots) {
+            if (slot.seq == seq) slot.done = true;
+        }
+        self->flush_in_order();
+    }
+    return ret;
+}
+
+void ParallelDecoder::on_encoded_eos(GstAppSink *, gpointer user_data)
+{
+    auto self = static_cast<ParallelDecoder *>(user_data);
+    for (auto &worker : self->_workers) {
+        gst_app_src_end_of_stream(worker.src);
+    }
+}
+
+GstFlowReturn ParallelDecoder::on_decoded(GstAppSink *appsink, gpointer user_data)
+{
+    auto worker = static_cast<Worker *>(user_data);
+    auto self = worker->self;
+    auto sample = gst_app_sink_pull_sample(appsink);
+    if (!sample) return GST_FLOW_EOS;
+    auto pts = GST_BUFFER_PTS(gst_sample_get_buffer(sample));
+
+    std::lock_guard lock(self->_mutex);
+    // A worker decodes its frames in order, so anything queued ahead of the matching frame was
+    // dropped by the decoder.
+    while (sample && !worker->queued.empty()) {
+        auto pending = worker->queued.front();
+        worker->queued.pop_front();
+
+        auto front = self->_slots.empty() ? pending.seq + 1 : self->_slots.front().seq;
+        if (pending.seq < front) continue;
+        auto &slot = self->_slots[pending.seq - front];
+
+        slot.done = true;
+        if (!GST_CLOCK_TIME_IS_VALID(pts) || !GST_CLOCK_TIME_IS_VALID(pending.pts) ||
+            pending.pts == pts) {
+            slot.sample = sample;
+            sample = nullptr;
+            ++self->_decoded;
+        } else {
+            ++self->_lost;
+        }
+    }
+    if (sample) {
+        gst_sample_unref(sample);
+    }
+
+    self->flush_in_order();
+    return GST_FLOW_OK;
+}
+
+void ParallelDecoder::on_decoded_eos(GstAppSink *, gpointer user_data)
+{
+    auto worker = static_cast<Worker *>(user_data);
+    auto self = worker->self;
+
+    std::lock_guard lock(self->_mutex);
+    worker->eos = true;
+    for (const auto &pending : worker->queued) {
+        for (auto &slot : self->_slots) {
+            if (slot.seq == pending.seq && !slot.done) {
+                slot.done = true;
+                ++self->_lost;
+            }
+        }
+    }
+    worker->queued.clear();
+    self->flush_in_order();
+}
+
+void ParallelDecoder::on_output_drained(GstAppSrc *, guint, gpointer user_data)
+{
+    auto self = static_cast<ParallelDecoder *>(user_data);
+    std::lock_guard lock(self->_mutex);
+    self->flush_in_order();
+}
+
+GstPadProbeReturn ParallelDecoder::on_dispatch_event(GstPad *, GstPadProbeInfo *info, gpointer data)
+{
+    auto event = gst_pad_probe_info_get_event(info);
+    if (GST_EVENT_TYPE(event) == GST_EVENT_STREAM_START) {
+        static_cast<ParallelDecoder *>(data)->reset();
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+void ParallelDecoder::reset()
+{
+    std::lock_guard lock(_mutex);
+    for (auto &slot : _slots) {
+        if (slot.sample) {
+            gst_sample_unref(slot.sample);
+        }
+    }
+    _slots.clear();
+    for (auto &worker : _workers) {
+        worker.queued.clear();
+        worker.eos = false;
+    }
+    _output_eos = false;
+    _space.notify_all();
+}
+
+void ParallelDecoder::flush_in_order()
+{
+    while (!_slots.empty() && _slots.front().done) {
+        auto slot = _slots.front();
+        if (slot.sample) {
+            if (gst_app_src_get_current_level_buffers(_output) >= OutputMaxBuffers) break;
+            gst_app_src_push_sample(_output, slot.sample);
+            gst_sample_unref(slot.sample);
+        }
+        _slots.pop_front();
+    }
+    _space.notify_all();
+
+    // After the last frame, which may have waited for room in the output.
+    auto all_eos = std::all_of(_workers.begin(), _workers.end(), [](const auto &w) {
+        return w.eos;
+    });
+    if (all_eos && _slots.empty() && !_output_eos) {
+        _output_eos = true;
+        gst_app_src_end_of_stream(_output);
+    }
+}
+
+}  // namespace xvc
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/gstbin.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+
+namespace xvc
+{
+
+// Frame-parallel decode stage for intra-only streams such as M-JPEG. Encoded frames are dealt
+// round-robin to N decoder chains (appsrc ! decoder ! appsink) and the decoded frames are pushed
+// back out, in their original order, from a single appsrc. At most `window` frames are in flight;
+// when the window is full the upstream streaming thread waits, which bounds the reorder buffer.
+// Decoded frames only leave their slots while the output appsrc holds fewer than a couple, so a
+// slow consumer fills the window as well.
+class ParallelDecoder
+{
+public:
+    using DecoderFactory = std::function<GstElement *(int worker)>;
+
+    struct Stats {
+        std::uint64_t decoded;
+        std::uint64_t lost;  // Frames a worker decoder did not output, e.g. corrupt JPEGs.
+        std::size_t in_flight;
+    };
+
+    // Adds the stage to `bin` after `upstream` and returns the appsrc to link downstream, or
+    // nullptr on failure. The stage is owned by `bin`. Non-null `output_caps` constrain what the
+    // decoders negotiate, since the workers cannot see the caps downstream of the appsrc.
+    static GstElement *attach(
+        GstBin *bin, GstElement *upstream, int workers, int window, DecoderFactory make_decoder,
+        GstCaps *output_caps = nullptr
+    );
+
+    // Returns nullptr when `bin` has no parallel decode stage.
+    static ParallelDecoder *find(GstBin *bin);
+
+    [[nodiscard]] Stats stats();
+
+    ParallelDecoder(const ParallelDecoder &) = delete;
+    ParallelDecoder &operator=(const ParallelDecoder &) = delete;
+
+private:
+    struct Slot {
+        std::uint64_t seq;
+        GstSample *sample;  // Decoded frame, nullptr until the worker delivers it.
+        bool done;
+    };
+
+    struct Pending {
+        std::uint64_t seq;
+        GstClockTime pts;
+    };
+
+    struct Worker {
+        ParallelDecoder *self;
+        int index;
+        GstAppSrc *src;
+        std::deque<Pending> queued;  // Frames handed to this worker, in order.
+        bool eos;
+    };
+
+    ParallelDecoder(int window);
+    ~ParallelDecoder();
+
+    static GstFlowReturn on_encoded(GstAppSink *appsink, gpointer user_data);
+    static void on_encoded_eos(GstAppSink *appsink, gpointer user_data);
+    static GstFlowReturn on_decoded(GstAppSink *appsink, gpointer user_data);
+    static void on_decoded_eos(GstAppSink *appsink, gpointer user_data);
+    static void on_output_drained(GstAppSrc *appsrc, guint length, gpointer user_data);
+    static GstPadProbeReturn on_dispatch_event(GstPad *pad, GstPadProbeInfo *info, gpointer data);
+
+    void reset();
+    // Pushes the completed frames at the head of the reorder buffer while the output has room, and
+    // EOS after the last one. Called with _mutex held.
+    void flush_in_order();
+
+    std::size_t _window;
+    GstAppSink *_dispatch;
+    GstAppSrc *_output;
+    std::vector<Worker> _workers;
+
+    std::mutex _mutex;
+    std::condition_variable _space;
+    std::deque<Slot> _slots;
+    std::uint64_t _next_seq;
+    std::uint64_t _decoded;
+    std::uint64_t _lost;
+    bool _output_eos;
+};
+
+}  // namespace xvc
@@ -0,0 +1,110 @@
+#include "pretrigger_ring.h"
+
+#include <limits>
+
+
+namespace
+{
+
+constexpr auto NoTimestamp = std::numeric_limits<std::uint64_t>::max();
+
+}  // namespace
+
+
+namespace xvc
+{
+
+PreTriggerRing::PreTriggerRing(std::chrono::nanoseconds window, std::size_t memory_limit)
+    : _window(static_cast<std::uint64_t>(window.count())),
+      _memory_limit(memory_limit),
+      _bytes(0),
+      _dropped(0)
+{
+}
+
+void PreTriggerRing::push(SpillRecord record, bool keyframe)
+{
+    // Nothing can be decoded from a unit that does not follow a keyframe.
+    if (_entries.empty() && !keyframe) {
+        drop(record);
+        return;
+    }
+
+    _bytes += record.size();
+    _entries.push_back({std::move(record), keyframe});
+    carry_caps();
+
+    while (!_entries.empty() && (_bytes > _memory_limit || expired())) {
+        drop_front_gop();
+    }
+}
+
+std::vector<SpillRecord> PreTriggerRing::take()
+{
+    std::vector<SpillRecord> records;
+    records.reserve(_entries.size());
+    for (auto &entry : _entries) {
+        if (!entry.record.caps.empty()) {
+            _caps = entry.record.caps;
+        }
+        records.push_back(std::move(entry.record));
+    }
+    _entries.clear();
+    _bytes = 0;
+    return records;
+}
+
+void PreTriggerRing::clear()
+{
+    for (auto &entry : _entries) {
+        drop(entry.record);
+    }
+    _entries.clear();
+    _bytes = 0;
+}
+
+PreTriggerRing::Stats PreTriggerRing::stats() const { return {_entries.size(), _bytes, _dropped}; }
+
+bool PreTriggerRing::expired() const
+{
+    // Dropping the front GOP must still leave at least `window` behind the newest unit.
+    auto newest = _entries.back().record.pts;
+    if (newest == NoTimestamp) return false;
+    for (std::size_t i = 1; i < _entries.size(); ++i) {
+        if (!_entries[i].keyframe) continue;
+        auto pts = _entries[i].record.pts;
+        return pts != NoTimestamp && pts <= newest && newest - pts >= _window;
+    }
+    return false;
+}
+
+void PreTriggerRing::drop_front_gop()
+{
+    do {
+        _bytes -= _entries.front().record.size();
+        drop(_entries.front().record);
+        _entries.pop_front();
+    } while (!_entries.empty() && !_entries.front().keyframe);
+    if (!_entries.empty()) {
+        carry_caps();
+    }
+}
+
+void PreTriggerRing::drop(SpillRecord &record)
+{
+    if (!record.caps.empty()) {
+        _caps = std::move(record.caps);
+    }
+    ++_dropped;
+}
+
+void PreTriggerRing::carry_caps()
+{
+    auto &front = _entries.front().record;
+    if (front.caps.empty() && !_caps.empty()) {
+        front.caps = _caps;
+        _bytes += front.caps.size();
+    }
+}
+
+}  // namespace xvc
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "spill_buffer.h"
+
+
+namespace xvc
+{
+
+// The most recent encoded access units of a stream, so a recording can start before its trigger.
+// The ring always begins with a keyframe: old units are dropped a whole GOP at a time, as long as
+// what remains still spans `window`, and unconditionally once the ring holds more than
+// `memory_limit` bytes. Not thread-safe.
+class PreTriggerRing
+{
+public:
+    struct Stats {
+        std::size_t frames;
+        std::size_t bytes;
+        std::uint64_t dropped;  // Units that aged out, or arrived before the first keyframe.
+    };
+
+    PreTriggerRing(std::chrono::nanoseconds window, std::size_t memory_limit);
+
+    // Records carry caps only when they change, see SpillRecord.
+    void push(SpillRecord record, bool keyframe);
+    // Empties the ring. The first record carries the caps in effect for it.
+    std::vector<SpillRecord> take();
+    void clear();
+
+    [[nodiscard]] Stats stats() const;
+
+private:
+    struct Entry {
+        SpillRecord record;
+        bool keyframe;
+    };
+
+    [[nodiscard]] bool expired() const;
+    void drop_front_gop();
+    void drop(SpillRecord &record);
+    void carry_caps();
+
+    std::uint64_t _window;
+    std::size_t _memory_limit;
+    std::deque<Entry> _entries;
+    std::size_t _bytes;
+    std::uint64_t _dropped;
+    std::string _caps;  // Caps of the last record dropped, still in effect for the front.
+};
+
+}  // namespace xvc
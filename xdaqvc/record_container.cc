@@ -0,0 +1,259 @@
+#include "record_container.h"
+
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+#include <mutex>
+
+#include "elementary_stream.h"
+
+
+// GObject boilerplate for the "xvcesmux" element.
+
+struct XvcEsMux {
+    GstElement parent;
+    GstPad *srcpad;
+    GstPad *sinkpad;  // Requested by splitmuxsink, once.
+    xvc::ElementaryCodec codec;
+    // Of the current file.
+    xvc::FrameIndexWriter *index;
+    gboolean unindexed;  // The index could not be opened.
+    guint64 offset;
+};
+
+struct XvcEsMuxClass {
+    GstElementClass parent_class;
+};
+
+G_DEFINE_TYPE(XvcEsMux, xvc_es_mux, GST_TYPE_ELEMENT)
+
+// Access units with their parameter sets, as h265parse config-interval=-1 makes them.
+#define ELEMENTARY_CAPS "video/x-h265, stream-format=byte-stream, alignment=au; image/jpeg"
+
+namespace
+{
+
+// Fragments of fragmented MP4, in milliseconds.
+constexpr guint Mp4FragmentDuration = 1000;
+
+GstStaticPadTemplate src_template =
+    GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS(ELEMENTARY_CAPS));
+GstStaticPadTemplate video_template = GST_STATIC_PAD_TEMPLATE(
+    "video", GST_PAD_SINK, GST_PAD_REQUEST, GST_STATIC_CAPS(ELEMENTARY_CAPS)
+);
+
+XvcEsMux *self_of(GstObject *object) { return reinterpret_cast<XvcEsMux *>(object); }
+
+void close_index(XvcEsMux *self)
+{
+    if (!self->index) return;
+    if (!self->index->close()) {
+        GST_ELEMENT_WARNING(self, RESOURCE, WRITE, ("Could not write the frame index."), (nullptr));
+    }
+    delete self->index;
+    self->index = nullptr;
+}
+
+// Next to the file the sink downstream writes, which splitmuxsink names before the first buffer.
+void open_index(XvcEsMux *self)
+{
+    gchar *location = nullptr;
+    if (auto peer = gst_pad_get_peer(self->srcpad)) {
+        if (auto sink = gst_pad_get_parent_element(peer)) {
+            if (g_object_class_find_property(G_OBJECT_GET_CLASS(sink), "location")) {
+                g_object_get(G_OBJECT(sink), "location", &location, nullptr);
+            }
+            gst_object_unref(sink);
+        }
+        gst_object_unref(peer);
+    }
+    if (!location) {
+        GST_ELEMENT_WARNING(self, RESOURCE, NOT_FOUND, ("No file to index."), (nullptr));
+        self->unindexed = TRUE;
+        return;
+    }
+    self->index = new xvc::FrameIndexWriter(xvc::frame_index_path(location), self->codec);
+    if (!self->index->is_open()) {
+        GST_ELEMENT_WARNING(
+            self, RESOURCE, OPEN_WRITE, ("Could not index %s.", location), (nullptr)
+        );
+        delete self->index;
+        self->index = nullptr;
+        self->unindexed = TRUE;
+    }
+    g_free(location);
+}
+
+GstFlowReturn chain(GstPad *, GstObject *parent, GstBuffer *buffer)
+{
+    auto self = self_of(parent);
+    if (!self->index && !self->unindexed) {
+        open_index(self);
+    }
+    auto size = gst_buffer_get_size(buffer);
+    if (self->index) {
+        auto or_unknown = [](GstClockTime t) {
+            return GST_CLOCK_TIME_IS_VALID(t) ? static_cast<std::int64_t>(t) : -1;
+        };
+        self->index->append(
+            {self->offset,
+             static_cast<std::uint32_t>(size),
+             !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT),
+             or_unknown(GST_BUFFER_PTS(buffer)),
+             or_unknown(GST_BUFFER_DTS(buffer))}
+        );
+    }
+    self->offset += size;
+    return gst_pad_push(self->srcpad, buffer);
+}
+
+gboolean sink_event(GstPad *pad, GstObject *parent, GstEvent *event)
+{
+    auto self = self_of(parent);
+    switch (GST_EVENT_TYPE(event)) {
+    case GST_EVENT_CAPS: {
+        GstCaps *caps = nullptr;
+        gst_event_parse_caps(event, &caps);
+        auto structure = gst_caps_get_structure(caps, 0);
+        self->codec = gst_structure_has_name(structure, "image/jpeg") ? xvc::ElementaryCodec::Jpeg
+                                                                       : xvc::ElementaryCodec::H265;
+        break;
+    }
+    case GST_EVENT_SEGMENT: {
+        // A byte stream downstream, as from any muxer.
+        GstSegment segment;
+        gst_segment_init(&segment, GST_FORMAT_BYTES);
+        gst_event_unref(event);
+        return gst_pad_push_event(self->srcpad, gst_event_new_segment(&segment));
+    }
+    case GST_EVENT_EOS: close_index(self); break;
+    default: break;
+    }
+    return gst_pad_event_default(pad, parent, event);
+}
+
+GstPad *request_new_pad(GstElement *element, GstPadTemplate *templ, const gchar *, const GstCaps *)
+{
+    auto self = self_of(GST_OBJECT(element));
+    if (self->sinkpad) return nullptr;
+    self->sinkpad = gst_pad_new_from_template(templ, "video");
+    gst_pad_set_chain_function(self->sinkpad, chain);
+    gst_pad_set_event_function(self->sinkpad, sink_event);
+    GST_PAD_SET_PROXY_CAPS(self->sinkpad);
+    gst_element_add_pad(element, self->sinkpad);
+    return self->sinkpad;
+}
+
+void release_pad(GstElement *element, GstPad *pad)
+{
+    auto self = self_of(GST_OBJECT(element));
+    if (pad != self->sinkpad) return;
+    self->sinkpad = nullptr;
+    gst_element_remove_pad(element, pad);
+}
+
+GstStateChangeReturn change_state(GstElement *element, GstStateChange transition)
+{
+    auto self = self_of(GST_OBJECT(element));
+    auto result = GST_ELEMENT_CLASS(xvc_es_mux_parent_class)->change_state(element, transition);
+    if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+        close_index(self);
+        self->unindexed = FALSE;
+        self->offset = 0;
+    }
+    return result;
+}
+
+void finalize(GObject *object)
+{
+    auto self = self_of(GST_OBJECT(object));
+    close_index(self);
+    G_OBJECT_CLASS(xvc_es_mux_parent_class)->finalize(object);
+}
+
+}  // namespace
+
+static void xvc_es_mux_class_init(XvcEsMuxClass *klass)
+{
+    auto gobject_class = G_OBJECT_CLASS(klass);
+    auto element_class = GST_ELEMENT_CLASS(klass);
+
+    gobject_class->finalize = finalize;
+    gst_element_class_set_static_metadata(
+        element_class,
+        "libxvc elementary stream muxer",
+        "Codec/Muxer",
+        "Writes the elementary stream as is, with a frame index next to it",
+        "KonteX Neuroscience"
+    );
+    gst_element_class_add_static_pad_template(element_class, &src_template);
+    gst_element_class_add_static_pad_template(element_class, &video_template);
+
+    element_class->request_new_pad = request_new_pad;
+    element_class->release_pad = release_pad;
+    element_class->change_state = change_state;
+}
+
+static void xvc_es_mux_init(XvcEsMux *self)
+{
+    self->srcpad = gst_pad_new_from_static_template(&src_template, "src");
+    gst_element_add_pad(GST_ELEMENT(self), self->srcpad);
+    self->sinkpad = nullptr;
+    self->codec = xvc::ElementaryCodec::H265;
+    self->index = nullptr;
+    self->unindexed = FALSE;
+    self->offset = 0;
+}
+
+
+namespace xvc
+{
+
+bool register_elementary_mux_element()
+{
+    static std::once_flag once;
+    static auto registered = false;
+    std::call_once(once, [] {
+        registered =
+            gst_element_register(nullptr, "xvcesmux", GST_RANK_NONE, xvc_es_mux_get_type());
+        if (!registered) {
+            spdlog::error("Failed to register the xvcesmux element.");
+        }
+    });
+    return registered;
+}
+
+bool use_container(GstElement *splitmuxsink, RecordContainer container)
+{
+    switch (container) {
+    case RecordContainer::Matroska:
+        g_object_set(G_OBJECT(splitmuxsink), "muxer-factory", "matroskamux", nullptr);
+        return true;
+    case RecordContainer::FragmentedMp4: {
+        auto properties = gst_structure_new(
+            "properties", "fragment-duration", G_TYPE_UINT, Mp4FragmentDuration, nullptr
+        );
+        g_object_set(G_OBJECT(splitmuxsink), "muxer-factory", "mp4mux", nullptr);
+        g_object_set(G_OBJECT(splitmuxsink), "muxer-properties", properties, nullptr);
+        gst_structure_free(properties);
+        return true;
+    }
+    case RecordContainer::Elementary:
+        if (!register_elementary_mux_element()) return false;
+        g_object_set(G_OBJECT(splitmuxsink), "muxer-factory", "xvcesmux", nullptr);
+        return true;
+    }
+    return false;
+}
+
+std::string container_extension(RecordContainer container, bool h265)
+{
+    switch (container) {
+    case RecordContainer::Matroska: return ".mkv";
+    case RecordContainer::FragmentedMp4: return ".mp4";
+    case RecordContainer::Elementary: return h265 ? ".h265" : ".mjpeg";
+    }
+    return ".mkv";
+}
+
+}  // namespace xvc
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <gst/gstelement.h>
+
+#include <string>
+
+#include "xvc.h"
+
+
+namespace xvc
+{
+
+// Registers the "xvcesmux" element, the muxer of RecordContainer::Elementary: it passes H.265
+// byte-stream access units or JPEG frames through unchanged and writes the frame index of the file
+// named by the "location" of the sink downstream (elementary_stream.h). Safe to call more than
+// once.
+bool register_elementary_mux_element();
+
+// Makes `splitmuxsink`, which must have async-finalize set, mux every fragment into `container`.
+// Call before it goes to READY.
+bool use_container(GstElement *splitmuxsink, RecordContainer container);
+
+// Of the files of `container`, with the dot.
+std::string container_extension(RecordContainer container, bool h265);
+
+}  // namespace xvc
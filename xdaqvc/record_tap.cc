@@ -0,0 +1,267 @@
+#include "record_tap.h"
+
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+#include <utility>
+#include <vector>
+
+#include "admission.h"
+
+
+namespace
+{
+
+// Flags that describe the access unit rather than its memory.
+constexpr guint32 RecordedFlags = GST_BUFFER_FLAG_DISCONT | GST_BUFFER_FLAG_RESYNC |
+                                  GST_BUFFER_FLAG_CORRUPTED | GST_BUFFER_FLAG_MARKER |
+                                  GST_BUFFER_FLAG_HEADER | GST_BUFFER_FLAG_GAP |
+                                  GST_BUFFER_FLAG_DROPPABLE | GST_BUFFER_FLAG_DELTA_UNIT;
+
+// Of queue_record: enough to ride out a slow journal write, little enough to bound its memory.
+constexpr guint64 RecordQueueTime = 2 * GST_SECOND;
+constexpr guint RecordQueueBytes = 64 << 20;
+
+// Long enough to average over a few GOPs.
+constexpr auto RateWindow = std::chrono::seconds(3);
+
+GstElement *create_element(const gchar *factoryname, const gchar *name)
+{
+    auto element = gst_element_factory_make(factoryname, name);
+    if (!element) {
+        spdlog::error("Element {} could not be created.", factoryname);
+    }
+    return element;
+}
+
+}  // namespace
+
+
+namespace xvc
+{
+
+RecordTap::RecordTap(
+    GstPipeline *pipeline, std::chrono::nanoseconds pretrigger, std::size_t memory_limit
+)
+    : _pipeline(pipeline),
+      _caps(nullptr),
+      _stream_caps(nullptr),
+      _window_bytes(0),
+      _stream_rate(0)
+{
+    if (pretrigger.count() > 0) {
+        _ring = std::make_unique<PreTriggerRing>(pretrigger, memory_limit);
+    }
+}
+
+RecordTap::~RecordTap()
+{
+    if (_caps) {
+        gst_caps_unref(_caps);
+    }
+    if (_stream_caps) {
+        gst_caps_unref(_stream_caps);
+    }
+}
+
+bool RecordTap::link()
+{
+    // The spill buffer bounds memory, so queue_record only has to absorb journal writes. It must
+    // never block the tee: when full it drops new units, which the recording counts as lost.
+    auto queue_record = create_element("queue", "queue_record");
+    auto tap = create_element("appsink", "record_tap");
+    if (!queue_record || !tap) return false;
+    // clang-format off
+    g_object_set(G_OBJECT(queue_record),
+        "max-size-buffers", 0,
+        "max-size-bytes", RecordQueueBytes,
+        "max-size-time", RecordQueueTime,
+        "leaky", 1,  // upstream
+        nullptr
+    );
+    g_object_set(G_OBJECT(tap),
+        "sync", FALSE,
+        "async", FALSE,
+        "emit-signals", FALSE,
+        nullptr
+    );
+    // clang-format on
+    g_signal_connect(queue_record, "overrun", G_CALLBACK(&RecordTap::on_overrun), this);
+    GstAppSinkCallbacks callbacks{};
+    callbacks.new_sample = &RecordTap::on_sample;
+    gst_app_sink_set_callbacks(GST_APP_SINK(tap), &callbacks, this, nullptr);
+
+    gst_bin_add_many(GST_BIN(_pipeline), queue_record, tap, nullptr);
+    if (!gst_element_link(queue_record, tap)) {
+        spdlog::error("Elements could not be linked.");
+        return false;
+    }
+    gst_element_sync_state_with_parent(queue_record);
+    gst_element_sync_state_with_parent(tap);
+
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> tee(
+        gst_bin_get_by_name(GST_BIN(_pipeline), "t"), gst_object_unref
+    );
+    auto src_pad = gst_element_request_pad_simple(tee.get(), "src_1");
+    std::unique_ptr<GstPad, decltype(&gst_object_unref)> sink_pad(
+        gst_element_get_static_pad(queue_record, "sink"), gst_object_unref
+    );
+    auto ret = gst_pad_link(src_pad, sink_pad.get());
+    gst_object_unref(src_pad);
+    if (GST_PAD_LINK_FAILED(ret)) {
+        spdlog::error("Failed to link 'tee' src pad to 'queue' sink pad");
+        return false;
+    }
+    return true;
+}
+
+std::size_t RecordTap::connect(Sink sink)
+{
+    std::lock_guard lock(_mutex);
+    std::vector<SpillRecord> records;
+    if (_ring) {
+        records = _ring->take();
+    }
+    if (records.empty()) {
+        release(_next);
+        _next = std::move(sink);
+        return 0;
+    }
+
+    // The ring only fills while no sink is connected.
+    for (auto &record : records) {
+        sink.push(std::move(record));
+    }
+    release(_next);
+    _sink = std::move(sink);
+    gst_caps_replace(&_caps, nullptr);
+    return records.size();
+}
+
+void RecordTap::disconnect(const void *owner)
+{
+    std::lock_guard lock(_mutex);
+    if (_next.owner == owner) {
+        release(_next);
+    }
+    if (_sink.owner == owner) {
+        release(_sink);
+        gst_caps_replace(&_caps, nullptr);
+    }
+}
+
+bool RecordTap::connected() const
+{
+    std::lock_guard lock(_mutex);
+    return _sink.push || _next.push;
+}
+
+PreTriggerRing::Stats RecordTap::ring_stats() const
+{
+    std::lock_guard lock(_mutex);
+    return _ring ? _ring->stats() : PreTriggerRing::Stats{0, 0, 0};
+}
+
+double RecordTap::stream_mb_per_s() const
+{
+    std::lock_guard lock(_mutex);
+    if (_stream_rate > 0) return _stream_rate;
+    if (!_stream_caps || gst_caps_is_empty(_stream_caps)) return 0;
+    auto structure = gst_caps_get_structure(_stream_caps, 0);
+    auto width = 0;
+    auto height = 0;
+    auto fps_n = 0;
+    auto fps_d = 1;
+    gst_structure_get_int(structure, "width", &width);
+    gst_structure_get_int(structure, "height", &height);
+    gst_structure_get_fraction(structure, "framerate", &fps_n, &fps_d);
+    auto fps = fps_d > 0 ? fps_n / static_cast<double>(fps_d) : 0.0;
+    return estimate_mb_per_s(gst_structure_get_name(structure), width, height, fps);
+}
+
+GstFlowReturn RecordTap::on_sample(GstAppSink *appsink, gpointer user_data)
+{
+    auto self = static_cast<RecordTap *>(user_data);
+    std::unique_ptr<GstSample, decltype(&gst_sample_unref)> sample(
+        gst_app_sink_pull_sample(appsink), gst_sample_unref
+    );
+    if (!sample) return GST_FLOW_EOS;
+
+    std::lock_guard lock(self->_mutex);
+    self->measure(sample.get());
+    // Drops before a sink connected are of no recording.
+    if (auto dropped = self->_dropped.exchange(0); dropped > 0 && self->_sink.lost) {
+        self->_sink.lost(dropped);
+    }
+    if (!self->_sink.push && !self->_next.push && !self->_ring) return GST_FLOW_OK;
+
+    auto buffer = gst_sample_get_buffer(sample.get());
+    auto keyframe = !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    if (self->_next.push && keyframe) {
+        self->release(self->_sink);
+        self->_sink = std::move(self->_next);
+        self->_next = {};
+        gst_caps_replace(&self->_caps, nullptr);
+    }
+
+    auto caps = gst_sample_get_caps(sample.get());
+    SpillRecord record{
+        GST_BUFFER_PTS(buffer),
+        GST_BUFFER_DTS(buffer),
+        GST_BUFFER_DURATION(buffer),
+        GST_BUFFER_FLAGS(buffer) & RecordedFlags,
+        {},
+        {}
+    };
+    if (caps && (!self->_caps || !gst_caps_is_equal(caps, self->_caps))) {
+        gst_caps_replace(&self->_caps, caps);
+        auto text = gst_caps_to_string(caps);
+        record.caps = text;
+        g_free(text);
+    }
+    record.payload.resize(gst_buffer_get_size(buffer));
+    gst_buffer_extract(buffer, 0, record.payload.data(), record.payload.size());
+
+    if (self->_sink.push) {
+        self->_sink.push(std::move(record));
+    } else if (self->_ring) {
+        self->_ring->push(std::move(record), keyframe);
+    }
+    return GST_FLOW_OK;
+}
+
+// The queue is leaky upstream, so every overrun drops the unit that caused it.
+void RecordTap::on_overrun(GstElement *, gpointer user_data)
+{
+    ++static_cast<RecordTap *>(user_data)->_dropped;
+}
+
+void RecordTap::measure(GstSample *sample)
+{
+    auto now = std::chrono::steady_clock::now();
+    auto caps = gst_sample_get_caps(sample);
+    if (caps && (!_stream_caps || !gst_caps_is_equal(caps, _stream_caps))) {
+        gst_caps_replace(&_stream_caps, caps);
+        // Whatever was measured is of the previous caps.
+        _stream_rate = 0;
+        _window_bytes = 0;
+    }
+    if (_window_bytes == 0) {
+        _window_begin = now;
+    }
+    _window_bytes += gst_buffer_get_size(gst_sample_get_buffer(sample));
+    if (auto elapsed = std::chrono::duration<double>(now - _window_begin); elapsed >= RateWindow) {
+        _stream_rate = _window_bytes / elapsed.count() / 1e6;
+        _window_bytes = 0;
+    }
+}
+
+void RecordTap::release(Sink &sink)
+{
+    if (sink.release) {
+        sink.release();
+    }
+    sink = {};
+}
+
+}  // namespace xvc
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <gst/app/gstappsink.h>
+#include <gst/gstpipeline.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include "pretrigger_ring.h"
+#include "spill_buffer.h"
+
+
+namespace xvc
+{
+
+// The record side of the tee: tee pad src_1, queue_record and an appsink ("record_tap") that copies
+// every encoded access unit out of the live pipeline. Units go to the connected sink, or while
+// none is connected, into a PreTriggerRing if the tap has one. Switching sinks is the valve of the
+// record branch: the tap stays linked for the life of the pipeline.
+class RecordTap
+{
+public:
+    struct Sink {
+        const void *owner = nullptr;
+        std::function<void(SpillRecord)> push;
+        // Called once `push` will not be called anymore.
+        std::function<void()> release;
+        // Units the full record queue dropped before they reached the tap.
+        std::function<void(std::uint64_t)> lost;
+    };
+
+    // A zero `pretrigger` window means no ring: units are discarded while no sink is connected.
+    RecordTap(GstPipeline *pipeline, std::chrono::nanoseconds pretrigger, std::size_t memory_limit);
+    ~RecordTap();
+
+    RecordTap(const RecordTap &) = delete;
+    RecordTap &operator=(const RecordTap &) = delete;
+
+    bool link();
+
+    // Hands the ring's contents, then every new unit, to `sink`, and returns the units from the
+    // ring. With an empty ring, `sink` takes over at the next keyframe; until then a sink already
+    // connected keeps receiving units, so consecutive recordings neither overlap nor leave a gap.
+    std::size_t connect(Sink sink);
+    // Releases the sink of `owner`, if still connected or waiting for its keyframe.
+    void disconnect(const void *owner);
+
+    [[nodiscard]] bool connected() const;
+    [[nodiscard]] PreTriggerRing::Stats ring_stats() const;
+    // Of the stream, recorded or not: measured over the last few seconds, or until then estimated
+    // from its caps. 0 before the first unit.
+    [[nodiscard]] double stream_mb_per_s() const;
+
+private:
+    static GstFlowReturn on_sample(GstAppSink *appsink, gpointer user_data);
+    static void on_overrun(GstElement *queue, gpointer user_data);
+    void release(Sink &sink);
+    void measure(GstSample *sample);
+
+    GstPipeline *_pipeline;
+    std::unique_ptr<PreTriggerRing> _ring;
+
+    std::atomic<std::uint64_t> _dropped{0};  // By queue_record, not yet reported.
+
+    mutable std::mutex _mutex;
+    Sink _sink;
+    Sink _next;      // Waiting for a keyframe.
+    GstCaps *_caps;  // Last caps handed out; reset whenever units change destination.
+    GstCaps *_stream_caps;
+    std::chrono::steady_clock::time_point _window_begin;
+    std::uint64_t _window_bytes;
+    double _stream_rate;  // Of the last complete window.
+};
+
+}  // namespace xvc
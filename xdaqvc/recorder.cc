@@ -0,0 +1,504 @@
+#include "recorder.h"
+
+#include <gst/gst.h>
+#include <spdlog/spdlog.h>
+
+#include <filesystem>
+#include <memory>
+#include <system_error>
+#include <utility>
+
+#include "compact_sidecar.h"
+#include "file_sink.h"
+#include "io_governor.h"
+#include "retention.h"
+#include "timestamp_index.h"
+
+
+namespace
+{
+
+auto constexpr DataKey = "xvc-recording-bin";
+
+// Bounds what the writer pipeline holds; beyond it the drain thread blocks and the spill buffer
+// takes over.
+constexpr guint64 WriterMaxBytes = 8 << 20;
+
+// Shorter waits for the writer are not worth reporting as stalls.
+constexpr auto MinStall = std::chrono::milliseconds(1);
+
+// Longest the writer may go without a message while it finishes, i.e. closes a fragment, or, once
+// the recording is stopped, without taking a unit from the full appsrc, before the recording is
+// given up on.
+constexpr GstClockTime FinishTimeout = 30 * GST_SECOND;
+
+GstElement *create_element(const gchar *factoryname, const gchar *name)
+{
+    auto element = gst_element_factory_make(factoryname, name);
+    if (!element) {
+        spdlog::error("Element {} could not be created.", factoryname);
+    }
+    return element;
+}
+
+void log_error(GstMessage *message)
+{
+    GError *error = nullptr;
+    gst_message_parse_error(message, &error, nullptr);
+    spdlog::error("Recording: {}", error ? error->message : "unknown error");
+    g_clear_error(&error);
+}
+
+}  // namespace
+
+
+namespace xvc
+{
+
+Recorder::Recorder(const RecordOptions &options)
+    : _options(options),
+      _writer(nullptr),
+      _src(nullptr),
+      _spill(options.spill_memory_limit, options.spill_directory),
+      _tap(nullptr),
+      _fragments_open(0),
+      _result(_done.get_future().share())
+{
+}
+
+Recorder::~Recorder()
+{
+    stop();
+    _spill.close();
+    if (_drain.joinable()) {
+        _drain.join();
+    }
+    if (_writer) {
+        gst_element_set_state(_writer, GST_STATE_NULL);
+        std::unique_ptr<GstBus, decltype(&gst_object_unref)> bus(
+            gst_element_get_bus(_writer), gst_object_unref
+        );
+        gst_bus_set_sync_handler(bus.get(), nullptr, nullptr, nullptr);
+        _sidecar.reset();
+        gst_object_unref(_writer);
+    }
+    if (!_finished) {
+        // Never started, so nothing was written.
+        _done.set_value({true, {}});
+    }
+}
+
+bool Recorder::prepare(const BuildWriter &build, GstPadProbeCallback extract)
+{
+    _writer = gst_pipeline_new("recorder");
+    gst_object_ref_sink(_writer);
+    _src = create_element("appsrc", "record_src");
+    if (!_src) return false;
+    // clang-format off
+    g_object_set(G_OBJECT(_src),
+        "format", GST_FORMAT_TIME,
+        "block", TRUE,
+        "max-bytes", WriterMaxBytes,
+        nullptr
+    );
+    // clang-format on
+    gst_bin_add(GST_BIN(_writer), _src);
+    if (!build(GST_BIN(_writer), _src, _options.container)) {
+        spdlog::error("Recording: the writer could not be built.");
+        return false;
+    }
+    if (_options.sink == RecordSink::Direct) {
+        std::unique_ptr<GstElement, decltype(&gst_object_unref)> filesink(
+            gst_bin_get_by_name(GST_BIN(_writer), "filesink"), gst_object_unref
+        );
+        if (!use_file_sink(filesink.get(), {.preallocate = _options.preallocate}, &_meter)) {
+            return false;
+        }
+    }
+    if (extract) {
+        MetadataSidecar::Closed closed;
+        if (_options.compact_sidecar || !_options.index.empty()) {
+            closed = [this, options = _options](const std::filesystem::path &video) {
+                IoGovernor::Grant finalizing;
+                if (_io) finalizing = _io->finalize();
+                auto bin = std::filesystem::path(video).replace_extension(".bin");
+                if (options.compact_sidecar &&
+                    compact_sidecar(bin, std::filesystem::path(video).replace_extension(".xbin"))) {
+                    std::error_code ec;
+                    std::filesystem::remove(bin, ec);
+                }
+                if (!options.index.empty() && !TimestampIndex::update(options.index, video)) {
+                    spdlog::warn("Recording: {} was not indexed.", video.string());
+                }
+            };
+        }
+        _sidecar = std::make_unique<MetadataSidecar>(_writer, extract, std::move(closed));
+    }
+    // Errors are acted on as they are posted: the drain thread may be blocked on the full appsrc,
+    // and only stopping the writer wakes it up.
+    std::unique_ptr<GstBus, decltype(&gst_object_unref)> bus(
+        gst_element_get_bus(_writer), gst_object_unref
+    );
+    gst_bus_set_sync_handler(bus.get(), &Recorder::on_message, this, nullptr);
+    // The file name is only asked for on the way to PLAYING, after start() configured it.
+    if (gst_element_set_state(_writer, GST_STATE_READY) == GST_STATE_CHANGE_FAILURE) {
+        spdlog::error("Recording: the writer could not be prepared.");
+        return false;
+    }
+    return true;
+}
+
+bool Recorder::start(RecordTap *tap, const std::string &camera, const Configure &configure)
+{
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> filesink(
+        gst_bin_get_by_name(GST_BIN(_writer), "filesink"), gst_object_unref
+    );
+    _io = IoGovernor::instance().join(camera, {_options.io_weight, _options.io_priority});
+    // Counted by the admission checks of other cameras until its rate is measured.
+    _io->expect(tap->stream_mb_per_s());
+    if (_options.sink == RecordSink::Direct) {
+        write_through(filesink.get(), _io.get());
+    }
+    configure(filesink.get());
+    if (gst_element_set_state(_writer, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        spdlog::error("Recording: the writer could not be started.");
+        return false;
+    }
+    _drain = std::jthread(&Recorder::drain, this);
+
+    _tap = tap;
+    _pretrigger_frames = _tap->connect({
+        this,
+        [this](SpillRecord record) {
+            ++_frames;
+            auto size = record.size();
+            if (_spill.push(std::move(record))) {
+                _io->queued(size);
+            } else {
+                // Never stall the live stream for the recording.
+                ++_lost;
+            }
+        },
+        [this] { _spill.close(); },
+        [this](std::uint64_t dropped) { _lost += dropped; }
+    });
+    return true;
+}
+
+void Recorder::stop()
+{
+    if (_stopped.exchange(true)) return;
+    if (_tap) {
+        _tap->disconnect(this);
+    }
+    _spill.close();
+}
+
+RecordStats Recorder::stats() const
+{
+    auto spill = _spill.stats();
+    auto writes = _meter.stats();
+    return {
+        _frames.load(),
+        _pretrigger_frames.load(),
+        _lost.load() + spill.lost,
+        spill.memory_bytes,
+        spill.journal_bytes,
+        spill.spilled,
+        spill.peak_memory_bytes,
+        _sidecar ? _sidecar->stats().frames : 0,
+        writes.mb_per_s(),
+        static_cast<std::uint64_t>(writes.max_latency.count()),
+        static_cast<std::uint64_t>(writes.max_stall.count())
+    };
+}
+
+void Recorder::drain()
+{
+    std::unique_ptr<GstBus, decltype(&gst_object_unref)> bus(
+        gst_element_get_bus(_writer), gst_object_unref
+    );
+    auto src = GST_APP_SRC(_src);
+    std::uint64_t pushed = 0;
+
+    while (!_failed && !_spill.drained()) {
+        while (auto message = gst_bus_pop_filtered(bus.get(), GST_MESSAGE_ELEMENT)) {
+            handle(message);
+            gst_message_unref(message);
+        }
+        auto record = _spill.pop();
+        if (!record) continue;
+        auto size = record->size();
+
+        if (!record->caps.empty()) {
+            auto caps = gst_caps_from_string(record->caps.c_str());
+            gst_app_src_set_caps(src, caps);
+            gst_caps_unref(caps);
+        }
+        auto payload = new std::vector<std::uint8_t>(std::move(record->payload));
+        auto buffer = gst_buffer_new_wrapped_full(
+            GST_MEMORY_FLAG_READONLY,
+            payload->data(),
+            payload->size(),
+            0,
+            payload->size(),
+            payload,
+            [](gpointer data) { delete static_cast<std::vector<std::uint8_t> *>(data); }
+        );
+        GST_BUFFER_PTS(buffer) = record->pts;
+        GST_BUFFER_DTS(buffer) = record->dts;
+        GST_BUFFER_DURATION(buffer) = record->duration;
+        GST_BUFFER_FLAGS(buffer) = record->flags;
+        // Only a push into the full appsrc blocks, and may do so for good if the writer hangs.
+        GstClockID watchdog = nullptr;
+        if (gst_app_src_get_current_level_bytes(src) + size > WriterMaxBytes) {
+            watchdog = watch_push();
+        }
+        auto begin = std::chrono::steady_clock::now();
+        if (gst_app_src_push_buffer(src, buffer) != GST_FLOW_OK) {
+            spdlog::error("Recording: the writer stopped accepting frames.");
+            _failed = true;
+        }
+        if (watchdog) {
+            gst_clock_id_unschedule(watchdog);
+            gst_clock_id_unref(watchdog);
+        }
+        auto waited = std::chrono::steady_clock::now() - begin;
+        if (waited >= MinStall) {
+            _io->stalled(std::chrono::duration_cast<std::chrono::microseconds>(waited));
+        }
+        _io->handed(size);
+        ++pushed;
+    }
+    if (_failed) {
+        // Nothing reaches the file anymore; what the tap still hands over is counted as lost.
+        _spill.close();
+    }
+
+    // Done once the writer is at EOS and, with async-finalize, every fragment is closed. Nothing
+    // was opened without a single unit, and a failed writer never gets there.
+    gst_app_src_end_of_stream(src);
+    auto eos = pushed == 0;
+    while (!_failed && (!eos || _fragments_open > 0)) {
+        auto message = gst_bus_timed_pop_filtered(
+            bus.get(), FinishTimeout, GstMessageType(GST_MESSAGE_EOS | GST_MESSAGE_ELEMENT)
+        );
+        if (!message) {
+            spdlog::error("Recording: the writer did not finish in time.");
+            _failed = true;
+            break;
+        }
+        eos |= GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS;
+        handle(message);
+        gst_message_unref(message);
+    }
+    if (_sidecar) {
+        _sidecar->finish();
+    }
+    gst_element_set_state(_writer, GST_STATE_NULL);
+    _finished = true;
+    spdlog::info("Recording finished");
+    _done.set_value({!_failed, std::move(_files)});
+}
+
+GstBusSyncReply Recorder::on_message(GstBus *, GstMessage *message, gpointer user_data)
+{
+    auto self = static_cast<Recorder *>(user_data);
+    if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR) {
+        log_error(message);
+        self->abort();
+        return GST_BUS_DROP;
+    }
+    if (self->_sidecar) {
+        self->_sidecar->message(message);
+    }
+    return GST_BUS_PASS;
+}
+
+void Recorder::abort()
+{
+    if (_failed.exchange(true)) return;
+    // Posted from a streaming thread of the writer, which cannot stop the writer itself. Stopping
+    // it flushes the appsrc, so a blocked push returns.
+    gst_element_call_async(
+        _writer,
+        [](GstElement *writer, gpointer) { gst_element_set_state(writer, GST_STATE_NULL); },
+        nullptr,
+        nullptr
+    );
+}
+
+GstClockID Recorder::watch_push()
+{
+    // While recording, the spill buffer takes up the slack of a slow writer; once stopped,
+    // nothing is left to wait for but the writer.
+    auto clock = gst_system_clock_obtain();
+    auto watchdog = gst_clock_new_periodic_id(
+        clock, gst_clock_get_time(clock) + FinishTimeout, FinishTimeout
+    );
+    gst_clock_id_wait_async(
+        watchdog,
+        [](GstClock *, GstClockTime, GstClockID, gpointer data) -> gboolean {
+            auto self = static_cast<Recorder *>(data);
+            if (self->_spill.closed() && !self->_failed) {
+                spdlog::error("Recording: the writer did not take a frame in time.");
+                self->abort();
+            }
+            return TRUE;
+        },
+        this,
+        nullptr
+    );
+    gst_object_unref(clock);
+    return watchdog;
+}
+
+void Recorder::handle(GstMessage *message)
+{
+    auto structure = gst_message_get_structure(message);
+    if (!structure) return;
+    if (gst_structure_has_name(structure, "splitmuxsink-fragment-opened")) {
+        ++_fragments_open;
+    } else if (gst_structure_has_name(structure, "splitmuxsink-fragment-closed")) {
+        --_fragments_open;
+        if (auto location = gst_structure_get_string(structure, "location")) {
+            _files.emplace_back(location);
+            RetentionManager::instance().closed(location);
+        }
+    }
+}
+
+RecordingBin::RecordingBin(
+    GstPipeline *pipeline,
+    std::chrono::nanoseconds pretrigger,
+    std::size_t pretrigger_memory_limit,
+    Recorder::BuildWriter build,
+    GstPadProbeCallback extract
+)
+    : _tap(pipeline, pretrigger, pretrigger_memory_limit),
+      _build(std::move(build)),
+      _extract(extract),
+      _last{0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}
+{
+    std::promise<RecordResult> none;
+    none.set_value({true, {}});
+    _last_result = none.get_future().share();
+}
+
+RecordingBin *RecordingBin::attach(
+    GstPipeline *pipeline,
+    std::chrono::nanoseconds pretrigger,
+    std::size_t pretrigger_memory_limit,
+    Recorder::BuildWriter build,
+    GstPadProbeCallback extract
+)
+{
+    auto self = new RecordingBin(
+        pipeline, pretrigger, pretrigger_memory_limit, std::move(build), extract
+    );
+    g_object_set_data_full(G_OBJECT(pipeline), DataKey, self, [](gpointer data) {
+        delete static_cast<RecordingBin *>(data);
+    });
+    if (!self->_tap.link()) return nullptr;
+    self->prepare({});
+    return self;
+}
+
+RecordingBin *RecordingBin::find(GstPipeline *pipeline)
+{
+    return static_cast<RecordingBin *>(g_object_get_data(G_OBJECT(pipeline), DataKey));
+}
+
+RecordingBin::~RecordingBin()
+{
+    if (_preparing.joinable()) {
+        _preparing.join();
+    }
+}
+
+bool RecordingBin::start(
+    const RecordOptions &options,
+    const std::string &camera,
+    const Recorder::Configure &configure,
+    std::shared_future<RecordResult> &handed_over
+)
+{
+    auto begin = std::chrono::steady_clock::now();
+    std::lock_guard control(_control);
+    if (_preparing.joinable()) {
+        _preparing.join();
+    }
+    // Only a change of options costs the construction of the writer.
+    if (!_spare || !(_spare->options() == options)) {
+        _spare = std::make_unique<Recorder>(options);
+        if (!_spare->prepare(_build, _extract)) {
+            _spare.reset();
+            return false;
+        }
+    }
+
+    auto recorder = std::move(_spare);
+    auto started = recorder->start(&_tap, camera, configure);
+    if (started) {
+        std::lock_guard lock(_mutex);
+        reap();
+        // The tap releases the previous recorder at the handover.
+        if (_active) {
+            _last_result = _active->result();
+            handed_over = _last_result;
+            _finishing.push_back(std::move(_active));
+        }
+        _active = std::move(recorder);
+        spdlog::info(
+            "Recording started in {} us",
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - begin
+            )
+                .count()
+        );
+    }
+    prepare(options);
+    return started;
+}
+
+std::shared_future<RecordResult> RecordingBin::stop()
+{
+    std::lock_guard control(_control);
+    std::lock_guard lock(_mutex);
+    reap();
+    if (_active) {
+        _active->stop();
+        _last_result = _active->result();
+        _finishing.push_back(std::move(_active));
+    }
+    return _last_result;
+}
+
+RecordStats RecordingBin::stats() const
+{
+    std::lock_guard lock(_mutex);
+    if (_active) return _active->stats();
+    if (!_finishing.empty()) return _finishing.back()->stats();
+    return _last;
+}
+
+void RecordingBin::prepare(const RecordOptions &options)
+{
+    _preparing = std::jthread([this, options] {
+        auto spare = std::make_unique<Recorder>(options);
+        if (spare->prepare(_build, _extract)) {
+            _spare = std::move(spare);
+        }
+    });
+}
+
+void RecordingBin::reap()
+{
+    std::erase_if(_finishing, [this](const std::unique_ptr<Recorder> &recorder) {
+        if (!recorder->finished()) return false;
+        _last = recorder->stats();
+        return true;
+    });
+}
+
+}  // namespace xvc
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <gst/gstpipeline.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "direct_file_writer.h"
+#include "io_governor.h"
+#include "metadata_sidecar.h"
+#include "record_tap.h"
+#include "spill_buffer.h"
+#include "xvc.h"
+
+
+namespace xvc
+{
+
+// One recording, decoupled from the live path. The RecordTap hands every access unit to a
+// SpillBuffer; a drain thread pushes them into a separate writer pipeline (appsrc "record_src",
+// parser, splitmuxsink "filesink") with its own streaming threads. A slow disk therefore backs up
+// into the spill buffer and its journal, never into the tee. Everything a camera records goes
+// through its IoGovernor queue: the spill buffer is its backlog, and with RecordSink::Direct its
+// writes and finalizations wait for their turn among the other cameras.
+class Recorder
+{
+public:
+    // Links `src` to the muxer of `container` inside `writer`.
+    using BuildWriter =
+        std::function<bool(GstBin *writer, GstElement *src, RecordContainer container)>;
+    // Sets the output of the "filesink" before it goes to PLAYING.
+    using Configure = std::function<void(GstElement *filesink)>;
+
+    explicit Recorder(const RecordOptions &options);
+    // Waits until everything recorded so far is written and the writer pipeline stopped.
+    ~Recorder();
+
+    Recorder(const Recorder &) = delete;
+    Recorder &operator=(const Recorder &) = delete;
+
+    // Builds the writer and brings it to READY, so start() only has to configure and play it.
+    // With an `extract` callback from xdaqmetadata, a .bin sidecar is written next to each file.
+    bool prepare(const BuildWriter &build, GstPadProbeCallback extract = nullptr);
+    // `camera` names the IoGovernor queue.
+    bool start(RecordTap *tap, const std::string &camera, const Configure &configure);
+    // Disconnects from the tap. The drain thread then writes out what is left, sends EOS to the
+    // writer pipeline and stops it in the background once splitmuxsink closed every file.
+    void stop();
+
+    [[nodiscard]] const RecordOptions &options() const { return _options; }
+    [[nodiscard]] bool finished() const { return _finished; }
+    [[nodiscard]] std::shared_future<RecordResult> result() const { return _result; }
+    [[nodiscard]] RecordStats stats() const;
+
+private:
+    void drain();
+    // The writer's bus sync handler.
+    static GstBusSyncReply on_message(GstBus *bus, GstMessage *message, gpointer user_data);
+    // Gives up on the writer after an error; safe from any thread.
+    void abort();
+    // Calls abort() if, once stopped, a push into the appsrc has been blocked for FinishTimeout.
+    // Unschedule the returned clock ID when the push returns.
+    GstClockID watch_push();
+    void handle(GstMessage *message);
+
+    RecordOptions _options;
+    GstElement *_writer;
+    GstElement *_src;
+    SpillBuffer _spill;
+    std::unique_ptr<MetadataSidecar> _sidecar;
+    WriteMeter _meter;  // Of the xvcfilesinks, with RecordSink::Direct.
+    std::shared_ptr<IoGovernor::Queue> _io;
+    RecordTap *_tap;
+    std::atomic<bool> _stopped{false};
+    std::atomic<bool> _finished{false};
+    std::atomic<bool> _failed{false};
+
+    std::atomic<std::uint64_t> _frames{0};
+    std::atomic<std::uint64_t> _pretrigger_frames{0};
+    std::atomic<std::uint64_t> _lost{0};
+
+    // Drain thread only.
+    int _fragments_open;
+    std::vector<fs::path> _files;
+    std::promise<RecordResult> _done;
+    std::shared_future<RecordResult> _result;
+
+    std::jthread _drain;
+};
+
+// The record branch of a stream, built once by setup_*_srt_stream and attached to its pipeline.
+// A Recorder is prepared in the background ahead of time, so starting a recording only configures
+// its output and connects it to the tap; the next one is prepared meanwhile, with the same options.
+// Starting with other options builds the writer on the spot. Starting while recording hands over
+// at the next keyframe without losing a frame.
+class RecordingBin
+{
+public:
+    // Links the tap, with a pre-trigger ring if `pretrigger` is nonzero. Returns nullptr on failure.
+    static RecordingBin *attach(
+        GstPipeline *pipeline,
+        std::chrono::nanoseconds pretrigger,
+        std::size_t pretrigger_memory_limit,
+        Recorder::BuildWriter build,
+        GstPadProbeCallback extract
+    );
+    static RecordingBin *find(GstPipeline *pipeline);
+
+    ~RecordingBin();
+
+    RecordingBin(const RecordingBin &) = delete;
+    RecordingBin &operator=(const RecordingBin &) = delete;
+
+    // `handed_over` is set to the result of the recording taken over from, if any.
+    bool start(
+        const RecordOptions &options,
+        const std::string &camera,
+        const Recorder::Configure &configure,
+        std::shared_future<RecordResult> &handed_over
+    );
+    // See stop_h265_recording.
+    std::shared_future<RecordResult> stop();
+
+    // Of the current or, when stopped, the last recording.
+    [[nodiscard]] RecordStats stats() const;
+    [[nodiscard]] double stream_mb_per_s() const { return _tap.stream_mb_per_s(); }
+
+private:
+    RecordingBin(
+        GstPipeline *pipeline,
+        std::chrono::nanoseconds pretrigger,
+        std::size_t pretrigger_memory_limit,
+        Recorder::BuildWriter build,
+        GstPadProbeCallback extract
+    );
+
+    void prepare(const RecordOptions &options);
+    void reap();
+
+    RecordTap _tap;  // Outlives the recorders connected to it.
+    Recorder::BuildWriter _build;
+    GstPadProbeCallback _extract;
+
+    std::mutex _control;  // Serializes start() and stop().
+    std::unique_ptr<Recorder> _spare;
+    std::jthread _preparing;
+
+    mutable std::mutex _mutex;
+    std::unique_ptr<Recorder> _active;
+    std::vector<std::unique_ptr<Recorder>> _finishing;  // Still writing out their last units.
+    RecordStats _last;
+    std::shared_future<RecordResult> _last_result;
+};
+
+}  // namespace xvc
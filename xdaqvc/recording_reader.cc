@@ -0,0 +1,627 @@
+#include "recording_reader.h"
+
+#include <gst/app/gstappsink.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include "jpeg_decode.h"
+#include "mkv_scanner.h"
+
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+
+constexpr char IndexMagic[8] = {'X', 'V', 'C', 'S', 'E', 'E', 'K', '1'};
+
+GstElement *create_element(const gchar *factoryname, const gchar *name)
+{
+    auto element = gst_element_factory_make(factoryname, name);
+    if (!element) {
+        spdlog::error("Element {} could not be created.", factoryname);
+    }
+    return element;
+}
+
+// What a cached index remembers of each segment, to tell whether it changed since.
+struct SegmentStamp {
+    std::uint64_t size;
+    std::int64_t modified;
+};
+
+std::optional<SegmentStamp> stamp(const fs::path &path)
+{
+    std::error_code ec;
+    auto size = fs::file_size(path, ec);
+    if (ec) return std::nullopt;
+    auto modified = fs::last_write_time(path, ec);
+    if (ec) return std::nullopt;
+    return SegmentStamp{size, modified.time_since_epoch().count()};
+}
+
+template <typename T>
+bool read_value(std::istream &in, T &value)
+{
+    return static_cast<bool>(in.read(reinterpret_cast<char *>(&value), sizeof(value)));
+}
+
+template <typename T>
+void write_value(std::ostream &out, const T &value)
+{
+    out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+}  // namespace
+
+
+namespace xvc
+{
+
+// parser ! decoder ! appsink, fed from a pad of our own so that a whole GOP is pushed, drained
+// and pulled on the calling thread without a streaming thread in between. Every decode starts
+// with a flush, which resets the parser and the decoder for a keyframe from anywhere.
+class RecordingReader::Decoder
+{
+public:
+    explicit Decoder(bool h265) : _pipeline(gst_pipeline_new("reader")), _sink(nullptr)
+    {
+        auto parser = create_element(h265 ? "h265parse" : "jpegparse", "parser");
+#ifdef _WIN32
+        auto dec = h265 ? create_element("d3d11h265dec", "dec") : nullptr;
+#elif __APPLE__
+        auto dec = h265 ? create_element("vtdec", "dec") : nullptr;
+#else
+        auto dec = h265 ? create_element("avdec_h265", "dec") : nullptr;
+#endif
+        if (!h265) {
+            dec = register_jpeg_decode_element() ? create_element("xvcjpegdec", "dec")
+                                                 : create_element("jpegdec", "dec");
+        }
+        // System memory, so that hardware decoders download their output.
+        auto cf_dec = create_element("capsfilter", "cf_dec");
+        _sink = create_element("appsink", "sink");
+        if (!parser || !dec || !cf_dec || !_sink) return;
+
+        std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> raw(
+            gst_caps_new_empty_simple("video/x-raw"), gst_caps_unref
+        );
+        g_object_set(G_OBJECT(cf_dec), "caps", raw.get(), nullptr);
+        g_object_set(G_OBJECT(_sink), "sync", FALSE, "async", FALSE, nullptr);
+        gst_bin_add_many(GST_BIN(_pipeline), parser, dec, cf_dec, _sink, nullptr);
+        if (!gst_element_link_many(parser, dec, cf_dec, _sink, nullptr)) {
+            spdlog::error("Failed to link the recording decoder.");
+            _sink = nullptr;
+            return;
+        }
+
+        _pad = gst_pad_new("src", GST_PAD_SRC);
+        std::unique_ptr<GstPad, decltype(&gst_object_unref)> sink_pad(
+            gst_element_get_static_pad(parser, "sink"), gst_object_unref
+        );
+        gst_pad_link(_pad, sink_pad.get());
+        gst_pad_set_active(_pad, TRUE);
+        if (gst_element_set_state(_pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+            spdlog::error("Failed to start the recording decoder.");
+            _sink = nullptr;
+            return;
+        }
+
+        // clang-format off
+        std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> caps(
+            h265 ? gst_caps_new_simple(
+                       "video/x-h265",
+                       "stream-format", G_TYPE_STRING, "byte-stream",
+                       "alignment", G_TYPE_STRING, "au",
+                       nullptr)
+                 : gst_caps_new_empty_simple("image/jpeg"),
+            gst_caps_unref
+        );
+        // clang-format on
+        gst_pad_push_event(_pad, gst_event_new_stream_start("recording"));
+        gst_pad_push_event(_pad, gst_event_new_caps(caps.get()));
+    }
+
+    ~Decoder()
+    {
+        gst_element_set_state(_pipeline, GST_STATE_NULL);
+        if (_pad) gst_object_unref(_pad);
+        gst_object_unref(_pipeline);
+    }
+
+    Decoder(const Decoder &) = delete;
+    Decoder &operator=(const Decoder &) = delete;
+
+    [[nodiscard]] bool ok() const { return _sink != nullptr; }
+
+    // Decodes the access units of one GOP, taking ownership of them, and returns the samples in
+    // presentation order.
+    std::vector<GstSample *> decode(const std::vector<GstBuffer *> &units)
+    {
+        gst_pad_push_event(_pad, gst_event_new_flush_start());
+        gst_pad_push_event(_pad, gst_event_new_flush_stop(TRUE));
+        GstSegment segment;
+        gst_segment_init(&segment, GST_FORMAT_TIME);
+        gst_pad_push_event(_pad, gst_event_new_segment(&segment));
+
+        auto flow = GST_FLOW_OK;
+        for (auto buffer : units) {
+            if (flow == GST_FLOW_OK) {
+                flow = gst_pad_push(_pad, buffer);
+            } else {
+                gst_buffer_unref(buffer);
+            }
+        }
+        // Nothing between the pad and the appsink is asynchronous, so once EOS returns every
+        // frame the decoder was holding back is queued in the appsink.
+        gst_pad_push_event(_pad, gst_event_new_eos());
+
+        std::vector<GstSample *> samples;
+        while (auto sample = gst_app_sink_try_pull_sample(GST_APP_SINK(_sink), 0)) {
+            samples.push_back(sample);
+        }
+
+        std::unique_ptr<GstBus, decltype(&gst_object_unref)> bus(
+            gst_element_get_bus(_pipeline), gst_object_unref
+        );
+        while (auto message = gst_bus_pop_filtered(bus.get(), GST_MESSAGE_ERROR)) {
+            GError *error = nullptr;
+            gst_message_parse_error(message, &error, nullptr);
+            spdlog::error("Recording decoder: {}", error ? error->message : "unknown error");
+            g_clear_error(&error);
+            gst_message_unref(message);
+        }
+        gst_bus_set_flushing(bus.get(), TRUE);
+        gst_bus_set_flushing(bus.get(), FALSE);
+        if (flow != GST_FLOW_OK && flow != GST_FLOW_EOS) {
+            spdlog::error("Recording decoder: {}", gst_flow_get_name(flow));
+        }
+        return samples;
+    }
+
+private:
+    GstElement *_pipeline;
+    GstElement *_sink;
+    GstPad *_pad = nullptr;
+};
+
+RecordingReader::RecordingReader(std::vector<fs::path> segments)
+    : RecordingReader(std::move(segments), Options{})
+{
+}
+
+RecordingReader::RecordingReader(std::vector<fs::path> segments, Options options)
+    : _paths(std::move(segments)),
+      _options(std::move(options)),
+      _h265(false),
+      _cached_bytes(0),
+      _direction(1),
+      _generation(0),
+      _stats{}
+{
+}
+
+RecordingReader::~RecordingReader()
+{
+    _prefetch_thread = {};
+}
+
+bool RecordingReader::open()
+{
+    _prefetch_thread = {};
+    _segments.clear();
+    _frames.clear();
+    for (const auto &path : _paths) {
+        MappedFile file(path, MappedFile::Access::Random);
+        if (!file.is_open()) {
+            spdlog::error("{}: could not be opened", path.string());
+            return false;
+        }
+        _segments.push_back({fs::absolute(path), std::move(file), std::nullopt, 0});
+    }
+
+    // The codec configuration is in the segment headers, which are parsed either way.
+    std::optional<bool> h265;
+    for (auto &segment : _segments) {
+        MkvScanner scanner(segment.file.data());
+        if (!scanner.open()) {
+            spdlog::error("{}: {}", segment.path.string(), scanner.error());
+            return false;
+        }
+        const auto &tracks = scanner.tracks();
+        auto track = std::find_if(tracks.begin(), tracks.end(), [](const MkvTrack &t) {
+            return t.codec_id == HevcCodecId || t.codec_id == JpegCodecId;
+        });
+        if (track == tracks.end()) {
+            spdlog::error("{}: no H.265 or M-JPEG track.", segment.path.string());
+            return false;
+        }
+        auto is_h265 = track->codec_id == HevcCodecId;
+        if (h265 && *h265 != is_h265) {
+            spdlog::error("{}: not the codec of the other segments.", segment.path.string());
+            return false;
+        }
+        h265 = is_h265;
+        if (is_h265 && !(segment.config = parse_hvcc(track->codec_private))) {
+            spdlog::error("{}: invalid HEVC codec private data.", segment.path.string());
+            return false;
+        }
+    }
+    _h265 = h265.value_or(false);
+
+    if (!load_index()) {
+        if (!build_index()) return false;
+        save_index();
+    }
+    for (std::size_t n = _frames.size(); n-- > 0;) {
+        _segments[_frames[n].segment].first = n;
+    }
+
+    _decoder = std::make_unique<Decoder>(_h265);
+    if (!_decoder->ok()) return false;
+    if (_options.prefetch_frames > 0) {
+        _prefetch_decoder = std::make_unique<Decoder>(_h265);
+        if (!_prefetch_decoder->ok()) return false;
+        _prefetch_thread = std::jthread([this](std::stop_token stop) { prefetch(stop); });
+    }
+    return true;
+}
+
+std::chrono::nanoseconds RecordingReader::pts(std::size_t n) const
+{
+    return std::chrono::nanoseconds(n < _frames.size() ? _frames[n].pts : 0);
+}
+
+std::optional<std::size_t> RecordingReader::frame_number(
+    const fs::path &segment, std::uint32_t frame
+) const
+{
+    auto absolute = fs::absolute(segment);
+    for (std::size_t i = 0; i < _segments.size(); ++i) {
+        if (_segments[i].path != absolute) continue;
+        auto n = _segments[i].first + frame;
+        if (n < _frames.size() && _frames[n].segment == i) return n;
+        return std::nullopt;
+    }
+    return std::nullopt;
+}
+
+FramePtr RecordingReader::frame(std::size_t n)
+{
+    if (n >= _frames.size()) return nullptr;
+    auto gop = static_cast<std::size_t>(_frames[n].gop);
+
+    std::unique_lock lock(_mutex);
+    if (_target && n != *_target) {
+        _direction = n > *_target ? 1 : -1;
+    }
+    _target = n;
+    ++_generation;
+    _requested.notify_one();
+
+    if (auto cached = lookup(n)) {
+        ++_stats.hits;
+        return cached;
+    }
+    while (_in_flight.contains(gop)) {
+        _decoded.wait(lock);
+        if (auto cached = lookup(n)) {
+            ++_stats.waits;
+            return cached;
+        }
+    }
+    ++_stats.misses;
+    _in_flight.insert(gop);
+    lock.unlock();
+    auto frames = decode(*_decoder, gop);
+    lock.lock();
+    _in_flight.erase(gop);
+    insert(gop, frames);
+    _decoded.notify_all();
+    return frames[n - gop];
+}
+
+FramePtr RecordingReader::frame_at(std::chrono::nanoseconds pts)
+{
+    auto it = std::upper_bound(
+        _frames.begin(),
+        _frames.end(),
+        pts.count(),
+        [](std::int64_t value, const FrameEntry &entry) { return value < entry.pts; }
+    );
+    if (it == _frames.begin()) return nullptr;
+    return frame(static_cast<std::size_t>(it - _frames.begin() - 1));
+}
+
+RecordingReader::Stats RecordingReader::stats() const
+{
+    std::lock_guard lock(_mutex);
+    auto stats = _stats;
+    stats.cached_frames = _cache.size();
+    stats.cached_bytes = _cached_bytes;
+    return stats;
+}
+
+bool RecordingReader::load_index()
+{
+    if (_options.index.empty()) return false;
+    std::ifstream in(_options.index, std::ios::binary);
+    if (!in) return false;
+
+    char magic[sizeof(IndexMagic)];
+    std::uint32_t segment_count;
+    std::uint32_t h265;
+    std::uint64_t frame_count;
+    if (!in.read(magic, sizeof(magic)) || std::memcmp(magic, IndexMagic, sizeof(magic)) != 0 ||
+        !read_value(in, segment_count) || !read_value(in, h265) ||
+        !read_value(in, frame_count) || segment_count != _segments.size() ||
+        (h265 != 0) != _h265) {
+        return false;
+    }
+    for (const auto &segment : _segments) {
+        SegmentStamp saved;
+        std::uint32_t length;
+        if (!read_value(in, saved.size) || !read_value(in, saved.modified) ||
+            !read_value(in, length)) {
+            return false;
+        }
+        std::string name(length, '\0');
+        if (!in.read(name.data(), length)) return false;
+        auto current = stamp(segment.path);
+        if (fs::path(name) != segment.path || !current || current->size != saved.size ||
+            current->modified != saved.modified) {
+            return false;
+        }
+    }
+
+    std::vector<FrameEntry> frames(frame_count);
+    if (!in.read(reinterpret_cast<char *>(frames.data()), frames.size() * sizeof(FrameEntry))) {
+        return false;
+    }
+    for (const auto &entry : frames) {
+        if (entry.segment >= _segments.size() || entry.gop >= frames.size() ||
+            entry.offset + entry.size > _segments[entry.segment].file.data().size()) {
+            return false;
+        }
+    }
+    _frames = std::move(frames);
+    return true;
+}
+
+bool RecordingReader::build_index()
+{
+    std::int64_t offset = 0;
+    std::optional<std::int64_t> start;
+    for (std::uint32_t s = 0; s < _segments.size(); ++s) {
+        const auto &segment = _segments[s];
+        MkvScanner scanner(segment.file.data());
+        scanner.open();
+        auto track = std::find_if(
+            scanner.tracks().begin(),
+            scanner.tracks().end(),
+            [&](const MkvTrack &t) { return t.codec_id == (_h265 ? HevcCodecId : JpegCodecId); }
+        );
+
+        auto first = _frames.size();
+        std::uint32_t frame = 0;
+        auto scanned = scanner.scan([&](const MkvBlock &block) {
+            if (block.track != track->number) return true;
+            if (!start) start = block.pts;
+            // Segments that restart their timestamps continue the session's timeline one frame
+            // after the previous segment.
+            if (frame == 0 && first > 0 && block.pts - *start + offset <= _frames.back().pts) {
+                auto step = first > 1 ? _frames[first - 1].pts - _frames[first - 2].pts : 1;
+                offset = _frames.back().pts + std::max<std::int64_t>(step, 1) - block.pts + *start;
+            }
+            auto n = static_cast<std::uint32_t>(_frames.size());
+            auto gop = block.keyframe || frame == 0 ? n : _frames.back().gop;
+            _frames.push_back(
+                {block.offset,
+                 block.pts - *start + offset,
+                 static_cast<std::uint32_t>(block.payload.size()),
+                 s,
+                 frame++,
+                 gop}
+            );
+            return true;
+        });
+        if (!scanned) {
+            // A segment still being written, or cut short; its complete frames are usable.
+            spdlog::warn("{}: {}", segment.path.string(), scanner.error());
+        }
+    }
+    if (_frames.empty()) {
+        spdlog::error("The recording has no frames.");
+        return false;
+    }
+    return true;
+}
+
+void RecordingReader::save_index() const
+{
+    if (_options.index.empty()) return;
+    auto partial = fs::path(_options.index) += ".part";
+    {
+        std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+        out.write(IndexMagic, sizeof(IndexMagic));
+        write_value(out, static_cast<std::uint32_t>(_segments.size()));
+        write_value(out, static_cast<std::uint32_t>(_h265));
+        write_value(out, static_cast<std::uint64_t>(_frames.size()));
+        for (const auto &segment : _segments) {
+            auto current = stamp(segment.path).value_or(SegmentStamp{0, 0});
+            auto name = segment.path.string();
+            write_value(out, current.size);
+            write_value(out, current.modified);
+            write_value(out, static_cast<std::uint32_t>(name.size()));
+            out.write(name.data(), name.size());
+        }
+        out.write(
+            reinterpret_cast<const char *>(_frames.data()), _frames.size() * sizeof(FrameEntry)
+        );
+        if (!out.flush()) {
+            spdlog::warn("{}: could not be written", partial.string());
+            out.close();
+            std::error_code ec;
+            fs::remove(partial, ec);
+            return;
+        }
+    }
+    std::error_code ec;
+    fs::rename(partial, _options.index, ec);
+    if (ec) {
+        spdlog::warn("{}: {}", _options.index.string(), ec.message());
+        fs::remove(partial, ec);
+    }
+}
+
+std::size_t RecordingReader::gop_end(std::size_t gop) const
+{
+    auto end = gop + 1;
+    while (end < _frames.size() && _frames[end].gop == gop) ++end;
+    return end;
+}
+
+std::vector<FramePtr> RecordingReader::decode(Decoder &decoder, std::size_t gop)
+{
+    auto end = gop_end(gop);
+    std::vector<GstBuffer *> units;
+    units.reserve(end - gop);
+    std::vector<std::uint8_t> au;
+    for (auto n = gop; n < end; ++n) {
+        const auto &entry = _frames[n];
+        const auto &segment = _segments[entry.segment];
+        auto payload = segment.file.data().subspan(entry.offset, entry.size);
+        GstBuffer *buffer;
+        if (_h265) {
+            // The parameter sets only travel in the track header; repeat them before every
+            // keyframe, since each decode starts afresh.
+            au.clear();
+            if (n == gop) {
+                au = segment.config->parameter_sets;
+            }
+            if (!append_byte_stream(payload, segment.config->length_size, au)) {
+                spdlog::error(
+                    "{}: malformed access unit at {}", segment.path.string(), entry.offset
+                );
+                break;
+            }
+            buffer = gst_buffer_new_allocate(nullptr, au.size(), nullptr);
+            gst_buffer_fill(buffer, 0, au.data(), au.size());
+        } else {
+            // A view of the mapping, which outlives the decoders.
+            auto data = const_cast<std::uint8_t *>(payload.data());
+            buffer = gst_buffer_new_wrapped_full(
+                GST_MEMORY_FLAG_READONLY, data, payload.size(), 0, payload.size(), nullptr, nullptr
+            );
+        }
+        GST_BUFFER_PTS(buffer) = entry.pts;
+        if (n == gop) {
+            GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DISCONT);
+        } else {
+            GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+        }
+        units.push_back(buffer);
+    }
+
+    // Samples normally come out one per frame in order; match them by timestamp in case the
+    // decoder dropped one.
+    std::vector<FramePtr> frames(end - gop);
+    auto next = gop;
+    for (auto sample : decoder.decode(units)) {
+        auto pts = static_cast<std::int64_t>(GST_BUFFER_PTS(gst_sample_get_buffer(sample)));
+        if (next >= end || _frames[next].pts != pts) {
+            auto it = std::find_if(
+                _frames.begin() + gop,
+                _frames.begin() + end,
+                [&](const FrameEntry &entry) { return entry.pts == pts; }
+            );
+            next = static_cast<std::size_t>(it - _frames.begin());
+        }
+        if (next >= end) {
+            gst_sample_unref(sample);
+            continue;
+        }
+        auto frame = std::make_shared<const Frame>(sample);
+        if (frame->valid()) frames[next - gop] = std::move(frame);
+        ++next;
+    }
+    return frames;
+}
+
+FramePtr RecordingReader::lookup(std::size_t n)
+{
+    auto it = _cache.find(n);
+    if (it == _cache.end()) return nullptr;
+    _lru.splice(_lru.begin(), _lru, it->second.order);
+    return it->second.frame;
+}
+
+void RecordingReader::insert(std::size_t gop, const std::vector<FramePtr> &frames)
+{
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+        if (!frames[i]) continue;
+        ++_stats.decoded;
+        if (_cache.contains(gop + i)) continue;
+        auto bytes = gst_buffer_get_size(gst_sample_get_buffer(frames[i]->sample()));
+        _lru.push_front(gop + i);
+        _cache.emplace(gop + i, CacheEntry{frames[i], bytes, _lru.begin()});
+        _cached_bytes += bytes;
+    }
+    while (_cached_bytes > _options.cache_bytes && !_lru.empty()) {
+        auto it = _cache.find(_lru.back());
+        _cached_bytes -= it->second.bytes;
+        _cache.erase(it);
+        _lru.pop_back();
+    }
+}
+
+void RecordingReader::prefetch(std::stop_token stop)
+{
+    std::unique_lock lock(_mutex);
+    std::uint64_t seen = 0;
+    while (_requested.wait(lock, stop, [&] { return _generation != seen; })) {
+        seen = _generation;
+        auto target = *_target;
+        auto direction = _direction;
+
+        // Walk the GOPs in the scrub direction until enough frames past the target are decoded,
+        // starting over whenever the target moves.
+        auto gop = static_cast<std::size_t>(_frames[target].gop);
+        auto ahead = direction > 0 ? gop_end(gop) - target - 1 : target - gop;
+        while (ahead < _options.prefetch_frames && seen == _generation &&
+               !stop.stop_requested()) {
+            if (direction > 0) {
+                gop = gop_end(gop);
+                if (gop >= _frames.size()) break;
+            } else {
+                if (gop == 0) break;
+                gop = _frames[gop - 1].gop;
+            }
+            auto end = gop_end(gop);
+            ahead += end - gop;
+            if (_in_flight.contains(gop) || (_cache.contains(gop) && _cache.contains(end - 1))) {
+                continue;
+            }
+
+            _in_flight.insert(gop);
+            lock.unlock();
+            auto frames = decode(*_prefetch_decoder, gop);
+            lock.lock();
+            _in_flight.erase(gop);
+            insert(gop, frames);
+            for (const auto &frame : frames) {
+                if (frame) ++_stats.prefetched;
+            }
+            _decoded.notify_all();
+        }
+    }
+}
+
+}  // namespace xvc
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <stop_token>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "frame_source.h"
+#include "hevc.h"
+#include "mapped_file.h"
+
+
+namespace xvc
+{
+
+// Random access to the decoded frames of a recording session, for review tools that scrub back
+// and forth. The segments are mapped and indexed once: the offset, size, timestamp and keyframe of
+// every frame, straight from the Matroska blocks, so a seek is a binary search and a decode of
+// the frames from the nearest keyframe, never a demux. A decoded GOP is kept whole in a
+// byte-bounded LRU, so stepping through it after a seek costs nothing, and a background thread
+// decodes ahead in the direction of the last moves. Every M-JPEG frame is its own GOP.
+//
+// Frames are in whatever raw format the decoder produces. frame() and frame_at() are meant to be
+// called from one thread.
+class RecordingReader
+{
+public:
+    struct Options {
+        std::size_t cache_bytes = 512 * 1024 * 1024;
+        // Frames decoded ahead of the last one returned; at least one GOP for H.265. 0 disables
+        // the prefetch thread.
+        std::size_t prefetch_frames = 30;
+        // The index is kept here and reused while the segments are unchanged; empty to rebuild
+        // it on every open().
+        std::filesystem::path index;
+    };
+
+    struct Stats {
+        std::uint64_t hits;
+        std::uint64_t misses;      // Decoded on the caller's thread.
+        std::uint64_t waits;       // Waited for the prefetch thread to finish the frame.
+        std::uint64_t decoded;     // Frames, by both threads.
+        std::uint64_t prefetched;  // Frames decoded by the prefetch thread.
+        std::size_t cached_frames;
+        std::size_t cached_bytes;
+    };
+
+    explicit RecordingReader(std::vector<std::filesystem::path> segments);
+    RecordingReader(std::vector<std::filesystem::path> segments, Options options);
+    ~RecordingReader();
+
+    RecordingReader(const RecordingReader &) = delete;
+    RecordingReader &operator=(const RecordingReader &) = delete;
+
+    // Maps and indexes the segments and starts the decoders. False if a segment is not an M-JPEG
+    // or H.265 recording, or the segments do not share a codec.
+    bool open();
+
+    [[nodiscard]] std::size_t size() const { return _frames.size(); }
+    [[nodiscard]] bool h265() const { return _h265; }
+    // Of frame `n` on the session's timeline, which continues across segments.
+    [[nodiscard]] std::chrono::nanoseconds pts(std::size_t n) const;
+    // The frame number of frame `frame` of `segment`, to follow a TimestampIndex::Location.
+    [[nodiscard]] std::optional<std::size_t> frame_number(
+        const std::filesystem::path &segment, std::uint32_t frame
+    ) const;
+
+    // Null if `n` is out of range or does not decode.
+    FramePtr frame(std::size_t n);
+    // The last frame at or before `pts` on the session's timeline.
+    FramePtr frame_at(std::chrono::nanoseconds pts);
+
+    [[nodiscard]] Stats stats() const;
+
+private:
+    struct Segment {
+        std::filesystem::path path;
+        MappedFile file;
+        std::optional<HevcConfig> config;
+        std::size_t first;  // Frame number of its first frame.
+    };
+
+    struct FrameEntry {
+        std::uint64_t offset;  // Of the payload in the segment.
+        std::int64_t pts;      // On the session's timeline, nanoseconds.
+        std::uint32_t size;
+        std::uint32_t segment;
+        std::uint32_t frame;   // In the segment.
+        std::uint32_t gop;     // Frame number of the keyframe starting its GOP.
+    };
+
+    struct CacheEntry {
+        FramePtr frame;
+        std::size_t bytes;
+        std::list<std::size_t>::iterator order;
+    };
+
+    class Decoder;
+
+    bool load_index();
+    bool build_index();
+    void save_index() const;
+
+    // The frames [gop, end) of the GOP starting at `gop`.
+    [[nodiscard]] std::size_t gop_end(std::size_t gop) const;
+    std::vector<FramePtr> decode(Decoder &decoder, std::size_t gop);
+    // Called with _mutex held.
+    FramePtr lookup(std::size_t n);
+    void insert(std::size_t gop, const std::vector<FramePtr> &frames);
+
+    void prefetch(std::stop_token stop);
+
+    std::vector<std::filesystem::path> _paths;
+    Options _options;
+    std::vector<Segment> _segments;
+    std::vector<FrameEntry> _frames;
+    bool _h265;
+
+    std::unique_ptr<Decoder> _decoder;
+    std::unique_ptr<Decoder> _prefetch_decoder;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _decoded;        // A GOP left _in_flight.
+    std::condition_variable_any _requested;  // _target moved.
+    std::unordered_map<std::size_t, CacheEntry> _cache;
+    std::list<std::size_t> _lru;         // Most recent first.
+    std::size_t _cached_bytes;
+    std::set<std::size_t> _in_flight;    // GOPs being decoded.
+    std::optional<std::size_t> _target;  // Last frame asked for.
+    int _direction;
+    std::uint64_t _generation;
+    Stats _stats;
+
+    std::jthread _prefetch_thread;
+};
+
+}  // namespace xvc
@@ -0,0 +1,240 @@
+#include "retention.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <set>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+
+// The video and the sidecars, or frame index, written next to it.
+std::vector<fs::path> files_of(const fs::path &video)
+{
+    return {
+        video,
+        fs::path(video).replace_extension(".bin"),
+        fs::path(video).replace_extension(".xbin"),
+        fs::path(video).replace_extension(".idx")
+    };
+}
+
+std::uint64_t size_of(const fs::path &video)
+{
+    std::uint64_t bytes = 0;
+    for (const auto &file : files_of(video)) {
+        std::error_code ec;
+        auto size = fs::file_size(file, ec);
+        if (!ec) bytes += size;
+    }
+    return bytes;
+}
+
+fs::path directory_of(const fs::path &camera)
+{
+    return camera.has_parent_path() ? camera.parent_path() : fs::path(".");
+}
+
+}  // namespace
+
+
+namespace xvc
+{
+
+RetentionManager &RetentionManager::instance()
+{
+    static RetentionManager manager;
+    return manager;
+}
+
+RetentionManager::RetentionManager(std::chrono::milliseconds poll)
+    : _poll(poll), _opened(0), _requested(0), _completed(0), _stats{0, 0, {}}
+{
+    _thread = std::jthread([this](std::stop_token stop) { run(stop); });
+}
+
+RetentionManager::~RetentionManager()
+{
+    _thread.request_stop();
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+void RetentionManager::track(const fs::path &camera, const RetentionPolicy &policy)
+{
+    {
+        std::lock_guard lock(_mutex);
+        _cameras[camera].policy = policy;
+        ++_requested;
+    }
+    _changed.notify_all();
+}
+
+void RetentionManager::opened(const fs::path &camera, const fs::path &video)
+{
+    {
+        std::unique_lock lock(_mutex);
+        // The name is about to be written again: let a deletion of the old file finish first.
+        _removed.wait(lock, [&] { return !_removing.contains(video); });
+        for (auto &[_, state] : _cameras) {
+            std::erase_if(state.files, [&](const File &file) { return file.video == video; });
+        }
+        _cameras[camera].files.push_back({video, _opened++, false});
+        ++_requested;
+    }
+    _changed.notify_all();
+}
+
+void RetentionManager::closed(const fs::path &video)
+{
+    {
+        std::lock_guard lock(_mutex);
+        for (auto &[camera, state] : _cameras) {
+            auto file = std::find_if(state.files.begin(), state.files.end(), [&](const File &file) {
+                return file.video == video;
+            });
+            if (file != state.files.end()) {
+                file->closed = true;
+                ++_requested;
+                break;
+            }
+        }
+    }
+    _changed.notify_all();
+}
+
+void RetentionManager::flush()
+{
+    std::unique_lock lock(_mutex);
+    auto request = ++_requested;
+    _changed.notify_all();
+    _passed.wait(lock, [&] { return _completed >= request; });
+}
+
+RetentionManager::Stats RetentionManager::stats() const
+{
+    std::lock_guard lock(_mutex);
+    return _stats;
+}
+
+void RetentionManager::run(std::stop_token stop)
+{
+    std::unique_lock lock(_mutex);
+    while (!stop.stop_requested()) {
+        auto pass = _requested;
+        lock.unlock();
+        enforce();
+        lock.lock();
+        _completed = pass;
+        _passed.notify_all();
+        // Files grow and volumes fill up between notifications as well.
+        _changed.wait_for(lock, stop, _poll, [&] { return _requested != pass; });
+    }
+}
+
+void RetentionManager::enforce()
+{
+    std::vector<std::pair<fs::path, Camera>> cameras;
+    {
+        std::lock_guard lock(_mutex);
+        cameras.assign(_cameras.begin(), _cameras.end());
+    }
+    std::set<fs::path> deleted;
+
+    for (const auto &[camera, state] : cameras) {
+        const auto &policy = state.policy;
+        if (!policy.max_files && !policy.max_bytes) continue;
+        std::vector<std::uint64_t> sizes;
+        std::uint64_t total = 0;
+        if (policy.max_bytes) {
+            for (const auto &file : state.files) {
+                sizes.push_back(size_of(file.video));
+                total += sizes.back();
+            }
+        }
+        auto count = state.files.size();
+        for (std::size_t i = 0; i < state.files.size(); ++i) {
+            auto over = (policy.max_files && count > policy.max_files) ||
+                        (policy.max_bytes && total > policy.max_bytes);
+            if (!over) break;
+            // Still being written, or finalized after the next one was opened.
+            if (!state.files[i].closed) continue;
+            remove(camera, state.files[i]);
+            deleted.insert(state.files[i].video);
+            --count;
+            if (policy.max_bytes) total -= sizes[i];
+        }
+    }
+
+    while (true) {
+        const File *oldest = nullptr;
+        const fs::path *owner = nullptr;
+        for (const auto &[camera, state] : cameras) {
+            if (!state.policy.min_free_bytes) continue;
+            std::error_code ec;
+            auto space = fs::space(directory_of(camera), ec);
+            if (ec || space.available >= state.policy.min_free_bytes) continue;
+            for (const auto &file : state.files) {
+                if (!file.closed || deleted.contains(file.video)) continue;
+                if (!oldest || file.order < oldest->order) {
+                    oldest = &file;
+                    owner = &camera;
+                }
+                break;
+            }
+        }
+        if (!oldest) break;
+        remove(*owner, *oldest);
+        deleted.insert(oldest->video);
+    }
+}
+
+std::uint64_t RetentionManager::remove(const fs::path &camera, const File &entry)
+{
+    const auto &video = entry.video;
+    auto is_entry = [&](const File &file) { return file.order == entry.order; };
+    {
+        // The passes work on a copy; the entry may have been replaced by a new recording since.
+        std::lock_guard lock(_mutex);
+        const auto &files = _cameras[camera].files;
+        if (std::find_if(files.begin(), files.end(), is_entry) == files.end()) return 0;
+        _removing.insert(video);
+    }
+    auto begin = std::chrono::steady_clock::now();
+    std::uint64_t bytes = 0;
+    for (const auto &file : files_of(video)) {
+        std::error_code ec;
+        auto size = fs::file_size(file, ec);
+        if (ec) size = 0;
+        if (fs::remove(file, ec)) {
+            bytes += size;
+        } else if (ec) {
+            spdlog::warn("Retention: {} could not be deleted: {}", file.string(), ec.message());
+        }
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - begin
+    );
+    spdlog::info("Retention: deleted {} ({:.1f} MB)", video.string(), bytes / 1e6);
+
+    {
+        std::lock_guard lock(_mutex);
+        std::erase_if(_cameras[camera].files, is_entry);
+        _removing.erase(video);
+        ++_stats.deleted_files;
+        _stats.deleted_bytes += bytes;
+        _stats.max_delete = std::max(_stats.max_delete, elapsed);
+    }
+    _removed.notify_all();
+    return bytes;
+}
+
+}  // namespace xvc
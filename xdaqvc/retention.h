@@ -0,0 +1,99 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stop_token>
+#include <thread>
+
+
+namespace xvc
+{
+
+// Limits on the files of one camera. 0 disables a limit.
+struct RetentionPolicy {
+    std::size_t max_files = 0;
+    std::uint64_t max_bytes = 0;  // Videos and their sidecars together.
+    // On the volume holding the camera's files, whichever cameras recorded the rest.
+    std::uint64_t min_free_bytes = 0;
+
+    bool operator==(const RetentionPolicy &) const = default;
+};
+
+// Deletes old recordings off the streaming threads. splitmuxsink reports every file it opens and
+// closes; a background thread then deletes the oldest closed files of a camera, video and
+// sidecars, until the camera is back within its policy. The volume's free space is checked
+// after each file and every `poll` interval. When it is too low, the oldest closed file of any
+// camera on that volume goes first. Files still being written are never deleted, nor anything
+// recorded before the camera was tracked.
+class RetentionManager
+{
+public:
+    struct Stats {
+        std::uint64_t deleted_files;  // Videos, each with its sidecars.
+        std::uint64_t deleted_bytes;
+        std::chrono::microseconds max_delete;  // Slowest deletion of a video and its sidecars.
+    };
+
+    // The one the recordings of this process use.
+    static RetentionManager &instance();
+
+    explicit RetentionManager(std::chrono::milliseconds poll = std::chrono::seconds(5));
+    ~RetentionManager();
+
+    RetentionManager(const RetentionManager &) = delete;
+    RetentionManager &operator=(const RetentionManager &) = delete;
+
+    // Sets the policy of `camera`, the base path its file names start with; files already tracked
+    // for it stay.
+    void track(const std::filesystem::path &camera, const RetentionPolicy &policy);
+    // Cheap enough for the format-location callback. A recording that reuses the name of a file
+    // already tracked overwrites it, so the old entry is dropped.
+    void opened(const std::filesystem::path &camera, const std::filesystem::path &video);
+    void closed(const std::filesystem::path &video);
+
+    // Returns once a pass over every camera started after the call is done.
+    void flush();
+    [[nodiscard]] Stats stats() const;
+
+private:
+    struct File {
+        std::filesystem::path video;
+        std::uint64_t order;  // Opening order across cameras.
+        bool closed;
+    };
+
+    struct Camera {
+        RetentionPolicy policy;
+        std::deque<File> files;  // Oldest first.
+    };
+
+    void run(std::stop_token stop);
+    void enforce();
+    // Deletes `file` of `camera` and its sidecars and forgets it; returns the bytes freed. Nothing
+    // is deleted if the entry is gone, e.g. because its name was opened again since.
+    std::uint64_t remove(const std::filesystem::path &camera, const File &file);
+
+    std::chrono::milliseconds _poll;
+
+    mutable std::mutex _mutex;
+    std::condition_variable_any _changed;
+    std::condition_variable _passed;
+    std::condition_variable _removed;
+    std::set<std::filesystem::path> _removing;  // Videos being deleted.
+    std::map<std::filesystem::path, Camera> _cameras;
+    std::uint64_t _opened;
+    std::uint64_t _requested;  // Passes asked for,
+    std::uint64_t _completed;  // and the last one started that is done.
+    Stats _stats;
+
+    std::jthread _thread;
+};
+
+}  // namespace xvc
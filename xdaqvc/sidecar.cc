@@ -0,0 +1,46 @@
+#include "sidecar.h"
+
+#include <spdlog/spdlog.h>
+
+#include <cstring>
+#include <system_error>
+
+#include "compact_sidecar.h"
+#include "mapped_file.h"
+
+
+namespace xvc
+{
+
+std::vector<SidecarRecord> read_sidecar(const std::filesystem::path &path)
+{
+    if (path.extension() == ".xbin") {
+        std::vector<SidecarRecord> records;
+        CompactSidecarReader reader(path);
+        if (!reader.read_all(records)) records.clear();
+        return records;
+    }
+
+    MappedFile file(path);
+    auto data = file.data();
+    auto count = data.size() / sizeof(SidecarRecord);
+    if (data.size() % sizeof(SidecarRecord) != 0) {
+        spdlog::warn("{}: ignoring a partial record at the end", path.string());
+    }
+    std::vector<SidecarRecord> records(count);
+    if (count > 0) {
+        std::memcpy(records.data(), data.data(), count * sizeof(SidecarRecord));
+    }
+    return records;
+}
+
+std::filesystem::path find_sidecar(const std::filesystem::path &video)
+{
+    namespace fs = std::filesystem;
+    auto bin = fs::path(video).replace_extension(".bin");
+    auto compact = fs::path(video).replace_extension(".xbin");
+    std::error_code ec;
+    return !fs::exists(bin, ec) && fs::exists(compact, ec) ? compact : bin;
+}
+
+}  // namespace xvc
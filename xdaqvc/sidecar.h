@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+
+namespace xvc
+{
+
+// One frame of a .bin sidecar as xdaqmetadata's KeyValueStore writes it: fixed-size records in
+// the order frames reached the muxer. Everything in libxvc that reads sidecars goes through this
+// layout.
+struct SidecarRecord {
+    std::uint64_t pts;               // Of the frame in the .mkv, in nanoseconds.
+    std::uint64_t fpga_timestamp;    // Hardware timestamp.
+    std::uint32_t rhythm_timestamp;  // Ephys sample number.
+    std::uint32_t ttl_in;
+    std::uint32_t ttl_out;
+    std::uint32_t spi_perf_counter;
+    std::uint64_t reserved;
+};
+static_assert(sizeof(SidecarRecord) == 40);
+
+// The records of `path`, a .bin or a compact .xbin sidecar. A partial record at the end of a .bin,
+// from an interrupted write, is dropped.
+std::vector<SidecarRecord> read_sidecar(const std::filesystem::path &path);
+// The sidecar of `video`: its .bin, or its .xbin when there is only that one.
+std::filesystem::path find_sidecar(const std::filesystem::path &video);
+
+}  // namespace xvc
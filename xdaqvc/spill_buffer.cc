@@ -0,0 +1,367 @@
+#include "spill_buffer.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <system_error>
+#include <utility>
+
+
+namespace
+{
+
+// Spilled records are written to the journal in batches of this size. Until then the consumer
+// takes them straight from memory.
+constexpr std::size_t JournalBatchBytes = 1 << 20;
+
+// Past this much waiting for the journal writer the disk does not keep up either, and further
+// records are refused.
+constexpr std::size_t MaxBatchBytes = 32 << 20;
+
+struct JournalHeader {
+    std::uint64_t pts;
+    std::uint64_t dts;
+    std::uint64_t duration;
+    std::uint32_t flags;
+    std::uint32_t caps_size;
+    std::uint64_t payload_size;
+};
+
+std::filesystem::path unique_journal_path(const std::filesystem::path &directory)
+{
+    static std::atomic<unsigned> counter{0};
+    auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+    return directory / ("xvc-spill-" + std::to_string(now) + "-" + std::to_string(counter++) +
+                        ".journal");
+}
+
+}  // namespace
+
+
+namespace xvc
+{
+
+SpillBuffer::SpillBuffer(std::size_t memory_limit, std::filesystem::path journal_directory)
+    : _memory_limit(memory_limit),
+      _journal_directory(std::move(journal_directory)),
+      _memory_bytes(0),
+      _peak_memory_bytes(0),
+      _spilling(false),
+      _journal_records(0),
+      _journal_bytes(0),
+      _file_records(0),
+      _read_offset(0),
+      _write_offset(0),
+      _batch_begin(0),
+      _batch_records(0),
+      _writing(false),
+      _truncate(false),
+      _spilled(0),
+      _lost(0),
+      _closed(false)
+{
+}
+
+SpillBuffer::~SpillBuffer()
+{
+    if (_writer.joinable()) {
+        _writer.request_stop();
+        _writer.join();
+    }
+    _journal_in.close();
+    _journal_out.close();
+    if (!_journal_path.empty()) {
+        std::error_code ec;
+        std::filesystem::remove(_journal_path, ec);
+    }
+}
+
+bool SpillBuffer::push(SpillRecord record)
+{
+    std::unique_lock lock(_mutex);
+    if (_closed) return false;
+
+    if (!_spilling && _memory_bytes + record.size() > _memory_limit && !_memory.empty()) {
+        _spilling = true;
+        spdlog::warn("Recording is falling behind, spilling to disk.");
+    }
+
+    if (_spilling) {
+        if (!append_journal(record)) return false;
+    } else {
+        _memory_bytes += record.size();
+        _peak_memory_bytes = std::max(_peak_memory_bytes, _memory_bytes);
+        _memory.push_back(std::move(record));
+    }
+    lock.unlock();
+    _available.notify_one();
+    return true;
+}
+
+std::optional<SpillRecord> SpillBuffer::pop(std::chrono::milliseconds timeout)
+{
+    std::unique_lock lock(_mutex);
+    _available.wait_for(lock, timeout, [this] {
+        return !_memory.empty() || journal_readable() || (_closed && _journal_records == 0);
+    });
+
+    // Everything in memory is older than anything in the journal, and the file older than the
+    // batch.
+    if (!_memory.empty()) {
+        auto record = std::move(_memory.front());
+        _memory.pop_front();
+        _memory_bytes -= record.size();
+        return record;
+    }
+    if (_read_offset < _write_offset) {
+        return read_journal(lock);
+    }
+    if (journal_readable()) {
+        return read_batch();
+    }
+    return std::nullopt;
+}
+
+void SpillBuffer::close()
+{
+    {
+        std::lock_guard lock(_mutex);
+        _closed = true;
+    }
+    _available.notify_all();
+}
+
+bool SpillBuffer::closed() const
+{
+    std::lock_guard lock(_mutex);
+    return _closed;
+}
+
+bool SpillBuffer::drained() const
+{
+    std::lock_guard lock(_mutex);
+    return _closed && _memory.empty() && _journal_records == 0;
+}
+
+SpillBuffer::Stats SpillBuffer::stats() const
+{
+    std::lock_guard lock(_mutex);
+    return {_memory_bytes, _journal_bytes, _spilled, _peak_memory_bytes, _lost};
+}
+
+bool SpillBuffer::append_journal(const SpillRecord &record)
+{
+    if (_batch.size() - _batch_begin >= MaxBatchBytes) return false;
+
+    JournalHeader header{
+        record.pts,
+        record.dts,
+        record.duration,
+        record.flags,
+        static_cast<std::uint32_t>(record.caps.size()),
+        record.payload.size()
+    };
+    auto append = [this](const void *data, std::size_t size) {
+        auto bytes = static_cast<const char *>(data);
+        _batch.insert(_batch.end(), bytes, bytes + size);
+    };
+    append(&header, sizeof(header));
+    append(record.caps.data(), record.caps.size());
+    append(record.payload.data(), record.payload.size());
+    ++_batch_records;
+    _journal_bytes += sizeof(header) + record.size();
+    ++_journal_records;
+    ++_spilled;
+
+    if (!_writer.joinable()) {
+        _writer = std::jthread([this](std::stop_token stop) { write_journal(stop); });
+    }
+    if (_batch.size() - _batch_begin >= JournalBatchBytes) {
+        _batch_full.notify_one();
+    }
+    return true;
+}
+
+bool SpillBuffer::journal_readable() const
+{
+    // The batch has to wait for the one being written, which holds older records.
+    return _read_offset < _write_offset || (!_writing && _batch_records > 0);
+}
+
+std::optional<SpillRecord> SpillBuffer::read_journal(std::unique_lock<std::mutex> &lock)
+{
+    auto offset = _read_offset;
+    auto available = _write_offset - _read_offset;
+    lock.unlock();
+    auto record = read_record(offset, available);
+    lock.lock();
+
+    if (!record) {
+        // The sizes of whatever follows cannot be trusted either. The writer may have added to
+        // the file meanwhile, and only moves _write_offset forward.
+        spdlog::error(
+            "Failed to read the spill journal {}, {} records lost.",
+            _journal_path.string(),
+            _file_records
+        );
+        _lost += _file_records;
+        _journal_records -= _file_records;
+        _journal_bytes -= _write_offset - _read_offset;
+        _file_records = 0;
+        _read_offset = _write_offset;
+        if (_journal_records == 0) {
+            rewind();
+        }
+        return std::nullopt;
+    }
+    auto read = sizeof(JournalHeader) + record->size();
+    _read_offset += read;
+    --_file_records;
+    _journal_bytes -= read;
+    if (--_journal_records == 0) {
+        rewind();
+    }
+    return record;
+}
+
+std::optional<SpillRecord> SpillBuffer::read_batch()
+{
+    JournalHeader header{};
+    auto data = _batch.data() + _batch_begin;
+    std::memcpy(&header, data, sizeof(header));
+    data += sizeof(header);
+
+    SpillRecord record{header.pts, header.dts, header.duration, header.flags, {}, {}};
+    record.caps.assign(data, header.caps_size);
+    data += header.caps_size;
+    record.payload.assign(data, data + header.payload_size);
+
+    auto read = sizeof(header) + record.size();
+    _batch_begin += read;
+    if (--_batch_records == 0) {
+        _batch.clear();
+        _batch_begin = 0;
+    }
+    _journal_bytes -= read;
+    if (--_journal_records == 0) {
+        rewind();
+    }
+    return record;
+}
+
+void SpillBuffer::rewind()
+{
+    // Caught up: start over at the beginning of the file and go back to memory.
+    if (_write_offset > 0) {
+        _truncate = true;
+        _batch_full.notify_one();
+    }
+    _read_offset = 0;
+    _write_offset = 0;
+    _spilling = false;
+}
+
+void SpillBuffer::write_journal(std::stop_token stop)
+{
+    std::unique_lock lock(_mutex);
+    while (_batch_full.wait(lock, stop, [this] {
+        return _batch.size() - _batch_begin >= JournalBatchBytes || _truncate;
+    })) {
+        std::vector<char> batch;
+        batch.swap(_batch);
+        auto begin = std::exchange(_batch_begin, 0);
+        auto records = std::exchange(_batch_records, 0);
+        auto truncate = std::exchange(_truncate, false);
+        auto offset = _write_offset;
+        _writing = records > 0;
+
+        lock.unlock();
+        auto written = write_batch(batch.data() + begin, batch.size() - begin, offset, truncate);
+        lock.lock();
+
+        _writing = false;
+        if (written) {
+            _write_offset += batch.size() - begin;
+            _file_records += records;
+        } else {
+            _journal_bytes -= batch.size() - begin;
+            _journal_records -= records;
+            _lost += records;
+        }
+        _available.notify_one();
+    }
+}
+
+bool SpillBuffer::write_batch(
+    const char *data, std::size_t size, std::uint64_t offset, bool truncate
+)
+{
+    if (!_journal_out.is_open()) {
+        auto directory = _journal_directory.empty() ? std::filesystem::temp_directory_path()
+                                                    : _journal_directory;
+        auto path = unique_journal_path(directory);
+        _journal_out.open(path, std::ios::out | std::ios::trunc | std::ios::binary);
+        if (!_journal_out) {
+            spdlog::error("Failed to create the spill journal {}.", path.string());
+            _journal_out.close();
+            _journal_out.clear();
+            return false;
+        }
+        spdlog::info("Spill journal: {}", path.string());
+        std::lock_guard lock(_mutex);
+        _journal_path = path;
+    }
+    if (truncate) {
+        std::error_code ec;
+        std::filesystem::resize_file(_journal_path, 0, ec);
+    }
+    if (size == 0) return true;
+
+    _journal_out.seekp(static_cast<std::streamoff>(offset));
+    _journal_out.write(data, static_cast<std::streamsize>(size));
+    _journal_out.flush();
+    if (!_journal_out) {
+        spdlog::error("Failed to write the spill journal {}.", _journal_path.string());
+        _journal_out.clear();
+        return false;
+    }
+    return true;
+}
+
+std::optional<SpillRecord> SpillBuffer::read_record(std::uint64_t offset, std::uint64_t available)
+{
+    if (!_journal_in.is_open()) {
+        std::filesystem::path path;
+        {
+            std::lock_guard lock(_mutex);
+            path = _journal_path;
+        }
+        _journal_in.open(path, std::ios::in | std::ios::binary);
+    }
+    _journal_in.clear();
+    _journal_in.seekg(static_cast<std::streamoff>(offset));
+
+    JournalHeader header{};
+    if (available < sizeof(header) ||
+        !_journal_in.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+        return std::nullopt;
+    }
+    auto body = available - sizeof(header);
+    if (header.caps_size > body || header.payload_size > body - header.caps_size) {
+        return std::nullopt;
+    }
+    SpillRecord record{header.pts, header.dts, header.duration, header.flags, {}, {}};
+    record.caps.resize(header.caps_size);
+    record.payload.resize(header.payload_size);
+    _journal_in.read(record.caps.data(), static_cast<std::streamsize>(record.caps.size()));
+    _journal_in.read(
+        reinterpret_cast<char *>(record.payload.data()),
+        static_cast<std::streamsize>(record.payload.size())
+    );
+    if (!_journal_in) return std::nullopt;
+    return record;
+}
+
+}  // namespace xvc
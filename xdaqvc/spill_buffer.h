@@ -0,0 +1,111 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace xvc
+{
+
+using namespace std::chrono_literals;
+
+// An encoded access unit on its way to the recording muxer.
+struct SpillRecord {
+    std::uint64_t pts;
+    std::uint64_t dts;
+    std::uint64_t duration;
+    std::uint32_t flags;
+    std::string caps;  // Serialized caps when they changed since the previous record, else empty.
+    std::vector<std::uint8_t> payload;
+
+    [[nodiscard]] std::size_t size() const { return payload.size() + caps.size(); }
+};
+
+// Unbounded FIFO of records with bounded memory: records are kept in memory up to
+// `memory_limit` bytes, then appended to a journal file until the consumer has caught up with
+// everything written there. push() never waits for the consumer or the disk: spilled records are
+// collected in memory and written to the journal in batches by a thread of its own, and pop()
+// reads the journal without holding the lock push() takes. Records come out in the order they
+// went in. One producer and one consumer.
+class SpillBuffer
+{
+public:
+    struct Stats {
+        std::size_t memory_bytes;
+        std::uint64_t journal_bytes;  // Written to the journal and not yet read back.
+        std::uint64_t spilled;        // Records that went through the journal so far.
+        std::size_t peak_memory_bytes;
+        std::uint64_t lost;  // Accepted by push(), then lost with a failed journal write or read.
+    };
+
+    // The journal is created in `journal_directory`, or the system temporary directory when empty,
+    // the first time the memory limit is reached, and removed on destruction.
+    explicit SpillBuffer(std::size_t memory_limit, std::filesystem::path journal_directory = {});
+    ~SpillBuffer();
+
+    SpillBuffer(const SpillBuffer &) = delete;
+    SpillBuffer &operator=(const SpillBuffer &) = delete;
+
+    // Returns false after close() or when the journal writer is too far behind.
+    bool push(SpillRecord record);
+    // Waits up to `timeout` for a record. Returns nothing on timeout, or once the buffer is closed
+    // and empty.
+    std::optional<SpillRecord> pop(std::chrono::milliseconds timeout = 100ms);
+    // Rejects further records; the remaining ones can still be popped.
+    void close();
+
+    [[nodiscard]] bool closed() const;
+    [[nodiscard]] bool drained() const;
+    [[nodiscard]] Stats stats() const;
+
+private:
+    bool append_journal(const SpillRecord &record);
+    [[nodiscard]] bool journal_readable() const;
+    std::optional<SpillRecord> read_journal(std::unique_lock<std::mutex> &lock);
+    std::optional<SpillRecord> read_batch();
+    void rewind();
+    void write_journal(std::stop_token stop);
+    bool write_batch(const char *data, std::size_t size, std::uint64_t offset, bool truncate);
+    std::optional<SpillRecord> read_record(std::uint64_t offset, std::uint64_t available);
+
+    std::size_t _memory_limit;
+    std::filesystem::path _journal_directory;
+    std::filesystem::path _journal_path;
+    std::ofstream _journal_out;  // Only used by the writer thread.
+    std::ifstream _journal_in;   // Only used by the consumer.
+
+    mutable std::mutex _mutex;
+    std::condition_variable _available;
+    std::condition_variable_any _batch_full;
+    std::deque<SpillRecord> _memory;
+    std::size_t _memory_bytes;
+    std::size_t _peak_memory_bytes;
+    bool _spilling;  // Records go to the journal until it has been read back completely.
+    std::uint64_t _journal_records;  // In the file, on their way there or in the batch.
+    std::uint64_t _journal_bytes;
+    std::uint64_t _file_records;  // Between _read_offset and _write_offset.
+    std::uint64_t _read_offset;
+    std::uint64_t _write_offset;
+    std::vector<char> _batch;  // Journal records not written yet, from _batch_begin on.
+    std::size_t _batch_begin;
+    std::uint64_t _batch_records;
+    bool _writing;   // A batch is being written after _write_offset.
+    bool _truncate;  // The file was read back completely and can be emptied.
+    std::uint64_t _spilled;
+    std::uint64_t _lost;
+    bool _closed;
+    std::jthread _writer;
+};
+
+}  // namespace xvc
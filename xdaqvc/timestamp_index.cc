@@ -0,0 +1,485 @@
+#include "timestamp_index.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include "elementary_stream.h"
+#include "mkv_scanner.h"
+#include "sidecar.h"
+
+
+namespace fs = std::filesystem;
+
+
+namespace
+{
+
+constexpr char Magic[8] = {'X', 'V', 'C', 'I', 'N', 'D', 'E', 'X'};
+constexpr std::uint32_t Version = 1;
+
+// Followed by the segment paths (a 32-bit length, then UTF-8), then the entries at an 8-byte
+// aligned offset, then the 32-bit positions ordered by sample number.
+struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t segment_count;
+    std::uint64_t entry_count;
+    std::uint64_t segments_offset;
+    std::uint64_t entries_offset;
+    std::uint64_t by_sample_offset;
+};
+
+std::size_t align8(std::size_t size) { return (size + 7) & ~std::size_t(7); }
+
+bool by_timestamp(const xvc::IndexEntry &a, const xvc::IndexEntry &b)
+{
+    return a.timestamp < b.timestamp;
+}
+
+// Segments update() added since the index file was last written are appended to a log next to
+// it instead: per segment, a SegmentRecord, its path (UTF-8, relative like those of the index),
+// padding to 8 bytes, then its entries in frame order.
+constexpr char SegmentMagic[8] = {'X', 'V', 'C', 'I', 'S', 'E', 'G', '1'};
+
+struct SegmentRecord {
+    char magic[8];
+    std::uint32_t name_length;
+    std::uint32_t reserved;
+    std::uint64_t entry_count;
+};
+
+// Segments the log takes before update() folds it into the index file.
+constexpr std::size_t CompactEvery = 32;
+
+struct LoggedSegment {
+    fs::path video;
+    std::vector<xvc::IndexEntry> entries;
+};
+
+struct Log {
+    std::vector<LoggedSegment> segments;
+    std::uint64_t size;  // Of the complete records.
+};
+
+fs::path log_path(const fs::path &index) { return fs::path(index) += ".log"; }
+
+std::string relative_name(const fs::path &segment, const fs::path &directory)
+{
+    auto relative = segment.lexically_relative(directory);
+    return (relative.empty() ? segment : relative).generic_string();
+}
+
+// Up to the first record a crash cut short.
+Log read_log(const fs::path &path, const fs::path &directory)
+{
+    Log log{{}, 0};
+    std::error_code ec;
+    if (!fs::exists(path, ec)) return log;
+    xvc::MappedFile file(path);
+    auto data = file.data();
+    while (data.size() - log.size >= sizeof(SegmentRecord)) {
+        SegmentRecord record;
+        std::memcpy(&record, data.data() + log.size, sizeof(record));
+        if (std::memcmp(record.magic, SegmentMagic, sizeof(SegmentMagic)) != 0) break;
+        auto entries_offset = align8(sizeof(record) + record.name_length);
+        auto available = data.size() - log.size;
+        if (entries_offset > available ||
+            record.entry_count > (available - entries_offset) / sizeof(xvc::IndexEntry)) {
+            break;
+        }
+        auto begin = data.data() + log.size;
+        auto name = std::string(
+            reinterpret_cast<const char *>(begin + sizeof(record)), record.name_length
+        );
+        LoggedSegment segment{directory / fs::path(name), {}};
+        segment.entries.resize(record.entry_count);
+        std::memcpy(
+            segment.entries.data(),
+            begin + entries_offset,
+            segment.entries.size() * sizeof(xvc::IndexEntry)
+        );
+        log.segments.push_back(std::move(segment));
+        log.size += entries_offset + record.entry_count * sizeof(xvc::IndexEntry);
+    }
+    return log;
+}
+
+// After the complete records of the log, dropping whatever a crash left behind them.
+bool append_log(
+    const fs::path &path,
+    const Log &log,
+    const fs::path &directory,
+    const fs::path &video,
+    const std::vector<xvc::IndexEntry> &entries
+)
+{
+    std::error_code ec;
+    if (fs::exists(path, ec) && fs::file_size(path, ec) != log.size) {
+        fs::resize_file(path, log.size, ec);
+    }
+    auto name = relative_name(video, directory);
+    SegmentRecord record{};
+    std::memcpy(record.magic, SegmentMagic, sizeof(SegmentMagic));
+    record.name_length = static_cast<std::uint32_t>(name.size());
+    record.entry_count = entries.size();
+
+    std::ofstream out(path, std::ios::binary | std::ios::app);
+    out.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    out.write(name.data(), name.size());
+    const char padding[8] = {};
+    out.write(padding, align8(sizeof(record) + name.size()) - sizeof(record) - name.size());
+    out.write(
+        reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(xvc::IndexEntry)
+    );
+    if (!out.flush()) {
+        spdlog::error("{}: could not be written", path.string());
+        return false;
+    }
+    return true;
+}
+
+// The frames of `video` in frame order, from its sidecar, and their offsets and keyframe flags
+// from the .mkv itself or the frame index of an elementary stream.
+std::optional<std::vector<xvc::IndexEntry>> read_segment(const fs::path &video)
+{
+    auto records = xvc::read_sidecar(xvc::find_sidecar(video));
+    if (records.empty()) return std::nullopt;
+
+    // A sidecar has one record per frame of the video track, in the same order. A segment that is
+    // still being written or was cut short only has offsets for the frames before its end.
+    std::vector<xvc::IndexEntry> entries;
+    entries.reserve(records.size());
+    for (const auto &record : records) {
+        entries.push_back(
+            {record.fpga_timestamp,
+             static_cast<std::int64_t>(record.pts),
+             0,
+             record.rhythm_timestamp,
+             0,
+             0,
+             0}
+        );
+    }
+    if (xvc::ElementaryReader stream(video); stream.is_open()) {
+        for (std::size_t frame = 0; frame < std::min(stream.size(), entries.size()); ++frame) {
+            entries[frame].offset = stream.record(frame).offset;
+            entries[frame].keyframe = stream.record(frame).keyframe;
+        }
+        return entries;
+    }
+
+    xvc::MappedFile file(video);
+    xvc::MkvScanner scanner(file.data());
+    if (!file.is_open() || !scanner.open() || scanner.tracks().empty()) return std::nullopt;
+    auto track = scanner.tracks().front().number;
+    std::size_t frame = 0;
+    scanner.scan([&](const xvc::MkvBlock &block) {
+        if (block.track != track) return true;
+        entries[frame].offset = block.offset;
+        entries[frame].keyframe = block.keyframe;
+        return ++frame < entries.size();
+    });
+    return entries;
+}
+
+}  // namespace
+
+
+namespace xvc
+{
+
+std::optional<TimestampIndex> TimestampIndex::load(const fs::path &path)
+{
+    auto index = map(path);
+    if (!index) return std::nullopt;
+    auto log = read_log(log_path(path), fs::absolute(path).parent_path());
+    for (auto &segment : log.segments) {
+        // Also in the file if update() was interrupted after writing it.
+        if (!index->contains(segment.video)) {
+            index->add_segment(segment.video, std::move(segment.entries));
+        }
+    }
+    return index;
+}
+
+std::optional<TimestampIndex> TimestampIndex::map(const fs::path &path)
+{
+    MappedFile file(path, MappedFile::Access::Random);
+    auto data = file.data();
+    Header header;
+    if (data.size() < sizeof(header)) return std::nullopt;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version) {
+        spdlog::error("{}: not a timestamp index", path.string());
+        return std::nullopt;
+    }
+    auto entries_end = header.entries_offset + header.entry_count * sizeof(IndexEntry);
+    auto by_sample_end = header.by_sample_offset + header.entry_count * sizeof(std::uint32_t);
+    if (header.entries_offset % 8 != 0 || header.segments_offset > header.entries_offset ||
+        entries_end > header.by_sample_offset || by_sample_end > data.size()) {
+        spdlog::error("{}: truncated timestamp index", path.string());
+        return std::nullopt;
+    }
+
+    TimestampIndex index;
+    auto directory = fs::absolute(path).parent_path();
+    auto pos = header.segments_offset;
+    for (std::uint32_t i = 0; i < header.segment_count; ++i) {
+        std::uint32_t length;
+        if (pos + sizeof(length) > header.entries_offset) return std::nullopt;
+        std::memcpy(&length, data.data() + pos, sizeof(length));
+        pos += sizeof(length);
+        if (pos + length > header.entries_offset) return std::nullopt;
+        std::string name(reinterpret_cast<const char *>(data.data() + pos), length);
+        index._segments.push_back(directory / fs::path(name));
+        pos += length;
+    }
+    index._entries = {
+        reinterpret_cast<const IndexEntry *>(data.data() + header.entries_offset),
+        static_cast<std::size_t>(header.entry_count)
+    };
+    index._by_sample = {
+        reinterpret_cast<const std::uint32_t *>(data.data() + header.by_sample_offset),
+        static_cast<std::size_t>(header.entry_count)
+    };
+    index._file = std::move(file);
+    return index;
+}
+
+bool TimestampIndex::save(const fs::path &path) const
+{
+    auto directory = fs::absolute(path).parent_path();
+    std::vector<std::string> names;
+    std::size_t names_size = 0;
+    for (const auto &segment : _segments) {
+        names.push_back(relative_name(segment, directory));
+        names_size += sizeof(std::uint32_t) + names.back().size();
+    }
+
+    Header header{};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.segment_count = static_cast<std::uint32_t>(_segments.size());
+    header.entry_count = _entries.size();
+    header.segments_offset = sizeof(Header);
+    header.entries_offset = align8(sizeof(Header) + names_size);
+    header.by_sample_offset = header.entries_offset + _entries.size_bytes();
+
+    auto partial = fs::path(path) += ".part";
+    {
+        std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        for (const auto &name : names) {
+            auto length = static_cast<std::uint32_t>(name.size());
+            out.write(reinterpret_cast<const char *>(&length), sizeof(length));
+            out.write(name.data(), name.size());
+        }
+        const char padding[8] = {};
+        out.write(padding, header.entries_offset - sizeof(Header) - names_size);
+        out.write(reinterpret_cast<const char *>(_entries.data()), _entries.size_bytes());
+        out.write(reinterpret_cast<const char *>(_by_sample.data()), _by_sample.size_bytes());
+        if (!out.flush()) {
+            spdlog::error("{}: could not be written", partial.string());
+            out.close();
+            std::error_code ec;
+            fs::remove(partial, ec);
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(partial, path, ec);
+    if (ec) {
+        spdlog::error("{}: {}", path.string(), ec.message());
+        fs::remove(partial, ec);
+        return false;
+    }
+    return true;
+}
+
+bool TimestampIndex::add_segment(const fs::path &video)
+{
+    auto absolute = fs::absolute(video);
+    if (contains(absolute)) return true;
+    auto entries = read_segment(absolute);
+    if (!entries) return false;
+    add_segment(absolute, std::move(*entries));
+    return true;
+}
+
+void TimestampIndex::add_segment(const fs::path &video, std::vector<IndexEntry> entries)
+{
+    make_mutable();
+    auto segment = static_cast<std::uint32_t>(_segments.size());
+    _segments.push_back(fs::absolute(video));
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        entries[i].segment = segment;
+        entries[i].frame = static_cast<std::uint32_t>(i);
+    }
+    if (!std::is_sorted(entries.begin(), entries.end(), by_timestamp)) {
+        std::stable_sort(entries.begin(), entries.end(), by_timestamp);
+    }
+
+    // Segments normally arrive in order and only extend both arrays.
+    auto &all = _owned_entries;
+    auto old = all.size();
+    all.insert(all.end(), entries.begin(), entries.end());
+    _entries = all;
+    if (old > 0 && old < all.size() && all[old].timestamp < all[old - 1].timestamp) {
+        std::inplace_merge(all.begin(), all.begin() + old, all.end(), by_timestamp);
+        _entries = all;
+        sort_by_sample();
+        return;
+    }
+
+    auto by_sample = [&](std::uint32_t a, std::uint32_t b) {
+        return all[a].sample < all[b].sample;
+    };
+    auto &order = _owned_by_sample;
+    order.resize(all.size());
+    std::iota(order.begin() + old, order.end(), static_cast<std::uint32_t>(old));
+    std::stable_sort(order.begin() + old, order.end(), by_sample);
+    if (old > 0 && old < order.size() && by_sample(order[old], order[old - 1])) {
+        std::inplace_merge(order.begin(), order.begin() + old, order.end(), by_sample);
+    }
+    _by_sample = order;
+}
+
+std::size_t TimestampIndex::prune()
+{
+    constexpr auto Removed = std::numeric_limits<std::uint32_t>::max();
+    std::vector<std::uint32_t> remap(_segments.size(), Removed);
+    std::vector<fs::path> kept;
+    for (std::size_t i = 0; i < _segments.size(); ++i) {
+        std::error_code ec;
+        if (fs::exists(_segments[i], ec)) {
+            remap[i] = static_cast<std::uint32_t>(kept.size());
+            kept.push_back(_segments[i]);
+        }
+    }
+    auto removed = _segments.size() - kept.size();
+    if (removed == 0) return 0;
+
+    make_mutable();
+    std::erase_if(_owned_entries, [&](const IndexEntry &entry) {
+        return remap[entry.segment] == Removed;
+    });
+    for (auto &entry : _owned_entries) {
+        entry.segment = remap[entry.segment];
+    }
+    _segments = std::move(kept);
+    _entries = _owned_entries;
+    sort_by_sample();
+    return removed;
+}
+
+std::optional<TimestampIndex::Location> TimestampIndex::at_timestamp(std::uint64_t timestamp) const
+{
+    auto it = std::upper_bound(
+        _entries.begin(),
+        _entries.end(),
+        timestamp,
+        [](std::uint64_t value, const IndexEntry &entry) { return value < entry.timestamp; }
+    );
+    if (it == _entries.begin()) return std::nullopt;
+    return locate(*(it - 1));
+}
+
+std::optional<TimestampIndex::Location> TimestampIndex::at_sample(std::uint32_t sample) const
+{
+    auto it = std::upper_bound(
+        _by_sample.begin(),
+        _by_sample.end(),
+        sample,
+        [&](std::uint32_t value, std::uint32_t position) {
+            return value < _entries[position].sample;
+        }
+    );
+    if (it == _by_sample.begin()) return std::nullopt;
+    return locate(_entries[*(it - 1)]);
+}
+
+bool TimestampIndex::contains(const fs::path &video) const
+{
+    return std::find(_segments.begin(), _segments.end(), fs::absolute(video)) != _segments.end();
+}
+
+bool TimestampIndex::update(const fs::path &path, const fs::path &video)
+{
+    static std::mutex mutex;
+    std::lock_guard lock(mutex);
+
+    std::error_code ec;
+    auto index = fs::exists(path, ec) ? map(path) : std::nullopt;
+    auto directory = fs::absolute(path).parent_path();
+    auto log = read_log(log_path(path), directory);
+
+    auto absolute = fs::absolute(video);
+    auto logged = std::any_of(log.segments.begin(), log.segments.end(), [&](const auto &segment) {
+        return segment.video == absolute;
+    });
+    auto known = logged || (index && index->contains(absolute));
+    auto added = known ? std::nullopt : read_segment(absolute);
+    auto ok = known || added.has_value();
+
+    // Deleted segments stay until the log is folded into the file, as retention deletes about as
+    // often as segments are added.
+    if (index && log.segments.size() + 1 < CompactEvery) {
+        if (!added) return ok;
+        return append_log(log_path(path), log, directory, absolute, *added) && ok;
+    }
+
+    if (!index) {
+        index.emplace();
+    }
+    // Drop the mapping before the file is replaced.
+    index->make_mutable();
+    for (auto &segment : log.segments) {
+        if (!index->contains(segment.video)) {
+            index->add_segment(segment.video, std::move(segment.entries));
+        }
+    }
+    if (added) {
+        index->add_segment(absolute, std::move(*added));
+    }
+    index->prune();
+    if (!index->save(path)) return false;
+    fs::remove(log_path(path), ec);
+    return ok;
+}
+
+void TimestampIndex::make_mutable()
+{
+    if (!_file.is_open()) return;
+    _owned_entries.assign(_entries.begin(), _entries.end());
+    _owned_by_sample.assign(_by_sample.begin(), _by_sample.end());
+    _entries = _owned_entries;
+    _by_sample = _owned_by_sample;
+    _file = MappedFile();
+}
+
+void TimestampIndex::sort_by_sample()
+{
+    auto &order = _owned_by_sample;
+    order.resize(_owned_entries.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) {
+        return _owned_entries[a].sample < _owned_entries[b].sample;
+    });
+    _by_sample = order;
+}
+
+TimestampIndex::Location TimestampIndex::locate(const IndexEntry &entry) const
+{
+    return {_segments[entry.segment], entry};
+}
+
+}  // namespace xvc
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "mapped_file.h"
+
+
+namespace xvc
+{
+
+struct IndexEntry {
+    std::uint64_t timestamp;  // Hardware timestamp.
+    std::int64_t pts;         // Nanoseconds.
+    std::uint64_t offset;     // Of the frame in the segment file; 0 if unknown.
+    std::uint32_t sample;     // Ephys sample number.
+    std::uint32_t segment;
+    std::uint32_t frame;      // In the segment.
+    std::uint32_t keyframe;
+};
+static_assert(sizeof(IndexEntry) == 40);
+
+// Maps the hardware timestamps and sample numbers of every frame in a session's segments to the
+// frame, sorted so that either lookup is a binary search. The file form is the same arrays behind
+// a small header, so load() only maps it; the first change copies the arrays into memory.
+// Segments are kept relative to the index file, which can move along with them.
+//
+// update() appends each segment to a log next to the file ("<index>.log") and only rewrites the
+// file, folding the log in, every few dozen segments; load() applies the log.
+class TimestampIndex
+{
+public:
+    struct Location {
+        std::filesystem::path segment;
+        IndexEntry entry;
+    };
+
+    TimestampIndex() = default;
+
+    // Along with the segments in its log.
+    static std::optional<TimestampIndex> load(const std::filesystem::path &path);
+    // Replaces `path` atomically.
+    bool save(const std::filesystem::path &path) const;
+
+    // Reads the frames of `video` from its sidecar, and their offsets and keyframe flags from the
+    // .mkv itself, or from the frame index of an elementary stream. False if either cannot be
+    // read; true if already indexed.
+    bool add_segment(const std::filesystem::path &video);
+    // Adds frames already read, in frame order; their `segment` and `frame` are filled in.
+    void add_segment(const std::filesystem::path &video, std::vector<IndexEntry> entries);
+    // Drops the segments whose file is gone and returns how many.
+    std::size_t prune();
+
+    // The last frame at or before `timestamp` or `sample`.
+    [[nodiscard]] std::optional<Location> at_timestamp(std::uint64_t timestamp) const;
+    [[nodiscard]] std::optional<Location> at_sample(std::uint32_t sample) const;
+
+    [[nodiscard]] bool contains(const std::filesystem::path &video) const;
+    [[nodiscard]] const std::vector<std::filesystem::path> &segments() const { return _segments; }
+    // Sorted by timestamp.
+    [[nodiscard]] std::span<const IndexEntry> entries() const { return _entries; }
+
+    // Adds `video` to the index at `path`, creating it. Costs about the size of `video`'s entries,
+    // plus a rewrite of the file now and then, which also drops deleted segments. Calls for the
+    // same file are serialized within the process; used as segments are closed while recording.
+    static bool update(const std::filesystem::path &path, const std::filesystem::path &video);
+
+private:
+    // The file alone.
+    static std::optional<TimestampIndex> map(const std::filesystem::path &path);
+    void make_mutable();
+    void sort_by_sample();
+    [[nodiscard]] Location locate(const IndexEntry &entry) const;
+
+    MappedFile _file;
+    std::vector<std::filesystem::path> _segments;
+    std::span<const IndexEntry> _entries;         // Into _file or _owned_entries.
+    std::span<const std::uint32_t> _by_sample;    // Entry positions ordered by sample number.
+    std::vector<IndexEntry> _owned_entries;
+    std::vector<std::uint32_t> _owned_by_sample;
+};
+
+}  // namespace xvc
@@ -0,0 +1,220 @@
+#include "video_convert.h"
+
+#include <gst/gst.h>
+#include <gst/video/gstvideofilter.h>
+#include <gst/video/video.h>
+#include <spdlog/spdlog.h>
+
+#include <mutex>
+#include <optional>
+
+
+namespace
+{
+
+std::optional<xvc::RgbFormat> rgb_format(GstVideoFormat format)
+{
+    switch (format) {
+    case GST_VIDEO_FORMAT_RGB: return xvc::RgbFormat::RGB;
+    case GST_VIDEO_FORMAT_RGBA: return xvc::RgbFormat::RGBA;
+    case GST_VIDEO_FORMAT_BGRx: return xvc::RgbFormat::BGRx;
+    default: return std::nullopt;
+    }
+}
+
+// jpegdec produces full-range BT.601, so the range matters as much as the matrix.
+xvc::ColorMatrix color_matrix(const GstVideoInfo &info)
+{
+    auto bt709 = info.colorimetry.matrix == GST_VIDEO_COLOR_MATRIX_BT709;
+    if (info.colorimetry.range == GST_VIDEO_COLOR_RANGE_0_255) {
+        return bt709 ? xvc::ColorMatrix::BT709Full : xvc::ColorMatrix::BT601Full;
+    }
+    return bt709 ? xvc::ColorMatrix::BT709 : xvc::ColorMatrix::BT601;
+}
+
+bool convert_planes(
+    const GstVideoFrame *in, std::uint8_t *dst, int dst_stride, xvc::RgbFormat format,
+    xvc::ColorMatrix matrix
+)
+{
+    auto plane = [in](guint i) {
+        return static_cast<const std::uint8_t *>(GST_VIDEO_FRAME_PLANE_DATA(in, i));
+    };
+    auto width = GST_VIDEO_FRAME_WIDTH(in);
+    auto height = GST_VIDEO_FRAME_HEIGHT(in);
+
+    switch (GST_VIDEO_FRAME_FORMAT(in)) {
+    case GST_VIDEO_FORMAT_NV12:
+        xvc::nv12_to_rgb(
+            plane(0),
+            GST_VIDEO_FRAME_PLANE_STRIDE(in, 0),
+            plane(1),
+            GST_VIDEO_FRAME_PLANE_STRIDE(in, 1),
+            dst,
+            dst_stride,
+            width,
+            height,
+            format,
+            matrix
+        );
+        return true;
+    case GST_VIDEO_FORMAT_I420:
+        xvc::i420_to_rgb(
+            plane(0),
+            GST_VIDEO_FRAME_PLANE_STRIDE(in, 0),
+            plane(1),
+            GST_VIDEO_FRAME_PLANE_STRIDE(in, 1),
+            plane(2),
+            GST_VIDEO_FRAME_PLANE_STRIDE(in, 2),
+            dst,
+            dst_stride,
+            width,
+            height,
+            format,
+            matrix
+        );
+        return true;
+    default: return false;
+    }
+}
+
+}  // namespace
+
+
+// GObject boilerplate for the "xvcconvert" element.
+
+struct XvcVideoConvert {
+    GstVideoFilter parent;
+    xvc::ColorMatrix matrix;
+};
+
+struct XvcVideoConvertClass {
+    GstVideoFilterClass parent_class;
+};
+
+G_DEFINE_TYPE(XvcVideoConvert, xvc_video_convert, GST_TYPE_VIDEO_FILTER)
+
+namespace
+{
+
+GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
+    "sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE("{ NV12, I420 }"))
+);
+
+GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
+    "src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE("{ RGB, RGBA, BGRx }"))
+);
+
+// Same geometry and framerate on both sides; only the format and the fields tied to it change.
+GstCaps *transform_caps(
+    GstBaseTransform *trans, GstPadDirection direction, GstCaps *caps, GstCaps *filter
+)
+{
+    auto result = gst_caps_new_empty();
+    for (guint i = 0; i < gst_caps_get_size(caps); ++i) {
+        auto structure = gst_structure_copy(gst_caps_get_structure(caps, i));
+        gst_structure_remove_fields(structure, "format", "colorimetry", "chroma-site", nullptr);
+        gst_caps_append_structure(result, structure);
+    }
+
+    auto other_pad = direction == GST_PAD_SINK ? trans->srcpad : trans->sinkpad;
+    auto template_caps = gst_pad_get_pad_template_caps(other_pad);
+    auto constrained = gst_caps_intersect(result, template_caps);
+    gst_caps_unref(template_caps);
+    gst_caps_unref(result);
+
+    if (filter) {
+        auto filtered =
+            gst_caps_intersect_full(filter, constrained, GST_CAPS_INTERSECT_FIRST);
+        gst_caps_unref(constrained);
+        return filtered;
+    }
+    return constrained;
+}
+
+gboolean set_info(
+    GstVideoFilter *filter, GstCaps *, GstVideoInfo *in_info, GstCaps *, GstVideoInfo *out_info
+)
+{
+    if (GST_VIDEO_INFO_WIDTH(in_info) != GST_VIDEO_INFO_WIDTH(out_info) ||
+        GST_VIDEO_INFO_HEIGHT(in_info) != GST_VIDEO_INFO_HEIGHT(out_info) ||
+        !rgb_format(GST_VIDEO_INFO_FORMAT(out_info))) {
+        return FALSE;
+    }
+    reinterpret_cast<XvcVideoConvert *>(filter)->matrix = color_matrix(*in_info);
+    return TRUE;
+}
+
+GstFlowReturn transform_frame(GstVideoFilter *filter, GstVideoFrame *in, GstVideoFrame *out)
+{
+    auto self = reinterpret_cast<XvcVideoConvert *>(filter);
+    auto format = rgb_format(GST_VIDEO_FRAME_FORMAT(out));
+    if (!format || !convert_planes(
+                       in,
+                       static_cast<std::uint8_t *>(GST_VIDEO_FRAME_PLANE_DATA(out, 0)),
+                       GST_VIDEO_FRAME_PLANE_STRIDE(out, 0),
+                       *format,
+                       self->matrix
+                   )) {
+        return GST_FLOW_NOT_NEGOTIATED;
+    }
+    return GST_FLOW_OK;
+}
+
+}  // namespace
+
+static void xvc_video_convert_class_init(XvcVideoConvertClass *klass)
+{
+    auto element_class = GST_ELEMENT_CLASS(klass);
+    auto trans_class = GST_BASE_TRANSFORM_CLASS(klass);
+    auto filter_class = GST_VIDEO_FILTER_CLASS(klass);
+
+    gst_element_class_set_static_metadata(
+        element_class,
+        "libxvc colour converter",
+        "Filter/Converter/Video",
+        "Converts NV12/I420 to RGB, RGBA or BGRx with SIMD kernels",
+        "KonteX Neuroscience"
+    );
+    gst_element_class_add_static_pad_template(element_class, &sink_template);
+    gst_element_class_add_static_pad_template(element_class, &src_template);
+
+    trans_class->transform_caps = transform_caps;
+    trans_class->passthrough_on_same_caps = FALSE;
+    filter_class->set_info = set_info;
+    filter_class->transform_frame = transform_frame;
+}
+
+static void xvc_video_convert_init(XvcVideoConvert *self)
+{
+    self->matrix = xvc::ColorMatrix::BT601;
+}
+
+
+namespace xvc
+{
+
+bool convert_frame(const Frame &frame, std::uint8_t *dst, int dst_stride, RgbFormat format)
+{
+    if (!frame.valid()) return false;
+    return convert_planes(frame.video_frame(), dst, dst_stride, format, color_matrix(frame.info()));
+}
+
+bool register_video_convert_element()
+{
+    static std::once_flag once;
+    static auto registered = false;
+    std::call_once(once, [] {
+        registered = gst_element_register(
+            nullptr, "xvcconvert", GST_RANK_NONE, xvc_video_convert_get_type()
+        );
+        if (!registered) {
+            spdlog::error("Failed to register the xvcconvert element.");
+        } else {
+            spdlog::info("xvcconvert uses {} kernels", simd_level_name(detect_simd_level()));
+        }
+    });
+    return registered;
+}
+
+}  // namespace xvc
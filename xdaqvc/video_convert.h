@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+#include "color_convert.h"
+#include "frame_source.h"
+
+
+namespace xvc
+{
+
+// Converts an NV12 or I420 frame handle into `dst`. The matrix follows the frame colorimetry
+// (BT.709 when tagged so, BT.601 otherwise). Returns false for any other input format.
+bool convert_frame(const Frame &frame, std::uint8_t *dst, int dst_stride, RgbFormat format);
+
+// Registers the "xvcconvert" element, a drop-in replacement for videoconvert restricted to
+// NV12/I420 input and RGB/RGBA/BGRx output that runs the kernels of color_convert.h. Safe to call
+// more than once.
+bool register_video_convert_element();
+
+}  // namespace xvc
@@ -24,10 +24,26 @@
 #include <gst/video/video-info.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
 #include <memory>
+#include <optional>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#include "admission.h"
+#include "decode_filter.h"
+#include "frame_source.h"
+#include "jpeg_decode.h"
+#include "parallel_decoder.h"
+#include "io_governor.h"
+#include "recorder.h"
+#include "retention.h"
+#include "video_convert.h"
 #include "xdaqmetadata/key_value_store.h"
 #include "xdaqmetadata/xdaqmetadata.h"
 
@@ -47,407 +63,863 @@ GstElement *create_element(const gchar *factoryname, const gchar *name)
     return element;
 }
 
-struct FileTracker {
-    std::string base_filepath;
-    std::vector<fs::path> file_paths;
-    int max_files;
+// Names the files of a recording as splitmuxsink opens them. Old files are deleted by the
+// RetentionManager, off the streaming thread.
+struct FileNamer {
+    fs::path camera;
+    // splitmuxsink's location, "%02d" standing for the fragment number; empty to name the files by
+    // the time they are opened.
+    std::string location;
+    std::string extension;  // Of the files named by time.
 };
 
 gchararray generate_filename(
-    [[maybe_unused]] GstElement *splitmux, [[maybe_unused]] guint fragment_id, gpointer udata
+    [[maybe_unused]] GstElement *splitmux, guint fragment_id, gpointer udata
 )
 {
-    auto tracker = static_cast<FileTracker *>(udata);
-    auto now = std::chrono::system_clock::now();
-    auto time_t_now = std::chrono::system_clock::to_time_t(now);
-    std::tm tm_now;
+    auto namer = static_cast<FileNamer *>(udata);
+    std::string file_path;
+    if (namer->location.empty()) {
+        auto now = std::chrono::system_clock::now();
+        auto time_t_now = std::chrono::system_clock::to_time_t(now);
+        std::tm tm_now;
 
 #ifdef _WIN32
-    localtime_s(&tm_now, &time_t_now);
+        localtime_s(&tm_now, &time_t_now);
 #else
-    localtime_r(&time_t_now, &tm_now);
+        localtime_r(&time_t_now, &tm_now);
 #endif
 
-    auto timestamp = fmt::format("{:%Y-%m-%d_%H-%M-%S}", tm_now);
-    auto file_path = fmt::format("{}-{}.mkv", tracker->base_filepath, timestamp);
+        auto timestamp = fmt::format("{:%Y-%m-%d_%H-%M-%S}", tm_now);
+        file_path =
+            fmt::format("{}-{}{}", namer->camera.generic_string(), timestamp, namer->extension);
+    } else {
+        file_path = namer->location;
+        if (auto at = file_path.find("%02d"); at != std::string::npos) {
+            file_path.replace(at, 4, fmt::format("{:02}", fragment_id));
+        }
+    }
+
+    xvc::RetentionManager::instance().opened(namer->camera, file_path);
+    return g_strdup(file_path.c_str());
+}
 
-    tracker->file_paths.emplace_back(file_path);
+// Names the files through generate_filename and applies the retention policy of `camera`.
+void name_files(
+    GstElement *filesink, const fs::path &camera, const std::string &location,
+    const std::string &extension, int max_files, const xvc::RecordOptions &options
+)
+{
+    xvc::RetentionManager::instance().track(
+        camera,
+        {static_cast<std::size_t>(std::max(max_files, 0)),
+         options.max_bytes,
+         options.min_free_bytes}
+    );
+    g_signal_connect_data(
+        filesink,
+        "format-location",
+        G_CALLBACK(generate_filename),
+        new FileNamer{camera, location, extension},
+        [](gpointer data, GClosure *) { delete static_cast<FileNamer *>(data); },
+        GConnectFlags(0)
+    );
+    // Numbers keep counting up instead of wrapping around over the oldest files.
+    g_object_set(G_OBJECT(filesink), "max-files", 0, nullptr);
+}
 
-    if (tracker->file_paths.size() > static_cast<size_t>(tracker->max_files)) {
-        fs::remove(tracker->file_paths.front());
-        auto binFile = tracker->file_paths.front();
-        binFile.replace_extension(".bin");
-        fs::remove(binFile);
-        tracker->file_paths.erase(tracker->file_paths.begin());
+const gchar *format_name(xvc::PixelFormat format)
+{
+    switch (format) {
+    case xvc::PixelFormat::NV12: return "NV12";
+    case xvc::PixelFormat::I420: return "I420";
+    case xvc::PixelFormat::RGBA: return "RGBA";
+    case xvc::PixelFormat::BGRx: return "BGRx";
+    case xvc::PixelFormat::RGB: return "RGB";
+    case xvc::PixelFormat::Native: break;
     }
+    return nullptr;
+}
 
-    return g_strdup(file_path.c_str());
+// Formats xvcjpegdec can decode to without a converter.
+bool decodes_to(xvc::PixelFormat format)
+{
+    return format == xvc::PixelFormat::I420 || format == xvc::PixelFormat::RGB ||
+           format == xvc::PixelFormat::RGBA || format == xvc::PixelFormat::BGRx;
 }
 
-}  // namespace
+GstElement *create_scaled_jpeg_decoder(const gchar *name, int denom)
+{
+    auto dec = create_element("xvcjpegdec", name);
+    if (dec) {
+        g_object_set(G_OBJECT(dec), "scale-denom", denom, nullptr);
+    }
+    return dec;
+}
 
+enum class Codec { H265, Jpeg };
 
-namespace xvc
+// What setup_*_srt_stream was asked for. It is kept on the pipeline so that attach_display can
+// rebuild the display branch.
+struct StreamConfig {
+    Codec codec;
+    xvc::StreamOptions options;
+};
+
+auto constexpr StreamConfigKey = "xvc-stream-config";
+
+StreamConfig *stream_config(GstPipeline *pipeline)
+{
+    return static_cast<StreamConfig *>(g_object_get_data(G_OBJECT(pipeline), StreamConfigKey));
+}
+
+void set_stream_config(GstPipeline *pipeline, Codec codec, const xvc::StreamOptions &options)
 {
+    g_object_set_data_full(
+        G_OBJECT(pipeline),
+        StreamConfigKey,
+        new StreamConfig{codec, options},
+        [](gpointer data) { delete static_cast<StreamConfig *>(data); }
+    );
+}
 
-void setup_h265_srt_stream(GstPipeline *pipeline, const std::string &uri)
+// Limits for queue_display and the appsink, or nothing to keep the GStreamer defaults.
+std::optional<xvc::LatencyLimits> latency_limits(const xvc::StreamOptions &options)
 {
-    spdlog::info("Setup GStreamer H.265 SRT stream pipeline");
+    switch (options.latency) {
+    case xvc::LatencyPolicy::LowLatency: return xvc::LatencyLimits{1, 0, true, 1, true, false};
+    case xvc::LatencyPolicy::NoDrop:
+        return xvc::LatencyLimits{0, GST_SECOND, false, 4, false, false};
+    case xvc::LatencyPolicy::Custom: return options.latency_limits;
+    case xvc::LatencyPolicy::Default: break;
+    }
+    return std::nullopt;
+}
 
-    auto src = create_element("srtsrc", "src");
-    auto parser = create_element("h265parse", "parser");
-    auto cf_parser = create_element("capsfilter", "cf_parser");
-    auto tee = create_element("tee", "t");
+// Buffers entering and leaving queue_display, to tell how many a leaky queue discarded.
+struct QueueCounter {
+    std::atomic<std::uint64_t> in{0};
+    std::atomic<std::uint64_t> out{0};
+};
+
+auto constexpr QueueCounterKey = "xvc-queue-counter";
+
+// Buffers reaching the "appsink", to tell how many it dropped before a FrameSource got them.
+auto constexpr SinkCounterKey = "xvc-sink-counter";
+
+// Set on the pipeline while detach_display waits for the display branch to go idle.
+auto constexpr DetachingKey = "xvc-display-detaching";
+
+// How long attach_display waits for such a detach, which only takes the buffer in flight.
+constexpr auto DetachWait = std::chrono::seconds(1);
+
+GstPadProbeReturn count_buffer(GstPad *, GstPadProbeInfo *, gpointer counter)
+{
+    ++*static_cast<std::atomic<std::uint64_t> *>(counter);
+    return GST_PAD_PROBE_OK;
+}
+
+// The "appsink" frames are delivered from. It stays in the pipeline while the display branch comes
+// and goes, so it must not hold up state changes when nothing is linked to it.
+GstElement *create_display_sink(GstBin *bin, const xvc::StreamOptions &options)
+{
+    auto appsink = create_element("appsink", "appsink");
+    g_object_set(G_OBJECT(appsink), "async", FALSE, nullptr);
+    if (auto limits = latency_limits(options)) {
+        g_object_set(
+            G_OBJECT(appsink),
+            "max-buffers",
+            static_cast<guint>(limits->sink_max_buffers),
+            "drop",
+            static_cast<gboolean>(limits->sink_drop),
+            "sync",
+            static_cast<gboolean>(limits->sink_sync),
+            nullptr
+        );
+    }
+    gst_bin_add(bin, appsink);
+
+    auto counter = new std::atomic<std::uint64_t>(0);
+    g_object_set_data_full(G_OBJECT(appsink), SinkCounterKey, counter, [](gpointer data) {
+        delete static_cast<std::atomic<std::uint64_t> *>(data);
+    });
+    std::unique_ptr<GstPad, decltype(&gst_object_unref)> pad(
+        gst_element_get_static_pad(appsink, "sink"), gst_object_unref
+    );
+    gst_pad_add_probe(pad.get(), GST_PAD_PROBE_TYPE_BUFFER, count_buffer, counter, nullptr);
+    return appsink;
+}
+
+GstElement *create_display_queue(GstBin *bin, const xvc::StreamOptions &options)
+{
     auto queue_display = create_element("queue", "queue_display");
-#ifdef _WIN32
-    auto dec = create_element("d3d11h265dec", "dec");
-#elif __APPLE__
-    auto dec = create_element("vtdec", "dec");
-#else
-    auto dec = create_element("avdec_h265", "dec");
-#endif
-    auto cf_dec = create_element("capsfilter", "cf_dec");
-    auto conv = create_element("videoconvert", "conv");
+    if (auto limits = latency_limits(options)) {
+        g_object_set(
+            G_OBJECT(queue_display),
+            "max-size-buffers",
+            static_cast<guint>(limits->queue_max_buffers),
+            "max-size-bytes",
+            0u,
+            "max-size-time",
+            static_cast<guint64>(limits->queue_max_time),
+            "leaky",
+            limits->queue_leaky ? 2 /* downstream */ : 0,
+            nullptr
+        );
+    }
+    gst_bin_add(bin, queue_display);
+
+    // Installed before any other probe on queue_display, so it sees every buffer, including those
+    // the decode filter then drops.
+    auto counter = new QueueCounter;
+    g_object_set_data_full(G_OBJECT(bin), QueueCounterKey, counter, [](gpointer data) {
+        delete static_cast<QueueCounter *>(data);
+    });
+    for (const auto &[pad_name, count] :
+         {std::pair{"sink", &counter->in}, std::pair{"src", &counter->out}}) {
+        std::unique_ptr<GstPad, decltype(&gst_object_unref)> pad(
+            gst_element_get_static_pad(queue_display, pad_name), gst_object_unref
+        );
+        gst_pad_add_probe(pad.get(), GST_PAD_PROBE_TYPE_BUFFER, count_buffer, count, nullptr);
+    }
+    return queue_display;
+}
+
+// Converts the output of `upstream` to the requested display format and returns the element to
+// link to the "appsink", or nullptr on failure. `upstream_format` is what `upstream` is known to
+// produce; when it already matches the request no converter is inserted, and 4:2:0 to RGB goes
+// through xvcconvert.
+GstElement *convert_display_output(
+    GstBin *bin, GstElement *upstream, xvc::PixelFormat upstream_format,
+    const xvc::StreamOptions &options
+)
+{
+    if (options.format == xvc::PixelFormat::Native || options.format == upstream_format) {
+        return upstream;
+    }
+
+    auto yuv420_in = upstream_format == xvc::PixelFormat::NV12 ||
+                     upstream_format == xvc::PixelFormat::I420;
+    auto rgb_out = options.format == xvc::PixelFormat::RGB ||
+                   options.format == xvc::PixelFormat::RGBA ||
+                   options.format == xvc::PixelFormat::BGRx;
+    auto builtin = options.builtin_converter && yuv420_in && rgb_out &&
+                   xvc::register_video_convert_element();
+
+    auto conv = create_element(builtin ? "xvcconvert" : "videoconvert", "conv");
     auto cf_conv = create_element("capsfilter", "cf_conv");
-    auto appsink = create_element("appsink", "appsink");
 
     // clang-format off
-    std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> cf_src_caps(
-        gst_caps_new_simple(
-        "application/x-rtp",
-        "encoding-name", G_TYPE_STRING, "H265", 
-        nullptr),
-        gst_caps_unref
-    );
-    std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> cf_parser_caps(
-        gst_caps_new_simple(
-        "video/x-h265",
-        "stream-format", G_TYPE_STRING, "byte-stream", 
-        "alignment", G_TYPE_STRING, "au", 
-        nullptr),
-        gst_caps_unref
-    );
-    std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> cf_dec_caps(
-        gst_caps_new_simple(
-        "video/x-raw",
-        "format", G_TYPE_STRING, "NV12", 
-        nullptr),
-        gst_caps_unref
-    );
     std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> cf_conv_caps(
         gst_caps_new_simple(
         "video/x-raw",
-        "format", G_TYPE_STRING, "RGB", 
+        "format", G_TYPE_STRING, format_name(options.format), 
         nullptr),
         gst_caps_unref
     );
     // clang-format on
 
-    g_object_set(G_OBJECT(src), "uri", fmt::format("srt://{}", uri).c_str(), nullptr);
-    g_object_set(G_OBJECT(cf_parser), "caps", cf_parser_caps.get(), nullptr);
-    g_object_set(G_OBJECT(cf_dec), "caps", cf_dec_caps.get(), nullptr);
     g_object_set(G_OBJECT(cf_conv), "caps", cf_conv_caps.get(), nullptr);
 
-    gst_bin_add_many(
-        GST_BIN(pipeline),
-        src,
-        parser,
-        cf_parser,
-        tee,
-        queue_display,
-        dec,
-        cf_dec,
-        conv,
-        cf_conv,
-        appsink,
-        nullptr
-    );
-
-    if (!gst_element_link_many(src, parser, cf_parser, tee, nullptr) ||
-        !gst_element_link_many(tee, queue_display, dec, cf_dec, conv, cf_conv, appsink, nullptr)) {
-        spdlog::error("Elements could not be linked.");
-        gst_object_unref(pipeline);
-    }
+    gst_bin_add_many(bin, conv, cf_conv, nullptr);
+    return gst_element_link_many(upstream, conv, cf_conv, nullptr) ? cf_conv : nullptr;
 }
 
-void setup_jpeg_srt_stream(GstPipeline *pipeline, const std::string &uri)
+// queue_display ! dec ! cf_dec, always NV12.
+GstElement *build_h265_decoder(
+    GstBin *bin, GstElement *queue_display, const xvc::StreamOptions &options,
+    xvc::PixelFormat &format
+)
 {
-    spdlog::info("Setup GStreamer M-JPEG SRT stream pipeline");
-
-    auto src = create_element("srtclientsrc", "src");
-    auto parser = create_element("jpegparse", "parser");
-    auto tee = create_element("tee", "t");
-    auto queue_display = create_element("queue", "queue_display");
 #ifdef _WIN32
-    auto dec = create_element("jpegdec", "dec");
+    auto dec = create_element("d3d11h265dec", "dec");
 #elif __APPLE__
     auto dec = create_element("vtdec", "dec");
 #else
-    auto dec = create_element("jpegdec", "dec");
+    auto dec = create_element("avdec_h265", "dec");
 #endif
-    auto conv = create_element("videoconvert", "conv");
-    auto cf_conv = create_element("capsfilter", "cf_conv");
-    auto appsink = create_element("appsink", "appsink");
+    auto cf_dec = create_element("capsfilter", "cf_dec");
 
     // clang-format off
-    std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> cf_conv_caps(
+    std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> cf_dec_caps(
         gst_caps_new_simple(
         "video/x-raw",
-        "format", G_TYPE_STRING, "RGB", 
+        "format", G_TYPE_STRING, "NV12", 
         nullptr),
         gst_caps_unref
     );
     // clang-format on
 
-    g_object_set(G_OBJECT(src), "uri", fmt::format("srt://{}", uri).c_str(), nullptr);
-    g_object_set(G_OBJECT(cf_conv), "caps", cf_conv_caps.get(), nullptr);
+    g_object_set(G_OBJECT(cf_dec), "caps", cf_dec_caps.get(), nullptr);
+    gst_bin_add_many(bin, dec, cf_dec, nullptr);
 
-    gst_bin_add_many(
-        GST_BIN(pipeline), src, parser, tee, queue_display, dec, conv, cf_conv, appsink, nullptr
-    );
+    // Sits in front of queue_display, so dropped access units are not even queued. Installed even
+    // in DecodeMode::All so the mode can be switched while streaming.
+    xvc::DecodeFilter::attach(bin, queue_display, options.decode_mode, options.decode_prefix);
 
-    if (!gst_element_link_many(src, parser, tee, nullptr) ||
-        !gst_element_link_many(tee, queue_display, dec, conv, cf_conv, appsink, nullptr)) {
-        spdlog::error("Elements could not be linked.");
-        gst_object_unref(pipeline);
-    }
+    format = xvc::PixelFormat::NV12;
+    return gst_element_link_many(queue_display, dec, cf_dec, nullptr) ? cf_dec : nullptr;
 }
 
-void start_h265_recording(
-    GstPipeline *pipeline, fs::path &filepath, bool continuous, int max_size_time, int max_files
+// queue_display ! decoder, where the decoder is jpegdec, xvcjpegdec or the parallel decode stage.
+GstElement *build_jpeg_decoder(
+    GstBin *bin, GstElement *queue_display, const xvc::StreamOptions &options,
+    xvc::PixelFormat &format
 )
 {
-    spdlog::info("Start GStreamer H.265 recording");
+    // jpegdec follows the chroma subsampling of the camera, so its output format is only known
+    // once the first frame is decoded. The scaled decoder can produce I420 and packed RGB itself,
+    // in which case the format is pinned right after it and no converter is needed.
+    auto scaled = options.jpeg_scale != xvc::JpegScale::Full && xvc::register_jpeg_decode_element();
+    auto direct = scaled && decodes_to(options.format);
+    std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> direct_caps(
+        direct ? gst_caps_new_simple(
+                     "video/x-raw", "format", G_TYPE_STRING, format_name(options.format), nullptr
+                 )
+               : nullptr,
+        gst_caps_unref
+    );
+    auto denom = static_cast<int>(options.jpeg_scale);
+    format = direct ? options.format : xvc::PixelFormat::Native;
+
+    GstElement *decoded = nullptr;
+    if (options.decoder_threads > 1) {
+        decoded = xvc::ParallelDecoder::attach(
+            bin,
+            queue_display,
+            options.decoder_threads,
+            options.reorder_window,
+            [scaled, denom](int worker) {
+                auto name = fmt::format("worker_dec_{}", worker);
+                return scaled ? create_scaled_jpeg_decoder(name.c_str(), denom)
+                              : create_element("jpegdec", name.c_str());
+            },
+            direct_caps.get()
+        );
+    } else if (scaled) {
+        decoded = create_scaled_jpeg_decoder("dec", denom);
+        gst_bin_add(bin, decoded);
+        if (!gst_element_link(queue_display, decoded)) decoded = nullptr;
+        if (decoded && direct) {
+            auto cf_dec = create_element("capsfilter", "cf_dec");
+            g_object_set(G_OBJECT(cf_dec), "caps", direct_caps.get(), nullptr);
+            gst_bin_add(bin, cf_dec);
+            decoded = gst_element_link(decoded, cf_dec) ? cf_dec : nullptr;
+        }
+    } else {
+#ifdef _WIN32
+        decoded = create_element("jpegdec", "dec");
+#elif __APPLE__
+        decoded = create_element("vtdec", "dec");
+#else
+        decoded = create_element("jpegdec", "dec");
+#endif
+        gst_bin_add(bin, decoded);
+        if (!gst_element_link(queue_display, decoded)) decoded = nullptr;
+    }
+    return decoded;
+}
 
-    auto tee = gst_bin_get_by_name(GST_BIN(pipeline), "t");
-    auto src_pad = gst_element_request_pad_simple(tee, "src_1");
+// The display branch as a "display" bin: queue_display, the decoder and the output format
+// conversion, between a "sink" and a "src" ghost pad.
+GstElement *create_display_bin(const StreamConfig &config)
+{
+    auto bin = gst_bin_new("display");
+    auto queue_display = create_display_queue(GST_BIN(bin), config.options);
+
+    auto format = xvc::PixelFormat::Native;
+    auto decoded =
+        config.codec == Codec::H265
+            ? build_h265_decoder(GST_BIN(bin), queue_display, config.options, format)
+            : build_jpeg_decoder(GST_BIN(bin), queue_display, config.options, format);
+    auto output =
+        decoded ? convert_display_output(GST_BIN(bin), decoded, format, config.options) : nullptr;
+    if (!output) {
+        gst_object_unref(gst_object_ref_sink(bin));
+        return nullptr;
+    }
 
-    auto queue_record = create_element("queue", "queue_record");
+    std::unique_ptr<GstPad, decltype(&gst_object_unref)> sink_pad(
+        gst_element_get_static_pad(queue_display, "sink"), gst_object_unref
+    );
+    std::unique_ptr<GstPad, decltype(&gst_object_unref)> src_pad(
+        gst_element_get_static_pad(output, "src"), gst_object_unref
+    );
+    gst_element_add_pad(bin, gst_ghost_pad_new("sink", sink_pad.get()));
+    gst_element_add_pad(bin, gst_ghost_pad_new("src", src_pad.get()));
+    return bin;
+}
+
+// Everything of the record branch that does not depend on the output file, see RecordingBin.
+bool build_h265_writer(GstBin *writer, GstElement *src, xvc::RecordContainer container)
+{
     auto parser = create_element("h265parse", "record_parser");
     auto cf_parser = create_element("capsfilter", "cf_record_parser");
     auto filesink = create_element("splitmuxsink", "filesink");
 
-    filepath += continuous ? ".mkv" : "-%02d.mkv";
-    auto _max_size_time = continuous ? 0 : max_size_time * GST_SECOND * 60;
-
+    // An elementary stream stays in Annex-B form, with the parameter sets in every keyframe so
+    // each one decodes on its own; the containers take hvc1.
+    auto elementary = container == xvc::RecordContainer::Elementary;
     // clang-format off
     std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> cf_parser_caps(
         gst_caps_new_simple(
         "video/x-h265",
-        "stream-format", G_TYPE_STRING, "hvc1", 
+        "stream-format", G_TYPE_STRING, elementary ? "byte-stream" : "hvc1",
         "alignment", G_TYPE_STRING, "au", 
         nullptr),
         gst_caps_unref
     );
     // clang-format on
+    if (elementary) {
+        g_object_set(G_OBJECT(parser), "config-interval", -1, nullptr);
+    }
 
     g_object_set(G_OBJECT(cf_parser), "caps", cf_parser_caps.get(), nullptr);
-    g_object_set(G_OBJECT(filesink), "location", filepath.generic_string().c_str(), nullptr);
-    g_object_set(
-        G_OBJECT(filesink), "max-size-time", _max_size_time, nullptr
-    );  // max-size-time=0 -> continuous
-    g_object_set(G_OBJECT(filesink), "max-files", max_files, nullptr);
     g_object_set(
         G_OBJECT(filesink), "max-size-bytes", 0, nullptr
     );  // Set max-size-bytes to 0 in order to make send-keyframe-requests work.
     g_object_set(G_OBJECT(filesink), "send-keyframe-requests", true, nullptr);
     g_object_set(G_OBJECT(filesink), "async-finalize", true, nullptr);
-    g_object_set(
-        G_OBJECT(filesink), "muxer-factory", "matroskamux", nullptr
-    );  // Valid only for async-finalize = TRUE
-
 
-    gst_bin_add_many(GST_BIN(pipeline), queue_record, parser, cf_parser, filesink, nullptr);
+    gst_bin_add_many(writer, parser, cf_parser, filesink, nullptr);
+    // The muxer factory is valid only with async-finalize = TRUE.
+    return xvc::use_container(filesink, container) &&
+           gst_element_link_many(src, parser, cf_parser, filesink, nullptr);
+}
 
-    if (!gst_element_link_many(queue_record, parser, cf_parser, filesink, nullptr)) {
-        spdlog::error("Elements could not be linked.");
-        gst_object_unref(pipeline);
-        return;
-    }
+bool build_jpeg_writer(GstBin *writer, GstElement *src, xvc::RecordContainer container)
+{
+    auto parser = create_element("jpegparse", "record_parser");
+    auto filesink = create_element("splitmuxsink", "filesink");
 
-    gst_element_sync_state_with_parent(queue_record);
-    gst_element_sync_state_with_parent(parser);
-    gst_element_sync_state_with_parent(cf_parser);
-    gst_element_sync_state_with_parent(filesink);
+    g_object_set(G_OBJECT(filesink), "async-finalize", true, nullptr);
 
-    std::unique_ptr<GstPad, decltype(&gst_object_unref)> sink_pad(
-        gst_element_get_static_pad(queue_record, "sink"), gst_object_unref
-    );
+    gst_bin_add_many(writer, parser, filesink, nullptr);
+    // The muxer factory is valid only with async-finalize = TRUE.
+    return xvc::use_container(filesink, container) &&
+           gst_element_link_many(src, parser, filesink, nullptr);
+}
 
-    auto ret = gst_pad_link(src_pad, sink_pad.get());
-    if (GST_PAD_LINK_FAILED(ret)) {
-        spdlog::error("Failed to link 'tee' src pad to 'queue' sink pad");
-        gst_object_unref(pipeline);
-        return;
+// The recorder finishes the file on its own thread.
+std::shared_future<xvc::RecordResult> stop_recording(GstPipeline *pipeline)
+{
+    if (auto bin = xvc::RecordingBin::find(pipeline)) {
+        return bin->stop();
     }
-    GST_DEBUG_BIN_TO_DOT_FILE(
-        GST_BIN(pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "video-capture-after-link"
+    std::promise<xvc::RecordResult> none;
+    none.set_value({false, {}});
+    return none.get_future().share();
+}
+
+// Whether the volume of `camera` keeps up with one more recording, per `options.admission`.
+xvc::RecordAdmission admit(
+    xvc::RecordingBin *bin, const fs::path &camera, const xvc::RecordOptions &options
+)
+{
+    xvc::RecordAdmission admission{false, false, true, bin->stream_mb_per_s(), 0, 0, 0, 0, 0};
+    if (options.admission == xvc::Admission::Off) return admission;
+
+    auto check = xvc::check_admission(
+        camera,
+        admission.needed_mb_per_s,
+        options.admission_headroom,
+        xvc::IoGovernor::instance(),
+        xvc::StorageCache::instance()
     );
+    if (!check) {
+        spdlog::warn("Recording: the volume of {} could not be checked.", camera.string());
+        return admission;
+    }
+    admission.checked = true;
+    admission.within_budget = check->within_budget;
+    admission.active_mb_per_s = check->active_mb_per_s;
+    admission.budget_mb_per_s = check->budget_mb_per_s;
+    admission.storage_mb_per_s = check->storage.write_mb_per_s;
+    admission.fsync_p50_us = check->storage.fsync_p50.count();
+    admission.fsync_max_us = check->storage.fsync_max.count();
+    if (!check->within_budget) {
+        auto level = options.admission == xvc::Admission::Refuse ? spdlog::level::err
+                                                                 : spdlog::level::warn;
+        spdlog::log(
+            level,
+            "Recording: {} needs {:.1f} MB/s on top of {:.1f} MB/s, over the budget of {:.1f} "
+            "MB/s ({:.1f} MB/s sustained, fsync p50 {} us).",
+            camera.string(),
+            admission.needed_mb_per_s,
+            admission.active_mb_per_s,
+            admission.budget_mb_per_s,
+            admission.storage_mb_per_s,
+            admission.fsync_p50_us
+        );
+    }
+    return admission;
 }
 
-void stop_h265_recording(GstPipeline *pipeline)
+bool refused(const xvc::RecordAdmission &admission, const xvc::RecordOptions &options)
 {
-    spdlog::info("Stop GStreamer H.265 recording");
+    return options.admission == xvc::Admission::Refuse && !admission.within_budget;
+}
 
-    auto tee = gst_bin_get_by_name(GST_BIN(pipeline), "t");
-    auto src_pad = gst_element_get_static_pad(tee, "src_1");
-    gst_pad_add_probe(
-        src_pad,
-        GST_PAD_PROBE_TYPE_IDLE,
-        [](GstPad *src_pad, GstPadProbeInfo *, gpointer user_data) -> GstPadProbeReturn {
-            spdlog::info("Unlinking");
+bool link_record_branch(GstPipeline *pipeline, Codec codec, const xvc::StreamOptions &options)
+{
+    return xvc::RecordingBin::attach(
+               pipeline,
+               options.pretrigger,
+               options.pretrigger_memory_limit,
+               codec == Codec::H265 ? build_h265_writer : build_jpeg_writer,
+               codec == Codec::H265 ? h265_parse_saving_metadata : jpeg_parse_saving_metadata
+           ) != nullptr;
+}
 
-            auto pipeline = GST_PIPELINE(user_data);
-            auto tee = gst_bin_get_by_name(GST_BIN(pipeline), "t");
-            std::unique_ptr<GstElement, decltype(&gst_object_unref)> queue_record(
-                gst_bin_get_by_name(GST_BIN(pipeline), "queue_record"), gst_object_unref
-            );
-            std::unique_ptr<GstElement, decltype(&gst_object_unref)> parser(
-                gst_bin_get_by_name(GST_BIN(pipeline), "record_parser"), gst_object_unref
-            );
-            std::unique_ptr<GstElement, decltype(&gst_object_unref)> cf_parser(
-                gst_bin_get_by_name(GST_BIN(pipeline), "cf_record_parser"), gst_object_unref
-            );
-            std::unique_ptr<GstElement, decltype(&gst_object_unref)> filesink(
-                gst_bin_get_by_name(GST_BIN(pipeline), "filesink"), gst_object_unref
-            );
-            std::unique_ptr<GstPad, decltype(&gst_object_unref)> sink_pad(
-                gst_element_get_static_pad(queue_record.get(), "sink"), gst_object_unref
-            );
-            gst_pad_unlink(src_pad, sink_pad.get());
-            gst_pad_send_event(sink_pad.get(), gst_event_new_eos());
+}  // namespace
 
-            gst_bin_remove(GST_BIN(pipeline), queue_record.get());
-            gst_bin_remove(GST_BIN(pipeline), parser.get());
-            gst_bin_remove(GST_BIN(pipeline), cf_parser.get());
-            gst_bin_remove(GST_BIN(pipeline), filesink.get());
 
-            gst_element_set_state(queue_record.get(), GST_STATE_NULL);
-            gst_element_set_state(cf_parser.get(), GST_STATE_NULL);
-            gst_element_set_state(parser.get(), GST_STATE_NULL);
-            gst_element_set_state(filesink.get(), GST_STATE_NULL);
+namespace xvc
+{
 
-            gst_element_release_request_pad(tee, src_pad);
-            gst_object_unref(src_pad);
+void setup_h265_srt_stream(
+    GstPipeline *pipeline, const std::string &uri, const StreamOptions &options
+)
+{
+    spdlog::info("Setup GStreamer H.265 SRT stream pipeline");
 
-            return GST_PAD_PROBE_REMOVE;
-        },
-        pipeline,
-        nullptr
+    auto src = create_element("srtsrc", "src");
+    auto parser = create_element("h265parse", "parser");
+    auto cf_parser = create_element("capsfilter", "cf_parser");
+    auto tee = create_element("tee", "t");
+
+    // clang-format off
+    std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> cf_src_caps(
+        gst_caps_new_simple(
+        "application/x-rtp",
+        "encoding-name", G_TYPE_STRING, "H265", 
+        nullptr),
+        gst_caps_unref
+    );
+    std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> cf_parser_caps(
+        gst_caps_new_simple(
+        "video/x-h265",
+        "stream-format", G_TYPE_STRING, "byte-stream", 
+        "alignment", G_TYPE_STRING, "au", 
+        nullptr),
+        gst_caps_unref
+    );
+    // clang-format on
+
+    g_object_set(G_OBJECT(src), "uri", fmt::format("srt://{}", uri).c_str(), nullptr);
+    g_object_set(G_OBJECT(cf_parser), "caps", cf_parser_caps.get(), nullptr);
+    // Neither the display nor the record branch is always there.
+    g_object_set(G_OBJECT(tee), "allow-not-linked", TRUE, nullptr);
+
+    gst_bin_add_many(GST_BIN(pipeline), src, parser, cf_parser, tee, nullptr);
+    create_display_sink(GST_BIN(pipeline), options);
+    set_stream_config(pipeline, Codec::H265, options);
+
+    if (!gst_element_link_many(src, parser, cf_parser, tee, nullptr) ||
+        (options.display && !attach_display(pipeline)) ||
+        !link_record_branch(pipeline, Codec::H265, options)) {
+        spdlog::error("Elements could not be linked.");
+    }
+}
+
+bool set_decode_mode(GstPipeline *pipeline, DecodeMode mode, int decode_prefix)
+{
+    auto config = stream_config(pipeline);
+    if (!config || config->codec != Codec::H265) {
+        spdlog::error("The pipeline is not an H.265 stream.");
+        return false;
+    }
+    config->options.decode_mode = mode;
+    config->options.decode_prefix = decode_prefix;
+
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> display(
+        gst_bin_get_by_name(GST_BIN(pipeline), "display"), gst_object_unref
     );
+    if (display) {
+        if (auto filter = DecodeFilter::find(GST_BIN(display.get()))) {
+            filter->set_mode(mode, decode_prefix);
+        }
+    }
+    return true;
 }
 
-void start_jpeg_recording(
-    GstPipeline *pipeline, fs::path &filepath, bool continuous, int max_size_time, int max_files
+void setup_jpeg_srt_stream(
+    GstPipeline *pipeline, const std::string &uri, const StreamOptions &options
 )
 {
-    spdlog::info("Start GStreamer M-JPEG recording");
+    spdlog::info("Setup GStreamer M-JPEG SRT stream pipeline");
 
-    auto tee = gst_bin_get_by_name(GST_BIN(pipeline), "t");
-    auto src_pad = gst_element_request_pad_simple(tee, "src_1");
+    auto src = create_element("srtclientsrc", "src");
+    auto parser = create_element("jpegparse", "parser");
+    auto tee = create_element("tee", "t");
 
-    auto queue_record = create_element("queue", "queue_record");
-    auto parser = create_element("jpegparse", "record_parser");
-    auto filesink = create_element("splitmuxsink", "filesink");
+    g_object_set(G_OBJECT(src), "uri", fmt::format("srt://{}", uri).c_str(), nullptr);
+    // Neither the display nor the record branch is always there.
+    g_object_set(G_OBJECT(tee), "allow-not-linked", TRUE, nullptr);
 
-    auto _max_size_time = continuous ? 0 : max_size_time * GST_SECOND * 60;
-    auto tracker =
-        std::make_unique<FileTracker>(FileTracker{filepath.generic_string(), {}, max_files});
+    gst_bin_add_many(GST_BIN(pipeline), src, parser, tee, nullptr);
+    create_display_sink(GST_BIN(pipeline), options);
+    set_stream_config(pipeline, Codec::Jpeg, options);
 
-    g_signal_connect(filesink, "format-location", G_CALLBACK(generate_filename), tracker.release());
+    if (!gst_element_link_many(src, parser, tee, nullptr) ||
+        (options.display && !attach_display(pipeline)) ||
+        !link_record_branch(pipeline, Codec::Jpeg, options)) {
+        spdlog::error("Elements could not be linked.");
+    }
+}
 
-    g_object_set(
-        G_OBJECT(filesink), "max-size-time", _max_size_time, nullptr
-    );  // max-size-time=0 -> continuous
-    g_object_set(G_OBJECT(filesink), "max-files", max_files, nullptr);
-    g_object_set(G_OBJECT(filesink), "async-finalize", true, nullptr);
-    g_object_set(
-        G_OBJECT(filesink), "muxer-factory", "matroskamux", nullptr
-    );  // Valid only for async-finalize = TRUE
+bool attach_display(GstPipeline *pipeline)
+{
+    auto config = stream_config(pipeline);
+    if (!config) {
+        spdlog::error("The pipeline was not set up by setup_*_srt_stream.");
+        return false;
+    }
+    // The display bin stays in the pipeline until the idle probe of detach_display has run.
+    auto deadline = std::chrono::steady_clock::now() + DetachWait;
+    while (g_object_get_data(G_OBJECT(pipeline), DetachingKey)) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            spdlog::warn("The display branch is still being detached.");
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> existing(
+        gst_bin_get_by_name(GST_BIN(pipeline), "display"), gst_object_unref
+    );
+    if (existing) {
+        spdlog::warn("The display branch is already attached.");
+        return false;
+    }
 
-    gst_bin_add_many(GST_BIN(pipeline), queue_record, parser, filesink, nullptr);
+    spdlog::info("Attach the display branch");
 
-    if (!gst_element_link_many(queue_record, parser, filesink, nullptr)) {
-        spdlog::error("Elements could not be linked.");
-        gst_object_unref(pipeline);
-        return;
-    }
+    auto display = create_display_bin(*config);
+    if (!display) return false;
+    gst_bin_add(GST_BIN(pipeline), display);
 
-    gst_element_sync_state_with_parent(queue_record);
-    gst_element_sync_state_with_parent(parser);
-    gst_element_sync_state_with_parent(filesink);
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> appsink(
+        gst_bin_get_by_name(GST_BIN(pipeline), "appsink"), gst_object_unref
+    );
+    if (!gst_element_link(display, appsink.get())) {
+        spdlog::error("Failed to link the display branch to 'appsink'.");
+        gst_bin_remove(GST_BIN(pipeline), display);
+        return false;
+    }
+    gst_element_sync_state_with_parent(display);
 
+    // Linked last, so frames only start flowing once the whole branch is running.
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> tee(
+        gst_bin_get_by_name(GST_BIN(pipeline), "t"), gst_object_unref
+    );
+    auto src_pad = gst_element_request_pad_simple(tee.get(), "src_0");
     std::unique_ptr<GstPad, decltype(&gst_object_unref)> sink_pad(
-        gst_element_get_static_pad(queue_record, "sink"), gst_object_unref
+        gst_element_get_static_pad(display, "sink"), gst_object_unref
     );
-
-    auto ret = gst_pad_link(src_pad, sink_pad.get());
-    if (GST_PAD_LINK_FAILED(ret)) {
-        spdlog::error("Failed to link 'tee' src pad to 'queue' sink pad");
-        gst_object_unref(pipeline);
-        return;
+    if (GST_PAD_LINK_FAILED(gst_pad_link(src_pad, sink_pad.get()))) {
+        spdlog::error("Failed to link 'tee' src pad to the display branch.");
+        gst_element_release_request_pad(tee.get(), src_pad);
+        gst_object_unref(src_pad);
+        gst_element_set_state(display, GST_STATE_NULL);
+        gst_bin_remove(GST_BIN(pipeline), display);
+        return false;
     }
-    GST_DEBUG_BIN_TO_DOT_FILE(GST_BIN(pipeline), GST_DEBUG_GRAPH_SHOW_ALL, "after-link");
+    gst_object_unref(src_pad);
+    return true;
 }
 
-void stop_jpeg_recording(GstPipeline *pipeline)
+void detach_display(GstPipeline *pipeline)
 {
-    spdlog::info("Stop GStreamer M-JPEG recording");
+    if (g_object_get_data(G_OBJECT(pipeline), DetachingKey)) {
+        spdlog::warn("The display branch is already being detached.");
+        return;
+    }
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> tee(
+        gst_bin_get_by_name(GST_BIN(pipeline), "t"), gst_object_unref
+    );
+    auto src_pad = tee ? gst_element_get_static_pad(tee.get(), "src_0") : nullptr;
+    if (!src_pad) {
+        spdlog::warn("The display branch is not attached.");
+        return;
+    }
 
-    auto tee = gst_bin_get_by_name(GST_BIN(pipeline), "t");
-    auto src_pad = gst_element_get_static_pad(tee, "src_1");
+    spdlog::info("Detach the display branch");
 
-    // Increase the reference count so that 'pipeline' remains valid.
+    // Until the probe is gone, whether it ran or not, 'pipeline' remains valid and further calls
+    // return early.
+    g_object_set_data(G_OBJECT(pipeline), DetachingKey, GINT_TO_POINTER(TRUE));
     gst_object_ref(pipeline);
 
     gst_pad_add_probe(
         src_pad,
         GST_PAD_PROBE_TYPE_IDLE,
         [](GstPad *src_pad, GstPadProbeInfo *, gpointer user_data) -> GstPadProbeReturn {
-            spdlog::info("Unlinking");
-
             auto pipeline = GST_PIPELINE(user_data);
-            auto tee = gst_bin_get_by_name(GST_BIN(pipeline), "t");
-            std::unique_ptr<GstElement, decltype(&gst_object_unref)> queue_record(
-                gst_bin_get_by_name(GST_BIN(pipeline), "queue_record"), gst_object_unref
+            std::unique_ptr<GstElement, decltype(&gst_object_unref)> tee(
+                gst_pad_get_parent_element(src_pad), gst_object_unref
             );
-            std::unique_ptr<GstElement, decltype(&gst_object_unref)> parser(
-                gst_bin_get_by_name(GST_BIN(pipeline), "record_parser"), gst_object_unref
+            std::unique_ptr<GstElement, decltype(&gst_object_unref)> display(
+                gst_bin_get_by_name(GST_BIN(pipeline), "display"), gst_object_unref
             );
-            std::unique_ptr<GstElement, decltype(&gst_object_unref)> filesink(
-                gst_bin_get_by_name(GST_BIN(pipeline), "filesink"), gst_object_unref
-            );
-            std::unique_ptr<GstPad, decltype(&gst_object_unref)> sink_pad(
-                gst_element_get_static_pad(queue_record.get(), "sink"), gst_object_unref
-            );
-            gst_pad_send_event(sink_pad.get(), gst_event_new_eos());
+            if (display) {
+                std::unique_ptr<GstPad, decltype(&gst_object_unref)> sink_pad(
+                    gst_element_get_static_pad(display.get(), "sink"), gst_object_unref
+                );
+                gst_pad_unlink(src_pad, sink_pad.get());
+
+                gst_bin_remove(GST_BIN(pipeline), display.get());
+                gst_element_set_state(display.get(), GST_STATE_NULL);
+            }
+            if (tee) {
+                gst_element_release_request_pad(tee.get(), src_pad);
+            }
+            return GST_PAD_PROBE_REMOVE;
+        },
+        pipeline,
+        [](gpointer user_data) {
+            g_object_set_data(G_OBJECT(user_data), DetachingKey, nullptr);
+            gst_object_unref(user_data);
+        }
+    );
+    gst_object_unref(src_pad);
+}
+
+DisplayStats display_stats(GstPipeline *pipeline)
+{
+    DisplayStats stats{0, 0};
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> display(
+        gst_bin_get_by_name(GST_BIN(pipeline), "display"), gst_object_unref
+    );
+    if (!display) return stats;
+
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> queue_display(
+        gst_bin_get_by_name(GST_BIN(display.get()), "queue_display"), gst_object_unref
+    );
+    auto counter =
+        static_cast<QueueCounter *>(g_object_get_data(G_OBJECT(display.get()), QueueCounterKey));
+    if (queue_display && counter) {
+        guint queued = 0;
+        g_object_get(G_OBJECT(queue_display.get()), "current-level-buffers", &queued, nullptr);
+        std::uint64_t filtered = 0;
+        if (auto filter = DecodeFilter::find(GST_BIN(display.get()))) {
+            filtered = filter->stats().dropped;
+        }
+        auto out = counter->out.load();
+        auto in = counter->in.load();
+        auto accounted = out + queued + filtered;
+        stats.queue_dropped = in > accounted ? in - accounted : 0;
+    }
+
+    std::unique_ptr<GstElement, decltype(&gst_object_unref)> appsink(
+        gst_bin_get_by_name(GST_BIN(pipeline), "appsink"), gst_object_unref
+    );
+    // A FrameSource pulls every sample as the appsink queues it, so whatever reached the appsink
+    // and not the FrameSource was dropped: too late, or pushed out of the queue with drop=true.
+    auto counter = static_cast<std::atomic<std::uint64_t> *>(
+        g_object_get_data(G_OBJECT(appsink.get()), SinkCounterKey)
+    );
+    auto source = FrameSource::find(appsink.get());
+    if (counter && source) {
+        auto in = counter->load();
+        auto received = source->stats().received;
+        stats.sink_dropped = in > received ? in - received : 0;
+        return stats;
+    }
+    GstStructure *sink_stats = nullptr;
+    g_object_get(G_OBJECT(appsink.get()), "stats", &sink_stats, nullptr);
+    if (sink_stats) {
+        guint64 dropped = 0;
+        gst_structure_get_uint64(sink_stats, "dropped", &dropped);
+        stats.sink_dropped = dropped;
+        gst_structure_free(sink_stats);
+    }
+    return stats;
+}
 
-            // Launch a detached thread to remove the elements after a delay.
-            std::thread([pipeline,  // captured pipeline (ref'ed)
-                         queue_record = std::move(queue_record),
-                         parser = std::move(parser),
-                         filesink = std::move(filesink)]() {
-                std::this_thread::sleep_for(std::chrono::milliseconds(3500));
-                gst_bin_remove(GST_BIN(pipeline), queue_record.get());
-                gst_bin_remove(GST_BIN(pipeline), parser.get());
-                gst_bin_remove(GST_BIN(pipeline), filesink.get());
+RecordAdmission start_h265_recording(
+    GstPipeline *pipeline, fs::path &filepath, bool continuous, int max_size_time, int max_files,
+    const RecordOptions &options
+)
+{
+    spdlog::info("Start GStreamer H.265 recording");
 
-                gst_element_set_state(queue_record.get(), GST_STATE_NULL);
-                gst_element_set_state(parser.get(), GST_STATE_NULL);
-                gst_element_set_state(filesink.get(), GST_STATE_NULL);
+    auto bin = RecordingBin::find(pipeline);
+    if (!bin) {
+        spdlog::error("The pipeline has no record branch.");
+        return {false, false, true, 0, 0, 0, 0, 0, 0};
+    }
 
-                // Release the extra reference on the pipeline.
-                gst_object_unref(pipeline);
-            }).detach();
+    auto camera = filepath;
+    auto admission = admit(bin, camera, options);
+    if (refused(admission, options)) return admission;
 
-            gst_element_release_request_pad(tee, src_pad);
-            gst_object_unref(src_pad);
+    auto extension = container_extension(options.container, true);
+    filepath += continuous ? extension : "-%02d" + extension;
+    auto _max_size_time = continuous ? 0 : max_size_time * GST_SECOND * 60;
 
-            return GST_PAD_PROBE_REMOVE;
-        },
-        pipeline,
-        nullptr
-    );
+    auto configure = [&](GstElement *filesink) {
+        name_files(filesink, camera, filepath.generic_string(), extension, max_files, options);
+        g_object_set(
+            G_OBJECT(filesink), "max-size-time", _max_size_time, nullptr
+        );  // max-size-time=0 -> continuous
+    };
+    admission.started =
+        bin->start(options, camera.generic_string(), configure, admission.handed_over);
+    return admission;
+}
+
+std::shared_future<RecordResult> stop_h265_recording(GstPipeline *pipeline)
+{
+    spdlog::info("Stop GStreamer H.265 recording");
+
+    return stop_recording(pipeline);
+}
+
+RecordAdmission start_jpeg_recording(
+    GstPipeline *pipeline, fs::path &filepath, bool continuous, int max_size_time, int max_files,
+    const RecordOptions &options
+)
+{
+    spdlog::info("Start GStreamer M-JPEG recording");
+
+    auto bin = RecordingBin::find(pipeline);
+    if (!bin) {
+        spdlog::error("The pipeline has no record branch.");
+        return {false, false, true, 0, 0, 0, 0, 0, 0};
+    }
+
+    auto admission = admit(bin, filepath, options);
+    if (refused(admission, options)) return admission;
+
+    auto _max_size_time = continuous ? 0 : max_size_time * GST_SECOND * 60;
+
+    auto configure = [&](GstElement *filesink) {
+        name_files(
+            filesink, filepath, {}, container_extension(options.container, false), max_files,
+            options
+        );
+        g_object_set(
+            G_OBJECT(filesink), "max-size-time", _max_size_time, nullptr
+        );  // max-size-time=0 -> continuous
+    };
+    admission.started =
+        bin->start(options, filepath.generic_string(), configure, admission.handed_over);
+    return admission;
+}
+
+std::shared_future<RecordResult> stop_jpeg_recording(GstPipeline *pipeline)
+{
+    spdlog::info("Stop GStreamer M-JPEG recording");
+
+    return stop_recording(pipeline);
+}
+
+RecordStats record_stats(GstPipeline *pipeline)
+{
+    if (auto bin = RecordingBin::find(pipeline)) {
+        return bin->stats();
+    }
+    return {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 }
 
 void mock_camera(GstPipeline *pipeline, const std::string &)
@@ -521,7 +993,45 @@ void mock_camera(GstPipeline *pipeline, const std::string &)
     if (!gst_element_link_many(src, cf_src, appsink, nullptr)) {
         // if (!gst_element_link_many(src, cf_src, parser, dec, conv, cf_conv, appsink, nullptr)) {
         spdlog::error("Elements could not be linked.");
-        gst_object_unref(pipeline);
+    }
+}
+
+void mock_camera(GstPipeline *pipeline, const std::string &, const StreamOptions &options)
+{
+    spdlog::info("Setup GStreamer mock camera with decoded NV12 output");
+
+    auto src = create_element("videotestsrc", "src");
+    auto cf_src = create_element("capsfilter", "cf_src");
+
+    // clang-format off
+    std::unique_ptr<GstCaps, decltype(&gst_caps_unref)> cf_src_caps(
+        gst_caps_new_simple(
+            "video/x-raw",
+            "format", G_TYPE_STRING, "NV12", 
+            "width", G_TYPE_INT, 3840,
+            "height", G_TYPE_INT, 2160,
+            "framerate", GST_TYPE_FRACTION, 500, 1,
+            nullptr
+        ),
+        gst_caps_unref
+    );
+    // clang-format on
+
+    g_object_set(G_OBJECT(cf_src), "caps", cf_src_caps.get(), nullptr);
+
+    gst_bin_add_many(GST_BIN(pipeline), src, cf_src, nullptr);
+
+    auto appsink = create_display_sink(GST_BIN(pipeline), options);
+    g_object_set(G_OBJECT(appsink), "drop", true, nullptr);
+    g_object_set(G_OBJECT(appsink), "sync", false, nullptr);
+
+    if (!gst_element_link(src, cf_src)) {
+        spdlog::error("Elements could not be linked.");
+        return;
+    }
+    auto output = convert_display_output(GST_BIN(pipeline), cf_src, PixelFormat::NV12, options);
+    if (!output || !gst_element_link(output, appsink)) {
+        spdlog::error("Elements could not be linked.");
     }
 }
 
@@ -4,8 +4,13 @@
 
 #include <gst/gstpipeline.h>
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
+#include <future>
 #include <string>
+#include <vector>
 
 
 namespace fs = std::filesystem;
@@ -14,20 +19,230 @@ namespace fs = std::filesystem;
 namespace xvc
 {
 
-void setup_h265_srt_stream(GstPipeline *pipeline, const std::string &uri);
-void setup_jpeg_srt_stream(GstPipeline *pipeline, const std::string &uri);
+// Pixel format delivered to the "appsink" of the display branch.
+enum class PixelFormat {
+    Native,  // Whatever the decoder produces (NV12 for H.265), without any conversion.
+    NV12,
+    I420,
+    RGBA,  // 4 bytes per pixel, so every row is 4-byte aligned.
+    BGRx,  // 4 bytes per pixel, so every row is 4-byte aligned.
+    RGB,
+};
+
+// Resolution of the M-JPEG display branch relative to the camera. Reduced sizes come straight out
+// of the scaled inverse DCT, so the full-size image is never decoded; recording is unaffected.
+enum class JpegScale {
+    Full = 1,
+    Half = 2,
+    Quarter = 4,
+    Eighth = 8,
+};
+
+// Access units of an H.265 stream the display branch decodes. The others are dropped in front of
+// the decoder; the recording branch still receives every access unit.
+enum class DecodeMode {
+    All,
+    Keyframes,  // IRAP pictures only.
+    GopPrefix,  // The first `decode_prefix` frames of every GOP, starting with its keyframe.
+};
+
+// How the display branch trades latency for completeness. Only queue_display and the appsink are
+// affected; recording is fed by the tee before them.
+enum class LatencyPolicy {
+    Default,     // GStreamer defaults for queue_display and the appsink.
+    LowLatency,  // Leaky one-frame queue_display; appsink max-buffers=1, drop=true, sync=false.
+    NoDrop,      // Bounded blocking queues. A display slower than the camera stalls the tee, and
+                 // with it recording, so only use it when every frame must be shown.
+    Custom,      // StreamOptions::latency_limits.
+};
+
+struct LatencyLimits {
+    // queue_display; 0 leaves a limit unset.
+    unsigned queue_max_buffers = 0;
+    std::uint64_t queue_max_time = 0;  // Nanoseconds.
+    bool queue_leaky = false;          // Drop the oldest frame instead of blocking when full.
+    // appsink; max-buffers 0 is unlimited.
+    unsigned sink_max_buffers = 0;
+    bool sink_drop = false;
+    bool sink_sync = true;
+};
+
+// Frames the latency policy dropped on the display branch. Frames a FrameSource discards when its
+// ring is full are in FrameSource::Stats instead.
+struct DisplayStats {
+    std::uint64_t queue_dropped;  // Discarded by a leaky queue_display since it was attached.
+    // Discarded by the appsink: too late with sync, or pushed out of its queue by a newer frame
+    // with max-buffers and drop. Without a FrameSource on the pipeline, only the late ones.
+    std::uint64_t sink_dropped;
+};
+
+struct StreamOptions {
+    // Build the display branch (queue_display, decoder, conversion) right away. Recording-only
+    // stations set it to false and call attach_display when frames are actually wanted.
+    bool display = true;
+    PixelFormat format = PixelFormat::RGB;
+    // Convert NV12/I420 to RGB/RGBA/BGRx with libxvc's SIMD kernels instead of videoconvert.
+    bool builtin_converter = true;
+    // M-JPEG only: decode whole frames on this many threads in parallel. 1 keeps a single decoder.
+    int decoder_threads = 1;
+    // Frames in flight across the decoder threads; 0 picks twice the thread count.
+    int reorder_window = 0;
+    // M-JPEG only: preview resolution.
+    JpegScale jpeg_scale = JpegScale::Full;
+    // H.265 only: preview decode mode, see set_decode_mode.
+    DecodeMode decode_mode = DecodeMode::All;
+    int decode_prefix = 1;
+    LatencyPolicy latency = LatencyPolicy::Default;
+    LatencyLimits latency_limits{};  // Only used with LatencyPolicy::Custom.
+    // Keep this much of the encoded stream, from a keyframe on, so start_*_recording begins that
+    // long before it is called. The memory limit wins over the window. 0 disables the ring.
+    std::chrono::milliseconds pretrigger{0};
+    std::size_t pretrigger_memory_limit = 32 << 20;
+};
+
+// Writer of the recorded files.
+enum class RecordSink {
+    Stock,   // splitmuxsink's filesink, through the page cache.
+    Direct,  // xvcfilesink (file_sink.h): preallocated files, large aligned unbuffered writes
+             // from a write-behind thread. For high frame rates and resolutions. Needs
+             // GStreamer 1.22; with an older one, start_*_recording fails.
+};
+
+// Layout of the recorded files.
+enum class RecordContainer {
+    Matroska,       // .mkv, which every reader of this library takes.
+    FragmentedMp4,  // .mp4 in fragments of a second; readable up to the last one after a crash.
+    Elementary,     // .h265 or .mjpeg elementary stream and a frame index, see elementary_stream.h.
+};
+
+// What start_*_recording does when the volume cannot keep up with one more recording.
+enum class Admission {
+    Off,     // Start without checking.
+    Warn,    // Start, and log the numbers.
+    Refuse,  // Do not start.
+};
+
+// The record branch hands every access unit to a spill buffer and a separate writer pipeline, so
+// a slow disk never stalls the live stream: up to `spill_memory_limit` bytes are buffered in
+// memory, anything beyond that goes to a journal file in `spill_directory` (the system temporary
+// directory when empty) until the writer has caught up.
+struct RecordOptions {
+    std::size_t spill_memory_limit = 64 << 20;
+    fs::path spill_directory;
+    // Replace each closed .bin sidecar with a compact .xbin one (see compact_sidecar.h).
+    bool compact_sidecar = false;
+    // When set, every segment is added to this TimestampIndex as soon as its sidecar is closed.
+    fs::path index;
+    // Besides the `max_files` of start_*_recording, the oldest closed files of the camera, with
+    // their sidecars, are deleted in the background while its files take more than `max_bytes`,
+    // or the volume has less than `min_free_bytes` free. 0 disables either; see retention.h.
+    std::uint64_t max_bytes = 0;
+    std::uint64_t min_free_bytes = 0;
+    RecordSink sink = RecordSink::Stock;
+    // Sidecars are written for every container; `index` takes Matroska and elementary streams.
+    RecordContainer container = RecordContainer::Matroska;
+    // RecordSink::Direct: disk space reserved ahead of the data of each file.
+    std::uint64_t preallocate = 256 << 20;
+    // Share of the disk among the cameras recording in this process, see io_governor.h. Only
+    // RecordSink::Direct writes are scheduled; the stock filesink writes into the page cache, so
+    // those recordings are only measured and have their sidecars finalized in turn.
+    std::uint32_t io_weight = 1;
+    int io_priority = 0;
+    // Checks that the volume sustains the camera's stream on top of the recordings already active
+    // there, against `admission_headroom` of its sequential write throughput. The first check of a
+    // directory benchmarks it for a few seconds, so consider xvc::StorageCache::get (admission.h)
+    // ahead of time.
+    Admission admission = Admission::Off;
+    double admission_headroom = 0.7;
+
+    bool operator==(const RecordOptions &) const = default;
+};
+
+struct RecordStats {
+    std::uint64_t frames;             // Access units received from the tee,
+    std::uint64_t pretrigger_frames;  // the first ones of which came from the pre-trigger ring.
+    std::uint64_t lost;           // Dropped by the full record queue or the failed journal.
+    std::uint64_t memory_bytes;   // Waiting for the writer in memory,
+    std::uint64_t journal_bytes;  // and in the journal.
+    std::uint64_t spilled;        // Access units that went through the journal.
+    std::uint64_t peak_memory_bytes;
+    std::uint64_t metadata_frames;  // Handed to the .bin sidecar writer.
+    // RecordSink::Direct only, across the files written so far.
+    double write_mb_per_s;       // Sustained by the disk while it was being written to.
+    std::uint64_t max_write_us;  // Slowest single write.
+    std::uint64_t max_stall_us;  // Longest the muxer waited for the write-behind queue.
+};
+
+// Outcome of a recording, once its last file is closed.
+struct RecordResult {
+    bool ok;                      // False if the writer failed.
+    std::vector<fs::path> files;  // In the order splitmuxsink closed them.
+};
+
+// Outcome of the admission check of start_*_recording.
+struct RecordAdmission {
+    bool started;
+    bool checked;        // The volume was benchmarked, now or earlier.
+    bool within_budget;  // Also true when unchecked.
+    // By this camera: measured on its stream, or estimated from its caps until then.
+    double needed_mb_per_s;
+    double active_mb_per_s;   // By the other recordings on the same volume.
+    double budget_mb_per_s;   // What recordings may use of the volume.
+    double storage_mb_per_s;  // Sequential writes, as benchmarked.
+    std::uint64_t fsync_p50_us;
+    std::uint64_t fsync_max_us;
+    // Started while recording: the recording it took over from, which finishes in the background.
+    std::shared_future<RecordResult> handed_over;
+};
+
+void setup_h265_srt_stream(
+    GstPipeline *pipeline, const std::string &uri, const StreamOptions &options = {}
+);
+void setup_jpeg_srt_stream(
+    GstPipeline *pipeline, const std::string &uri, const StreamOptions &options = {}
+);
+// Adds or removes the display branch of a pipeline set up by setup_*_srt_stream, possibly while it
+// is playing, the same way start_*_recording handles the record branch. The "appsink" stays in the
+// pipeline, so a FrameSource survives and simply receives no frames while detached.
+// detach_display returns before the branch is gone: that waits for the buffer in flight on it.
+// attach_display waits up to a second for a pending detach. It returns false if the detach is
+// still pending, and a later call can succeed. If the branch is attached, it also returns false.
+bool attach_display(GstPipeline *pipeline);
+void detach_display(GstPipeline *pipeline);
+// All zero while the display branch is detached.
+DisplayStats display_stats(GstPipeline *pipeline);
+
+// Changes the decode mode of a running H.265 stream. Returns false for pipelines not set up by
+// setup_h265_srt_stream.
+bool set_decode_mode(GstPipeline *pipeline, DecodeMode mode, int decode_prefix = 1);
 void mock_camera(GstPipeline *pipeline, const std::string &);
+// Emulates the display branch of a live stream: NV12 frames, as produced by the H.265 decoder, go
+// through the same output-format conversion as setup_*_srt_stream.
+void mock_camera(GstPipeline *pipeline, const std::string &, const StreamOptions &options);
 
-void start_h265_recording(
-    GstPipeline *pipeline, fs::path &filepath, bool continuous, int max_size_time, int max_files
+// Not started if the pipeline has no record branch, or with Admission::Refuse, if over budget.
+// The writer pipeline is built ahead of time, with default RecordOptions once setup_*_srt_stream
+// is done and afterwards with the options of the last recording, so starting takes a few
+// milliseconds; every stream holds one idle writer for it. Other options, or a start while that
+// writer is still being built, wait for a writer to be built, typically tens of milliseconds.
+RecordAdmission start_h265_recording(
+    GstPipeline *pipeline, fs::path &filepath, bool continuous, int max_size_time, int max_files,
+    const RecordOptions &options = {}
 );
-void stop_h265_recording(GstPipeline *pipeline);
+// Returns immediately. The future becomes ready once splitmuxsink has closed the last file, and is
+// the same for every call until the next recording starts, so stopping twice is harmless.
+std::shared_future<RecordResult> stop_h265_recording(GstPipeline *pipeline);
 
-void start_jpeg_recording(
-    GstPipeline *pipeline, fs::path &filepath, bool continuous, int max_size_time, int max_files
+RecordAdmission start_jpeg_recording(
+    GstPipeline *pipeline, fs::path &filepath, bool continuous, int max_size_time, int max_files,
+    const RecordOptions &options = {}
 );
-void stop_jpeg_recording(GstPipeline *pipeline);
+std::shared_future<RecordResult> stop_jpeg_recording(GstPipeline *pipeline);
+// Stats of the current or, after stop_*_recording, the last recording. All zero if none.
+RecordStats record_stats(GstPipeline *pipeline);
 
+// Writes the .bin sidecar of a finished recording. start_*_recording already writes it while
+// recording; these are for files recorded without it.
 void parse_video_save_binary_h265(const std::string &filepath);
 void parse_video_save_binary_jpeg(const std::string &filepath);
 